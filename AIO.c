@@ -0,0 +1,665 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "AIO.h"
+
+/* Request operations */
+enum {
+    OP_READ = 0,
+    OP_WRITE,
+    OP_FSYNC
+};
+
+/* Submission attempts while the kernel reports EAGAIN or EBUSY */
+#define AIO_SUBMIT_RETRIES 64
+
+static const char *backendNames[] = {"auto", "uring", "threads", "sync"};
+
+int Aio_ParseBackend(const char *text, AioBackend *backend) {
+    for (int b = AIO_AUTO; b <= AIO_SYNC; b++) {
+        if (strcmp(text, backendNames[b]) == 0) {
+            *backend = (AioBackend)b;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* Aio_BackendName(AioBackend backend) {
+    return backendNames[backend];
+}
+
+void* Aio_AllocAligned(size_t size) {
+    void *memory = NULL;
+
+    if (posix_memalign(&memory, AIO_DIRECT_ALIGN, size) != 0) {
+        fprintf(stderr, "Memory allocation failed for %zu-byte I/O buffer\n", size);
+        return NULL;
+    }
+    return memory;
+}
+
+int Aio_SyncDirectory(const char *path) {
+    char directory[4096];
+    const char *slash = strrchr(path, '/');
+    size_t length = slash == NULL ? 0 : (slash == path ? 1 : (size_t)(slash - path));
+
+    if (length >= sizeof(directory)) {
+        fprintf(stderr, "Path too long: %s\n", path);
+        return -1;
+    }
+    if (length == 0) {
+        strcpy(directory, ".");
+    } else {
+        memcpy(directory, path, length);
+        directory[length] = '\0';
+    }
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) != 0) {
+        fprintf(stderr, "Cannot flush directory %s: %s\n", directory, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/* ============= Completion ============= */
+
+/**
+ * Release a finished request's slot and report its result
+ */
+static void finishRequest(AioQueue *queue, int slot, int64_t result) {
+    AioRequest *request = &queue->slots[slot];
+    AioCallback callback = request->callback;
+    void *context = request->context;
+
+    if (result < 0) {
+        queue->failed = 1;
+    } else if (request->op != OP_FSYNC) {
+        queue->bytes += (uint64_t)result;
+    }
+    queue->inFlight--;
+    queue->freeSlots[queue->freeCount++] = slot;
+
+    if (callback != NULL) {
+        callback(context, result);
+    }
+}
+
+/**
+ * Run a request to the end with blocking calls
+ * @return: Bytes transferred, or a negative errno value
+ */
+static int64_t runRequest(AioRequest *request) {
+    if (request->op == OP_FSYNC) {
+        return fdatasync(request->fd) == 0 ? 0 : -errno;
+    }
+
+    while (request->done < request->length) {
+        ssize_t n = request->op == OP_READ
+            ? pread(request->fd, request->buffer + request->done,
+                    request->length - request->done,
+                    (off_t)(request->offset + request->done))
+            : pwrite(request->fd, request->buffer + request->done,
+                     request->length - request->done,
+                     (off_t)(request->offset + request->done));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (n == 0) {
+            if (request->op == OP_READ) {
+                break;
+            }
+            return -EIO;
+        }
+        request->done += (size_t)n;
+    }
+
+    return (int64_t)request->done;
+}
+
+/* ============= io_uring Backend ============= */
+
+static int ringEnter(AioRing *ring, unsigned submit, unsigned wait) {
+    for (;;) {
+        long entered = syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+                               wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (entered >= 0) {
+            ring->toSubmit -= (unsigned)entered;
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+static void ringClose(AioRing *ring) {
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing != NULL && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != NULL) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/**
+ * Create an io_uring with room for depth requests and map its rings
+ * @return: 0 on success, -1 if the kernel cannot provide one
+ */
+static int ringOpen(AioRing *ring, unsigned depth) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return -1;
+    }
+
+    /* IORING_OP_READ and IORING_OP_WRITE arrived with this feature (5.6) */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        ringClose(ring);
+        return -1;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes +
+                       params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) {
+            ring->sqRingSize = ring->cqRingSize;
+        }
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        ring->sqRing = NULL;
+        ringClose(ring);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            ring->cqRing = NULL;
+            ringClose(ring);
+            return -1;
+        }
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        ringClose(ring);
+        return -1;
+    }
+
+    char *sq = (char*)ring->sqRing;
+    char *cq = (char*)ring->cqRing;
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+    return 0;
+}
+
+/**
+ * Put the rest of a slot's request on the submission ring
+ *
+ * Every slot has at most one entry outstanding and the ring holds at
+ * least depth entries, so there is always room.
+ */
+static void ringQueue(AioQueue *queue, int slot) {
+    AioRing *ring = &queue->ring;
+    AioRequest *request = &queue->slots[slot];
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe*)ring->sqes)[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = request->fd;
+    sqe->user_data = (uint64_t)slot;
+    if (request->op == OP_FSYNC) {
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    } else {
+        sqe->opcode = request->op == OP_READ ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->addr = (uint64_t)(uintptr_t)(request->buffer + request->done);
+        sqe->len = (uint32_t)(request->length - request->done);
+        sqe->off = request->offset + request->done;
+    }
+
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->toSubmit++;
+    queue->submitted++;
+}
+
+/**
+ * Handle one completion: continue a short transfer or finish the request
+ */
+static void ringComplete(AioQueue *queue, int slot, int32_t res) {
+    AioRequest *request = &queue->slots[slot];
+
+    if (res < 0 || request->op == OP_FSYNC) {
+        finishRequest(queue, slot, res);
+        return;
+    }
+    if (res == 0 && request->op == OP_WRITE) {
+        finishRequest(queue, slot, -EIO);
+        return;
+    }
+
+    request->done += (size_t)res;
+    if (res > 0 && request->done < request->length) {
+        ringQueue(queue, slot);
+        return;
+    }
+    finishRequest(queue, slot, (int64_t)request->done);
+}
+
+/**
+ * Handle every completion already on the completion ring
+ * @return: Number of completions handled
+ */
+static int ringDrain(AioQueue *queue) {
+    AioRing *ring = &queue->ring;
+    int handled = 0;
+
+    /* Head is re-read each time: a callback may submit and reap too */
+    for (;;) {
+        unsigned head = *ring->cqHead;
+        if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        struct io_uring_cqe *cqe =
+            &((struct io_uring_cqe*)ring->cqes)[head & *ring->cqMask];
+        int slot = (int)cqe->user_data;
+        int32_t res = cqe->res;
+
+        __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+        ringComplete(queue, slot, res);
+        handled++;
+    }
+    return handled;
+}
+
+/**
+ * Submit what is queued and handle completions
+ * @param wait: Wait for at least one completion when nonzero
+ */
+static void ringReap(AioQueue *queue, int wait) {
+    AioRing *ring = &queue->ring;
+
+    if (ring->toSubmit > 0 || wait) {
+        if (ringEnter(ring, ring->toSubmit, wait ? 1 : 0) != 0) {
+            perror("io_uring_enter");
+        }
+    }
+    ringDrain(queue);
+}
+
+/**
+ * Enter what is queued, retrying while the kernel is short of room
+ *
+ * EBUSY means the completion ring is full and EAGAIN that the kernel
+ * could not take more requests for now; both clear as completions are
+ * reaped, so those are handled (waiting for one if none is ready, and
+ * some request is in flight) before trying again.
+ *
+ * @return: 0 on success, -1 on another error or after
+ *          AIO_SUBMIT_RETRIES attempts, with errno set
+ */
+static int ringSubmit(AioQueue *queue) {
+    AioRing *ring = &queue->ring;
+
+    for (int attempt = 0; ; attempt++) {
+        if (ringEnter(ring, ring->toSubmit, 0) == 0) {
+            return 0;
+        }
+        if ((errno != EAGAIN && errno != EBUSY) || attempt == AIO_SUBMIT_RETRIES) {
+            return -1;
+        }
+        if (ringDrain(queue) == 0 && queue->inFlight > ring->toSubmit) {
+            /* Wait without submitting; errors here show up on the retry */
+            syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS,
+                    NULL, 0);
+            ringDrain(queue);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * Take a slot's entry back off the submission ring
+ * @return: 1 if it was removed, 0 if it is not the last unsubmitted entry
+ */
+static int ringUnqueue(AioQueue *queue, int slot) {
+    AioRing *ring = &queue->ring;
+    unsigned tail = *ring->sqTail;
+    struct io_uring_sqe *sqe =
+        &((struct io_uring_sqe*)ring->sqes)[(tail - 1) & *ring->sqMask];
+
+    if (ring->toSubmit == 0 || sqe->user_data != (uint64_t)slot) {
+        return 0;
+    }
+    __atomic_store_n(ring->sqTail, tail - 1, __ATOMIC_RELEASE);
+    ring->toSubmit--;
+    queue->submitted--;
+    return 1;
+}
+
+/* ============= Thread Backend ============= */
+
+static void* poolWorker(void *arg) {
+    AioQueue *queue = (AioQueue*)arg;
+    AioPool *pool = &queue->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stopping && pool->pendingCount == 0) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->pendingCount == 0) {
+            break;
+        }
+
+        int slot = pool->pending[pool->pendingHead];
+        pool->pendingHead = (pool->pendingHead + 1) % queue->depth;
+        pool->pendingCount--;
+        pthread_mutex_unlock(&pool->lock);
+
+        queue->slots[slot].result = runRequest(&queue->slots[slot]);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->finished[(pool->finishedHead + pool->finishedCount) % queue->depth] = slot;
+        pool->finishedCount++;
+        pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static void poolQueue(AioQueue *queue, int slot) {
+    AioPool *pool = &queue->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending[(pool->pendingHead + pool->pendingCount) % queue->depth] = slot;
+    pool->pendingCount++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    queue->submitted++;
+}
+
+/**
+ * Report finished requests; callbacks run without the pool lock
+ * @param wait: Wait for at least one completion when nonzero
+ */
+static void poolReap(AioQueue *queue, int wait) {
+    AioPool *pool = &queue->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (wait && pool->finishedCount == 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    while (pool->finishedCount > 0) {
+        int slot = pool->finished[pool->finishedHead];
+        pool->finishedHead = (pool->finishedHead + 1) % queue->depth;
+        pool->finishedCount--;
+        pthread_mutex_unlock(&pool->lock);
+
+        finishRequest(queue, slot, queue->slots[slot].result);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void poolStop(AioQueue *queue) {
+    AioPool *pool = &queue->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int t = 0; t < pool->threadCount; t++) {
+        pthread_join(pool->threads[t], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool->pending);
+    free(pool->finished);
+}
+
+/**
+ * Start the worker threads
+ * @return: 0 on success, -1 on failure
+ */
+static int poolStart(AioQueue *queue) {
+    AioPool *pool = &queue->pool;
+    int threads = queue->depth < AIO_MAX_THREADS ? (int)queue->depth : AIO_MAX_THREADS;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->pending = (int*)malloc(queue->depth * sizeof(int));
+    pool->finished = (int*)malloc(queue->depth * sizeof(int));
+    if (pool->pending == NULL || pool->finished == NULL) {
+        fprintf(stderr, "Memory allocation failed for I/O threads\n");
+        free(pool->pending);
+        free(pool->finished);
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&pool->threads[t], NULL, poolWorker, queue) != 0) {
+            break;
+        }
+        pool->threadCount++;
+    }
+    if (pool->threadCount == 0) {
+        fprintf(stderr, "Cannot start I/O threads\n");
+        poolStop(queue);
+        return -1;
+    }
+    return 0;
+}
+
+/* ============= Queue ============= */
+
+int Aio_Init(AioQueue *queue, AioBackend backend, unsigned depth) {
+    memset(queue, 0, sizeof(*queue));
+    queue->ring.fd = -1;
+
+    if (depth == 0 || depth > AIO_MAX_DEPTH) {
+        fprintf(stderr, "I/O queue depth must be 1 to %d\n", AIO_MAX_DEPTH);
+        return -1;
+    }
+
+    queue->depth = depth;
+    queue->slots = (AioRequest*)calloc(depth, sizeof(AioRequest));
+    queue->freeSlots = (int*)malloc(depth * sizeof(int));
+    if (queue->slots == NULL || queue->freeSlots == NULL) {
+        fprintf(stderr, "Memory allocation failed for I/O queue\n");
+        free(queue->slots);
+        free(queue->freeSlots);
+        return -1;
+    }
+    for (unsigned s = 0; s < depth; s++) {
+        queue->freeSlots[s] = (int)(depth - 1 - s);
+    }
+    queue->freeCount = depth;
+
+    if (backend == AIO_AUTO || backend == AIO_URING) {
+        if (ringOpen(&queue->ring, depth) == 0) {
+            queue->backend = AIO_URING;
+            return 0;
+        }
+        if (backend == AIO_URING) {
+            fprintf(stderr, "io_uring unavailable (%s); using I/O threads\n",
+                    strerror(errno));
+        }
+        backend = AIO_THREADS;
+    }
+
+    if (backend == AIO_THREADS && poolStart(queue) != 0) {
+        free(queue->slots);
+        free(queue->freeSlots);
+        return -1;
+    }
+    queue->backend = backend;
+    return 0;
+}
+
+void Aio_Free(AioQueue *queue) {
+    Aio_Wait(queue);
+
+    if (queue->backend == AIO_URING) {
+        ringClose(&queue->ring);
+    } else if (queue->backend == AIO_THREADS) {
+        poolStop(queue);
+    }
+    free(queue->slots);
+    free(queue->freeSlots);
+    queue->slots = NULL;
+    queue->freeSlots = NULL;
+}
+
+/**
+ * Handle completions of whichever backend is in use
+ */
+static void reap(AioQueue *queue, int wait) {
+    if (queue->backend == AIO_URING) {
+        ringReap(queue, wait);
+    } else if (queue->backend == AIO_THREADS) {
+        poolReap(queue, wait);
+    }
+}
+
+/**
+ * Fill a free slot with a request and hand it to the backend,
+ * completing older requests first if every slot is busy
+ */
+static int submit(AioQueue *queue, int op, int fd, void *buffer, size_t length,
+                  uint64_t offset, AioCallback callback, void *context) {
+    while (queue->freeCount == 0) {
+        reap(queue, 1);
+    }
+
+    int slot = queue->freeSlots[--queue->freeCount];
+    AioRequest *request = &queue->slots[slot];
+    request->op = op;
+    request->fd = fd;
+    request->buffer = (char*)buffer;
+    request->length = length;
+    request->offset = offset;
+    request->done = 0;
+    request->callback = callback;
+    request->context = context;
+    request->result = 0;
+    queue->inFlight++;
+
+    switch (queue->backend) {
+        case AIO_URING:
+            ringQueue(queue, slot);
+            if (ringSubmit(queue) != 0) {
+                perror("io_uring_enter");
+                /*
+                 * Never entered, so no completion will come: free the
+                 * slot. If a callback queued entries behind it, it stays
+                 * queued and goes in with them on the next reap.
+                 */
+                if (ringUnqueue(queue, slot)) {
+                    queue->inFlight--;
+                    queue->freeSlots[queue->freeCount++] = slot;
+                    return -1;
+                }
+            }
+            break;
+        case AIO_THREADS:
+            poolQueue(queue, slot);
+            break;
+        default:
+            queue->submitted++;
+            finishRequest(queue, slot, runRequest(request));
+            break;
+    }
+    return 0;
+}
+
+int Aio_Read(AioQueue *queue, int fd, void *buffer, size_t length,
+             uint64_t offset, AioCallback callback, void *context) {
+    return submit(queue, OP_READ, fd, buffer, length, offset, callback, context);
+}
+
+int Aio_Write(AioQueue *queue, int fd, const void *buffer, size_t length,
+              uint64_t offset, AioCallback callback, void *context) {
+    return submit(queue, OP_WRITE, fd, (void*)buffer, length, offset,
+                  callback, context);
+}
+
+unsigned Aio_Poll(AioQueue *queue) {
+    reap(queue, 0);
+    return queue->inFlight;
+}
+
+int Aio_Wait(AioQueue *queue) {
+    while (queue->inFlight > 0) {
+        reap(queue, 1);
+    }
+
+    int failed = queue->failed;
+    queue->failed = 0;
+    return failed ? -1 : 0;
+}
+
+int Aio_Sync(AioQueue *queue, int fd) {
+    if (Aio_Wait(queue) != 0) {
+        return -1;
+    }
+    if (submit(queue, OP_FSYNC, fd, NULL, 0, 0, NULL, NULL) != 0) {
+        return -1;
+    }
+    return Aio_Wait(queue);
+}
@@ -0,0 +1,187 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file AIO.h
+ * @brief Asynchronous file I/O for catalog snapshots, logs and imports
+ *
+ * An AioQueue keeps up to depth reads and writes in flight at once. On
+ * Linux it submits them through an io_uring, talking to the kernel
+ * directly so liburing is not needed; where io_uring is missing or
+ * blocked it falls back to a small pool of threads doing pread and
+ * pwrite. The synchronous backend runs each request as it is
+ * submitted and is there for comparison.
+ *
+ * Completions are reported only on the thread that owns the queue,
+ * from inside Aio_Read, Aio_Write (when the queue is full and a slot
+ * has to be freed), Aio_Poll and Aio_Wait, so callbacks need no
+ * locking. A queue must be used by one thread at a time.
+ *
+ * Short transfers are continued internally: a write completes once
+ * every byte is written, and a read once the buffer is full or the
+ * file ends. Requests in flight together are not ordered; call
+ * Aio_Wait before anything that depends on earlier writes, such as
+ * Aio_Sync.
+ *
+ * Buffers for files opened with O_DIRECT must be aligned to
+ * AIO_DIRECT_ALIGN, as must their lengths and offsets; Aio_AllocAligned
+ * returns suitable memory.
+ */
+
+#define AIO_DEFAULT_DEPTH 32
+#define AIO_MAX_DEPTH 4096
+#define AIO_CHUNK_SIZE ((size_t)1 << 20)   /* Transfer size for bulk I/O */
+#define AIO_DIRECT_ALIGN 4096
+#define AIO_MAX_THREADS 8                   /* Threads of the fallback pool */
+
+typedef enum {
+    AIO_AUTO = 0,                     /* io_uring if available, else threads */
+    AIO_URING,
+    AIO_THREADS,
+    AIO_SYNC
+} AioBackend;
+
+/**
+ * Called when a request completes
+ * @param result: Bytes transferred (for a read, fewer at end of file),
+ *                or a negative errno value
+ */
+typedef void (*AioCallback)(void *context, int64_t result);
+
+/* One request, in a slot of the queue */
+typedef struct {
+    int op;                           /* Internal operation code */
+    int fd;
+    char *buffer;
+    size_t length;
+    uint64_t offset;
+    size_t done;                      /* Bytes transferred so far */
+    AioCallback callback;
+    void *context;
+    int64_t result;                   /* Final result, for the thread pool */
+} AioRequest;
+
+/* Rings shared with the kernel (io_uring backend) */
+typedef struct {
+    int fd;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    void *sqes;
+    size_t sqesSize;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    void *cqes;
+    unsigned toSubmit;                /* Queued but not yet entered */
+} AioRing;
+
+/* Worker threads and their queues (thread backend) */
+typedef struct {
+    pthread_t threads[AIO_MAX_THREADS];
+    int threadCount;
+    pthread_mutex_t lock;
+    pthread_cond_t work;              /* Pending requests or stopping */
+    pthread_cond_t done;              /* A request finished */
+    int *pending;                     /* Ring of slots to run */
+    int *finished;                    /* Ring of slots to report */
+    unsigned pendingHead, pendingCount;
+    unsigned finishedHead, finishedCount;
+    int stopping;
+} AioPool;
+
+typedef struct {
+    AioBackend backend;               /* Backend in use, never AIO_AUTO */
+    unsigned depth;                   /* Most requests in flight */
+    AioRequest *slots;                /* depth request slots */
+    int *freeSlots;                   /* Stack of unused slot numbers */
+    unsigned freeCount;
+    unsigned inFlight;
+    int failed;                       /* An error since the last Aio_Wait */
+    AioRing ring;
+    AioPool pool;
+    uint64_t submitted;               /* Requests, continuations included */
+    uint64_t bytes;                   /* Bytes transferred */
+} AioQueue;
+
+/**
+ * @brief Set up a queue
+ * @param queue Queue to initialize
+ * @param backend Backend to use; AIO_URING falls back to threads when
+ *                the kernel refuses an io_uring
+ * @param depth Most requests in flight, 1 to AIO_MAX_DEPTH
+ * @return 0 on success, -1 on failure
+ */
+int Aio_Init(AioQueue *queue, AioBackend backend, unsigned depth);
+
+/**
+ * @brief Wait for outstanding requests and release the queue
+ */
+void Aio_Free(AioQueue *queue);
+
+/**
+ * @brief Parse "auto", "uring", "threads" or "sync"
+ * @return 0 on success, -1 on an unknown name
+ */
+int Aio_ParseBackend(const char *text, AioBackend *backend);
+
+/**
+ * @brief Name of a backend, as Aio_ParseBackend reads it
+ */
+const char* Aio_BackendName(AioBackend backend);
+
+/**
+ * @brief Queue a read of length bytes at offset into buffer
+ * @param callback Called on completion, or NULL
+ * @return 0 if queued, -1 if it could not be submitted
+ */
+int Aio_Read(AioQueue *queue, int fd, void *buffer, size_t length,
+             uint64_t offset, AioCallback callback, void *context);
+
+/**
+ * @brief Queue a write of length bytes from buffer at offset
+ *
+ * The buffer must stay untouched until the request completes.
+ *
+ * @param callback Called on completion, or NULL
+ * @return 0 if queued, -1 if it could not be submitted
+ */
+int Aio_Write(AioQueue *queue, int fd, const void *buffer, size_t length,
+              uint64_t offset, AioCallback callback, void *context);
+
+/**
+ * @brief Report whatever has completed, without waiting
+ * @return Number of requests still in flight
+ */
+unsigned Aio_Poll(AioQueue *queue);
+
+/**
+ * @brief Wait until every request has completed
+ * @return 0 if all succeeded since the last Aio_Wait, -1 otherwise
+ */
+int Aio_Wait(AioQueue *queue);
+
+/**
+ * @brief Wait for every request, then flush a file's data to disk
+ * @return 0 on success, -1 on failure
+ */
+int Aio_Sync(AioQueue *queue, int fd);
+
+/**
+ * @brief Allocate memory aligned for O_DIRECT transfers; free() it
+ * @return The memory, or NULL on failure
+ */
+void* Aio_AllocAligned(size_t size);
+
+/**
+ * @brief Flush the directory holding a file, making a rename or create
+ * of that file durable
+ * @return 0 on success, -1 on failure
+ */
+int Aio_SyncDirectory(const char *path);
+
+#endif /* AIO_H */
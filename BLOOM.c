@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BLOOM.h"
+
+#define BLOOM_BLOCK_BYTES (BLOOM_BLOCK_BITS / 8)
+
+/* ============= Hashing ============= */
+
+/* Final avalanche of splitmix64 */
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t Bloom_HashId(int id) {
+    return mix64((uint64_t)(uint32_t)id);
+}
+
+uint64_t Bloom_HashKey(const char *key) {
+    uint64_t hash = 14695981039346656037ull;
+
+    while (*key != '\0') {
+        hash ^= (unsigned char)*key++;
+        hash *= 1099511628211ull;
+    }
+
+    return mix64(hash);
+}
+
+/* ============= Blocks ============= */
+
+/*
+ * A filter picks the block from the low half of the hash; the bit
+ * positions come from the high bits of the hash times an odd constant,
+ * which depend on every bit, nine bits per position
+ */
+#define POSITION_BITS 9
+#define POSITION_MASK ((1u << POSITION_BITS) - 1)
+
+static uint64_t positionBits(uint64_t hash) {
+    return (hash * 0x9E3779B97F4A7C15ull) >> (64 - BLOOM_HASHES * POSITION_BITS);
+}
+
+void Bloom_BlockAdd(BloomBlock *block, uint64_t hash) {
+    uint64_t bits = positionBits(hash);
+
+    for (int i = 0; i < BLOOM_HASHES; i++, bits >>= POSITION_BITS) {
+        uint32_t bit = (uint32_t)bits & POSITION_MASK;
+        block->words[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+}
+
+int Bloom_BlockMayContain(const BloomBlock *block, uint64_t hash) {
+    uint64_t bits = positionBits(hash);
+
+    for (int i = 0; i < BLOOM_HASHES; i++, bits >>= POSITION_BITS) {
+        uint32_t bit = (uint32_t)bits & POSITION_MASK;
+        if (!(block->words[bit / 64] & ((uint64_t)1 << (bit % 64)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* ============= Filters ============= */
+
+static BloomBlock* blockFor(const BloomFilter *filter, uint64_t hash) {
+    /* Multiply-shift maps the low 32 bits onto [0, blockCount) */
+    uint64_t b = ((hash & 0xFFFFFFFFu) * filter->blockCount) >> 32;
+    return &filter->blocks[b];
+}
+
+int Bloom_Init(BloomFilter *filter, size_t capacity) {
+    size_t bits = (capacity > 0 ? capacity : 1) * BLOOM_BITS_PER_KEY;
+    size_t blocks = (bits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+
+    memset(filter, 0, sizeof(*filter));
+    filter->blocks = (BloomBlock*)aligned_alloc(BLOOM_BLOCK_BYTES,
+                                                blocks * sizeof(BloomBlock));
+    if (filter->blocks == NULL) {
+        fprintf(stderr, "Memory allocation failed for Bloom filter\n");
+        return -1;
+    }
+    filter->blockCount = (uint32_t)blocks;
+    Bloom_Clear(filter);
+
+    return 0;
+}
+
+void Bloom_Free(BloomFilter *filter) {
+    free(filter->blocks);
+    filter->blocks = NULL;
+    filter->blockCount = 0;
+}
+
+void Bloom_Clear(BloomFilter *filter) {
+    memset(filter->blocks, 0, (size_t)filter->blockCount * sizeof(BloomBlock));
+    filter->keys = 0;
+    filter->stale = 0;
+}
+
+void Bloom_Add(BloomFilter *filter, uint64_t hash) {
+    Bloom_BlockAdd(blockFor(filter, hash), hash);
+    filter->keys++;
+}
+
+void Bloom_Remove(BloomFilter *filter) {
+    filter->stale++;
+}
+
+int Bloom_MayContain(const BloomFilter *filter, uint64_t hash) {
+    return Bloom_BlockMayContain(blockFor(filter, hash), hash);
+}
+
+int Bloom_NeedsRebuild(const BloomFilter *filter) {
+    return (uint64_t)filter->stale * BLOOM_STALE_DIVISOR >
+           (uint64_t)(filter->keys - filter->stale);
+}
@@ -0,0 +1,97 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file BLOOM.h
+ * @brief Blocked Bloom filters for cheap negative lookups
+ *
+ * A Bloom filter answers "is this key certainly absent?" in a few
+ * nanoseconds, so a lookup for an ID or ISBN that does not exist can be
+ * turned away before it descends a tree or probes a hash table. It
+ * never reports a present key as absent; an absent key is reported as
+ * possibly present with a small probability (the false-positive rate).
+ *
+ * The filters here are blocked: each key sets BLOOM_HASHES bits inside
+ * one 64-byte BloomBlock chosen by its hash, so adding or testing a key
+ * touches a single cache line. At BLOOM_BITS_PER_KEY bits per key the
+ * false-positive rate is about 1%; a lone block holding 64 keys (one
+ * per packed catalog block, see PACK.h) gives about 3%.
+ *
+ * Bits cannot be cleared, so removing a key only counts it as stale:
+ * it keeps answering "possibly present" until the owner rebuilds the
+ * filter from its live keys, which Bloom_NeedsRebuild says is due once
+ * stale keys exceed 1 / BLOOM_STALE_DIVISOR of the live ones.
+ */
+
+#define BLOOM_BLOCK_BITS 512          /* One cache line */
+#define BLOOM_HASHES 6                /* Bits set per key */
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_STALE_DIVISOR 64
+
+typedef struct {
+    uint64_t words[BLOOM_BLOCK_BITS / 64];
+} BloomBlock;
+
+typedef struct {
+    BloomBlock *blocks;               /* Cache-line aligned */
+    uint32_t blockCount;
+    uint32_t keys;                    /* Keys added since the last clear */
+    uint32_t stale;                   /* Of those, keys removed since */
+} BloomFilter;
+
+/**
+ * @brief Hash of a book ID for the filters
+ */
+uint64_t Bloom_HashId(int id);
+
+/**
+ * @brief Hash of a NUL-terminated key (such as a normalized ISBN)
+ */
+uint64_t Bloom_HashKey(const char *key);
+
+/**
+ * @brief Set a key's bits in a single block
+ */
+void Bloom_BlockAdd(BloomBlock *block, uint64_t hash);
+
+/**
+ * @brief Test a key's bits in a single block
+ * @return 0 if the key was certainly never added, 1 if it may have been
+ */
+int Bloom_BlockMayContain(const BloomBlock *block, uint64_t hash);
+
+/**
+ * @brief Allocate an empty filter sized for a number of keys
+ * @return 0 on success, -1 on allocation failure
+ */
+int Bloom_Init(BloomFilter *filter, size_t capacity);
+
+void Bloom_Free(BloomFilter *filter);
+
+/**
+ * @brief Forget every key, as the first step of a rebuild
+ */
+void Bloom_Clear(BloomFilter *filter);
+
+void Bloom_Add(BloomFilter *filter, uint64_t hash);
+
+/**
+ * @brief Count a removed key as stale; its bits stay set
+ */
+void Bloom_Remove(BloomFilter *filter);
+
+/**
+ * @brief Test a key
+ * @return 0 if the key is certainly absent, 1 if it may be present
+ */
+int Bloom_MayContain(const BloomFilter *filter, uint64_t hash);
+
+/**
+ * @brief Whether enough keys are stale that the filter should be rebuilt
+ */
+int Bloom_NeedsRebuild(const BloomFilter *filter);
+
+#endif /* BLOOM_H */
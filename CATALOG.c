@@ -0,0 +1,1264 @@
+#define _GNU_SOURCE                   /* O_DIRECT */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CATALOG.h"
+#include "METRICS.h"
+#include "PACK.h"
+#include "TEXT.h"
+
+/* Approximate cache bytes per record: the entry plus its bucket share */
+#define ENTRY_COST (sizeof(CacheEntry) + 2 * sizeof(int))
+
+/* ============= File Format ============= */
+
+/* A catalog file's contents in two parts: a head, then a body */
+typedef struct {
+    const char *head;
+    size_t headSize;
+    const char *body;                 /* NULL when the head is the whole file */
+    uint64_t bodySize;
+} FileImage;
+
+/**
+ * Copy part of a catalog file's contents
+ */
+static void copyStream(const FileImage *image, uint64_t position, char *out,
+                       size_t length) {
+    while (length > 0) {
+        size_t n = length;
+
+        if (position < image->headSize) {
+            if (n > image->headSize - position) {
+                n = image->headSize - (size_t)position;
+            }
+            memcpy(out, image->head + position, n);
+        } else {
+            memcpy(out, image->body + (position - image->headSize), n);
+        }
+        out += n;
+        position += n;
+        length -= n;
+    }
+}
+
+/**
+ * Open a catalog file, with O_DIRECT if asked and the file system allows
+ * @param direct: In: whether to try O_DIRECT; out: whether it is in use
+ * @return: The descriptor, or -1 on failure
+ */
+static int openFile(const char *path, int flags, int *direct) {
+    int fd = open(path, flags | (*direct ? O_DIRECT : 0), 0644);
+
+    /* tmpfs and some other file systems refuse O_DIRECT */
+    if (fd < 0 && *direct && errno == EINVAL) {
+        *direct = 0;
+        fd = open(path, flags, 0644);
+    }
+    return fd;
+}
+
+static size_t alignUp(size_t value) {
+    return (value + AIO_DIRECT_ALIGN - 1) & ~(size_t)(AIO_DIRECT_ALIGN - 1);
+}
+
+/**
+ * Queue buffered writes of length bytes in AIO_CHUNK_SIZE pieces
+ * @return: 0 on success, -1 on failure
+ */
+static int writeChunks(AioQueue *queue, int fd, const char *data,
+                       uint64_t length, uint64_t offset) {
+    for (uint64_t at = 0; at < length; at += AIO_CHUNK_SIZE) {
+        size_t chunk = length - at < AIO_CHUNK_SIZE
+                     ? (size_t)(length - at) : AIO_CHUNK_SIZE;
+        if (Aio_Write(queue, fd, data + at, chunk, offset + at, NULL, NULL) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Queue the writes for a whole catalog file
+ *
+ * Buffered writes go straight from the image. O_DIRECT needs
+ * aligned memory, so the file is staged one queue-depth window at a
+ * time through an aligned buffer, padded to the alignment (the caller
+ * truncates the padding).
+ *
+ * @return: 0 on success, -1 on failure
+ */
+static int writeStream(const FileImage *image, AioQueue *queue, int fd,
+                       int direct) {
+    uint64_t total = image->headSize + image->bodySize;
+
+    if (!direct) {
+        if (writeChunks(queue, fd, image->head, image->headSize, 0) != 0 ||
+            writeChunks(queue, fd, image->body, image->bodySize,
+                        image->headSize) != 0) {
+            return -1;
+        }
+        return 0;
+    }
+
+    size_t window = (size_t)queue->depth * AIO_CHUNK_SIZE;
+    if (window > alignUp((size_t)total)) {
+        window = alignUp((size_t)total);
+    }
+    char *staging = (char*)Aio_AllocAligned(window);
+    if (staging == NULL) {
+        return -1;
+    }
+
+    int status = 0;
+    for (uint64_t at = 0; at < total && status == 0; at += window) {
+        size_t length = total - at < window ? (size_t)(total - at) : window;
+        size_t padded = alignUp(length);
+
+        copyStream(image, at, staging, length);
+        memset(staging + length, 0, padded - length);
+        for (size_t c = 0; c < padded && status == 0; c += AIO_CHUNK_SIZE) {
+            size_t chunk = padded - c < AIO_CHUNK_SIZE ? padded - c : AIO_CHUNK_SIZE;
+            status = Aio_Write(queue, fd, staging + c, chunk, at + c, NULL, NULL);
+        }
+        /* The staging buffer is refilled for the next window */
+        if (Aio_Wait(queue) != 0) {
+            status = -1;
+        }
+    }
+
+    free(staging);
+    return status;
+}
+
+/* Plain records are raw Books, so a Book must have no padding */
+_Static_assert(sizeof(Book) == 3 * sizeof(int) + sizeof(float) +
+                               2 * MAX_TITLE_LEN + 2 * MAX_AUTHOR_LEN + MAX_ISBN_LEN,
+               "Book has padding that would reach catalog files");
+
+/* The string fields of a Book */
+static const struct {
+    size_t offset;
+    size_t size;
+} recordStrings[] = {
+    {offsetof(Book, title), MAX_TITLE_LEN},
+    {offsetof(Book, author), MAX_AUTHOR_LEN},
+    {offsetof(Book, isbn), MAX_ISBN_LEN},
+    {offsetof(Book, titleFolded), MAX_TITLE_LEN},
+    {offsetof(Book, authorFolded), MAX_AUTHOR_LEN}
+};
+
+/**
+ * Zero every string of a plain record past its text: callers fill books
+ * with fgets or over older, longer strings, and those leftover bytes do
+ * not belong in the file
+ */
+static void clearRecordTails(Book *record) {
+    for (size_t s = 0; s < sizeof(recordStrings) / sizeof(recordStrings[0]); s++) {
+        char *text = (char*)record + recordStrings[s].offset;
+        size_t length = strnlen(text, recordStrings[s].size - 1);
+        memset(text + length, 0, recordStrings[s].size - length);
+    }
+}
+
+/**
+ * Copy a library's books as plain records with their string tails zeroed
+ * @return: The records, or NULL on allocation failure
+ */
+static Book* copyRecords(const Library *library) {
+    Book *records = (Book*)malloc((size_t)(library->count > 0 ? library->count : 1) *
+                                  sizeof(Book));
+    if (records == NULL) {
+        fprintf(stderr, "Memory allocation failed for catalog records\n");
+        return NULL;
+    }
+
+    for (int i = 0; i < library->count; i++) {
+        records[i] = library->books[i];
+        clearRecordTails(&records[i]);
+    }
+    return records;
+}
+
+/**
+ * Sync a written temporary file and rename it over the catalog
+ * @param total: File size; an O_DIRECT file is truncated to it
+ * @param status: 0 if every write was queued, -1 otherwise
+ * @return: 0 on success, -1 on failure (the temporary file is removed)
+ */
+static int replaceFile(AioQueue *queue, int fd, int direct, uint64_t total,
+                       const char *temp, const char *path, int status) {
+    if (Aio_Sync(queue, fd) != 0 || status != 0 ||
+        (direct && (ftruncate(fd, (off_t)total) != 0 || fdatasync(fd) != 0))) {
+        fprintf(stderr, "Cannot write %s: %s\n", temp, strerror(errno));
+        close(fd);
+        unlink(temp);
+        return -1;
+    }
+    if (close(fd) != 0 || rename(temp, path) != 0) {
+        fprintf(stderr, "Cannot replace %s: %s\n", path, strerror(errno));
+        unlink(temp);
+        return -1;
+    }
+    /* The rename may not survive a crash, so the log must not be emptied */
+    return Aio_SyncDirectory(path) != 0 ? -1 : 0;
+}
+
+int Catalog_Save(const Library *library, const char *path) {
+    return Catalog_Write(library, path, NULL, 0);
+}
+
+int Catalog_Write(const Library *library, const char *path, AioQueue *queue,
+                  int flags) {
+    char temp[4096];
+    CatalogHeader header = {CATALOG_MAGIC, CATALOG_VERSION,
+                            (uint32_t)sizeof(Book), library->count,
+                            library->nextId, 0};
+    FileImage image = {(const char*)&header, sizeof(header), NULL,
+                       (uint64_t)library->count * sizeof(Book)};
+    unsigned char *packed = NULL;
+    Book *records = NULL;
+    int direct = (flags & CATALOG_IO_DIRECT) != 0;
+    AioQueue local;
+
+    if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int)sizeof(temp)) {
+        fprintf(stderr, "Catalog path too long: %s\n", path);
+        return -1;
+    }
+    if (flags & CATALOG_COMPRESSED) {
+        size_t size;
+        packed = Pack_Encode(library, &size);
+        if (packed == NULL) {
+            return -1;
+        }
+        image.head = (const char*)packed;
+        image.headSize = size;
+        image.body = NULL;
+        image.bodySize = 0;
+    } else {
+        records = copyRecords(library);
+        if (records == NULL) {
+            return -1;
+        }
+        image.body = (const char*)records;
+    }
+    if (queue == NULL) {
+        if (Aio_Init(&local, AIO_SYNC, 1) != 0) {
+            free(packed);
+            free(records);
+            return -1;
+        }
+        queue = &local;
+    }
+
+    uint64_t total = image.headSize + image.bodySize;
+    int status = -1;
+    int fd = openFile(temp, O_WRONLY | O_CREAT | O_TRUNC, &direct);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create %s: %s\n", temp, strerror(errno));
+        goto done;
+    }
+
+    status = writeStream(&image, queue, fd, direct);
+    status = replaceFile(queue, fd, direct, total, temp, path, status);
+
+done:
+    if (queue == &local) {
+        Aio_Free(&local);
+    }
+    free(packed);
+    free(records);
+    return status;
+}
+
+/* ============= Streamed Writes ============= */
+
+/* A file written front to back through one staging window */
+typedef struct {
+    AioQueue *queue;
+    int fd;
+    int direct;
+    char *staging;
+    size_t window;
+    size_t fill;                      /* Bytes staged */
+    uint64_t offset;                  /* File offset of staging[0] */
+    int failed;
+} FileStream;
+
+/**
+ * Write out the staged bytes and wait for them, so the window can be
+ * refilled; with O_DIRECT a short last window is padded
+ */
+static void streamFlush(FileStream *stream) {
+    size_t length = stream->direct ? alignUp(stream->fill) : stream->fill;
+
+    memset(stream->staging + stream->fill, 0, length - stream->fill);
+    for (size_t c = 0; c < length && !stream->failed; c += AIO_CHUNK_SIZE) {
+        size_t chunk = length - c < AIO_CHUNK_SIZE ? length - c : AIO_CHUNK_SIZE;
+        if (Aio_Write(stream->queue, stream->fd, stream->staging + c, chunk,
+                      stream->offset + c, NULL, NULL) != 0) {
+            stream->failed = 1;
+        }
+    }
+    if (Aio_Wait(stream->queue) != 0) {
+        stream->failed = 1;
+    }
+    stream->offset += stream->fill;
+    stream->fill = 0;
+}
+
+static void streamPut(FileStream *stream, const void *data, size_t length) {
+    const char *bytes = (const char*)data;
+
+    while (length > 0 && !stream->failed) {
+        size_t n = stream->window - stream->fill;
+        n = length < n ? length : n;
+        memcpy(stream->staging + stream->fill, bytes, n);
+        stream->fill += n;
+        bytes += n;
+        length -= n;
+        if (stream->fill == stream->window) {
+            streamFlush(stream);
+        }
+    }
+}
+
+/* File offset of the next byte put */
+static uint64_t streamPosition(const FileStream *stream) {
+    return stream->offset + stream->fill;
+}
+
+/**
+ * Stream plain records after their header
+ * @return: Records written, or -1 if the source failed
+ */
+static int streamRecords(FileStream *stream, CatalogSource next, void *context,
+                         int count, int nextId) {
+    CatalogHeader header = {CATALOG_MAGIC, CATALOG_VERSION, (uint32_t)sizeof(Book),
+                            count, nextId, 0};
+    Book book;
+    int written = 0;
+    int got = 0;
+
+    streamPut(stream, &header, sizeof(header));
+    while (!stream->failed && (got = next(context, &book)) == 1) {
+        clearRecordTails(&book);
+        streamPut(stream, &book, sizeof(book));
+        written++;
+    }
+    return got == -1 ? -1 : written;
+}
+
+/**
+ * Stream a packed file: header, blocks, then the filters and index
+ * collected on the way, which take about 100 bytes per block
+ * @return: Books written, or -1 if the source failed or out of memory
+ */
+static int streamBlocks(FileStream *stream, CatalogSource next, void *context,
+                        int count, int nextId) {
+    uint32_t blockCount = (uint32_t)((count + PACK_BLOCK_BOOKS - 1) / PACK_BLOCK_BOOKS);
+    PackHeader header = {PACK_MAGIC, PACK_VERSION, blockCount, count, nextId, 0};
+    Book *books = (Book*)malloc(PACK_BLOCK_BOOKS * sizeof(Book));
+    unsigned char *block = (unsigned char*)malloc(PACK_MAX_BLOCK_BYTES);
+    PackBlockEntry *index = (PackBlockEntry*)malloc((blockCount + 1) * sizeof(PackBlockEntry));
+    BloomBlock *filters = (BloomBlock*)malloc((blockCount + 1) * sizeof(BloomBlock));
+    int written = -1;
+    uint32_t b = 0;
+    int got = 1;
+
+    if (books == NULL || block == NULL || index == NULL || filters == NULL) {
+        fprintf(stderr, "Memory allocation failed for packed catalog\n");
+        goto done;
+    }
+
+    streamPut(stream, &header, sizeof(header));
+    written = 0;
+    while (got == 1 && !stream->failed) {
+        int n = 0;
+        while (n < PACK_BLOCK_BOOKS && (got = next(context, &books[n])) == 1) {
+            n++;
+        }
+        if (n == 0 || got == -1) {
+            break;
+        }
+        if (b == blockCount) {
+            /* More books than announced; the count check below fails */
+            written += n;
+            break;
+        }
+
+        size_t length = Pack_EncodeBlock(books, n, block);
+        index[b].firstId = books[0].id;
+        index[b].lastId = books[n - 1].id;
+        index[b].offset = streamPosition(stream);
+        index[b].size = (uint32_t)length;
+        index[b].count = (uint32_t)n;
+        memset(&filters[b], 0, sizeof(filters[b]));
+        for (int i = 0; i < n; i++) {
+            Bloom_BlockAdd(&filters[b], Bloom_HashId(books[i].id));
+        }
+        streamPut(stream, block, length);
+        written += n;
+        b++;
+    }
+    if (got == -1) {
+        written = -1;
+        goto done;
+    }
+
+    /* Aligned as Pack_Encode aligns them */
+    static const char zeros[sizeof(BloomBlock)];
+    streamPut(stream, zeros, (sizeof(BloomBlock) - streamPosition(stream) % sizeof(BloomBlock)) %
+                             sizeof(BloomBlock));
+    streamPut(stream, filters, b * sizeof(BloomBlock));
+    PackTrailer trailer = {streamPosition(stream), b, PACK_MAGIC};
+    streamPut(stream, index, b * sizeof(PackBlockEntry));
+    streamPut(stream, &trailer, sizeof(trailer));
+
+done:
+    free(books);
+    free(block);
+    free(index);
+    free(filters);
+    return written;
+}
+
+int Catalog_WriteSource(CatalogSource next, void *context, int count, int nextId,
+                        const char *path, AioQueue *queue, int flags) {
+    char temp[4096];
+    FileStream stream;
+    int direct = (flags & CATALOG_IO_DIRECT) != 0;
+    AioQueue local;
+
+    if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int)sizeof(temp)) {
+        fprintf(stderr, "Catalog path too long: %s\n", path);
+        return -1;
+    }
+    if (queue == NULL) {
+        if (Aio_Init(&local, AIO_SYNC, 1) != 0) {
+            return -1;
+        }
+        queue = &local;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    stream.queue = queue;
+    stream.window = (size_t)queue->depth * AIO_CHUNK_SIZE;
+    stream.staging = (char*)Aio_AllocAligned(stream.window);
+    stream.fd = -1;
+    int status = -1;
+    if (stream.staging == NULL) {
+        goto done;
+    }
+    stream.fd = openFile(temp, O_WRONLY | O_CREAT | O_TRUNC, &direct);
+    if (stream.fd < 0) {
+        fprintf(stderr, "Cannot create %s: %s\n", temp, strerror(errno));
+        goto done;
+    }
+    stream.direct = direct;
+
+    int written = flags & CATALOG_COMPRESSED
+                ? streamBlocks(&stream, next, context, count, nextId)
+                : streamRecords(&stream, next, context, count, nextId);
+    if (written != -1 && written != count) {
+        fprintf(stderr, "Catalog source gave %d book(s), not %d\n", written, count);
+    }
+
+    uint64_t total = streamPosition(&stream);
+    if (!stream.failed && stream.fill > 0) {
+        streamFlush(&stream);
+    }
+    status = replaceFile(queue, stream.fd, direct, total, temp, path,
+                         stream.failed || written != count ? -1 : 0);
+
+done:
+    if (queue == &local) {
+        Aio_Free(&local);
+    }
+    free(stream.staging);
+    return status;
+}
+
+/* ============= Bulk Load ============= */
+
+/* Both formats begin with a header of the same size */
+_Static_assert(sizeof(PackHeader) == sizeof(CatalogHeader),
+               "packed and plain catalog headers differ in size");
+
+/* Parser state carried from one window of the file to the next */
+typedef struct {
+    Library *library;
+    const char *path;
+    CatalogHeader header;             /* Or a PackHeader, when packed */
+    size_t headerBytes;               /* Header bytes seen so far */
+    size_t headerSize;                /* Header bytes this version has */
+    Book record;                      /* Record being assembled */
+    size_t recordBytes;
+    int packed;                       /* The file is in the PACK.h format */
+    uint32_t blockCount;
+    uint32_t blocksLoaded;
+    unsigned char *block;             /* Packed block being assembled */
+    size_t blockBytes;
+    size_t blockSize;                 /* Its size, or 0 until known */
+    Book *books;                      /* The decoded block */
+    int loaded;
+    int failed;
+} LoadState;
+
+/**
+ * Size of the whole header, given its first CATALOG_HEADER_PREFIX bytes
+ */
+static size_t headerSize(const CatalogHeader *header) {
+    if (header->magic == PACK_MAGIC) {
+        return PACK_HEADER_SIZE(header->version);
+    }
+    return header->version >= CATALOG_VERSION ? sizeof(CatalogHeader)
+                                              : CATALOG_HEADER_PREFIX;
+}
+
+/**
+ * Check a complete header and prepare for the records that follow it
+ */
+static void startRecords(LoadState *state) {
+    const CatalogHeader *header = &state->header;
+
+    if (header->magic == PACK_MAGIC) {
+        PackHeader pack;
+        memcpy(&pack, header, sizeof(pack));
+        state->packed = 1;
+        state->blockCount = pack.blockCount;
+        state->block = (unsigned char*)malloc(PACK_MAX_BLOCK_BYTES);
+        state->books = (Book*)malloc(PACK_BLOCK_BOOKS * sizeof(Book));
+        if (state->block == NULL || state->books == NULL) {
+            fprintf(stderr, "Memory allocation failed for catalog blocks\n");
+            state->failed = 1;
+            return;
+        }
+        if (pack.version >= PACK_VERSION_UNFILTERED && pack.version <= PACK_VERSION &&
+            pack.count >= 0) {
+            return;
+        }
+    } else if (header->magic == CATALOG_MAGIC &&
+               (header->version == CATALOG_VERSION ||
+                header->version == CATALOG_VERSION_NO_NEXT_ID) &&
+               header->recordSize == sizeof(Book) && header->count >= 0) {
+        return;
+    }
+
+    fprintf(stderr, "%s is not a catalog file for this build\n", state->path);
+    state->failed = 1;
+}
+
+/**
+ * Assemble the next packed block and add its books to the library
+ * @return: Bytes consumed
+ */
+static size_t loadBlockBytes(LoadState *state, const char *bytes, size_t length) {
+    /* The index and trailer after the last block are only for lookups */
+    if (state->blocksLoaded == state->blockCount) {
+        return length;
+    }
+
+    size_t want = state->blockSize != 0 ? state->blockSize : sizeof(uint32_t);
+    size_t n = want - state->blockBytes;
+    n = length < n ? length : n;
+    memcpy(state->block + state->blockBytes, bytes, n);
+    state->blockBytes += n;
+
+    if (state->blockSize == 0 && state->blockBytes == sizeof(uint32_t)) {
+        uint32_t size;
+        memcpy(&size, state->block, sizeof(size));
+        if (size < sizeof(PackBlockHeader) || size > PACK_MAX_BLOCK_BYTES) {
+            fprintf(stderr, "%s has a corrupt block\n", state->path);
+            state->failed = 1;
+        }
+        state->blockSize = size;
+    } else if (state->blockSize != 0 && state->blockBytes == state->blockSize) {
+        int count = Pack_DecodeBlock(state->block, state->blockSize, state->books);
+        if (count < 0) {
+            fprintf(stderr, "%s has a corrupt block\n", state->path);
+            state->failed = 1;
+            return n;
+        }
+        for (int i = 0; i < count && !state->failed; i++) {
+            if (libraryRestoreBook(state->library, &state->books[i]) == -1) {
+                fprintf(stderr, "Cannot load book %d from %s\n",
+                        state->books[i].id, state->path);
+                state->failed = 1;
+            } else {
+                state->loaded++;
+            }
+        }
+        state->blocksLoaded++;
+        state->blockBytes = 0;
+        state->blockSize = 0;
+    }
+    return n;
+}
+
+/**
+ * Add the books in the next part of the file to the library
+ */
+static void loadBytes(LoadState *state, const char *bytes, size_t length) {
+    while (length > 0 && !state->failed) {
+        size_t n;
+
+        if (state->headerBytes < state->headerSize) {
+            n = state->headerSize - state->headerBytes;
+            n = length < n ? length : n;
+            memcpy((char*)&state->header + state->headerBytes, bytes, n);
+            state->headerBytes += n;
+
+            if (state->headerBytes == CATALOG_HEADER_PREFIX) {
+                state->headerSize = headerSize(&state->header);
+            }
+            if (state->headerBytes == state->headerSize) {
+                startRecords(state);
+            }
+        } else if (state->packed) {
+            n = loadBlockBytes(state, bytes, length);
+        } else if (state->loaded < state->header.count) {
+            n = sizeof(Book) - state->recordBytes;
+            n = length < n ? length : n;
+            memcpy((char*)&state->record + state->recordBytes, bytes, n);
+            state->recordBytes += n;
+
+            if (state->recordBytes == sizeof(Book)) {
+                state->recordBytes = 0;
+                if (libraryRestoreBook(state->library, &state->record) == -1) {
+                    fprintf(stderr, "Cannot load book %d from %s\n",
+                            state->record.id, state->path);
+                    state->failed = 1;
+                } else {
+                    state->loaded++;
+                }
+            }
+        } else {
+            break;
+        }
+        bytes += n;
+        length -= n;
+    }
+}
+
+/* Read completion: count the bytes a window received */
+static void countBytes(void *context, int64_t result) {
+    if (result > 0) {
+        *(uint64_t*)context += (uint64_t)result;
+    }
+}
+
+/**
+ * Queue the reads for one window of the file
+ * @return: 0 on success, -1 on failure
+ */
+static int readWindow(AioQueue *queue, int fd, char *buffer, size_t window,
+                      uint64_t at, uint64_t size, uint64_t *received) {
+    size_t length = alignUp(size - at < window ? (size_t)(size - at) : window);
+
+    *received = 0;
+    for (size_t c = 0; c < length; c += AIO_CHUNK_SIZE) {
+        size_t chunk = length - c < AIO_CHUNK_SIZE ? length - c : AIO_CHUNK_SIZE;
+        if (Aio_Read(queue, fd, buffer + c, chunk, at + c, countBytes, received) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int Catalog_Load(Library *library, const char *path, AioQueue *queue,
+                 int flags) {
+    LoadState state;
+    struct stat info;
+    int direct = (flags & CATALOG_IO_DIRECT) != 0;
+    char *buffers[2] = {NULL, NULL};
+    uint64_t received[2];
+    AioQueue local;
+
+    if (library->count != 0) {
+        fprintf(stderr, "A catalog can only be loaded into an empty library\n");
+        return -1;
+    }
+    if (queue == NULL) {
+        if (Aio_Init(&local, AIO_SYNC, 1) != 0) {
+            return -1;
+        }
+        queue = &local;
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.library = library;
+    state.path = path;
+    state.headerSize = CATALOG_HEADER_PREFIX;
+
+    int fd = openFile(path, O_RDONLY, &direct);
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        state.failed = 1;
+        goto done;
+    }
+
+    /* Two windows of half the queue depth: one is parsed while the other is read */
+    uint64_t size = (uint64_t)info.st_size;
+    size_t window = (queue->depth > 1 ? queue->depth / 2 : 1) * AIO_CHUNK_SIZE;
+    if (window > alignUp((size_t)size)) {
+        window = alignUp((size_t)size);
+    }
+    if (window == 0) {
+        window = AIO_DIRECT_ALIGN;
+    }
+    buffers[0] = (char*)Aio_AllocAligned(window);
+    buffers[1] = (char*)Aio_AllocAligned(window);
+    if (buffers[0] == NULL || buffers[1] == NULL ||
+        readWindow(queue, fd, buffers[0], window, 0, size, &received[0]) != 0) {
+        state.failed = 1;
+        goto done;
+    }
+
+    int b = 0;
+    for (uint64_t at = 0; at < size && !state.failed; at += window, b = !b) {
+        size_t length = size - at < window ? (size_t)(size - at) : window;
+
+        if (Aio_Wait(queue) != 0 || received[b] < length) {
+            fprintf(stderr, "Cannot read %s: %s\n", path,
+                    received[b] < length ? "file changed while loading" : "I/O error");
+            state.failed = 1;
+            break;
+        }
+        if (at + window < size &&
+            readWindow(queue, fd, buffers[!b], window, at + window, size,
+                       &received[!b]) != 0) {
+            state.failed = 1;
+            break;
+        }
+        loadBytes(&state, buffers[b], length);
+    }
+
+    if (!state.failed && (state.headerBytes < state.headerSize ||
+                          state.blocksLoaded < state.blockCount ||
+                          state.loaded != state.header.count)) {
+        fprintf(stderr, "%s is truncated\n", path);
+        state.failed = 1;
+    }
+
+    /* Only now: restoring a book with an ID below nextId is refused */
+    if (!state.failed && state.headerSize == sizeof(CatalogHeader) &&
+        library->nextId < state.header.nextId) {
+        library->nextId = state.header.nextId;
+    }
+
+done:
+    Aio_Wait(queue);
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(buffers[0]);
+    free(buffers[1]);
+    free(state.block);
+    free(state.books);
+    if (queue == &local) {
+        Aio_Free(&local);
+    }
+    return state.failed ? -1 : state.loaded;
+}
+
+/**
+ * Read a run of records from the file: the samples narrow the search to
+ * the CATALOG_SAMPLE_RECORDS records that can hold the ID
+ * @return: 1 if found, 0 if the ID is not in the catalog
+ */
+static int readRecordRun(const Catalog *catalog, int id, Book *book) {
+    Book run[CATALOG_SAMPLE_RECORDS];
+    int samples = (catalog->count + CATALOG_SAMPLE_RECORDS - 1) / CATALOG_SAMPLE_RECORDS;
+    int low = 0;
+    int high = samples - 1;
+
+    /* Last sample at or below the ID */
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        if (catalog->samples[mid] <= id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    if (high < 0) {
+        return 0;
+    }
+
+    int first = high * CATALOG_SAMPLE_RECORDS;
+    int count = catalog->count - first < CATALOG_SAMPLE_RECORDS
+              ? catalog->count - first : CATALOG_SAMPLE_RECORDS;
+    size_t bytes = (size_t)count * sizeof(Book);
+    off_t offset = (off_t)((const unsigned char*)&catalog->records[first] - catalog->map);
+    if (pread(catalog->fd, run, bytes, offset) != (ssize_t)bytes) {
+        fprintf(stderr, "Cannot read catalog records: %s\n", strerror(errno));
+        return 0;
+    }
+
+    low = 0;
+    high = count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+
+        if (run[mid].id == id) {
+            *book = run[mid];
+            return 1;
+        }
+        if (run[mid].id < id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Read a book from the file: a run of records, or the one packed block
+ * that can hold the ID unless the block's filter rules the ID out
+ * @return: 1 if found, 0 if the ID is not in the catalog
+ */
+static int readRecord(const Catalog *catalog, int id, Book *book) {
+    uint64_t block[(PACK_MAX_BLOCK_BYTES + 7) / 8];
+
+    if (catalog->blocks == NULL) {
+        return readRecordRun(catalog, id, book);
+    }
+
+    int b = Pack_FindBlock(catalog->blocks, catalog->blockCount, id);
+    if (b == -1) {
+        return 0;
+    }
+
+    if (catalog->filters != NULL &&
+        !Bloom_BlockMayContain(&catalog->filters[b], Bloom_HashId(id))) {
+        METRICS_INC(COUNTER_BLOOM_NEGATIVES);
+        return 0;
+    }
+
+    const PackBlockEntry *entry = &catalog->blocks[b];
+    int found = -1;
+    if (entry->size <= sizeof(block) &&
+        pread(catalog->fd, block, entry->size, (off_t)entry->offset) == (ssize_t)entry->size) {
+        found = Pack_FindInBlock((const unsigned char*)block, entry->size, id, book);
+    }
+    if (found < 0) {
+        fprintf(stderr, "Catalog block %d is corrupt\n", b);
+        return 0;
+    }
+    if (found == 0 && catalog->filters != NULL) {
+        METRICS_INC(COUNTER_BLOOM_FALSE_POSITIVES);
+    }
+    return found;
+}
+
+/* ============= Scans ============= */
+
+/**
+ * Give back the pages a scan has passed once it is a window past them,
+ * and ask for the window ahead
+ * @param offset: Mapping offset the scan has read up to
+ */
+static void scanReached(CatalogCursor *cursor, size_t offset) {
+    const Catalog *catalog = cursor->catalog;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (offset < cursor->window + CATALOG_SCAN_WINDOW) {
+        return;
+    }
+    size_t end = offset & ~(page - 1);
+    madvise((void*)(catalog->map + cursor->window), end - cursor->window,
+            MADV_DONTNEED);
+    cursor->window = end;
+    size_t ahead = catalog->mapSize - end < CATALOG_SCAN_WINDOW
+                 ? catalog->mapSize - end : CATALOG_SCAN_WINDOW;
+    madvise((void*)(catalog->map + end), ahead, MADV_WILLNEED);
+}
+
+int Catalog_StartScan(Catalog *catalog, CatalogCursor *cursor) {
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->catalog = catalog;
+    if (catalog->blocks != NULL) {
+        cursor->books = (Book*)malloc(PACK_BLOCK_BOOKS * sizeof(Book));
+        if (cursor->books == NULL) {
+            fprintf(stderr, "Memory allocation failed for catalog scan\n");
+            return -1;
+        }
+    }
+
+    /* The mapping is advised for random lookups, which read nothing ahead */
+    madvise((void*)catalog->map, catalog->mapSize < CATALOG_SCAN_WINDOW
+                                 ? catalog->mapSize : CATALOG_SCAN_WINDOW,
+            MADV_WILLNEED);
+    return 0;
+}
+
+int Catalog_NextRecord(CatalogCursor *cursor, Book *book) {
+    const Catalog *catalog = cursor->catalog;
+
+    if (catalog->blocks == NULL) {
+        if (cursor->next == catalog->count) {
+            return 0;
+        }
+        const Book *record = &catalog->records[cursor->next++];
+        *book = *record;
+        scanReached(cursor, (size_t)((const unsigned char*)(record + 1) - catalog->map));
+        return 1;
+    }
+
+    while (cursor->taken == cursor->decoded) {
+        if (cursor->next == catalog->blockCount) {
+            return 0;
+        }
+        const PackBlockEntry *entry = &catalog->blocks[cursor->next];
+        int count = Pack_DecodeBlock(catalog->map + entry->offset, entry->size,
+                                     cursor->books);
+        if (count < 0) {
+            fprintf(stderr, "Catalog block %d is corrupt\n", cursor->next);
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            Book *decoded = &cursor->books[i];
+            Text_Fold(decoded->title, decoded->titleFolded, sizeof(decoded->titleFolded));
+            Text_Fold(decoded->author, decoded->authorFolded, sizeof(decoded->authorFolded));
+        }
+        cursor->next++;
+        cursor->decoded = count;
+        cursor->taken = 0;
+        scanReached(cursor, (size_t)(entry->offset + entry->size));
+    }
+
+    *book = cursor->books[cursor->taken++];
+    return 1;
+}
+
+void Catalog_EndScan(CatalogCursor *cursor) {
+    const Catalog *catalog = cursor->catalog;
+
+    madvise((void*)(catalog->map + cursor->window), catalog->mapSize - cursor->window,
+            MADV_DONTNEED);
+    free(cursor->books);
+    cursor->books = NULL;
+}
+
+/* ============= Record Cache ============= */
+
+static uint32_t hashId(int id) {
+    return (uint32_t)id * 2654435761u;
+}
+
+/**
+ * Allocate a shard's entries and buckets for a byte budget
+ * @return: 0 on success, -1 on allocation failure
+ */
+static int initShard(CacheShard *shard, size_t budget) {
+    size_t capacity = budget / ENTRY_COST;
+    int buckets = 1;
+
+    memset(shard, 0, sizeof(*shard));
+    shard->head = -1;
+    shard->tail = -1;
+    pthread_mutex_init(&shard->lock, NULL);
+    if (capacity == 0) {
+        return 0;
+    }
+    if (capacity > (size_t)1 << 30) {
+        capacity = (size_t)1 << 30;
+    }
+    while ((size_t)buckets < capacity) {
+        buckets <<= 1;
+    }
+
+    shard->entries = (CacheEntry*)malloc(capacity * sizeof(CacheEntry));
+    shard->buckets = (int*)malloc((size_t)buckets * sizeof(int));
+    if (shard->entries == NULL || shard->buckets == NULL) {
+        fprintf(stderr, "Memory allocation failed for catalog cache\n");
+        return -1;
+    }
+    for (int b = 0; b < buckets; b++) {
+        shard->buckets[b] = -1;
+    }
+    shard->bucketMask = buckets - 1;
+    shard->capacity = (int)capacity;
+
+    return 0;
+}
+
+static void freeShard(CacheShard *shard) {
+    free(shard->entries);
+    free(shard->buckets);
+    pthread_mutex_destroy(&shard->lock);
+}
+
+/**
+ * Find a cached record in a shard (caller holds the lock)
+ * @return: Entry index, or -1 if not cached
+ */
+static int findEntry(const CacheShard *shard, int id, uint32_t hash) {
+    int e = shard->buckets[hash & (uint32_t)shard->bucketMask];
+
+    while (e != -1 && shard->entries[e].book.id != id) {
+        e = shard->entries[e].hashNext;
+    }
+
+    return e;
+}
+
+static void unlinkLru(CacheShard *shard, int e) {
+    CacheEntry *entry = &shard->entries[e];
+
+    if (entry->prev != -1) {
+        shard->entries[entry->prev].next = entry->next;
+    } else {
+        shard->head = entry->next;
+    }
+    if (entry->next != -1) {
+        shard->entries[entry->next].prev = entry->prev;
+    } else {
+        shard->tail = entry->prev;
+    }
+}
+
+static void pushFront(CacheShard *shard, int e) {
+    CacheEntry *entry = &shard->entries[e];
+
+    entry->prev = -1;
+    entry->next = shard->head;
+    if (shard->head != -1) {
+        shard->entries[shard->head].prev = e;
+    } else {
+        shard->tail = e;
+    }
+    shard->head = e;
+}
+
+/**
+ * Drop the least recently used record from its bucket and the LRU list
+ * @return: The freed entry index
+ */
+static int evictTail(CacheShard *shard) {
+    int victim = shard->tail;
+    int *link = &shard->buckets[hashId(shard->entries[victim].book.id) &
+                                (uint32_t)shard->bucketMask];
+
+    while (*link != victim) {
+        link = &shard->entries[*link].hashNext;
+    }
+    *link = shard->entries[victim].hashNext;
+    unlinkLru(shard, victim);
+
+    shard->evictions++;
+    METRICS_INC(COUNTER_CACHE_EVICTIONS);
+    return victim;
+}
+
+/**
+ * Cache a copy of a record read from the file (caller holds the lock)
+ */
+static void admitRecord(CacheShard *shard, const Book *record, uint32_t hash) {
+    int e = shard->used < shard->capacity ? shard->used++ : evictTail(shard);
+    int *bucket = &shard->buckets[hash & (uint32_t)shard->bucketMask];
+    CacheEntry *entry = &shard->entries[e];
+
+    entry->book = *record;
+    entry->hashNext = *bucket;
+    *bucket = e;
+    pushFront(shard, e);
+}
+
+/* ============= Public API ============= */
+
+Catalog* Catalog_Open(const char *path, size_t cache_bytes) {
+    Catalog *catalog = (Catalog*)calloc(1, sizeof(Catalog));
+    struct stat info;
+    const CatalogHeader *header;
+    int shards = 0;
+
+    if (catalog == NULL) {
+        fprintf(stderr, "Memory allocation failed for catalog\n");
+        return NULL;
+    }
+
+    catalog->fd = open(path, O_RDONLY);
+    if (catalog->fd < 0 || fstat(catalog->fd, &info) != 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+    if ((size_t)info.st_size < CATALOG_HEADER_PREFIX) {
+        fprintf(stderr, "%s is not a catalog file\n", path);
+        goto fail;
+    }
+
+    catalog->mapSize = (size_t)info.st_size;
+    void *map = mmap(NULL, catalog->mapSize, PROT_READ, MAP_SHARED,
+                     catalog->fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+    catalog->map = (const unsigned char*)map;
+
+    header = (const CatalogHeader*)catalog->map;
+    if (header->magic == PACK_MAGIC) {
+        if (Pack_OpenIndex(catalog->map, catalog->mapSize, &catalog->blocks,
+                           &catalog->filters) != 0) {
+            fprintf(stderr, "%s is not a valid packed catalog\n", path);
+            goto fail;
+        }
+        catalog->blockCount = (int)((const PackHeader*)catalog->map)->blockCount;
+        catalog->count = header->count;
+        if (catalog->blockCount > 0) {
+            catalog->nextId = catalog->blocks[catalog->blockCount - 1].lastId + 1;
+        }
+        if (header->version >= PACK_VERSION) {
+            catalog->nextId = ((const PackHeader*)catalog->map)->nextId;
+        }
+    } else if (header->magic != CATALOG_MAGIC ||
+        (header->version != CATALOG_VERSION &&
+         header->version != CATALOG_VERSION_NO_NEXT_ID) ||
+        catalog->mapSize < headerSize(header) ||
+        header->recordSize != sizeof(Book) || header->count < 0 ||
+        (catalog->mapSize - headerSize(header)) / sizeof(Book) <
+            (size_t)header->count) {
+        fprintf(stderr, "%s is not a catalog file for this build\n", path);
+        goto fail;
+    } else {
+        catalog->records = (const Book*)(catalog->map + headerSize(header));
+        catalog->count = header->count;
+        int samples = (catalog->count + CATALOG_SAMPLE_RECORDS - 1) / CATALOG_SAMPLE_RECORDS;
+        catalog->samples = (int*)malloc((size_t)(samples > 0 ? samples : 1) * sizeof(int));
+        if (catalog->samples == NULL) {
+            fprintf(stderr, "Memory allocation failed for catalog samples\n");
+            goto fail;
+        }
+        for (int i = 0; i < samples; i++) {
+            catalog->samples[i] = catalog->records[i * CATALOG_SAMPLE_RECORDS].id;
+        }
+        /* Sampling touched every page; lookups read the file instead */
+        madvise(map, catalog->mapSize, MADV_DONTNEED);
+        if (catalog->count > 0) {
+            catalog->nextId = catalog->records[catalog->count - 1].id + 1;
+        }
+        if (header->version >= CATALOG_VERSION) {
+            catalog->nextId = header->nextId;
+        }
+    }
+    if (catalog->nextId < 1) {
+        catalog->nextId = 1;
+    }
+
+    /* Only scans read the mapping, and they advise it as they go */
+    madvise(map, catalog->mapSize, MADV_RANDOM);
+
+    for (; shards < CATALOG_CACHE_SHARDS; shards++) {
+        if (initShard(&catalog->shards[shards],
+                      cache_bytes / CATALOG_CACHE_SHARDS) != 0) {
+            shards++;
+            goto fail;
+        }
+    }
+
+    return catalog;
+
+fail:
+    for (int s = 0; s < shards; s++) {
+        freeShard(&catalog->shards[s]);
+    }
+    free(catalog->samples);
+    if (catalog->map != NULL) {
+        munmap((void*)catalog->map, catalog->mapSize);
+    }
+    if (catalog->fd >= 0) {
+        close(catalog->fd);
+    }
+    free(catalog);
+    return NULL;
+}
+
+void Catalog_Close(Catalog *catalog) {
+    if (catalog == NULL) {
+        return;
+    }
+
+    for (int s = 0; s < CATALOG_CACHE_SHARDS; s++) {
+        freeShard(&catalog->shards[s]);
+    }
+    free(catalog->samples);
+    munmap((void*)catalog->map, catalog->mapSize);
+    close(catalog->fd);
+    free(catalog);
+}
+
+int Catalog_FindById(Catalog *catalog, int id, Book *book) {
+    uint32_t hash = hashId(id);
+    CacheShard *shard = &catalog->shards[(hash >> 16) & (CATALOG_CACHE_SHARDS - 1)];
+
+    if (shard->capacity == 0) {
+        return readRecord(catalog, id, book);
+    }
+
+    pthread_mutex_lock(&shard->lock);
+    int e = findEntry(shard, id, hash);
+    if (e != -1) {
+        unlinkLru(shard, e);
+        pushFront(shard, e);
+        *book = shard->entries[e].book;
+        shard->hits++;
+        METRICS_INC(COUNTER_CACHE_HITS);
+        pthread_mutex_unlock(&shard->lock);
+        return 1;
+    }
+    shard->misses++;
+    METRICS_INC(COUNTER_CACHE_MISSES);
+    pthread_mutex_unlock(&shard->lock);
+
+    /* Search the file unlocked: touching a cold page may block on disk */
+    if (!readRecord(catalog, id, book)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&shard->lock);
+    if (findEntry(shard, id, hash) == -1) {
+        admitRecord(shard, book, hash);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return 1;
+}
+
+int Catalog_Count(const Catalog *catalog) {
+    return catalog->count;
+}
+
+int Catalog_NextId(const Catalog *catalog) {
+    return catalog->nextId;
+}
+
+void Catalog_GetCacheStats(Catalog *catalog, CatalogCacheStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    for (int s = 0; s < CATALOG_CACHE_SHARDS; s++) {
+        CacheShard *shard = &catalog->shards[s];
+
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->entries += (size_t)shard->used;
+        stats->capacity += (size_t)shard->capacity;
+        if (shard->capacity > 0) {
+            stats->bytes += (size_t)shard->capacity * sizeof(CacheEntry) +
+                            ((size_t)shard->bucketMask + 1) * sizeof(int);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
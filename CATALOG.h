@@ -0,0 +1,300 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "AIO.h"
+#include "LIBRARY.h"
+#include "PACK.h"
+
+/**
+ * @file CATALOG.h
+ * @brief On-disk book catalog with a read-through cache of hot records
+ *
+ * A catalog file is a header followed by fixed-size Book records in
+ * ascending ID order, the same layout as library->books. The file is
+ * the source of truth: it is mapped read-only for scans, while an ID
+ * lookup that misses the cache reads just what it needs with pread():
+ * an in-memory sample of every CATALOG_SAMPLE_RECORDS-th record's ID
+ * narrows a plain file to one run of records, and a packed file's block
+ * index to one block. Lookups thus leave nothing of the file mapped, and
+ * the kernel keeps what it has read in its page cache, where cold pages
+ * go first under memory pressure.
+ *
+ * Hot records are copied into a bounded cache split into
+ * CATALOG_CACHE_SHARDS shards, each with its own lock, hash table and
+ * LRU list, so concurrent lookups of different books rarely contend.
+ * The byte budget is divided evenly between shards; a shard evicts its
+ * least recently used record when full. Hits, misses and evictions are
+ * counted per shard (see Catalog_GetCacheStats) and also in the
+ * METRICS counters.
+ *
+ * Lookups copy the record out, so a returned Book stays valid however
+ * the cache changes afterwards. A catalog is read-only once opened;
+ * Catalog_Save writes a new file and replaces the old one atomically.
+ *
+ * Catalog_Write and Catalog_Load move whole catalogs through an
+ * AioQueue in AIO_CHUNK_SIZE transfers, keeping up to the queue's depth
+ * of them in flight, optionally with O_DIRECT so a snapshot neither
+ * pollutes nor waits on the page cache.
+ *
+ * A scan (Catalog_StartScan) reads every record in ID order straight
+ * from the mapping, bypassing the cache. It asks the kernel to read
+ * ahead of it and gives back the pages behind it, CATALOG_SCAN_WINDOW
+ * bytes at a time, so a scan of a file far larger than memory keeps
+ * only about that much of it mapped. With lookups mapping nothing, what
+ * a process holds of a catalog stays near the cache budget however much
+ * of the file it has visited.
+ *
+ * Catalog_WriteSource writes a catalog from books handed over one at a
+ * time in ID order, staging one queue-depth window of the file at a
+ * time, so neither the books nor the file image need be in memory.
+ *
+ * With CATALOG_COMPRESSED a catalog is written in the packed format of
+ * PACK.h instead: compressed column blocks and a block index, a small
+ * fraction of the size. Catalog_Load and Catalog_Open recognize either
+ * format. A lookup in a packed catalog decodes only the block that can
+ * hold the ID, so it costs a few microseconds more than a plain record
+ * on a cache miss; hits are the same.
+ */
+
+/* Bytes of the mapping a scan keeps paged in ahead of it and behind it */
+#ifndef CATALOG_SCAN_WINDOW
+#define CATALOG_SCAN_WINDOW ((size_t)4 << 20)
+#endif
+
+/* Records per ID sample a plain catalog's lookups start from */
+#ifndef CATALOG_SAMPLE_RECORDS
+#define CATALOG_SAMPLE_RECORDS 16
+#endif
+
+/* Lock shards in the record cache; a power of two */
+#ifndef CATALOG_CACHE_SHARDS
+#define CATALOG_CACHE_SHARDS 16
+#endif
+
+#define CATALOG_MAGIC 0x4B4F4F42u     /* "BOOK" in a little-endian file */
+#define CATALOG_VERSION 3u            /* 3: the header holds the next ID */
+#define CATALOG_VERSION_NO_NEXT_ID 2u /* Same records after a shorter header */
+
+/* Flags for Catalog_Write and Catalog_Load */
+#define CATALOG_IO_DIRECT 1           /* Bypass the page cache (O_DIRECT) */
+#define CATALOG_COMPRESSED 2          /* Write the packed format (PACK.h) */
+
+/* Fixed header at the start of a catalog file */
+typedef struct {
+    uint32_t magic;                   /* CATALOG_MAGIC */
+    uint32_t version;                 /* CATALOG_VERSION */
+    uint32_t recordSize;              /* sizeof(Book) of the writer */
+    int32_t count;                    /* Number of records */
+    int32_t nextId;                   /* Writer library's next ID */
+    uint32_t reserved;                /* Zero */
+} CatalogHeader;
+
+/*
+ * Bytes every catalog format starts with: the whole header of a version
+ * 2 file, and the part of a PackHeader that tells the formats apart
+ */
+#define CATALOG_HEADER_PREFIX offsetof(CatalogHeader, nextId)
+
+/* Cached copy of one record */
+typedef struct {
+    Book book;
+    int prev;                         /* LRU neighbours, -1 at the ends */
+    int next;
+    int hashNext;                     /* Next entry in the same bucket */
+} CacheEntry;
+
+/* One independently locked part of the cache */
+typedef struct {
+    pthread_mutex_t lock;
+    CacheEntry *entries;              /* capacity entries */
+    int *buckets;                     /* Entry chains, -1 if empty */
+    int bucketMask;                   /* Bucket count - 1 */
+    int capacity;                     /* Most records held */
+    int used;                         /* Entries handed out so far */
+    int head;                         /* Most recently used, or -1 */
+    int tail;                         /* Least recently used, or -1 */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} CacheShard;
+
+typedef struct {
+    int fd;                           /* Open catalog file */
+    const unsigned char *map;         /* Whole file, mapped read-only */
+    size_t mapSize;                   /* Bytes mapped */
+    const Book *records;              /* Records, ascending by ID; NULL if packed */
+    int *samples;                     /* ID of every CATALOG_SAMPLE_RECORDS-th record; NULL if packed */
+    const PackBlockEntry *blocks;     /* Block index of a packed file, or NULL */
+    const BloomBlock *filters;        /* IDs of each block, or NULL */
+    int blockCount;
+    int count;                        /* Number of records */
+    int nextId;                       /* First ID the writer had not handed out */
+    CacheShard shards[CATALOG_CACHE_SHARDS];
+} Catalog;
+
+/* Position of a scan through a catalog's records */
+typedef struct {
+    Catalog *catalog;
+    int next;                         /* Next record, or next block if packed */
+    Book *books;                      /* Decoded block of a packed catalog */
+    int decoded;                      /* Books in it */
+    int taken;                        /* Of those, already returned */
+    size_t window;                    /* Mapping offset the paged-in window starts at */
+} CatalogCursor;
+
+/**
+ * Hands over the books of a catalog being written, one per call, in
+ * ascending ID order
+ * @return 1 with the next book, 0 after the last one, -1 on failure
+ */
+typedef int (*CatalogSource)(void *context, Book *book);
+
+/* Cache counters summed over all shards */
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;                   /* Records currently cached */
+    size_t capacity;                  /* Most records the budget allows */
+    size_t bytes;                     /* Memory held by the cache */
+} CatalogCacheStats;
+
+/**
+ * @brief Write a library's books to a catalog file
+ *
+ * The file is written under a temporary name, synced and renamed over
+ * path, so readers see either the old catalog or the complete new one.
+ * The directory is flushed before returning, so once this succeeds the
+ * new catalog survives a power loss and its log may be emptied.
+ *
+ * @param library Library to save
+ * @param path Catalog file to create or replace
+ * @return 0 on success, -1 on failure
+ */
+int Catalog_Save(const Library *library, const char *path);
+
+/**
+ * @brief Write a library's books to a catalog file through an I/O queue
+ *
+ * Same file and the same atomic replace as Catalog_Save. With
+ * CATALOG_IO_DIRECT the records are staged through aligned buffers;
+ * where the file system refuses O_DIRECT the file is written buffered.
+ *
+ * @param library Library to save
+ * @param path Catalog file to create or replace
+ * @param queue Queue to write through; NULL writes synchronously
+ * @param flags CATALOG_IO_DIRECT and/or CATALOG_COMPRESSED, or 0
+ * @return 0 on success, -1 on failure
+ */
+int Catalog_Write(const Library *library, const char *path, AioQueue *queue,
+                  int flags);
+
+/**
+ * @brief Write a catalog file from books handed over one at a time
+ *
+ * Same file, flags and atomic replace as Catalog_Write, for books that
+ * are not all in one library, such as a tiered catalog's file records
+ * merged with its changes. Memory use does not grow with the catalog.
+ *
+ * @param next Called for each book in turn
+ * @param context Passed to next
+ * @param count Number of books next hands over; the write fails if
+ *              it hands over a different number
+ * @param nextId First ID the catalog has not handed out
+ * @return 0 on success, -1 on failure
+ */
+int Catalog_WriteSource(CatalogSource next, void *context, int count, int nextId,
+                        const char *path, AioQueue *queue, int flags);
+
+/**
+ * @brief Load a catalog file into an empty library
+ *
+ * Reads the file in chunks through the queue; while one window of
+ * chunks is being added to the library the next one is already being
+ * read. Books keep their IDs, and IDs the writer had handed out to books
+ * deleted since are not handed out again (files from before version 3
+ * of either format do not record them).
+ *
+ * @param library Empty library to fill
+ * @param path Catalog file written by Catalog_Save or Catalog_Write,
+ *             plain or packed
+ * @param queue Queue to read through; NULL reads synchronously
+ * @param flags 0 or CATALOG_IO_DIRECT
+ * @return Number of books loaded, or -1 on failure
+ */
+int Catalog_Load(Library *library, const char *path, AioQueue *queue,
+                 int flags);
+
+/**
+ * @brief Open a catalog file with a record cache
+ * @param path Catalog file written by Catalog_Save or Catalog_Write
+ * @param cache_bytes Memory budget for cached records; 0 disables caching
+ * @return Pointer to the catalog, or NULL on failure
+ */
+Catalog* Catalog_Open(const char *path, size_t cache_bytes);
+
+/**
+ * @brief Unmap a catalog and free its cache
+ */
+void Catalog_Close(Catalog *catalog);
+
+/**
+ * @brief Look up a book by ID, reading through the cache
+ *
+ * Thread-safe: any number of threads may look up books at once.
+ *
+ * @param catalog Pointer to the catalog
+ * @param id Book ID to find
+ * @param book Receives a copy of the record when found
+ * @return 1 if found, 0 if the ID is not in the catalog
+ */
+int Catalog_FindById(Catalog *catalog, int id, Book *book);
+
+/**
+ * @brief Number of books in a catalog
+ */
+int Catalog_Count(const Catalog *catalog);
+
+/**
+ * @brief First ID the catalog's writer had not handed out
+ *
+ * Files from before version 3 of either format do not record it; their
+ * largest ID plus one is returned instead.
+ */
+int Catalog_NextId(const Catalog *catalog);
+
+/**
+ * @brief Start a scan of every record in ascending ID order
+ * @param cursor Receives the scan's position
+ * @return 0 on success, -1 on allocation failure
+ */
+int Catalog_StartScan(Catalog *catalog, CatalogCursor *cursor);
+
+/**
+ * @brief Read the next record of a scan
+ *
+ * The folded columns are filled in. Any number of lookups may run
+ * during a scan; the cache is neither read nor filled.
+ *
+ * @param book Receives a copy of the record
+ * @return 1 if a record was read, 0 at the end, -1 if the file is corrupt
+ */
+int Catalog_NextRecord(CatalogCursor *cursor, Book *book);
+
+/**
+ * @brief Finish a scan and give back the pages it still has mapped
+ */
+void Catalog_EndScan(CatalogCursor *cursor);
+
+/**
+ * @brief Sum the cache counters of all shards
+ * @param catalog Pointer to the catalog
+ * @param stats Receives the totals
+ */
+void Catalog_GetCacheStats(Catalog *catalog, CatalogCacheStats *stats);
+
+#endif /* CATALOG_H */
@@ -0,0 +1,341 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "GROUPSTATS.h"
+#include "TEXT.h"
+
+/* ============= Tables ============= */
+
+static uint32_t hashYear(int year) {
+    return (uint32_t)year * 2654435761u;
+}
+
+/**
+ * Allocate an empty table with room for capacity groups
+ * @return: 0 on success, -1 on allocation failure
+ */
+static int initTable(StatsTable *table, int capacity) {
+    int slots = 1;
+
+    while (slots < capacity * 2) {
+        slots <<= 1;
+    }
+
+    memset(table, 0, sizeof(*table));
+    table->groups = (StatsGroup*)malloc((size_t)capacity * sizeof(StatsGroup));
+    table->slots = (int*)malloc((size_t)slots * sizeof(int));
+    if (table->groups == NULL || table->slots == NULL) {
+        fprintf(stderr, "Memory allocation failed for group statistics\n");
+        free(table->groups);
+        free(table->slots);
+        return -1;
+    }
+    for (int s = 0; s < slots; s++) {
+        table->slots[s] = -1;
+    }
+    table->capacity = capacity;
+    table->slotMask = slots - 1;
+
+    return 0;
+}
+
+static void freeTable(StatsTable *table) {
+    free(table->groups);
+    free(table->slots);
+}
+
+/**
+ * Double a table's groups and rebuild its slots at twice the size
+ * @return: 0 on success, -1 on allocation failure
+ */
+static int growTable(StatsTable *table) {
+    int capacity = table->capacity * 2;
+    int slots = (table->slotMask + 1) * 2;
+    StatsGroup *groups = (StatsGroup*)realloc(table->groups,
+                                              (size_t)capacity * sizeof(StatsGroup));
+    int *index = (int*)malloc((size_t)slots * sizeof(int));
+
+    if (groups == NULL || index == NULL) {
+        if (groups != NULL) {
+            table->groups = groups;
+        }
+        free(index);
+        return -1;
+    }
+    for (int s = 0; s < slots; s++) {
+        index[s] = -1;
+    }
+    for (int g = 0; g < table->count; g++) {
+        uint32_t s = groups[g].hash & (uint32_t)(slots - 1);
+        while (index[s] != -1) {
+            s = (s + 1) & (uint32_t)(slots - 1);
+        }
+        index[s] = g;
+    }
+
+    free(table->slots);
+    table->groups = groups;
+    table->slots = index;
+    table->capacity = capacity;
+    table->slotMask = slots - 1;
+    return 0;
+}
+
+/**
+ * Find a group by key: an author handle, or a year when key is NULL
+ * @return: The group's slot; it holds -1 if the group does not exist
+ */
+static uint32_t findSlot(const StatsTable *table, const char *key, int year,
+                         uint32_t hash) {
+    uint32_t s = hash & (uint32_t)table->slotMask;
+
+    for (;;) {
+        int g = table->slots[s];
+        if (g == -1) {
+            return s;
+        }
+
+        const StatsGroup *group = &table->groups[g];
+        if (group->hash == hash &&
+            (key != NULL ? strcmp(group->key, key) == 0 : group->year == year)) {
+            return s;
+        }
+        s = (s + 1) & (uint32_t)table->slotMask;
+    }
+}
+
+/**
+ * Find a group, creating it empty if it does not exist
+ * @return: The group, or NULL on allocation failure
+ */
+static StatsGroup* groupFor(StatsTable *table, const char *key, int year,
+                            uint32_t hash) {
+    uint32_t s = findSlot(table, key, year, hash);
+
+    if (table->slots[s] != -1) {
+        return &table->groups[table->slots[s]];
+    }
+    if (table->count == table->capacity) {
+        if (growTable(table) != 0) {
+            return NULL;
+        }
+        s = findSlot(table, key, year, hash);
+    }
+
+    StatsGroup *group = &table->groups[table->count];
+    memset(group, 0, sizeof(*group));
+    if (key != NULL) {
+        snprintf(group->key, sizeof(group->key), "%s", key);
+    } else {
+        group->year = year;
+    }
+    group->hash = hash;
+    table->slots[s] = table->count++;
+    return group;
+}
+
+/* ============= Maintenance ============= */
+
+/**
+ * Add a book to its group (sign 1) or take it out again (sign -1)
+ * @param named: The group is an author, named after the book joining it
+ */
+static void applyToGroup(StatsTable *table, StatsGroup *group, const Book *book,
+                         int sign, int named) {
+    if (group->books == 0 && sign > 0) {
+        table->live++;
+        if (named) {
+            snprintf(group->name, sizeof(group->name), "%s", book->author);
+        }
+    }
+
+    group->books += sign;
+    group->quantity += sign * book->quantity;
+    group->valueCents += (int64_t)sign * libraryPriceKey(book->price) * book->quantity;
+
+    if (group->books == 0 && sign < 0) {
+        table->live--;
+    }
+}
+
+/**
+ * Count a stored book in (sign 1) or out of (sign -1) both tables
+ */
+static void applyBook(GroupStats *stats, const Book *book, int sign) {
+    StatsGroup *author = groupFor(&stats->authors, book->authorFolded, 0,
+                                  StrKey_Hash(book->authorFolded));
+    StatsGroup *year = groupFor(&stats->years, NULL, book->year,
+                                hashYear(book->year));
+
+    if (author == NULL || year == NULL) {
+        stats->failed = 1;
+        return;
+    }
+    applyToGroup(&stats->authors, author, book, sign, 1);
+    applyToGroup(&stats->years, year, book, sign, 0);
+}
+
+static void followMutation(void *context, const Book *before, const Book *after) {
+    GroupStats *stats = (GroupStats*)context;
+
+    if (before != NULL) {
+        applyBook(stats, before, -1);
+    }
+    if (after != NULL) {
+        applyBook(stats, after, 1);
+    }
+    stats->mutations++;
+}
+
+/* ============= Public API ============= */
+
+int GroupStats_Compute(GroupStats *stats, const Library *library) {
+    memset(stats, 0, sizeof(*stats));
+    stats->library = (Library*)library;
+
+    if (initTable(&stats->authors, GROUP_STATS_INITIAL_GROUPS) != 0) {
+        return -1;
+    }
+    if (initTable(&stats->years, GROUP_STATS_INITIAL_GROUPS) != 0) {
+        freeTable(&stats->authors);
+        return -1;
+    }
+
+    for (int i = 0; library != NULL && i < library->count; i++) {
+        applyBook(stats, &library->books[i], 1);
+    }
+    if (stats->failed) {
+        fprintf(stderr, "Memory allocation failed for group statistics\n");
+        GroupStats_Free(stats);
+        return -1;
+    }
+
+    return 0;
+}
+
+int GroupStats_Init(GroupStats *stats, Library *library) {
+    if (GroupStats_Compute(stats, library) != 0) {
+        return -1;
+    }
+    if (library == NULL) {
+        return 0;
+    }
+    if (libraryAddObserver(library, followMutation, stats) != 0) {
+        fprintf(stderr, "Too many library observers for group statistics\n");
+        GroupStats_Free(stats);
+        return -1;
+    }
+    stats->observing = 1;
+
+    return 0;
+}
+
+void GroupStats_Free(GroupStats *stats) {
+    if (stats->observing) {
+        libraryRemoveObserver(stats->library, followMutation, stats);
+        stats->observing = 0;
+    }
+    freeTable(&stats->authors);
+    freeTable(&stats->years);
+}
+
+void GroupStats_AddBook(GroupStats *stats, const Book *book) {
+    applyBook(stats, book, 1);
+}
+
+const StatsGroup* GroupStats_ByAuthor(const GroupStats *stats, const char *author) {
+    char key[MAX_AUTHOR_LEN];
+
+    Text_Fold(author, key, sizeof(key));
+    uint32_t s = findSlot(&stats->authors, key, 0, StrKey_Hash(key));
+    int g = stats->authors.slots[s];
+
+    return g != -1 && stats->authors.groups[g].books > 0
+           ? &stats->authors.groups[g] : NULL;
+}
+
+const StatsGroup* GroupStats_ByYear(const GroupStats *stats, int year) {
+    uint32_t s = findSlot(&stats->years, NULL, year, hashYear(year));
+    int g = stats->years.slots[s];
+
+    return g != -1 && stats->years.groups[g].books > 0
+           ? &stats->years.groups[g] : NULL;
+}
+
+int GroupStats_List(const StatsTable *table, const StatsGroup **groups,
+                    int capacity) {
+    int found = 0;
+
+    for (int g = 0; g < table->count && found < capacity; g++) {
+        if (table->groups[g].books > 0) {
+            groups[found++] = &table->groups[g];
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Check every group of a recount against the maintained table
+ * @param byAuthor: The tables are keyed by author handle, not year
+ * @return: Number of differences found
+ */
+static int compareTable(const StatsTable *table, const StatsTable *recount,
+                        int byAuthor) {
+    const char *kind = byAuthor ? "author" : "year";
+    int differences = 0;
+
+    for (int g = 0; g < recount->count; g++) {
+        const StatsGroup *want = &recount->groups[g];
+        int slot = table->slots[findSlot(table, byAuthor ? want->key : NULL,
+                                         want->year, want->hash)];
+        const StatsGroup *have = slot != -1 ? &table->groups[slot] : NULL;
+        char label[MAX_AUTHOR_LEN + 2];
+
+        if (have != NULL && have->books == want->books &&
+            have->quantity == want->quantity && have->valueCents == want->valueCents) {
+            continue;
+        }
+        if (byAuthor) {
+            snprintf(label, sizeof(label), "\"%s\"", want->key);
+        } else {
+            snprintf(label, sizeof(label), "%d", want->year);
+        }
+        fprintf(stderr, "GroupStats: %s %s has %d books, %d copies, %" PRId64
+                " cents; recount has %d, %d, %" PRId64 "\n", kind, label,
+                have != NULL ? have->books : 0, have != NULL ? have->quantity : 0,
+                have != NULL ? have->valueCents : 0, want->books, want->quantity,
+                want->valueCents);
+        differences++;
+    }
+    if (table->live != recount->live) {
+        fprintf(stderr, "GroupStats: %d %s groups hold books; recount has %d\n",
+                table->live, kind, recount->live);
+        differences++;
+    }
+
+    return differences;
+}
+
+int GroupStats_Verify(const GroupStats *stats) {
+    GroupStats recount;
+
+    if (stats->failed) {
+        fprintf(stderr, "GroupStats: a mutation was missed for lack of memory\n");
+        return -1;
+    }
+    if (stats->library == NULL) {
+        return 0;
+    }
+    if (GroupStats_Compute(&recount, stats->library) != 0) {
+        return -1;
+    }
+
+    int differences = compareTable(&stats->authors, &recount.authors, 1) +
+                      compareTable(&stats->years, &recount.years, 0);
+
+    GroupStats_Free(&recount);
+    return differences == 0 ? 0 : -1;
+}
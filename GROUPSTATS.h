@@ -0,0 +1,127 @@
+#ifndef GROUPSTATS_H
+#define GROUPSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LIBRARY.h"
+
+/**
+ * @file GROUPSTATS.h
+ * @brief Per-author and per-year totals, maintained as the library changes
+ *
+ * GroupStats keeps two materialized group-by tables over its library:
+ * one keyed by author handle (the folded author, so "José Núñez" and
+ * "JOSE NUNEZ" are one author) and one keyed by publication year. Each
+ * group holds its number of books, copies in stock and inventory value.
+ *
+ * The tables observe the library. Every add, update and delete subtracts
+ * the record before the change from its groups and adds the record
+ * after it, so keeping them current costs two hash lookups per mutation
+ * and reading a group costs one. Values are summed in whole cents
+ * (libraryPriceKey) so incremental totals match a recount exactly;
+ * GroupStats_Verify does that recount.
+ *
+ * Groups are never removed: a group whose last book goes away stays in
+ * its table with zero books, is skipped by lookups and listings, and is
+ * reused if a book joins it again.
+ */
+
+#define GROUP_STATS_INITIAL_GROUPS 64
+
+/* Totals of one author or year */
+typedef struct {
+    char key[MAX_AUTHOR_LEN];         /* Author handle; empty for a year */
+    char name[MAX_AUTHOR_LEN];        /* Author as spelled by the book that
+                                         started the group; empty for a year */
+    int year;                         /* Publication year; 0 for an author */
+    uint32_t hash;
+    int books;                        /* Records in the group */
+    int quantity;                     /* Copies in stock */
+    int64_t valueCents;               /* Sum of price in cents * quantity */
+} StatsGroup;
+
+/* Groups of one kind with a hash index over their keys */
+typedef struct {
+    StatsGroup *groups;               /* Dense, in order of creation */
+    int count;
+    int capacity;
+    int *slots;                       /* Open addressing; -1 if empty */
+    int slotMask;                     /* Slot count - 1 */
+    int live;                         /* Groups with at least one book */
+} StatsTable;
+
+typedef struct {
+    Library *library;
+    StatsTable authors;
+    StatsTable years;
+    int observing;                    /* Registered as a library observer */
+    int failed;                       /* A group could not be allocated */
+    uint64_t mutations;               /* Changes applied since init */
+} GroupStats;
+
+/**
+ * @brief Build the tables from a library and follow its mutations
+ * @param library Library to observe, or NULL for tables fed by hand
+ *                (GroupStats_AddBook)
+ * @return 0 on success, -1 on failure
+ */
+int GroupStats_Init(GroupStats *stats, Library *library);
+
+/**
+ * @brief Build the tables with one full scan, without following the library
+ *
+ * This is the from-scratch computation GroupStats_Verify compares
+ * against, and what a report would do without materialized tables.
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+int GroupStats_Compute(GroupStats *stats, const Library *library);
+
+/**
+ * @brief Count one book into its groups, for books outside a library
+ *
+ * The author is grouped by authorFolded, which storing a book in a
+ * library fills in; books fed by hand need it set (Text_Fold). An
+ * allocation failure sets stats->failed.
+ */
+void GroupStats_AddBook(GroupStats *stats, const Book *book);
+
+/**
+ * @brief Stop following the library (if following) and free the tables
+ */
+void GroupStats_Free(GroupStats *stats);
+
+/**
+ * @brief Totals of one author, matched by handle
+ * @return The group, or NULL if no book has that author
+ */
+const StatsGroup* GroupStats_ByAuthor(const GroupStats *stats, const char *author);
+
+/**
+ * @brief Totals of one publication year
+ * @return The group, or NULL if no book is from that year
+ */
+const StatsGroup* GroupStats_ByYear(const GroupStats *stats, int year);
+
+/**
+ * @brief Collect the groups of a table that hold books
+ * @param table stats->authors or stats->years
+ * @param groups Receives up to capacity groups, in creation order
+ * @param capacity Size of groups; table->live always suffices
+ * @return Number of groups stored
+ */
+int GroupStats_List(const StatsTable *table, const StatsGroup **groups,
+                    int capacity);
+
+/**
+ * @brief Recount both tables from the library and compare
+ *
+ * Differences are described on stderr. Tables fed by hand have nothing
+ * to be recounted from and always pass.
+ *
+ * @return 0 if every group matches the recount, -1 otherwise
+ */
+int GroupStats_Verify(const GroupStats *stats);
+
+#endif /* GROUPSTATS_H */
@@ -0,0 +1,326 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "INDEX.h"
+#include "METRICS.h"
+
+#define HASH_INITIAL_CAPACITY 64
+#define HASH_SLOT_EMPTY (-1)
+#define HASH_SLOT_DELETED (-2)
+#define POSTING_INITIAL_CAPACITY 4
+
+/* ============= Key Normalization ============= */
+
+size_t Index_NormalizeIsbn(const char *isbn, char *out, size_t out_len) {
+    size_t len = 0;
+
+    if (out_len == 0) {
+        return 0;
+    }
+
+    for (; isbn != NULL && *isbn != '\0' && len + 1 < out_len; isbn++) {
+        unsigned char c = (unsigned char)*isbn;
+        if (c == '-' || isspace(c)) {
+            continue;
+        }
+        out[len++] = (char)toupper(c);
+    }
+    out[len] = '\0';
+
+    return len;
+}
+
+/* ============= Hash Index ============= */
+
+/**
+ * Allocate a slot array with every slot marked empty
+ * @param capacity: Number of slots (power of two)
+ * @return: Pointer to the slot array, or NULL on failure
+ */
+static HashSlot* allocSlots(size_t capacity) {
+    HashSlot *slots = (HashSlot*)malloc(capacity * sizeof(HashSlot));
+    if (slots == NULL) {
+        fprintf(stderr, "Memory allocation failed for hash index\n");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].id = HASH_SLOT_EMPTY;
+    }
+
+    return slots;
+}
+
+/**
+ * Rebuild the slot array at a new capacity, dropping tombstones
+ * @param index: Pointer to the hash index
+ * @param capacity: New number of slots (power of two)
+ * @return: 0 on success, -1 on failure (index left unchanged)
+ */
+static int rehash(HashIndex *index, size_t capacity) {
+    HashSlot *slots = allocSlots(capacity);
+    if (slots == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        HashSlot *old = &index->slots[i];
+        if (old->id < 0) {
+            continue;
+        }
+
+        size_t pos = old->header.hash & (capacity - 1);
+        while (slots[pos].id != HASH_SLOT_EMPTY) {
+            pos = (pos + 1) & (capacity - 1);
+        }
+        slots[pos] = *old;
+    }
+
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+    index->tombstones = 0;
+    METRICS_INC(COUNTER_HASH_REHASHES);
+
+    return 0;
+}
+
+int HashIndex_Init(HashIndex *index) {
+    index->slots = allocSlots(HASH_INITIAL_CAPACITY);
+    index->capacity = index->slots != NULL ? HASH_INITIAL_CAPACITY : 0;
+    index->count = 0;
+    index->tombstones = 0;
+
+    return index->slots != NULL ? 0 : -1;
+}
+
+void HashIndex_Free(HashIndex *index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->tombstones = 0;
+}
+
+int HashIndex_Insert(HashIndex *index, const char *key, int id) {
+    if (key[0] == '\0') {
+        return 0;
+    }
+
+    /* Keep the load factor (live + deleted) under 70% */
+    if ((index->count + index->tombstones + 1) * 10 > index->capacity * 7) {
+        size_t capacity = index->capacity;
+        if ((index->count + 1) * 10 > capacity * 5) {
+            capacity *= 2;
+        }
+        if (rehash(index, capacity) != 0) {
+            return -1;
+        }
+    }
+
+    char stored[INDEX_KEY_LEN];
+    strncpy(stored, key, INDEX_KEY_LEN - 1);
+    stored[INDEX_KEY_LEN - 1] = '\0';
+
+    StrKey header;
+    StrKey_Make(&header, stored);
+    size_t pos = header.hash & (index->capacity - 1);
+
+    while (index->slots[pos].id >= 0) {
+        pos = (pos + 1) & (index->capacity - 1);
+    }
+
+    if (index->slots[pos].id == HASH_SLOT_DELETED) {
+        index->tombstones--;
+    }
+
+    HashSlot *slot = &index->slots[pos];
+    slot->header = header;
+    slot->id = id;
+    memcpy(slot->key, stored, header.length + 1);
+    index->count++;
+
+    return 0;
+}
+
+int HashIndex_Remove(HashIndex *index, const char *key, int id) {
+    if (key[0] == '\0') {
+        return 0;
+    }
+
+    StrKey header;
+    StrKey_Make(&header, key);
+    size_t pos = header.hash & (index->capacity - 1);
+
+    while (index->slots[pos].id != HASH_SLOT_EMPTY) {
+        HashSlot *slot = &index->slots[pos];
+        if (slot->id == id &&
+            StrKey_Equal(&slot->header, slot->key, &header, key)) {
+            slot->id = HASH_SLOT_DELETED;
+            index->count--;
+            index->tombstones++;
+            return 1;
+        }
+        pos = (pos + 1) & (index->capacity - 1);
+    }
+
+    return 0;
+}
+
+int HashIndex_Lookup(const HashIndex *index, const char *key,
+                     int *ids, int max_ids) {
+    if (key[0] == '\0' || index->capacity == 0) {
+        return 0;
+    }
+
+    StrKey header;
+    StrKey_Make(&header, key);
+    size_t pos = header.hash & (index->capacity - 1);
+    int found = 0;
+
+    while (index->slots[pos].id != HASH_SLOT_EMPTY) {
+        const HashSlot *slot = &index->slots[pos];
+        if (slot->id >= 0 &&
+            StrKey_Equal(&slot->header, slot->key, &header, key)) {
+            if (found < max_ids) {
+                ids[found] = slot->id;
+            }
+            found++;
+        }
+        pos = (pos + 1) & (index->capacity - 1);
+    }
+
+    return found;
+}
+
+/* ============= Ordered Index ============= */
+
+static void freePostingList(void *data) {
+    PostingList *list = (PostingList*)data;
+
+    free(list->ids);
+    free(list);
+}
+
+/**
+ * Where an ID is, or would go, in a posting list
+ */
+static int postingSlot(const PostingList *list, int id) {
+    int lo = 0, hi = list->count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (list->ids[mid] < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int OrderedIndex_Init(OrderedIndex *index) {
+    index->tree = RBTree_Create();
+    index->entries = 0;
+
+    return index->tree != NULL ? 0 : -1;
+}
+
+void OrderedIndex_Free(OrderedIndex *index) {
+    RBTree_Destroy(index->tree, freePostingList);
+    index->tree = NULL;
+    index->entries = 0;
+}
+
+int OrderedIndex_Insert(OrderedIndex *index, int key, int id) {
+    PostingList *list = (PostingList*)RBTree_Search(index->tree, key);
+
+    if (list == NULL) {
+        list = (PostingList*)malloc(sizeof(PostingList));
+        if (list == NULL) {
+            fprintf(stderr, "Memory allocation failed for posting list\n");
+            return -1;
+        }
+        list->ids = (int*)malloc(POSTING_INITIAL_CAPACITY * sizeof(int));
+        if (list->ids == NULL || RBTree_Insert(index->tree, key, list) != 1) {
+            fprintf(stderr, "Memory allocation failed for posting list\n");
+            free(list->ids);
+            free(list);
+            return -1;
+        }
+        list->count = 0;
+        list->capacity = POSTING_INITIAL_CAPACITY;
+    } else if (list->count == list->capacity) {
+        int *ids = (int*)realloc(list->ids, 2 * list->capacity * sizeof(int));
+        if (ids == NULL) {
+            fprintf(stderr, "Memory allocation failed for posting list\n");
+            return -1;
+        }
+        list->ids = ids;
+        list->capacity *= 2;
+        METRICS_INC(COUNTER_POSTING_GROWS);
+    }
+
+    /* New books have the highest ID, so this is nearly always an append */
+    int slot = list->count > 0 && list->ids[list->count - 1] > id
+             ? postingSlot(list, id) : list->count;
+    memmove(list->ids + slot + 1, list->ids + slot,
+            (size_t)(list->count - slot) * sizeof(int));
+    list->ids[slot] = id;
+    list->count++;
+    index->entries++;
+
+    return 0;
+}
+
+int OrderedIndex_Remove(OrderedIndex *index, int key, int id) {
+    PostingList *list = (PostingList*)RBTree_Search(index->tree, key);
+    if (list == NULL) {
+        return 0;
+    }
+
+    int slot = postingSlot(list, id);
+    if (slot == list->count || list->ids[slot] != id) {
+        return 0;
+    }
+
+    list->count--;
+    memmove(list->ids + slot, list->ids + slot + 1,
+            (size_t)(list->count - slot) * sizeof(int));
+    index->entries--;
+    if (list->count == 0) {
+        RBTree_Delete(index->tree, key, freePostingList);
+    }
+    return 1;
+}
+
+size_t OrderedIndex_CountRange(const OrderedIndex *index, int min_key,
+                               int max_key, size_t limit) {
+    size_t count = 0;
+    RBNode *node = RBTree_LowerBound(index->tree, min_key);
+
+    while (node != NULL && node->key <= max_key && count < limit) {
+        count += (size_t)((PostingList*)node->data)->count;
+        node = RBTree_Next(node);
+    }
+
+    return count < limit ? count : limit;
+}
+
+int OrderedIndex_ScanRange(const OrderedIndex *index, int min_key,
+                           int max_key, int *ids, int max_ids) {
+    int stored = 0;
+    RBNode *node = RBTree_LowerBound(index->tree, min_key);
+
+    while (node != NULL && node->key <= max_key && stored < max_ids) {
+        PostingList *list = (PostingList*)node->data;
+        for (int i = 0; i < list->count && stored < max_ids; i++) {
+            ids[stored++] = list->ids[i];
+        }
+        node = RBTree_Next(node);
+    }
+
+    return stored;
+}
@@ -0,0 +1,144 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+
+#include "RBTREE.h"
+#include "STRKEY.h"
+
+/**
+ * @file INDEX.h
+ * @brief Secondary indexes for the book catalog
+ *
+ * Two index shapes are provided: a hash index keyed by normalized ISBN
+ * for exact lookups, and an ordered index built on the Red-Black Tree
+ * that maps an integer key (year, price in cents) to the list of book
+ * IDs sharing that key, for range queries.
+ *
+ * Hash slots keep the StrKey header of their key, whose hash picks the
+ * slot; a probe compares headers and reads the key text only when they
+ * match.
+ */
+
+#define INDEX_KEY_LEN 20              /* Longest normalized hash key + NUL */
+
+/* Book IDs sharing one ordered-index key */
+typedef struct {
+    int *ids;                         /* Book IDs, ascending */
+    int count;                        /* Number of IDs in use */
+    int capacity;                     /* Allocated ID slots */
+} PostingList;
+
+/* Ordered index: RB tree from key to PostingList */
+typedef struct {
+    RBTree *tree;                     /* key -> PostingList* */
+    size_t entries;                   /* Total IDs across all postings */
+} OrderedIndex;
+
+/* Open-addressing slot of the hash index */
+typedef struct {
+    StrKey header;                    /* Of key; compared before the key */
+    int id;                           /* Book ID, or an empty/deleted mark */
+    char key[INDEX_KEY_LEN];          /* Normalized key */
+} HashSlot;
+
+/* Hash index: normalized key -> book IDs (duplicates allowed) */
+typedef struct {
+    HashSlot *slots;                  /* Slot array, power-of-two sized */
+    size_t capacity;                  /* Number of slots */
+    size_t count;                     /* Live entries */
+    size_t tombstones;                /* Deleted slots awaiting rehash */
+} HashIndex;
+
+/**
+ * @brief Normalize an ISBN for indexing
+ *
+ * Drops hyphens and whitespace and upper-cases the check digit 'x',
+ * so "978-0-7432-7356-5" and "9780743273565" share one key.
+ *
+ * @param isbn Raw ISBN as entered
+ * @param out Buffer receiving the normalized key
+ * @param out_len Size of out (at least INDEX_KEY_LEN is enough)
+ * @return Length of the normalized key
+ */
+size_t Index_NormalizeIsbn(const char *isbn, char *out, size_t out_len);
+
+/**
+ * @brief Initialize an empty hash index
+ * @return 0 on success, -1 on allocation failure
+ */
+int HashIndex_Init(HashIndex *index);
+
+/**
+ * @brief Release all memory held by a hash index
+ */
+void HashIndex_Free(HashIndex *index);
+
+/**
+ * @brief Add a (key, id) entry; empty keys are not indexed
+ * @param key Already-normalized key
+ * @return 0 on success, -1 on allocation failure
+ */
+int HashIndex_Insert(HashIndex *index, const char *key, int id);
+
+/**
+ * @brief Remove a (key, id) entry
+ * @return 1 if removed, 0 if not present
+ */
+int HashIndex_Remove(HashIndex *index, const char *key, int id);
+
+/**
+ * @brief Collect the IDs stored under a key
+ * @param ids Output array, may be NULL when max_ids is 0
+ * @param max_ids Capacity of ids
+ * @return Total number of matching IDs (may exceed max_ids)
+ */
+int HashIndex_Lookup(const HashIndex *index, const char *key,
+                     int *ids, int max_ids);
+
+/**
+ * @brief Initialize an empty ordered index
+ * @return 0 on success, -1 on allocation failure
+ */
+int OrderedIndex_Init(OrderedIndex *index);
+
+/**
+ * @brief Release all memory held by an ordered index
+ */
+void OrderedIndex_Free(OrderedIndex *index);
+
+/**
+ * @brief Add a (key, id) entry
+ * @return 0 on success, -1 on allocation failure
+ */
+int OrderedIndex_Insert(OrderedIndex *index, int key, int id);
+
+/**
+ * @brief Remove a (key, id) entry
+ * @return 1 if removed, 0 if not present
+ */
+int OrderedIndex_Remove(OrderedIndex *index, int key, int id);
+
+/**
+ * @brief Count IDs whose key lies in [min_key, max_key]
+ *
+ * Counting stops as soon as the total reaches limit, which lets a
+ * caller comparing candidate indexes abandon a range that is already
+ * known to be less selective than the best one found so far.
+ *
+ * @param limit Stop once this many IDs have been counted
+ * @return Number of IDs counted (at most limit)
+ */
+size_t OrderedIndex_CountRange(const OrderedIndex *index, int min_key,
+                               int max_key, size_t limit);
+
+/**
+ * @brief Collect IDs whose key lies in [min_key, max_key], in key order
+ * @param ids Output array
+ * @param max_ids Capacity of ids
+ * @return Number of IDs stored
+ */
+int OrderedIndex_ScanRange(const OrderedIndex *index, int min_key,
+                           int max_key, int *ids, int max_ids);
+
+#endif /* INDEX_H */
@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LIBRARY.h"
+#include "METRICS.h"
+#include "PAGES.h"
+#include "TEXT.h"
+
+/* IDs libraryFindManyById resolves per RBTree_SearchBatch call */
+#define LIBRARY_FIND_CHUNK 256
+
+/* ============= Index Maintenance ============= */
+
+/**
+ * Add a book to every index
+ * @param library: Pointer to the library
+ * @param book: The book to index
+ * @param slot: Where the book is (or will be) stored in library->books
+ * @return: 0 on success, -1 on failure with no index modified
+ */
+static int indexBook(Library *library, const Book *book, Book *slot) {
+    char isbn[INDEX_KEY_LEN];
+    Index_NormalizeIsbn(book->isbn, isbn, sizeof(isbn));
+
+    if (RBTree_Insert(library->idIndex, book->id, slot) != 1) {
+        return -1;
+    }
+    if (HashIndex_Insert(&library->isbnIndex, isbn, book->id) != 0) {
+        goto undo_id;
+    }
+    if (OrderedIndex_Insert(&library->yearIndex, book->year, book->id) != 0) {
+        goto undo_isbn;
+    }
+    if (OrderedIndex_Insert(&library->priceIndex, libraryPriceKey(book->price),
+                            book->id) != 0) {
+        goto undo_year;
+    }
+
+    Bloom_Add(&library->idFilter, Bloom_HashId(book->id));
+    if (isbn[0] != '\0') {
+        Bloom_Add(&library->isbnFilter, Bloom_HashKey(isbn));
+    }
+    return 0;
+
+undo_year:
+    OrderedIndex_Remove(&library->yearIndex, book->year, book->id);
+undo_isbn:
+    HashIndex_Remove(&library->isbnIndex, isbn, book->id);
+undo_id:
+    RBTree_Delete(library->idIndex, book->id, NULL);
+    return -1;
+}
+
+/**
+ * Remove a book from every index
+ * @param library: Pointer to the library
+ * @param book: The book to unindex
+ */
+static void unindexBook(Library *library, const Book *book) {
+    char isbn[INDEX_KEY_LEN];
+    Index_NormalizeIsbn(book->isbn, isbn, sizeof(isbn));
+
+    OrderedIndex_Remove(&library->priceIndex, libraryPriceKey(book->price),
+                        book->id);
+    OrderedIndex_Remove(&library->yearIndex, book->year, book->id);
+    HashIndex_Remove(&library->isbnIndex, isbn, book->id);
+    RBTree_Delete(library->idIndex, book->id, NULL);
+
+    Bloom_Remove(&library->idFilter);
+    if (isbn[0] != '\0') {
+        Bloom_Remove(&library->isbnFilter);
+    }
+}
+
+/**
+ * Rebuild the Bloom filters from the stored books once too many of
+ * their keys belong to deleted or replaced records
+ */
+static void compactFilters(Library *library) {
+    if (!Bloom_NeedsRebuild(&library->idFilter) &&
+        !Bloom_NeedsRebuild(&library->isbnFilter)) {
+        return;
+    }
+
+    Bloom_Clear(&library->idFilter);
+    Bloom_Clear(&library->isbnFilter);
+    for (int i = 0; i < library->count; i++) {
+        char isbn[INDEX_KEY_LEN];
+
+        Bloom_Add(&library->idFilter, Bloom_HashId(library->books[i].id));
+        if (Index_NormalizeIsbn(library->books[i].isbn, isbn, sizeof(isbn)) > 0) {
+            Bloom_Add(&library->isbnFilter, Bloom_HashKey(isbn));
+        }
+    }
+    METRICS_INC(COUNTER_BLOOM_REBUILDS);
+}
+
+/**
+ * Check the ID filter before the ID index
+ * @return: 0 if the ID is certainly not stored, 1 if it may be
+ */
+static int mayHoldId(const Library *library, int id) {
+    if (!Bloom_MayContain(&library->idFilter, Bloom_HashId(id))) {
+        METRICS_INC(COUNTER_BLOOM_NEGATIVES);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Check the ISBN filter before the ISBN index
+ * @param isbn: Normalized ISBN
+ * @return: 0 if no book has the ISBN, 1 if one may
+ */
+static int mayHoldIsbn(const Library *library, const char *isbn) {
+    if (isbn[0] == '\0' ||
+        !Bloom_MayContain(&library->isbnFilter, Bloom_HashKey(isbn))) {
+        METRICS_INC(COUNTER_BLOOM_NEGATIVES);
+        return 0;
+    }
+    return 1;
+}
+
+/* ============= Library Operations ============= */
+
+int libraryInit(Library *library) {
+    /* Placement only reaches pages the caller has not touched yet */
+    Pages_Advise(library->books, sizeof(library->books));
+
+    library->count = 0;
+    library->nextId = 1;
+    library->observerCount = 0;
+    library->fault = NULL;
+    library->faultContext = NULL;
+    library->idIndex = RBTree_Create();
+
+    if (library->idIndex == NULL) {
+        return -1;
+    }
+    if (HashIndex_Init(&library->isbnIndex) != 0) {
+        RBTree_Destroy(library->idIndex, NULL);
+        return -1;
+    }
+    if (Bloom_Init(&library->idFilter, MAX_BOOKS) != 0) {
+        HashIndex_Free(&library->isbnIndex);
+        RBTree_Destroy(library->idIndex, NULL);
+        return -1;
+    }
+    if (Bloom_Init(&library->isbnFilter, MAX_BOOKS) != 0) {
+        Bloom_Free(&library->idFilter);
+        HashIndex_Free(&library->isbnIndex);
+        RBTree_Destroy(library->idIndex, NULL);
+        return -1;
+    }
+    if (OrderedIndex_Init(&library->yearIndex) != 0) {
+        Bloom_Free(&library->isbnFilter);
+        Bloom_Free(&library->idFilter);
+        HashIndex_Free(&library->isbnIndex);
+        RBTree_Destroy(library->idIndex, NULL);
+        return -1;
+    }
+    if (OrderedIndex_Init(&library->priceIndex) != 0) {
+        OrderedIndex_Free(&library->yearIndex);
+        Bloom_Free(&library->isbnFilter);
+        Bloom_Free(&library->idFilter);
+        HashIndex_Free(&library->isbnIndex);
+        RBTree_Destroy(library->idIndex, NULL);
+        return -1;
+    }
+
+    return 0;
+}
+
+void libraryFree(Library *library) {
+    OrderedIndex_Free(&library->priceIndex);
+    OrderedIndex_Free(&library->yearIndex);
+    Bloom_Free(&library->isbnFilter);
+    Bloom_Free(&library->idFilter);
+    HashIndex_Free(&library->isbnIndex);
+    RBTree_Destroy(library->idIndex, NULL);
+    library->idIndex = NULL;
+    library->count = 0;
+}
+
+/**
+ * Tell every observer about a mutation that has been applied
+ */
+static void notifyObservers(const Library *library, const Book *before,
+                            const Book *after) {
+    for (int i = 0; i < library->observerCount; i++) {
+        library->observers[i](library->observerContexts[i], before, after);
+    }
+}
+
+int libraryAddObserver(Library *library, LibraryObserver observer,
+                       void *context) {
+    if (library->observerCount >= LIBRARY_MAX_OBSERVERS) {
+        return -1;
+    }
+
+    library->observers[library->observerCount] = observer;
+    library->observerContexts[library->observerCount] = context;
+    library->observerCount++;
+
+    return 0;
+}
+
+void libraryRemoveObserver(Library *library, LibraryObserver observer,
+                           void *context) {
+    for (int i = 0; i < library->observerCount; i++) {
+        if (library->observers[i] == observer &&
+            library->observerContexts[i] == context) {
+            library->observerCount--;
+            for (; i < library->observerCount; i++) {
+                library->observers[i] = library->observers[i + 1];
+                library->observerContexts[i] = library->observerContexts[i + 1];
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * Compute the folded search columns of a stored book
+ * @param book: Book whose title and author are set
+ */
+static void foldBook(Book *book) {
+    Text_Fold(book->title, book->titleFolded, sizeof(book->titleFolded));
+    Text_Fold(book->author, book->authorFolded, sizeof(book->authorFolded));
+}
+
+/**
+ * Compute the StrKey headers of the stored book at a position
+ * @param index: Position in library->books, already holding the book
+ */
+static void keyBook(Library *library, int index) {
+    const Book *book = &library->books[index];
+    BookKeys *keys = &library->keys;
+    char isbn[INDEX_KEY_LEN];
+
+    Index_NormalizeIsbn(book->isbn, isbn, sizeof(isbn));
+    StrKey_Make(&keys->title[index], book->title);
+    StrKey_Make(&keys->author[index], book->author);
+    StrKey_Make(&keys->isbn[index], book->isbn);
+    StrKey_Make(&keys->titleFolded[index], book->titleFolded);
+    StrKey_Make(&keys->authorFolded[index], book->authorFolded);
+    StrKey_Make(&keys->isbnNormal[index], isbn);
+}
+
+/**
+ * Close the gap left in every header column by a deleted position
+ * @param count: Positions in use before the delete
+ */
+static void dropKeys(BookKeys *keys, int index, int count) {
+    StrKey *columns[] = {keys->title, keys->author, keys->isbn,
+                         keys->titleFolded, keys->authorFolded, keys->isbnNormal};
+    size_t moved = (size_t)(count - index - 1) * sizeof(StrKey);
+
+    for (size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); c++) {
+        memmove(&columns[c][index], &columns[c][index + 1], moved);
+    }
+}
+
+/**
+ * Open a gap in every header column for an inserted position
+ * @param count: Positions in use before the insert
+ */
+static void openKeys(BookKeys *keys, int index, int count) {
+    StrKey *columns[] = {keys->title, keys->author, keys->isbn,
+                         keys->titleFolded, keys->authorFolded, keys->isbnNormal};
+    size_t moved = (size_t)(count - index) * sizeof(StrKey);
+
+    for (size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); c++) {
+        memmove(&columns[c][index + 1], &columns[c][index], moved);
+    }
+}
+
+/**
+ * Find a book by ID, first letting the fault function store it if the
+ * library does not hold it
+ * @return: Position of the book, or -1 if still not found
+ */
+static int findOrFault(Library *library, int id) {
+    int index = libraryFindById(library, id);
+
+    if (index == -1 && library->fault != NULL) {
+        library->fault(library->faultContext, library, id);
+        index = libraryFindById(library, id);
+    }
+    return index;
+}
+
+static int doAddBook(Library *library, Book *book) {
+    if (library->count >= MAX_BOOKS) {
+        return -1;
+    }
+
+    Book *slot = &library->books[library->count];
+    book->id = library->nextId;
+
+    if (indexBook(library, book, slot) != 0) {
+        return -1;
+    }
+
+    *slot = *book;
+    foldBook(slot);
+    keyBook(library, library->count);
+    library->count++;
+    library->nextId++;
+    notifyObservers(library, NULL, slot);
+
+    return book->id;
+}
+
+static int doUpdateBook(Library *library, const Book *book) {
+    int index = findOrFault(library, book->id);
+    if (index == -1) {
+        return 0;
+    }
+
+    Book *old = &library->books[index];
+    char oldIsbn[INDEX_KEY_LEN];
+    char newIsbn[INDEX_KEY_LEN];
+    int oldPrice = libraryPriceKey(old->price);
+    int newPrice = libraryPriceKey(book->price);
+    Index_NormalizeIsbn(old->isbn, oldIsbn, sizeof(oldIsbn));
+    Index_NormalizeIsbn(book->isbn, newIsbn, sizeof(newIsbn));
+
+    int isbnChanged = strcmp(oldIsbn, newIsbn) != 0;
+    int yearChanged = old->year != book->year;
+    int priceChanged = oldPrice != newPrice;
+
+    /* Add the new keys first so a failure leaves the old entries intact */
+    if (isbnChanged &&
+        HashIndex_Insert(&library->isbnIndex, newIsbn, book->id) != 0) {
+        return -1;
+    }
+    if (yearChanged &&
+        OrderedIndex_Insert(&library->yearIndex, book->year, book->id) != 0) {
+        goto undo_isbn;
+    }
+    if (priceChanged &&
+        OrderedIndex_Insert(&library->priceIndex, newPrice, book->id) != 0) {
+        goto undo_year;
+    }
+
+    if (isbnChanged) {
+        HashIndex_Remove(&library->isbnIndex, oldIsbn, book->id);
+        if (oldIsbn[0] != '\0') {
+            Bloom_Remove(&library->isbnFilter);
+        }
+        if (newIsbn[0] != '\0') {
+            Bloom_Add(&library->isbnFilter, Bloom_HashKey(newIsbn));
+        }
+    }
+    if (yearChanged) {
+        OrderedIndex_Remove(&library->yearIndex, old->year, book->id);
+    }
+    if (priceChanged) {
+        OrderedIndex_Remove(&library->priceIndex, oldPrice, book->id);
+    }
+
+    Book before = *old;
+    *old = *book;
+    foldBook(old);
+    keyBook(library, index);
+    if (isbnChanged) {
+        compactFilters(library);
+    }
+    notifyObservers(library, &before, old);
+    return 1;
+
+undo_year:
+    if (yearChanged) {
+        OrderedIndex_Remove(&library->yearIndex, book->year, book->id);
+    }
+undo_isbn:
+    if (isbnChanged) {
+        HashIndex_Remove(&library->isbnIndex, newIsbn, book->id);
+    }
+    return -1;
+}
+
+static int doDeleteBook(Library *library, int id) {
+    int index = findOrFault(library, id);
+    if (index == -1) {
+        return 0;
+    }
+
+    Book before = library->books[index];
+    unindexBook(library, &library->books[index]);
+
+    memmove(&library->books[index], &library->books[index + 1],
+            (size_t)(library->count - index - 1) * sizeof(Book));
+
+    /* The shifted books are the index's next nodes in key order */
+    RBNode *node = RBTree_LowerBound(library->idIndex, id);
+    for (int i = index; node != NULL; i++, node = RBTree_Next(node)) {
+        node->data = &library->books[i];
+    }
+    dropKeys(&library->keys, index, library->count);
+    library->count--;
+    compactFilters(library);
+    notifyObservers(library, &before, NULL);
+
+    return 1;
+}
+
+int libraryAddBook(Library *library, Book *book) {
+    METRICS_START(METRIC_LIBRARY_ADD);
+    int result = doAddBook(library, book);
+    METRICS_STOP(METRIC_LIBRARY_ADD);
+
+    return result;
+}
+
+int libraryRestoreBook(Library *library, const Book *book) {
+    if (book->id < library->nextId) {
+        return -1;
+    }
+
+    Book copy = *book;
+    int savedNextId = library->nextId;
+    library->nextId = book->id;
+
+    METRICS_START(METRIC_LIBRARY_ADD);
+    int result = doAddBook(library, &copy);
+    METRICS_STOP(METRIC_LIBRARY_ADD);
+
+    if (result == -1) {
+        library->nextId = savedNextId;
+    }
+    return result;
+}
+
+int libraryAdoptBook(Library *library, const Book *book) {
+    if (book->id >= library->nextId || libraryFindById(library, book->id) != -1) {
+        return 0;
+    }
+    if (library->count >= MAX_BOOKS) {
+        return -1;
+    }
+
+    /* First position holding a larger ID */
+    int low = 0;
+    int high = library->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (library->books[mid].id < book->id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    int index = low;
+
+    if (indexBook(library, book, &library->books[index]) != 0) {
+        return -1;
+    }
+    memmove(&library->books[index + 1], &library->books[index],
+            (size_t)(library->count - index) * sizeof(Book));
+
+    /* The shifted books are the index's nodes after the new one */
+    RBNode *node = RBTree_LowerBound(library->idIndex, book->id);
+    for (int i = index + 1; (node = RBTree_Next(node)) != NULL; i++) {
+        node->data = &library->books[i];
+    }
+    openKeys(&library->keys, index, library->count);
+
+    library->books[index] = *book;
+    foldBook(&library->books[index]);
+    keyBook(library, index);
+    library->count++;
+
+    return 1;
+}
+
+void librarySetFault(Library *library, LibraryFault fault, void *context) {
+    library->fault = fault;
+    library->faultContext = context;
+}
+
+int libraryUpdateBook(Library *library, const Book *book) {
+    METRICS_START(METRIC_LIBRARY_UPDATE);
+    int result = doUpdateBook(library, book);
+    METRICS_STOP(METRIC_LIBRARY_UPDATE);
+
+    return result;
+}
+
+int libraryDeleteBook(Library *library, int id) {
+    METRICS_START(METRIC_LIBRARY_DELETE);
+    int result = doDeleteBook(library, id);
+    METRICS_STOP(METRIC_LIBRARY_DELETE);
+
+    return result;
+}
+
+int libraryFindById(const Library *library, int id) {
+    METRICS_START(METRIC_LIBRARY_FIND);
+    Book *book = NULL;
+    if (mayHoldId(library, id)) {
+        book = (Book*)RBTree_Search(library->idIndex, id);
+        if (book == NULL) {
+            METRICS_INC(COUNTER_BLOOM_FALSE_POSITIVES);
+        }
+    }
+    METRICS_STOP(METRIC_LIBRARY_FIND);
+
+    return book != NULL ? (int)(book - library->books) : -1;
+}
+
+int libraryFindManyById(const Library *library, const int *ids,
+                        int *positions, int count) {
+    void *books[LIBRARY_FIND_CHUNK];
+    int probe[LIBRARY_FIND_CHUNK];
+    int from[LIBRARY_FIND_CHUNK];
+    int found = 0;
+
+    METRICS_ADD(COUNTER_LIBRARY_BATCH_FINDS, count);
+    for (int start = 0; start < count; start += LIBRARY_FIND_CHUNK) {
+        int n = count - start < LIBRARY_FIND_CHUNK ? count - start : LIBRARY_FIND_CHUNK;
+        int probes = 0;
+
+        /* Only IDs the filter cannot rule out descend the tree */
+        for (int i = 0; i < n; i++) {
+            positions[start + i] = -1;
+            if (mayHoldId(library, ids[start + i])) {
+                probe[probes] = ids[start + i];
+                from[probes++] = start + i;
+            }
+        }
+
+        int hits = (int)RBTree_SearchBatch(library->idIndex, probe, books, (size_t)probes);
+        METRICS_ADD(COUNTER_BLOOM_FALSE_POSITIVES, probes - hits);
+        found += hits;
+        for (int i = 0; i < probes; i++) {
+            if (books[i] != NULL) {
+                positions[from[i]] = (int)((Book*)books[i] - library->books);
+            }
+        }
+    }
+
+    return found;
+}
+
+void libraryAccumulateStats(LibraryStats *stats, const Book *book) {
+    if (stats->totalBooks == 0) {
+        stats->minPrice = stats->maxPrice = book->price;
+        stats->oldestYear = stats->newestYear = book->year;
+    }
+
+    stats->totalBooks++;
+    stats->totalQuantity += book->quantity;
+    stats->totalValue += book->price * book->quantity;
+
+    if (book->price < stats->minPrice)
+        stats->minPrice = book->price;
+    if (book->price > stats->maxPrice)
+        stats->maxPrice = book->price;
+    if (book->year < stats->oldestYear)
+        stats->oldestYear = book->year;
+    if (book->year > stats->newestYear)
+        stats->newestYear = book->year;
+}
+
+void libraryComputeStats(const Library *library, LibraryStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    for (int i = 0; i < library->count; i++) {
+        libraryAccumulateStats(stats, &library->books[i]);
+    }
+}
+
+void libraryDumpMetrics(const Library *library, FILE *out, int json) {
+    MetricsTree trees[] = {
+        {"id_index", library->idIndex},
+        {"year_index", library->yearIndex.tree},
+        {"price_index", library->priceIndex.tree}
+    };
+
+    Metrics_Dump(out, json ? METRICS_JSON : METRICS_TEXT, trees,
+                 (int)(sizeof(trees) / sizeof(trees[0])));
+}
+
+int libraryPriceKey(float price) {
+    return (int)(price * 100.0f + (price >= 0.0f ? 0.5f : -0.5f));
+}
+
+/* ============= Index Selection ============= */
+
+AccessPath libraryChooseIndex(const Library *library, const BookFilter *filter,
+                              int *estimate) {
+    AccessPath path = ACCESS_FULL_SCAN;
+    size_t best = (size_t)library->count;
+
+    /* Index access must beat half a scan to pay for the random reads */
+    size_t limit = best / 2;
+
+    if (filter->hasId) {
+        path = ACCESS_ID_INDEX;
+        best = limit = (size_t)(mayHoldId(library, filter->id) &&
+                                RBTree_Contains(library->idIndex, filter->id));
+    }
+    if (filter->isbn != NULL && limit > 0) {
+        char isbn[INDEX_KEY_LEN];
+        Index_NormalizeIsbn(filter->isbn, isbn, sizeof(isbn));
+        size_t count = mayHoldIsbn(library, isbn)
+                       ? (size_t)HashIndex_Lookup(&library->isbnIndex, isbn, NULL, 0)
+                       : 0;
+        if (count <= limit) {
+            path = ACCESS_ISBN_INDEX;
+            best = limit = count;
+        }
+    }
+    if (filter->hasYear && limit > 0) {
+        size_t count = OrderedIndex_CountRange(&library->yearIndex,
+                                               filter->yearMin,
+                                               filter->yearMax, limit + 1);
+        if (count <= limit) {
+            path = ACCESS_YEAR_INDEX;
+            best = limit = count;
+        }
+    }
+    if (filter->hasPrice && limit > 0) {
+        size_t count = OrderedIndex_CountRange(&library->priceIndex,
+                                               filter->priceMin,
+                                               filter->priceMax, limit + 1);
+        if (count <= limit) {
+            path = ACCESS_PRICE_INDEX;
+            best = count;
+        }
+    }
+
+    if (estimate != NULL) {
+        *estimate = (int)best;
+    }
+
+    return path;
+}
+
+int libraryIndexScan(const Library *library, const BookFilter *filter,
+                     AccessPath access, int *ids, int max_ids) {
+    switch (access) {
+        case ACCESS_ID_INDEX:
+            if (max_ids > 0 && mayHoldId(library, filter->id)) {
+                if (RBTree_Contains(library->idIndex, filter->id)) {
+                    ids[0] = filter->id;
+                    return 1;
+                }
+                METRICS_INC(COUNTER_BLOOM_FALSE_POSITIVES);
+            }
+            return 0;
+        case ACCESS_ISBN_INDEX: {
+            char isbn[INDEX_KEY_LEN];
+            Index_NormalizeIsbn(filter->isbn, isbn, sizeof(isbn));
+            if (!mayHoldIsbn(library, isbn)) {
+                return 0;
+            }
+            int found = HashIndex_Lookup(&library->isbnIndex, isbn, ids, max_ids);
+            if (found == 0) {
+                METRICS_INC(COUNTER_BLOOM_FALSE_POSITIVES);
+            }
+            return found < max_ids ? found : max_ids;
+        }
+        case ACCESS_YEAR_INDEX:
+            return OrderedIndex_ScanRange(&library->yearIndex, filter->yearMin,
+                                          filter->yearMax, ids, max_ids);
+        case ACCESS_PRICE_INDEX:
+            return OrderedIndex_ScanRange(&library->priceIndex, filter->priceMin,
+                                          filter->priceMax, ids, max_ids);
+        case ACCESS_FULL_SCAN:
+        default:
+            return 0;
+    }
+}
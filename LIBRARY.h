@@ -0,0 +1,281 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <stdio.h>
+
+#include "BLOOM.h"
+#include "INDEX.h"
+#include "RBTREE.h"
+#include "STRKEY.h"
+
+/**
+ * @file LIBRARY.h
+ * @brief Book catalog storage with ID and secondary indexes
+ *
+ * The Library owns the primary book array together with an ID index
+ * and secondary indexes on ISBN, publication year and price. Every
+ * mutation goes through the functions below so the indexes always
+ * agree with the stored records: a mutation either updates the array
+ * and all indexes, or (on allocation failure) none of them.
+ *
+ * Books are appended with increasing IDs, adopted books are inserted at
+ * their place and deletion closes the gap in place, so library->books
+ * is always in ascending ID order.
+ *
+ * Storing a book also fills in its titleFolded and authorFolded
+ * columns; callers never need to set them.
+ *
+ * Beside the book array, library->keys holds the StrKey header
+ * (STRKEY.h) of each book's text fields, one dense column per field in
+ * the same positions. Sorting and text predicates compare these headers
+ * and read a book's strings only when the headers cannot decide, so a
+ * comparison usually touches 16 bytes of a column instead of a Book.
+ * The columns stay in memory; Book records, and everything that copies,
+ * persists or ships them, are unchanged.
+ *
+ * Bloom filters over the IDs and normalized ISBNs sit in front of the
+ * ID and ISBN indexes, so a lookup for a key that was never stored
+ * (a stale link, a mistyped ISBN) usually returns without touching
+ * either index. Deleted or replaced keys linger in the filters until
+ * they are rebuilt from the book array, which a delete or update does
+ * once enough of them have piled up (Bloom_NeedsRebuild).
+ */
+
+/* Catalog capacity; benchmarks build with a larger -DMAX_BOOKS */
+#ifndef MAX_BOOKS
+#define MAX_BOOKS 100
+#endif
+#define MAX_TITLE_LEN 100
+#define MAX_AUTHOR_LEN 100
+#define MAX_ISBN_LEN 20
+#define LIBRARY_MAX_OBSERVERS 8
+
+typedef struct {
+    int id;
+    char title[MAX_TITLE_LEN];
+    char author[MAX_AUTHOR_LEN];
+    char isbn[MAX_ISBN_LEN];
+    int year;
+    float price;
+    int quantity;
+    char titleFolded[MAX_TITLE_LEN];  /* Search forms (Text_Fold), set on store */
+    char authorFolded[MAX_AUTHOR_LEN];
+} Book;
+
+/* StrKey headers of the stored books' text, indexed like library->books */
+typedef struct {
+    StrKey title[MAX_BOOKS];
+    StrKey author[MAX_BOOKS];
+    StrKey isbn[MAX_BOOKS];
+    StrKey titleFolded[MAX_BOOKS];
+    StrKey authorFolded[MAX_BOOKS];
+    StrKey isbnNormal[MAX_BOOKS];     /* Of the normalized ISBN, whose text is not kept */
+} BookKeys;
+
+/**
+ * Called after every successful mutation with the record before and
+ * after it; before is NULL for an add and after is NULL for a delete
+ */
+typedef void (*LibraryObserver)(void *context, const Book *before,
+                                const Book *after);
+
+struct Library;
+
+/**
+ * Called when an update or delete names an ID the library does not
+ * hold, before the ID is reported unknown; it may store the book from
+ * elsewhere (libraryAdoptBook) for the change to apply to
+ */
+typedef void (*LibraryFault)(void *context, struct Library *library, int id);
+
+typedef struct Library {
+    Book books[MAX_BOOKS];
+    BookKeys keys;                    /* Headers of books[i] at index i */
+    int count;
+    int nextId;                       /* Next ID handed out by libraryAddBook */
+    RBTree *idIndex;                  /* id -> Book* */
+    HashIndex isbnIndex;              /* normalized ISBN -> id */
+    BloomFilter idFilter;             /* IDs in idIndex, plus stale ones */
+    BloomFilter isbnFilter;           /* Keys in isbnIndex, plus stale ones */
+    OrderedIndex yearIndex;           /* year -> ids */
+    OrderedIndex priceIndex;          /* price in cents -> ids */
+    LibraryObserver observers[LIBRARY_MAX_OBSERVERS];
+    void *observerContexts[LIBRARY_MAX_OBSERVERS];
+    int observerCount;
+    LibraryFault fault;               /* Or NULL */
+    void *faultContext;
+} Library;
+
+/* Catalog-wide totals shown by the statistics view */
+typedef struct {
+    int totalBooks;
+    int totalQuantity;
+    float totalValue;                 /* Sum of price * quantity */
+    float minPrice, maxPrice;
+    int oldestYear, newestYear;
+} LibraryStats;
+
+/* Which structure drives a filtered lookup */
+typedef enum {
+    ACCESS_FULL_SCAN = 0,
+    ACCESS_ID_INDEX,
+    ACCESS_ISBN_INDEX,
+    ACCESS_YEAR_INDEX,
+    ACCESS_PRICE_INDEX
+} AccessPath;
+
+/* Conjunctive filter over the indexed fields; unset parts match all */
+typedef struct {
+    int hasId;
+    int id;                           /* Exact book ID */
+    const char *isbn;                 /* Exact ISBN, or NULL */
+    int hasYear;
+    int yearMin, yearMax;             /* Inclusive year range */
+    int hasPrice;
+    int priceMin, priceMax;           /* Inclusive price range, in cents */
+} BookFilter;
+
+/**
+ * Initialize an empty library and its indexes
+ * @return: 0 on success, -1 on allocation failure
+ */
+int libraryInit(Library *library);
+
+/**
+ * Release the indexes owned by a library
+ */
+void libraryFree(Library *library);
+
+/**
+ * Register a function to be told about every mutation
+ * @return: 0 on success, -1 if LIBRARY_MAX_OBSERVERS are registered
+ */
+int libraryAddObserver(Library *library, LibraryObserver observer,
+                       void *context);
+
+/**
+ * Unregister an observer added with the same function and context
+ */
+void libraryRemoveObserver(Library *library, LibraryObserver observer,
+                           void *context);
+
+/**
+ * Add a book, assigning it the next free ID
+ * @param book: Book to store; its id field is set on success
+ * @return: The new book ID, or -1 if the library is full or out of memory
+ */
+int libraryAddBook(Library *library, Book *book);
+
+/**
+ * Add a book under the ID it already carries, as when copying another
+ * library; IDs must arrive in ascending order
+ * @param book: Book to store; its id must be at least library->nextId
+ * @return: The book ID, or -1 if the ID is out of order, the library is
+ *          full or out of memory
+ */
+int libraryRestoreBook(Library *library, const Book *book);
+
+/**
+ * Store a book that already exists outside the library under its ID,
+ * such as a record of a catalog file the library only holds changes of
+ *
+ * The book goes to its place in ID order, shifting later positions up
+ * by one. Observers are not told: the catalog has not changed. Any
+ * results holding positions must be recomputed.
+ *
+ * @param book: Book to store; its id must be below library->nextId
+ * @return: 1 on success, 0 if the ID is already held or not below
+ *          nextId, -1 if the library is full or out of memory
+ */
+int libraryAdoptBook(Library *library, const Book *book);
+
+/**
+ * Set the function an update or delete of an unknown ID calls first
+ * @param fault: The function, or NULL for none
+ */
+void librarySetFault(Library *library, LibraryFault fault, void *context);
+
+/**
+ * Replace the stored record for book->id, reindexing changed fields
+ * @return: 1 on success, 0 if the ID is unknown (or the fault function
+ *          could not bring it in), -1 on allocation failure
+ */
+int libraryUpdateBook(Library *library, const Book *book);
+
+/**
+ * Delete the book with a given ID
+ * @return: 1 if deleted, 0 if the ID is unknown (or the fault function
+ *          could not bring it in)
+ */
+int libraryDeleteBook(Library *library, int id);
+
+/**
+ * Look up a book by ID through the ID index
+ * @return: Position of the book in library->books, or -1 if not found
+ */
+int libraryFindById(const Library *library, int id);
+
+/**
+ * Look up many books by ID, with the ID index descents interleaved
+ *
+ * Cheaper than calling libraryFindById once per ID when resolving more
+ * than a handful of IDs; see RBTree_SearchBatch.
+ *
+ * @param positions: Receives the position of each ID's book, or -1
+ * @return: Number of IDs found
+ */
+int libraryFindManyById(const Library *library, const int *ids,
+                        int *positions, int count);
+
+/**
+ * Compute catalog totals with one pass over the book array
+ * @param stats: Receives the totals; all zero for an empty library
+ */
+void libraryComputeStats(const Library *library, LibraryStats *stats);
+
+/**
+ * Add one book to totals, for books outside a library's array
+ * @param stats: Totals so far; zeroed before the first book
+ */
+void libraryAccumulateStats(LibraryStats *stats, const Book *book);
+
+/**
+ * Write operation metrics plus the shape of the library's index trees
+ * @param json: Nonzero for JSON, zero for a text table
+ */
+void libraryDumpMetrics(const Library *library, FILE *out, int json);
+
+/**
+ * Convert a price to the integer key used by the price index
+ */
+int libraryPriceKey(float price);
+
+/**
+ * Pick the most selective index for a filter
+ *
+ * Each indexed predicate is costed by the number of IDs its index
+ * would return; counting is cut off at the best estimate so far. When
+ * no index narrows the result to under half the catalog, a full scan
+ * of the book array is cheaper than chasing IDs and is chosen instead.
+ *
+ * @param estimate: Receives the expected number of candidate rows, or NULL
+ * @return: The chosen access path
+ */
+AccessPath libraryChooseIndex(const Library *library, const BookFilter *filter,
+                              int *estimate);
+
+/**
+ * Collect the IDs a filter's chosen index yields, in index order
+ *
+ * Only the predicate that drives the access path is applied; callers
+ * check the remaining predicates on each candidate.
+ *
+ * @param access: Access path from libraryChooseIndex (not a full scan)
+ * @param ids: Output array
+ * @param max_ids: Capacity of ids
+ * @return: Number of IDs stored
+ */
+int libraryIndexScan(const Library *library, const BookFilter *filter,
+                     AccessPath access, int *ids, int max_ids);
+
+#endif /* LIBRARY_H */
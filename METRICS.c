@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "METRICS.h"
+
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS ((64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+#define CALIBRATION_NS 10000000u
+
+/*
+ * Default sampling: catalog mutations and queries 1 in 8; point lookups
+ * and tree internals, which run inside scans, 1 in 64
+ */
+#define CATALOG_SAMPLE_MASK 7u
+#define TREE_SAMPLE_MASK 63u
+
+/* Log-linear latency histogram */
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t samples;
+    uint64_t sum;
+    uint64_t max;
+} Histogram;
+
+/* Calls per operation, added once per sampling period */
+static uint64_t metricsCalls[METRIC_OP_COUNT];
+static uint32_t metricsSampleMask[METRIC_OP_COUNT] = {
+    CATALOG_SAMPLE_MASK,              /* METRIC_LIBRARY_ADD */
+    CATALOG_SAMPLE_MASK,              /* METRIC_LIBRARY_UPDATE */
+    CATALOG_SAMPLE_MASK,              /* METRIC_LIBRARY_DELETE */
+    TREE_SAMPLE_MASK,                 /* METRIC_LIBRARY_FIND */
+    CATALOG_SAMPLE_MASK,              /* METRIC_QUERY_EXECUTE */
+    CATALOG_SAMPLE_MASK,              /* METRIC_SORT */
+    TREE_SAMPLE_MASK,                 /* METRIC_RB_INSERT */
+    TREE_SAMPLE_MASK,                 /* METRIC_RB_FIX_INSERT */
+    TREE_SAMPLE_MASK,                 /* METRIC_RB_DELETE */
+    TREE_SAMPLE_MASK,                 /* METRIC_RB_FIX_DELETE */
+    TREE_SAMPLE_MASK                  /* METRIC_RB_SEARCH */
+};
+uint64_t metricsCounters[COUNTER_COUNT];
+
+/* Untimed calls left before this thread times one, and where that
+ * count began */
+__thread int32_t metricsCountdown[METRIC_OP_COUNT];
+static __thread int32_t metricsPeriod[METRIC_OP_COUNT];
+/* Start ticks of the call this thread is timing, 0 when none is */
+__thread uint64_t metricsStarted[METRIC_OP_COUNT];
+
+static Histogram histograms[METRIC_OP_COUNT];
+
+static const char *opNames[METRIC_OP_COUNT] = {
+    "library_add",
+    "library_update",
+    "library_delete",
+    "library_find",
+    "query_execute",
+    "sort",
+    "rb_insert",
+    "rb_fix_insert",
+    "rb_delete",
+    "rb_fix_delete",
+    "rb_search"
+};
+
+static const char *counterNames[COUNTER_COUNT] = {
+    "rb_rotations",
+    "rb_node_allocs",
+    "rb_node_frees",
+    "hash_rehashes",
+    "posting_grows",
+    "cache_hits",
+    "cache_misses",
+    "cache_evictions",
+    "qcache_hits",
+    "qcache_misses",
+    "qcache_invalid",
+    "qcache_evictions",
+    "bloom_negatives",
+    "bloom_false_pos",
+    "bloom_rebuilds",
+    "lib_batch_finds"
+};
+
+/* Reference point for converting ticks to nanoseconds */
+static uint64_t startTicks;
+static uint64_t startNanos;
+
+static uint64_t nowNanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+__attribute__((constructor))
+static void captureStart(void) {
+    startNanos = nowNanos();
+    startTicks = Metrics_Ticks();
+}
+
+/* ============= Histogram ============= */
+
+static int bucketOf(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BUCKET_BITS;
+
+    return (shift + 1) * SUB_BUCKETS + (int)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+/**
+ * Get the largest value that falls into a bucket
+ */
+static uint64_t bucketHigh(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+
+    int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t sub = (uint64_t)(bucket % SUB_BUCKETS) + SUB_BUCKETS;
+
+    return ((sub + 1) << shift) - 1;
+}
+
+/* Add one timed latency, in Metrics_Ticks units, to a histogram */
+static void record(MetricOp op, uint64_t ticks) {
+    Histogram *histogram = &histograms[op];
+    uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+    /* Threads time calls of the same operation at once */
+    __atomic_fetch_add(&histogram->counts[bucketOf(ticks)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->samples, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, ticks, __ATOMIC_RELAXED);
+    while (ticks > max &&
+           !__atomic_compare_exchange_n(&histogram->max, &max, ticks, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* Copy a histogram other threads may be recording into */
+static void loadHistogram(MetricOp op, Histogram *copy) {
+    const Histogram *histogram = &histograms[op];
+
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        copy->counts[b] = __atomic_load_n(&histogram->counts[b], __ATOMIC_RELAXED);
+    }
+    copy->samples = __atomic_load_n(&histogram->samples, __ATOMIC_RELAXED);
+    copy->sum = __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED);
+    copy->max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+}
+
+/**
+ * Find the value at or below which a fraction of the samples fall
+ */
+static uint64_t percentile(const Histogram *histogram, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * (double)histogram->samples + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += histogram->counts[b];
+        if (seen >= rank) {
+            uint64_t high = bucketHigh(b);
+            return high < histogram->max ? high : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+/* ============= Sampling ============= */
+
+void Metrics_BeginSample(MetricOp op) {
+    /* The period that just ran out, plus this call */
+    __atomic_fetch_add(&metricsCalls[op], (uint64_t)metricsPeriod[op] + 1,
+                       __ATOMIC_RELAXED);
+    metricsPeriod[op] = (int32_t)metricsSampleMask[op];
+    metricsCountdown[op] = (int32_t)metricsSampleMask[op];
+    metricsStarted[op] = Metrics_Ticks();
+}
+
+void Metrics_EndSample(MetricOp op) {
+    record(op, Metrics_Ticks() - metricsStarted[op]);
+    metricsStarted[op] = 0;
+}
+
+/* Calls counted so far, including this thread's unflushed period */
+static uint64_t callsOf(MetricOp op) {
+    return __atomic_load_n(&metricsCalls[op], __ATOMIC_RELAXED) +
+           (uint64_t)(metricsPeriod[op] - metricsCountdown[op]);
+}
+
+void Metrics_SetSampling(MetricOp op, unsigned shift) {
+    metricsSampleMask[op] = shift >= 31 ? INT32_MAX
+                                        : ((uint32_t)1 << shift) - 1;
+}
+
+void Metrics_Reset(void) {
+    memset(metricsCalls, 0, sizeof(metricsCalls));
+    memset(metricsCountdown, 0, sizeof(metricsCountdown));
+    memset(metricsPeriod, 0, sizeof(metricsPeriod));
+    memset(metricsCounters, 0, sizeof(metricsCounters));
+    memset(histograms, 0, sizeof(histograms));
+}
+
+/* ============= Reporting ============= */
+
+static uint64_t counterOf(MetricCounter counter) {
+    return __atomic_load_n(&metricsCounters[counter], __ATOMIC_RELAXED);
+}
+
+/**
+ * Measure nanoseconds per tick against the monotonic clock
+ */
+static double nanosPerTick(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t nanos = nowNanos();
+
+    /* Make sure enough time has passed for a stable ratio */
+    while (nanos - startNanos < CALIBRATION_NS) {
+        nanos = nowNanos();
+    }
+
+    uint64_t ticks = Metrics_Ticks() - startTicks;
+    return ticks > 0 ? (double)(nanos - startNanos) / (double)ticks : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
+/* Share of the first counter in the sum of both: a hit ratio, or a
+ * filter's false-positive rate among the keys it was asked about and lacked */
+static double hitRatio(MetricCounter hits, MetricCounter misses) {
+    uint64_t lookups = counterOf(hits) + counterOf(misses);
+
+    return lookups ? (double)counterOf(hits) / (double)lookups : 0.0;
+}
+
+static void dumpText(FILE *out, const MetricsTree *trees, int ntrees,
+                     double scale) {
+    fprintf(out, "%-16s %12s %10s %10s %10s %10s %10s %10s %12s\n",
+            "operation", "calls", "sampled", "mean_ns", "p50_ns", "p90_ns",
+            "p99_ns", "p999_ns", "max_ns");
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        Histogram copy;
+        const Histogram *h = &copy;
+        loadHistogram((MetricOp)op, &copy);
+        double mean = h->samples ? (double)h->sum / (double)h->samples : 0.0;
+
+        fprintf(out, "%-16s %12llu %10llu %10.0f %10.0f %10.0f %10.0f %10.0f %12.0f\n",
+                opNames[op],
+                (unsigned long long)callsOf((MetricOp)op),
+                (unsigned long long)h->samples,
+                mean * scale,
+                h->samples ? percentile(h, 0.50) * scale : 0.0,
+                h->samples ? percentile(h, 0.90) * scale : 0.0,
+                h->samples ? percentile(h, 0.99) * scale : 0.0,
+                h->samples ? percentile(h, 0.999) * scale : 0.0,
+                (double)h->max * scale);
+    }
+
+    fprintf(out, "\n");
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        fprintf(out, "%-16s %12llu\n", counterNames[c],
+                (unsigned long long)counterOf(c));
+    }
+
+    /* Every insert allocates one node; RB_INSERT calls need -DMETRICS_TREE */
+    uint64_t inserts = counterOf(COUNTER_RB_NODE_ALLOCS);
+    fprintf(out, "%-16s %12.3f\n", "rotations/insert",
+            inserts ? (double)counterOf(COUNTER_RB_ROTATIONS) / (double)inserts
+                    : 0.0);
+    fprintf(out, "%-16s %12llu\n", "rb_nodes_live",
+            (unsigned long long)(counterOf(COUNTER_RB_NODE_ALLOCS) -
+                                 counterOf(COUNTER_RB_NODE_FREES)));
+    fprintf(out, "%-16s %12.3f\n", "cache_hit_ratio",
+            hitRatio(COUNTER_CACHE_HITS, COUNTER_CACHE_MISSES));
+    fprintf(out, "%-16s %12.3f\n", "qcache_hit_ratio",
+            hitRatio(COUNTER_QCACHE_HITS, COUNTER_QCACHE_MISSES));
+    fprintf(out, "%-16s %12.4f\n", "bloom_fp_rate",
+            hitRatio(COUNTER_BLOOM_FALSE_POSITIVES, COUNTER_BLOOM_NEGATIVES));
+
+    fprintf(out, "\n%-16s %12s %8s %12s\n", "tree", "nodes", "height", "node_bytes");
+    for (int t = 0; t < ntrees; t++) {
+        size_t size = RBTree_Size(trees[t].tree);
+        fprintf(out, "%-16s %12zu %8d %12zu\n", trees[t].name, size,
+                RBTree_Height(trees[t].tree), size * sizeof(RBNode));
+    }
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    fprintf(out, "\n%-16s %12zu\n%-16s %12zu\n%-16s %12zu\n",
+            "heap_arena", info.arena, "heap_in_use", info.uordblks,
+            "heap_mmapped", info.hblkhd);
+#endif
+}
+
+static void dumpJson(FILE *out, const MetricsTree *trees, int ntrees,
+                     double scale) {
+    fprintf(out, "{\"operations\":{");
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        Histogram copy;
+        const Histogram *h = &copy;
+        loadHistogram((MetricOp)op, &copy);
+        double mean = h->samples ? (double)h->sum / (double)h->samples : 0.0;
+
+        fprintf(out, "%s\"%s\":{\"calls\":%llu,\"sampled\":%llu,"
+                "\"mean_ns\":%.0f,\"p50_ns\":%.0f,\"p90_ns\":%.0f,"
+                "\"p99_ns\":%.0f,\"p999_ns\":%.0f,\"max_ns\":%.0f}",
+                op ? "," : "", opNames[op],
+                (unsigned long long)callsOf((MetricOp)op),
+                (unsigned long long)h->samples,
+                mean * scale,
+                h->samples ? percentile(h, 0.50) * scale : 0.0,
+                h->samples ? percentile(h, 0.90) * scale : 0.0,
+                h->samples ? percentile(h, 0.99) * scale : 0.0,
+                h->samples ? percentile(h, 0.999) * scale : 0.0,
+                (double)h->max * scale);
+    }
+
+    fprintf(out, "},\"counters\":{");
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        fprintf(out, "%s\"%s\":%llu", c ? "," : "", counterNames[c],
+                (unsigned long long)counterOf(c));
+    }
+
+    uint64_t inserts = counterOf(COUNTER_RB_NODE_ALLOCS);
+    fprintf(out, ",\"rotations_per_insert\":%.3f,\"rb_nodes_live\":%llu,"
+            "\"cache_hit_ratio\":%.3f,\"qcache_hit_ratio\":%.3f,"
+            "\"bloom_fp_rate\":%.4f}",
+            inserts ? (double)counterOf(COUNTER_RB_ROTATIONS) / (double)inserts
+                    : 0.0,
+            (unsigned long long)(counterOf(COUNTER_RB_NODE_ALLOCS) -
+                                 counterOf(COUNTER_RB_NODE_FREES)),
+            hitRatio(COUNTER_CACHE_HITS, COUNTER_CACHE_MISSES),
+            hitRatio(COUNTER_QCACHE_HITS, COUNTER_QCACHE_MISSES),
+            hitRatio(COUNTER_BLOOM_FALSE_POSITIVES, COUNTER_BLOOM_NEGATIVES));
+
+    fprintf(out, ",\"trees\":[");
+    for (int t = 0; t < ntrees; t++) {
+        size_t size = RBTree_Size(trees[t].tree);
+        fprintf(out, "%s{\"name\":\"%s\",\"nodes\":%zu,\"height\":%d,"
+                "\"node_bytes\":%zu}", t ? "," : "", trees[t].name, size,
+                RBTree_Height(trees[t].tree), size * sizeof(RBNode));
+    }
+    fprintf(out, "]");
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    fprintf(out, ",\"heap\":{\"arena\":%zu,\"in_use\":%zu,\"mmapped\":%zu}",
+            info.arena, info.uordblks, info.hblkhd);
+#endif
+
+#ifdef METRICS_DISABLED
+    fprintf(out, ",\"enabled\":false}\n");
+#else
+    fprintf(out, ",\"enabled\":true}\n");
+#endif
+}
+
+void Metrics_Dump(FILE *out, MetricsFormat format,
+                  const MetricsTree *trees, int ntrees) {
+    double scale = nanosPerTick();
+
+    if (format == METRICS_JSON) {
+        dumpJson(out, trees, ntrees, scale);
+        return;
+    }
+
+#ifdef METRICS_DISABLED
+    fprintf(out, "(metrics compiled out: built with -DMETRICS_DISABLED)\n");
+#endif
+    dumpText(out, trees, ntrees, scale);
+}
@@ -0,0 +1,183 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "RBTREE.h"
+
+/**
+ * @file METRICS.h
+ * @brief Operation counters and latency histograms
+ *
+ * Every instrumented operation counts each call. Latency is timed on
+ * one call in every 2^shift for that operation (see Metrics_SetSampling)
+ * and recorded into a log-linear histogram with 16 sub-buckets per
+ * power of two, which keeps percentile error under about 6%. Timing
+ * uses the CPU timestamp counter where available.
+ *
+ * The hooks touch only per-thread state: a countdown to the next timed
+ * call and, while a call is timed, its start ticks. The inline part is
+ * a decrement and two predicted branches and keeps nothing live across
+ * the instrumented body; starting and recording a sample happen out of
+ * line. Calls are added to the shared totals once per sampling period,
+ * so a dump sees other threads' most recent calls up to one period late.
+ * Event counters and histograms are shared by every thread and updated
+ * with relaxed atomic adds, so counts from concurrent threads are exact.
+ * An operation must not be timed inside a call of itself.
+ *
+ * Point lookups are counted and timed by their callers (libraryFind*,
+ * the query executor), not by the tree: even a decrement and a branch
+ * are a measurable share of a lookup in a cached tree. The RB_* timers
+ * inside RBTREE.c are compiled in only with -DMETRICS_TREE; without it
+ * the tree keeps just its rotation and node counters.
+ *
+ * Building with -DMETRICS_DISABLED turns every hook into a no-op, so
+ * instrumented code compiles to the same instructions as before.
+ */
+
+/* Timed operations */
+typedef enum {
+    METRIC_LIBRARY_ADD = 0,
+    METRIC_LIBRARY_UPDATE,
+    METRIC_LIBRARY_DELETE,
+    METRIC_LIBRARY_FIND,
+    METRIC_QUERY_EXECUTE,
+    METRIC_SORT,
+    METRIC_RB_INSERT,
+    METRIC_RB_FIX_INSERT,
+    METRIC_RB_DELETE,
+    METRIC_RB_FIX_DELETE,
+    METRIC_RB_SEARCH,
+    METRIC_OP_COUNT
+} MetricOp;
+
+/* Event counters */
+typedef enum {
+    COUNTER_RB_ROTATIONS = 0,
+    COUNTER_RB_NODE_ALLOCS,
+    COUNTER_RB_NODE_FREES,
+    COUNTER_HASH_REHASHES,
+    COUNTER_POSTING_GROWS,
+    COUNTER_CACHE_HITS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_CACHE_EVICTIONS,
+    COUNTER_QCACHE_HITS,
+    COUNTER_QCACHE_MISSES,
+    COUNTER_QCACHE_INVALIDATIONS,
+    COUNTER_QCACHE_EVICTIONS,
+    COUNTER_BLOOM_NEGATIVES,          /* Lookups a Bloom filter turned away */
+    COUNTER_BLOOM_FALSE_POSITIVES,    /* Lookups it let through that missed */
+    COUNTER_BLOOM_REBUILDS,
+    COUNTER_LIBRARY_BATCH_FINDS,      /* IDs resolved by libraryFindManyById */
+    COUNTER_COUNT
+} MetricCounter;
+
+typedef enum {
+    METRICS_TEXT = 0,
+    METRICS_JSON
+} MetricsFormat;
+
+/* A tree reported by Metrics_Dump */
+typedef struct {
+    const char *name;
+    RBTree *tree;
+} MetricsTree;
+
+extern uint64_t metricsCounters[COUNTER_COUNT];
+extern __thread int32_t metricsCountdown[METRIC_OP_COUNT];
+extern __thread uint64_t metricsStarted[METRIC_OP_COUNT];
+
+/**
+ * Read the timestamp counter (or a nanosecond clock elsewhere)
+ */
+static inline uint64_t Metrics_Ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/**
+ * Count the calls since the last sample and start timing this one
+ */
+__attribute__((cold, noinline)) void Metrics_BeginSample(MetricOp op);
+
+/**
+ * Add the timed call's latency to the operation's histogram
+ */
+__attribute__((cold, noinline)) void Metrics_EndSample(MetricOp op);
+
+/**
+ * Time one call in every 2^shift of an operation (0 times every call)
+ */
+void Metrics_SetSampling(MetricOp op, unsigned shift);
+
+/**
+ * Clear all counters and histograms
+ */
+void Metrics_Reset(void);
+
+/**
+ * Write counters, latency percentiles, tree shape and allocator stats
+ * @param trees: Trees to report size, height and node bytes for
+ * @param ntrees: Number of entries in trees
+ */
+void Metrics_Dump(FILE *out, MetricsFormat format,
+                  const MetricsTree *trees, int ntrees);
+
+#ifdef METRICS_DISABLED
+
+#define METRICS_INC(counter) ((void)0)
+#define METRICS_ADD(counter, n) ((void)0)
+#define METRICS_START(op) ((void)0)
+#define METRICS_STOP(op) ((void)0)
+#define METRICS_TREE_START(op) ((void)0)
+#define METRICS_TREE_STOP(op) ((void)0)
+
+#else
+
+#define METRICS_INC(counter) \
+    ((void)__atomic_fetch_add(&metricsCounters[(counter)], 1, __ATOMIC_RELAXED))
+#define METRICS_ADD(counter, n) \
+    ((void)__atomic_fetch_add(&metricsCounters[(counter)], (uint64_t)(n), __ATOMIC_RELAXED))
+#define METRICS_START(op) Metrics_Start(op)
+#define METRICS_STOP(op) Metrics_Stop(op)
+
+#ifdef METRICS_TREE
+#define METRICS_TREE_START(op) Metrics_Start(op)
+#define METRICS_TREE_STOP(op) Metrics_Stop(op)
+#else
+#define METRICS_TREE_START(op) ((void)0)
+#define METRICS_TREE_STOP(op) ((void)0)
+#endif
+
+/**
+ * Count a call and start timing it if it is sampled
+ */
+static inline void Metrics_Start(MetricOp op) {
+    if (__builtin_expect(--metricsCountdown[op] < 0, 0)) {
+        Metrics_BeginSample(op);
+    }
+}
+
+/**
+ * Record the call's latency if Metrics_Start timed it
+ */
+static inline void Metrics_Stop(MetricOp op) {
+    if (__builtin_expect(metricsStarted[op] != 0, 0)) {
+        Metrics_EndSample(op);
+    }
+}
+
+#endif /* METRICS_DISABLED */
+
+#endif /* METRICS_H */
@@ -0,0 +1,738 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PACK.h"
+#include "TEXT.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+#define LZ_SLACK 16                   /* Room past the output for wide copies */
+#define CENTS_LIMIT (1 << 24)         /* Whole cents a float holds exactly */
+
+/* Where each string column lives in a Book */
+static const struct {
+    size_t offset;
+    size_t size;
+} stringFields[PACK_STRING_COLUMNS] = {
+    {offsetof(Book, title), MAX_TITLE_LEN},
+    {offsetof(Book, author), MAX_AUTHOR_LEN},
+    {offsetof(Book, isbn), MAX_ISBN_LEN}
+};
+
+/* Largest raw string column, for decompression scratch space */
+#define MAX_FIELD_LEN \
+    (MAX_TITLE_LEN > MAX_AUTHOR_LEN ? MAX_TITLE_LEN : MAX_AUTHOR_LEN)
+#define MAX_COLUMN_BYTES (PACK_BLOCK_BOOKS * MAX_FIELD_LEN)
+#define SCRATCH_BYTES (MAX_COLUMN_BYTES + LZ_SLACK)
+
+/* ============= LZ Coder ============= */
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t lzHash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * Append one sequence: literals, then a match unless it is the last
+ *
+ * A token byte holds the literal count in its high nibble and the
+ * match length minus LZ_MIN_MATCH in its low one; 15 in either means
+ * the rest follows as bytes of 255 and a final smaller byte. A match
+ * is a two-byte back offset into the output.
+ *
+ * @return: 0 on success, -1 if out would overflow cap
+ */
+static int emitSequence(unsigned char *out, size_t cap, size_t *used,
+                        const unsigned char *literals, size_t literalCount,
+                        size_t offset, size_t match) {
+    size_t extra = match > 0 ? match - LZ_MIN_MATCH : 0;
+    size_t need = 1 + literalCount / 255 + 1 + literalCount + 2 + extra / 255 + 1;
+    size_t at = *used;
+
+    if (need > cap - at) {
+        return -1;
+    }
+
+    out[at++] = (unsigned char)(((literalCount < 15 ? literalCount : 15) << 4) |
+                                (extra < 15 ? extra : 15));
+    if (literalCount >= 15) {
+        size_t rest = literalCount - 15;
+        for (; rest >= 255; rest -= 255) {
+            out[at++] = 255;
+        }
+        out[at++] = (unsigned char)rest;
+    }
+    memcpy(out + at, literals, literalCount);
+    at += literalCount;
+
+    if (match > 0) {
+        out[at++] = (unsigned char)(offset & 0xFF);
+        out[at++] = (unsigned char)(offset >> 8);
+        if (extra >= 15) {
+            size_t rest = extra - 15;
+            for (; rest >= 255; rest -= 255) {
+                out[at++] = 255;
+            }
+            out[at++] = (unsigned char)rest;
+        }
+    }
+
+    *used = at;
+    return 0;
+}
+
+/**
+ * Greedy LZ77 compression with a hash table of 4-byte prefixes
+ * @return: Compressed size, or 0 if it would not fit in cap
+ */
+static size_t lzCompress(const unsigned char *src, size_t length,
+                         unsigned char *out, size_t cap) {
+    int32_t table[1 << LZ_HASH_BITS];
+    size_t used = 0;
+    size_t anchor = 0;
+    size_t at = 0;
+
+    memset(table, 0xFF, sizeof(table));
+    while (at + LZ_MIN_MATCH <= length) {
+        uint32_t hash = lzHash(read32(src + at));
+        int32_t candidate = table[hash];
+
+        table[hash] = (int32_t)at;
+        if (candidate < 0 || at - (size_t)candidate > LZ_MAX_OFFSET ||
+            read32(src + candidate) != read32(src + at)) {
+            at++;
+            continue;
+        }
+
+        size_t match = LZ_MIN_MATCH;
+        while (at + match < length && src[candidate + match] == src[at + match]) {
+            match++;
+        }
+        if (emitSequence(out, cap, &used, src + anchor, at - anchor,
+                         at - (size_t)candidate, match) != 0) {
+            return 0;
+        }
+        at += match;
+        anchor = at;
+    }
+
+    if (emitSequence(out, cap, &used, src + anchor, length - anchor, 0, 0) != 0) {
+        return 0;
+    }
+    return used;
+}
+
+/**
+ * Read the continuation bytes of a length whose nibble was 15
+ * @return: 0 on success, -1 if the input ends first
+ */
+static int readLength(const unsigned char *src, size_t length, size_t *at,
+                      size_t *value) {
+    unsigned char byte;
+
+    do {
+        if (*at >= length) {
+            return -1;
+        }
+        byte = src[(*at)++];
+        *value += byte;
+    } while (byte == 255);
+
+    return 0;
+}
+
+/**
+ * Undo lzCompress, checking every length and offset against the buffers
+ *
+ * Short literal runs and matches are copied in fixed 8 or 16 byte
+ * moves, which may write up to LZ_SLACK bytes past cap; out must have
+ * that much room. Literal copies only read that far ahead of a
+ * sequence when the input extends that far.
+ *
+ * @return: Decompressed size, or -1 if the input is corrupt
+ */
+static int64_t lzDecompress(const unsigned char *src, size_t length,
+                            unsigned char *out, size_t cap) {
+    size_t in = 0;
+    size_t produced = 0;
+
+    while (in < length) {
+        unsigned char token = src[in++];
+        size_t literals = token >> 4;
+
+        if (literals == 15 && readLength(src, length, &in, &literals) != 0) {
+            return -1;
+        }
+        if (literals > length - in || literals > cap - produced) {
+            return -1;
+        }
+        if (literals <= 16 && length - in >= 16) {
+            memcpy(out + produced, src + in, 16);
+        } else {
+            memcpy(out + produced, src + in, literals);
+        }
+        in += literals;
+        produced += literals;
+
+        /* The last sequence has no match */
+        if (in == length) {
+            break;
+        }
+        if (length - in < 2) {
+            return -1;
+        }
+
+        size_t offset = (size_t)src[in] | ((size_t)src[in + 1] << 8);
+        size_t match = (token & 15u);
+        in += 2;
+        if (match == 15 && readLength(src, length, &in, &match) != 0) {
+            return -1;
+        }
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > produced || match > cap - produced) {
+            return -1;
+        }
+
+        unsigned char *to = out + produced;
+        const unsigned char *from = to - offset;
+        if (offset >= 8) {
+            /* Each 8-byte move reads only bytes already written */
+            for (size_t i = 0; i < match; i += 8) {
+                memcpy(to + i, from + i, 8);
+            }
+        } else {
+            /* Overlapping copy repeats the last offset bytes */
+            for (size_t i = 0; i < match; i++) {
+                to[i] = from[i];
+            }
+        }
+        produced += match;
+    }
+
+    return (int64_t)produced;
+}
+
+/* ============= Bit Packing ============= */
+
+static int bitWidth(uint32_t value) {
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+static size_t packedBytes(int count, int bits) {
+    return ((size_t)count * (size_t)bits + 7) / 8;
+}
+
+/* Store the low bits of value at bit position at (out starts zeroed) */
+static void putBits(unsigned char *out, size_t at, uint32_t value, int bits) {
+    while (bits > 0) {
+        int shift = (int)(at & 7);
+        int take = 8 - shift < bits ? 8 - shift : bits;
+
+        out[at >> 3] |= (unsigned char)((value & ((1u << take) - 1)) << shift);
+        value >>= take;
+        bits -= take;
+        at += (size_t)take;
+    }
+}
+
+static uint32_t getBits(const unsigned char *in, size_t at, int bits) {
+    size_t first = at >> 3;
+    size_t bytes = ((at & 7) + (size_t)bits + 7) >> 3;
+    uint64_t word = 0;
+
+    for (size_t b = 0; b < bytes; b++) {
+        word |= (uint64_t)in[first + b] << (8 * b);
+    }
+    return (uint32_t)((word >> (at & 7)) & ((1ull << bits) - 1));
+}
+
+/**
+ * Frame of reference: the smallest value and the width of the offsets
+ */
+static int frameOf(const int32_t *values, int count, int32_t *base) {
+    int32_t low = INT32_MAX;
+    int32_t high = INT32_MIN;
+
+    for (int i = 0; i < count; i++) {
+        low = values[i] < low ? values[i] : low;
+        high = values[i] > high ? values[i] : high;
+    }
+    *base = count > 0 ? low : 0;
+    return count > 0 ? bitWidth((uint32_t)((int64_t)high - low)) : 0;
+}
+
+static void packColumn(unsigned char *out, const int32_t *values, int count,
+                       int32_t base, int bits) {
+    for (int i = 0; i < count; i++) {
+        putBits(out, (size_t)i * (size_t)bits,
+                (uint32_t)((int64_t)values[i] - base), bits);
+    }
+}
+
+static int32_t unpackValue(const unsigned char *column, int row, int32_t base,
+                           int bits) {
+    return (int32_t)((int64_t)base + getBits(column, (size_t)row * (size_t)bits, bits));
+}
+
+/* ============= Blocks ============= */
+
+/* Where each column of a checked block starts */
+typedef struct {
+    PackBlockHeader header;
+    const unsigned char *ids;
+    const unsigned char *years;
+    const unsigned char *quantities;
+    const unsigned char *prices;
+    const unsigned char *strings[PACK_STRING_COLUMNS];
+} BlockLayout;
+
+/**
+ * Convert a block's prices to whole cents if every one is exact
+ * @return: 1 if cents holds them all, 0 if raw bits must be kept
+ */
+static int priceCents(const Book *books, int count, int32_t *cents) {
+    for (int i = 0; i < count; i++) {
+        double scaled = (double)books[i].price * 100.0;
+        if (!(fabs(scaled) < CENTS_LIMIT)) {
+            return 0;
+        }
+
+        int32_t value = (int32_t)llround(scaled);
+        float back = (float)value / 100.0f;
+        if (memcmp(&back, &books[i].price, sizeof(back)) != 0) {
+            return 0;
+        }
+        cents[i] = value;
+    }
+    return 1;
+}
+
+size_t Pack_EncodeBlock(const Book *books, int count, unsigned char *out) {
+    int32_t ids[PACK_BLOCK_BOOKS], years[PACK_BLOCK_BOOKS];
+    int32_t quantities[PACK_BLOCK_BOOKS], prices[PACK_BLOCK_BOOKS];
+    unsigned char raw[MAX_COLUMN_BYTES];
+    PackBlockHeader header;
+
+    memset(&header, 0, sizeof(header));
+    header.count = (uint16_t)count;
+    for (int i = 0; i < count; i++) {
+        ids[i] = books[i].id;
+        years[i] = books[i].year;
+        quantities[i] = books[i].quantity;
+    }
+    header.priceCents = (uint8_t)priceCents(books, count, prices);
+    if (!header.priceCents) {
+        for (int i = 0; i < count; i++) {
+            memcpy(&prices[i], &books[i].price, sizeof(prices[i]));
+        }
+    }
+
+    int32_t base;
+    header.idBits = (uint8_t)frameOf(ids, count, &base);
+    header.idBase = base;
+    header.yearBits = (uint8_t)frameOf(years, count, &base);
+    header.yearBase = base;
+    header.quantityBits = (uint8_t)frameOf(quantities, count, &base);
+    header.quantityBase = base;
+    if (header.priceCents) {
+        header.priceBits = (uint8_t)frameOf(prices, count, &base);
+        header.priceBase = base;
+    } else {
+        header.priceBits = 32;
+        header.priceBase = 0;
+    }
+
+    size_t at = sizeof(header);
+    size_t columnBytes = packedBytes(count, header.idBits) +
+                         packedBytes(count, header.yearBits) +
+                         packedBytes(count, header.quantityBits) +
+                         packedBytes(count, header.priceBits);
+    memset(out + at, 0, columnBytes);
+    packColumn(out + at, ids, count, header.idBase, header.idBits);
+    at += packedBytes(count, header.idBits);
+    packColumn(out + at, years, count, header.yearBase, header.yearBits);
+    at += packedBytes(count, header.yearBits);
+    packColumn(out + at, quantities, count, header.quantityBase, header.quantityBits);
+    at += packedBytes(count, header.quantityBits);
+    packColumn(out + at, prices, count, header.priceBase, header.priceBits);
+    at += packedBytes(count, header.priceBits);
+
+    for (int c = 0; c < PACK_STRING_COLUMNS; c++) {
+        size_t rawSize = 0;
+
+        for (int i = 0; i < count; i++) {
+            const char *text = (const char*)&books[i] + stringFields[c].offset;
+            size_t length = strnlen(text, stringFields[c].size - 1);
+            memcpy(raw + rawSize, text, length);
+            raw[rawSize + length] = '\0';
+            rawSize += length + 1;
+        }
+
+        /* Keep the column as is unless compression saves something */
+        size_t packed = lzCompress(raw, rawSize, out + at, rawSize - 1);
+        if (packed == 0) {
+            memcpy(out + at, raw, rawSize);
+            packed = rawSize;
+        }
+        header.rawSize[c] = (uint32_t)rawSize;
+        header.packedSize[c] = (uint32_t)packed;
+        at += packed;
+    }
+
+    header.size = (uint32_t)at;
+    memcpy(out, &header, sizeof(header));
+    return at;
+}
+
+/**
+ * Check a block's header against its size and find its columns
+ * @return: 0 if consistent, -1 if corrupt
+ */
+static int layoutBlock(const unsigned char *block, size_t size,
+                       BlockLayout *layout) {
+    PackBlockHeader *header = &layout->header;
+
+    if (size < sizeof(*header)) {
+        return -1;
+    }
+    memcpy(header, block, sizeof(*header));
+    if (header->size > size || header->count == 0 ||
+        header->count > PACK_BLOCK_BOOKS || header->idBits > 32 ||
+        header->yearBits > 32 || header->quantityBits > 32 ||
+        header->priceBits > 32) {
+        return -1;
+    }
+
+    int count = header->count;
+    size_t at = sizeof(*header);
+    layout->ids = block + at;
+    at += packedBytes(count, header->idBits);
+    layout->years = block + at;
+    at += packedBytes(count, header->yearBits);
+    layout->quantities = block + at;
+    at += packedBytes(count, header->quantityBits);
+    layout->prices = block + at;
+    at += packedBytes(count, header->priceBits);
+
+    for (int c = 0; c < PACK_STRING_COLUMNS; c++) {
+        if (header->rawSize[c] > (size_t)count * stringFields[c].size ||
+            header->packedSize[c] > header->rawSize[c]) {
+            return -1;
+        }
+        layout->strings[c] = block + at;
+        at += header->packedSize[c];
+    }
+
+    return at == header->size ? 0 : -1;
+}
+
+/**
+ * Restore one string column's NUL-separated text
+ * @param raw: SCRATCH_BYTES of scratch space
+ * @return: 0 on success, -1 if corrupt
+ */
+static int unpackStrings(const BlockLayout *layout, int column,
+                         unsigned char *raw) {
+    size_t rawSize = layout->header.rawSize[column];
+    size_t packed = layout->header.packedSize[column];
+
+    if (packed == rawSize) {
+        memcpy(raw, layout->strings[column], rawSize);
+    } else if (lzDecompress(layout->strings[column], packed, raw,
+                            rawSize) != (int64_t)rawSize) {
+        return -1;
+    }
+    return rawSize > 0 && raw[rawSize - 1] == '\0' ? 0 : -1;
+}
+
+static float unpackPrice(const BlockLayout *layout, int row) {
+    int32_t value = unpackValue(layout->prices, row, layout->header.priceBase,
+                                layout->header.priceBits);
+    float price;
+
+    if (layout->header.priceCents) {
+        return (float)value / 100.0f;
+    }
+    memcpy(&price, &value, sizeof(price));
+    return price;
+}
+
+static void unpackNumbers(const BlockLayout *layout, int row, Book *book) {
+    const PackBlockHeader *header = &layout->header;
+
+    book->id = unpackValue(layout->ids, row, header->idBase, header->idBits);
+    book->year = unpackValue(layout->years, row, header->yearBase, header->yearBits);
+    book->quantity = unpackValue(layout->quantities, row, header->quantityBase,
+                                 header->quantityBits);
+    book->price = unpackPrice(layout, row);
+}
+
+/**
+ * Copy one NUL-terminated string out of a column into a Book field
+ * @return: Bytes consumed, or 0 if the string does not fit the field
+ */
+static size_t takeString(const unsigned char *text, size_t available,
+                         char *field, size_t fieldSize) {
+    const unsigned char *end = memchr(text, '\0', available);
+
+    if (end == NULL || (size_t)(end - text) >= fieldSize) {
+        return 0;
+    }
+    memcpy(field, text, (size_t)(end - text) + 1);
+    return (size_t)(end - text) + 1;
+}
+
+int Pack_DecodeBlock(const unsigned char *block, size_t size, Book *books) {
+    unsigned char raw[SCRATCH_BYTES];
+    BlockLayout layout;
+
+    if (layoutBlock(block, size, &layout) != 0) {
+        return -1;
+    }
+
+    int count = layout.header.count;
+    memset(books, 0, (size_t)count * sizeof(Book));
+    for (int i = 0; i < count; i++) {
+        unpackNumbers(&layout, i, &books[i]);
+    }
+
+    for (int c = 0; c < PACK_STRING_COLUMNS; c++) {
+        size_t rawSize = layout.header.rawSize[c];
+        size_t at = 0;
+
+        if (unpackStrings(&layout, c, raw) != 0) {
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            size_t n = takeString(raw + at, rawSize - at,
+                                  (char*)&books[i] + stringFields[c].offset,
+                                  stringFields[c].size);
+            if (n == 0) {
+                return -1;
+            }
+            at += n;
+        }
+        if (at != rawSize) {
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+int Pack_FindInBlock(const unsigned char *block, size_t size, int id,
+                     Book *book) {
+    unsigned char raw[SCRATCH_BYTES];
+    BlockLayout layout;
+
+    if (layoutBlock(block, size, &layout) != 0) {
+        return -1;
+    }
+
+    /* IDs ascend, so the packed column can be binary searched in place */
+    const PackBlockHeader *header = &layout.header;
+    int low = 0;
+    int high = header->count - 1;
+    int row = -1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int midId = unpackValue(layout.ids, mid, header->idBase, header->idBits);
+
+        if (midId == id) {
+            row = mid;
+            break;
+        }
+        if (midId < id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    if (row == -1) {
+        return 0;
+    }
+
+    memset(book, 0, sizeof(*book));
+    unpackNumbers(&layout, row, book);
+    for (int c = 0; c < PACK_STRING_COLUMNS; c++) {
+        size_t rawSize = header->rawSize[c];
+        size_t at = 0;
+
+        if (unpackStrings(&layout, c, raw) != 0) {
+            return -1;
+        }
+        for (int i = 0; i < row; i++) {
+            const unsigned char *end = memchr(raw + at, '\0', rawSize - at);
+            if (end == NULL) {
+                return -1;
+            }
+            at = (size_t)(end - raw) + 1;
+        }
+        if (at >= rawSize ||
+            takeString(raw + at, rawSize - at, (char*)book + stringFields[c].offset,
+                       stringFields[c].size) == 0) {
+            return -1;
+        }
+    }
+
+    Text_Fold(book->title, book->titleFolded, sizeof(book->titleFolded));
+    Text_Fold(book->author, book->authorFolded, sizeof(book->authorFolded));
+    return 1;
+}
+
+/* ============= Files ============= */
+
+unsigned char* Pack_Encode(const Library *library, size_t *size) {
+    int count = library->count;
+    uint32_t blockCount = (uint32_t)((count + PACK_BLOCK_BOOKS - 1) / PACK_BLOCK_BOOKS);
+    size_t capacity = sizeof(PackHeader) + blockCount * PACK_MAX_BLOCK_BYTES +
+                      sizeof(BloomBlock) + blockCount * sizeof(BloomBlock) +
+                      blockCount * sizeof(PackBlockEntry) + sizeof(PackTrailer);
+    unsigned char *image = (unsigned char*)malloc(capacity);
+    PackHeader header = {PACK_MAGIC, PACK_VERSION, blockCount, count,
+                         library->nextId, 0};
+    PackBlockEntry *index;
+
+    if (image == NULL) {
+        fprintf(stderr, "Memory allocation failed for packed catalog\n");
+        return NULL;
+    }
+    index = (PackBlockEntry*)malloc((blockCount + 1) * sizeof(PackBlockEntry));
+    if (index == NULL) {
+        fprintf(stderr, "Memory allocation failed for packed catalog\n");
+        free(image);
+        return NULL;
+    }
+
+    memcpy(image, &header, sizeof(header));
+    size_t at = sizeof(header);
+    for (uint32_t b = 0; b < blockCount; b++) {
+        int first = (int)b * PACK_BLOCK_BOOKS;
+        int n = count - first < PACK_BLOCK_BOOKS ? count - first : PACK_BLOCK_BOOKS;
+        size_t length = Pack_EncodeBlock(&library->books[first], n, image + at);
+
+        index[b].firstId = library->books[first].id;
+        index[b].lastId = library->books[first + n - 1].id;
+        index[b].offset = at;
+        index[b].size = (uint32_t)length;
+        index[b].count = (uint32_t)n;
+        at += length;
+    }
+
+    /* Filters and index are read in place from a mapping, so align them;
+       each filter is then one cache line */
+    size_t padding = (sizeof(BloomBlock) - at % sizeof(BloomBlock)) % sizeof(BloomBlock);
+    memset(image + at, 0, padding);
+    at += padding;
+
+    for (uint32_t b = 0; b < blockCount; b++) {
+        BloomBlock filter;
+
+        memset(&filter, 0, sizeof(filter));
+        for (uint32_t i = 0; i < index[b].count; i++) {
+            int id = library->books[b * PACK_BLOCK_BOOKS + i].id;
+            Bloom_BlockAdd(&filter, Bloom_HashId(id));
+        }
+        memcpy(image + at, &filter, sizeof(filter));
+        at += sizeof(filter);
+    }
+
+    PackTrailer trailer = {at, blockCount, PACK_MAGIC};
+    memcpy(image + at, index, blockCount * sizeof(PackBlockEntry));
+    at += blockCount * sizeof(PackBlockEntry);
+    memcpy(image + at, &trailer, sizeof(trailer));
+    at += sizeof(trailer);
+    free(index);
+
+    /* Give back the room reserved for incompressible blocks */
+    unsigned char *shrunk = (unsigned char*)realloc(image, at);
+    *size = at;
+    return shrunk != NULL ? shrunk : image;
+}
+
+int Pack_OpenIndex(const unsigned char *data, size_t size,
+                   const PackBlockEntry **blocks, const BloomBlock **filters) {
+    PackHeader header;
+    PackTrailer trailer;
+    size_t headerSize = PACK_HEADER_SIZE(PACK_VERSION_NO_NEXT_ID);
+
+    if (size < headerSize + sizeof(trailer)) {
+        return -1;
+    }
+    memcpy(&header, data, headerSize);
+    headerSize = PACK_HEADER_SIZE(header.version);
+    if (size < headerSize + sizeof(trailer)) {
+        return -1;
+    }
+    memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+    if (header.magic != PACK_MAGIC || header.version < PACK_VERSION_UNFILTERED ||
+        header.version > PACK_VERSION ||
+        trailer.magic != PACK_MAGIC || trailer.blockCount != header.blockCount ||
+        header.count < 0 || trailer.indexOffset < headerSize ||
+        trailer.indexOffset % sizeof(uint64_t) != 0 ||
+        trailer.indexOffset > size - sizeof(trailer) ||
+        (size - sizeof(trailer) - trailer.indexOffset) / sizeof(PackBlockEntry) !=
+            header.blockCount ||
+        (size - sizeof(trailer) - trailer.indexOffset) % sizeof(PackBlockEntry) != 0) {
+        return -1;
+    }
+
+    /* Blocks end where the filters (or, in version 1, the index) start */
+    uint64_t blocksEnd = trailer.indexOffset;
+    if (header.version != PACK_VERSION_UNFILTERED) {
+        uint64_t filterBytes = (uint64_t)header.blockCount * sizeof(BloomBlock);
+        if (filterBytes > trailer.indexOffset - headerSize) {
+            return -1;
+        }
+        blocksEnd = trailer.indexOffset - filterBytes;
+    }
+
+    const PackBlockEntry *index = (const PackBlockEntry*)(data + trailer.indexOffset);
+    int64_t books = 0;
+    for (uint32_t b = 0; b < header.blockCount; b++) {
+        if (index[b].offset < headerSize ||
+            index[b].offset > blocksEnd ||
+            index[b].size > blocksEnd - index[b].offset ||
+            index[b].count == 0 || index[b].count > PACK_BLOCK_BOOKS ||
+            index[b].firstId > index[b].lastId ||
+            (b > 0 && index[b].firstId <= index[b - 1].lastId)) {
+            return -1;
+        }
+        books += index[b].count;
+    }
+    if (books != header.count) {
+        return -1;
+    }
+
+    *blocks = index;
+    *filters = header.version != PACK_VERSION_UNFILTERED
+               ? (const BloomBlock*)(data + blocksEnd) : NULL;
+    return 0;
+}
+
+int Pack_FindBlock(const PackBlockEntry *blocks, int blockCount, int id) {
+    int low = 0;
+    int high = blockCount - 1;
+
+    /* Last block starting at or below id */
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+
+        if (blocks[mid].firstId <= id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return high >= 0 && blocks[high].lastId >= id ? high : -1;
+}
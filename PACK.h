@@ -0,0 +1,162 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "BLOOM.h"
+#include "LIBRARY.h"
+
+/**
+ * @file PACK.h
+ * @brief Compressed catalog format: column blocks with a block index
+ *
+ * A packed catalog stores books in ID order in blocks of up to
+ * PACK_BLOCK_BOOKS. Inside a block every field is a column:
+ *
+ *   - id, year and quantity are stored as offsets from the block's
+ *     smallest value, bit-packed at the width the largest offset needs;
+ *   - price is stored the same way in whole cents when every price in
+ *     the block is exactly a cent amount, and as raw float bits if not;
+ *   - title, author and isbn are NUL-separated strings compressed with
+ *     a byte-oriented LZ77 coder in the style of LZ4 (a column that
+ *     does not shrink is stored as is).
+ *
+ * The folded search columns are not stored; they are rebuilt from the
+ * title and author when a book is read back.
+ *
+ * The file is a PackHeader, the blocks, one BloomBlock per block
+ * holding the block's IDs, an index with the ID range, offset and size
+ * of each block, and a PackTrailer pointing at the index. Each block
+ * starts with its own size, so a reader streaming the file front to
+ * back needs no index, while a lookup by ID binary searches the index,
+ * asks the block's filter, and decodes the block only if the filter
+ * cannot rule the ID out; deleted IDs inside a block's range mostly
+ * never reach the decoder. Version 2 files, whose header lacks the
+ * next ID, and version 1 files, which also have no filters, are still
+ * read.
+ *
+ * Values are stored in the writer's byte order; string columns keep
+ * at most the field sizes of LIBRARY.h.
+ */
+
+#define PACK_MAGIC 0x4B415042u        /* "BPAK" in a little-endian file */
+#define PACK_VERSION 3u
+#define PACK_VERSION_NO_NEXT_ID 2u    /* Header without the next ID */
+#define PACK_VERSION_UNFILTERED 1u    /* Same as 2 without block filters */
+#define PACK_BLOCK_BOOKS 64
+
+/* Columns of a block in the order they are stored */
+enum { PACK_TITLE = 0, PACK_AUTHOR, PACK_ISBN, PACK_STRING_COLUMNS };
+
+/* Start of a packed file; the same size as a CatalogHeader */
+typedef struct {
+    uint32_t magic;                   /* PACK_MAGIC */
+    uint32_t version;                 /* PACK_VERSION */
+    uint32_t blockCount;
+    int32_t count;                    /* Number of books */
+    int32_t nextId;                   /* Writer library's next ID */
+    uint32_t reserved;                /* Zero */
+} PackHeader;
+
+/* Header bytes of a file of the given version */
+#define PACK_HEADER_SIZE(version) \
+    ((version) >= PACK_VERSION ? sizeof(PackHeader) : offsetof(PackHeader, nextId))
+
+/* Start of every block */
+typedef struct {
+    uint32_t size;                    /* Bytes of the block, this header included */
+    uint16_t count;                   /* Books in the block */
+    uint8_t idBits;                   /* Widths of the bit-packed columns */
+    uint8_t yearBits;
+    uint8_t quantityBits;
+    uint8_t priceBits;
+    uint8_t priceCents;               /* 1: prices are cents, 0: raw float bits */
+    uint8_t reserved;
+    int32_t idBase;                   /* Smallest value of each column */
+    int32_t yearBase;
+    int32_t quantityBase;
+    int32_t priceBase;
+    uint32_t rawSize[PACK_STRING_COLUMNS];    /* String column bytes */
+    uint32_t packedSize[PACK_STRING_COLUMNS]; /* Stored bytes; == raw if stored as is */
+} PackBlockHeader;
+
+/* Where one block is and which IDs it holds */
+typedef struct {
+    int32_t firstId;
+    int32_t lastId;
+    uint64_t offset;                  /* From the start of the file */
+    uint32_t size;
+    uint32_t count;
+} PackBlockEntry;
+
+/* End of a packed file */
+typedef struct {
+    uint64_t indexOffset;             /* Start of blockCount PackBlockEntry */
+    uint32_t blockCount;
+    uint32_t magic;                   /* PACK_MAGIC */
+} PackTrailer;
+
+/* Largest block the writer produces: header, numeric columns, raw strings */
+#define PACK_MAX_BLOCK_BYTES                                          \
+    (sizeof(PackBlockHeader) + 4 * PACK_BLOCK_BOOKS * sizeof(uint32_t) + \
+     PACK_BLOCK_BOOKS * (MAX_TITLE_LEN + MAX_AUTHOR_LEN + MAX_ISBN_LEN))
+
+/**
+ * @brief Encode a library's books as a packed catalog file image
+ * @param library Library to encode
+ * @param size Receives the image size in bytes
+ * @return The image (free() it), or NULL on allocation failure
+ */
+unsigned char* Pack_Encode(const Library *library, size_t *size);
+
+/**
+ * @brief Encode up to PACK_BLOCK_BOOKS books, ascending by ID, as one block
+ * @param out Receives the block; at least PACK_MAX_BLOCK_BYTES bytes
+ * @return Bytes written
+ */
+size_t Pack_EncodeBlock(const Book *books, int count, unsigned char *out);
+
+/**
+ * @brief Decode every book of one block
+ *
+ * The folded columns are left empty: storing a book in a library
+ * fills them in.
+ *
+ * @param block Block, starting with its PackBlockHeader
+ * @param size Bytes available at block
+ * @param books Receives up to PACK_BLOCK_BOOKS books
+ * @return Number of books decoded, or -1 if the block is corrupt
+ */
+int Pack_DecodeBlock(const unsigned char *block, size_t size, Book *books);
+
+/**
+ * @brief Decode the one book of a block with the given ID
+ *
+ * Only the string columns are decompressed; numeric fields are read
+ * from their packed position. The folded columns are filled in.
+ *
+ * @return 1 if found, 0 if the block does not hold the ID, -1 if corrupt
+ */
+int Pack_FindInBlock(const unsigned char *block, size_t size, int id,
+                     Book *book);
+
+/**
+ * @brief Check a packed file image and locate its block index
+ * @param data Whole file
+ * @param size File size
+ * @param blocks Receives the block index
+ * @param filters Receives the block filters, parallel to the index, or
+ *                NULL for a version 1 file
+ * @return 0 if the header, trailer and index are consistent, -1 otherwise
+ */
+int Pack_OpenIndex(const unsigned char *data, size_t size,
+                   const PackBlockEntry **blocks, const BloomBlock **filters);
+
+/**
+ * @brief Find the block that can hold an ID
+ * @return Index of the block, or -1 if no block covers the ID
+ */
+int Pack_FindBlock(const PackBlockEntry *blocks, int blockCount, int id);
+
+#endif /* PACK_H */
@@ -0,0 +1,335 @@
+#define _GNU_SOURCE                   /* pthread_setaffinity_np, MAP_HUGETLB */
+
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "PAGES.h"
+
+/* Most NUMA nodes tracked; one unsigned long of node mask */
+#define MAX_NODES 64
+
+static PagesPolicy policy = {PAGES_SMALL, PAGES_NUMA_DEFAULT, 0, 0};
+static PagesStats stats;
+
+#define COUNT(field, n) __atomic_add_fetch(&stats.field, (uint64_t)(n), __ATOMIC_RELAXED)
+
+/* ============= Policy ============= */
+
+int Pages_ParsePolicy(const char *text, PagesPolicy *out) {
+    PagesPolicy parsed = {PAGES_SMALL, PAGES_NUMA_DEFAULT, 0, 0};
+    char word[32];
+
+    while (*text != '\0') {
+        size_t length = strcspn(text, ",");
+        if (length == 0 || length >= sizeof(word)) {
+            return -1;
+        }
+        memcpy(word, text, length);
+        word[length] = '\0';
+        text += length;
+        if (*text == ',') {
+            text++;
+        }
+
+        char *end;
+        if (strcmp(word, "off") == 0 || strcmp(word, "small") == 0) {
+            parsed.size = PAGES_SMALL;
+        } else if (strcmp(word, "thp") == 0) {
+            parsed.size = PAGES_TRANSPARENT;
+        } else if (strcmp(word, "hugetlb") == 0) {
+            parsed.size = PAGES_HUGETLB;
+        } else if (strcmp(word, "local") == 0) {
+            parsed.numa = PAGES_NUMA_LOCAL;
+        } else if (strcmp(word, "interleave") == 0) {
+            parsed.numa = PAGES_NUMA_INTERLEAVE;
+        } else if (strncmp(word, "node=", 5) == 0 &&
+                   (parsed.node = (int)strtol(word + 5, &end, 10)) >= 0 &&
+                   parsed.node < MAX_NODES && end != word + 5 && *end == '\0') {
+            parsed.numa = PAGES_NUMA_NODE;
+        } else if (strcmp(word, "pin") == 0) {
+            parsed.pinWorkers = 1;
+        } else {
+            return -1;
+        }
+    }
+
+    *out = parsed;
+    return 0;
+}
+
+void Pages_FormatPolicy(const PagesPolicy *format, char *out, size_t out_len) {
+    static const char *sizeNames[] = {"small", "thp", "hugetlb"};
+    static const char *numaNames[] = {"", ",local", ",interleave", ",node="};
+
+    if (format->numa == PAGES_NUMA_NODE) {
+        snprintf(out, out_len, "%s%s%d%s", sizeNames[format->size],
+                 numaNames[format->numa], format->node,
+                 format->pinWorkers ? ",pin" : "");
+    } else {
+        snprintf(out, out_len, "%s%s%s", sizeNames[format->size],
+                 numaNames[format->numa], format->pinWorkers ? ",pin" : "");
+    }
+}
+
+void Pages_SetPolicy(const PagesPolicy *set) {
+    policy = *set;
+}
+
+void Pages_GetPolicy(PagesPolicy *get) {
+    *get = policy;
+}
+
+int Pages_Enabled(void) {
+    return policy.size != PAGES_SMALL || policy.numa != PAGES_NUMA_DEFAULT;
+}
+
+void Pages_GetStats(PagesStats *out) {
+    out->regions = __atomic_load_n(&stats.regions, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&stats.bytes, __ATOMIC_RELAXED);
+    out->hugetlbRegions = __atomic_load_n(&stats.hugetlbRegions, __ATOMIC_RELAXED);
+    out->hugetlbFallbacks = __atomic_load_n(&stats.hugetlbFallbacks, __ATOMIC_RELAXED);
+    out->advised = __atomic_load_n(&stats.advised, __ATOMIC_RELAXED);
+    out->numaBound = __atomic_load_n(&stats.numaBound, __ATOMIC_RELAXED);
+    out->numaFailed = __atomic_load_n(&stats.numaFailed, __ATOMIC_RELAXED);
+    out->pinned = __atomic_load_n(&stats.pinned, __ATOMIC_RELAXED);
+}
+
+/* ============= Topology ============= */
+
+/**
+ * Read the first line of a sysfs file
+ * @return: 0 on success, -1 if it cannot be read
+ */
+static int readLine(const char *path, char *line, size_t line_len) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int ok = fgets(line, (int)line_len, file) != NULL;
+    fclose(file);
+    return ok ? 0 : -1;
+}
+
+/**
+ * Expand a sysfs list such as "0-3,8" into the numbers it names
+ * @return: How many numbers were stored
+ */
+static int parseList(const char *text, int *values, int max_values) {
+    int count = 0;
+
+    while (*text != '\0' && *text != '\n') {
+        char *end;
+        long first = strtol(text, &end, 10);
+        long last = first;
+
+        if (end == text) {
+            break;
+        }
+        if (*end == '-') {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+        }
+        for (long value = first; value <= last && count < max_values; value++) {
+            values[count++] = (int)value;
+        }
+        text = *end == ',' ? end + 1 : end;
+    }
+
+    return count;
+}
+
+/**
+ * Online NUMA nodes, in ascending order
+ * @return: Number of nodes, at least 1 (node 0 when sysfs is missing)
+ */
+static int onlineNodes(int *nodes) {
+    char line[256];
+
+    int count = 0;
+    if (readLine("/sys/devices/system/node/online", line, sizeof(line)) == 0) {
+        count = parseList(line, nodes, MAX_NODES);
+    }
+    if (count == 0) {
+        nodes[0] = 0;
+        count = 1;
+    }
+    return count;
+}
+
+/* ============= Placement ============= */
+
+/**
+ * Give a page-aligned range the policy's NUMA placement
+ */
+static void bindRange(void *memory, size_t size) {
+    unsigned long mask = 0;
+    int mode;
+
+    switch (policy.numa) {
+        case PAGES_NUMA_LOCAL:
+            mode = MPOL_LOCAL;
+            break;
+        case PAGES_NUMA_INTERLEAVE: {
+            int nodes[MAX_NODES];
+            int count = onlineNodes(nodes);
+            for (int i = 0; i < count; i++) {
+                if (nodes[i] < MAX_NODES) {
+                    mask |= 1UL << nodes[i];
+                }
+            }
+            mode = MPOL_INTERLEAVE;
+            break;
+        }
+        case PAGES_NUMA_NODE:
+            mask = 1UL << policy.node;
+            mode = MPOL_BIND;
+            break;
+        default:
+            return;
+    }
+
+    if (syscall(SYS_mbind, memory, size, mode, mask != 0 ? &mask : NULL,
+                mask != 0 ? (unsigned long)MAX_NODES + 1 : 0UL, 0U) == 0) {
+        COUNT(numaBound, 1);
+    } else {
+        COUNT(numaFailed, 1);
+    }
+}
+
+/**
+ * Map size bytes aligned to a huge page, trimming the slack
+ */
+static void* mapAligned(size_t size) {
+    size_t span = size + PAGES_HUGE_SIZE;
+    char *raw = (char*)mmap(NULL, span, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    char *start = (char*)(((uintptr_t)raw + PAGES_HUGE_SIZE - 1) & ~(uintptr_t)(PAGES_HUGE_SIZE - 1));
+    if (start > raw) {
+        munmap(raw, (size_t)(start - raw));
+    }
+    if (raw + span > start + size) {
+        munmap(start + size, (size_t)(raw + span - (start + size)));
+    }
+    return start;
+}
+
+void* Pages_Alloc(size_t size, size_t *mapped) {
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    void *memory = NULL;
+
+    if (policy.size == PAGES_SMALL) {
+        size = (size + pageSize - 1) & ~(pageSize - 1);
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            memory = NULL;
+        }
+    } else {
+        size = (size + PAGES_HUGE_SIZE - 1) & ~(PAGES_HUGE_SIZE - 1);
+
+        if (policy.size == PAGES_HUGETLB) {
+            memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory == MAP_FAILED) {
+                memory = NULL;
+                COUNT(hugetlbFallbacks, 1);
+            } else {
+                COUNT(hugetlbRegions, 1);
+            }
+        }
+        if (memory == NULL) {
+            memory = mapAligned(size);
+            if (memory != NULL && madvise(memory, size, MADV_HUGEPAGE) == 0) {
+                COUNT(advised, 1);
+            }
+        }
+    }
+
+    if (memory == NULL) {
+        fprintf(stderr, "Memory allocation failed for %zu-byte arena: %s\n",
+                size, strerror(errno));
+        return NULL;
+    }
+
+    bindRange(memory, size);
+    COUNT(regions, 1);
+    COUNT(bytes, size);
+    *mapped = size;
+    return memory;
+}
+
+void Pages_Free(void *memory, size_t mapped) {
+    if (memory == NULL) {
+        return;
+    }
+
+    munmap(memory, mapped);
+    __atomic_sub_fetch(&stats.bytes, (uint64_t)mapped, __ATOMIC_RELAXED);
+}
+
+void Pages_Advise(void *memory, size_t size) {
+    uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)memory + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)memory + size) & ~(pageSize - 1);
+
+    if (!Pages_Enabled() || end <= start) {
+        return;
+    }
+
+    if (policy.size != PAGES_SMALL &&
+        madvise((void*)start, end - start, MADV_HUGEPAGE) == 0) {
+        COUNT(advised, 1);
+    }
+    bindRange((void*)start, end - start);
+}
+
+/* ============= Workers ============= */
+
+int Pages_PinWorker(int worker) {
+    char path[64];
+    char line[1024];
+    int nodes[MAX_NODES];
+    int cpus[CPU_SETSIZE];
+    cpu_set_t set;
+
+    if (!policy.pinWorkers || worker < 0) {
+        return 0;
+    }
+
+    int node = nodes[worker % onlineNodes(nodes)];
+    int count = 0;
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    if (readLine(path, line, sizeof(line)) == 0) {
+        count = parseList(line, cpus, CPU_SETSIZE);
+    }
+
+    CPU_ZERO(&set);
+    if (count > 0) {
+        for (int i = 0; i < count; i++) {
+            CPU_SET(cpus[i], &set);
+        }
+    } else {
+        /* No topology: spread workers over the online CPUs instead */
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        CPU_SET(online > 0 ? worker % (int)online : 0, &set);
+    }
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return 0;
+    }
+    COUNT(pinned, 1);
+    return 1;
+}
@@ -0,0 +1,140 @@
+#ifndef PAGES_H
+#define PAGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file PAGES.h
+ * @brief Huge-page and NUMA placement for the large catalog arenas
+ *
+ * Large catalogs spend much of a tree descent or a column scan on TLB
+ * misses. A process-wide policy, off by default, lets the big arenas
+ * (red-black tree node slabs, the library's book array, sort key
+ * buffers) ask for 2 MiB pages and a NUMA placement:
+ *
+ *   - transparent huge pages: regions are aligned to 2 MiB and marked
+ *     with madvise(MADV_HUGEPAGE), which works whenever THP is set to
+ *     "always" or "madvise";
+ *   - hugetlb pages: regions are mapped with MAP_HUGETLB from the
+ *     reserved pool (vm.nr_hugepages) and fall back to transparent huge
+ *     pages when the pool is empty;
+ *   - NUMA: memory is bound to the local node, interleaved over every
+ *     online node or bound to one node, with mbind(2) called directly
+ *     so libnuma is not needed. Where the kernel has no NUMA support
+ *     the request is counted as failed and memory is placed as usual.
+ *
+ * With worker pinning on, a thread working on shard n of a parallel job
+ * runs on the CPUs of node n modulo the node count, so the part of the
+ * data it first touches is local to it.
+ *
+ * Set the policy once, before building the structures it should apply
+ * to; memory already allocated keeps the placement it was given.
+ */
+
+#define PAGES_HUGE_SIZE ((size_t)2 << 20)
+
+/* Page size for the arenas */
+typedef enum {
+    PAGES_SMALL = 0,                  /* Ordinary pages, as malloc gives */
+    PAGES_TRANSPARENT,                /* Transparent huge pages via madvise */
+    PAGES_HUGETLB                     /* Reserved huge pages, else transparent */
+} PagesSize;
+
+/* NUMA placement for the arenas */
+typedef enum {
+    PAGES_NUMA_DEFAULT = 0,           /* The process's policy, first touch */
+    PAGES_NUMA_LOCAL,                 /* Node of the CPU touching the page */
+    PAGES_NUMA_INTERLEAVE,            /* Round-robin over online nodes */
+    PAGES_NUMA_NODE                   /* One node, given by node */
+} PagesNuma;
+
+typedef struct {
+    PagesSize size;
+    PagesNuma numa;
+    int node;                         /* For PAGES_NUMA_NODE */
+    int pinWorkers;                   /* Pin shard workers to their node */
+} PagesPolicy;
+
+/* What the policy has done so far */
+typedef struct {
+    uint64_t regions;                 /* Regions mapped by Pages_Alloc */
+    uint64_t bytes;                   /* Bytes currently mapped by Pages_Alloc */
+    uint64_t hugetlbRegions;          /* Regions backed by reserved huge pages */
+    uint64_t hugetlbFallbacks;        /* MAP_HUGETLB refused; THP used instead */
+    uint64_t advised;                 /* Ranges marked for transparent huge pages */
+    uint64_t numaBound;               /* Ranges given a NUMA placement */
+    uint64_t numaFailed;              /* mbind refused, usually no NUMA kernel */
+    uint64_t pinned;                  /* Workers pinned to a node's CPUs */
+} PagesStats;
+
+/**
+ * @brief Parse a policy such as "thp,interleave,pin"
+ *
+ * Comma-separated words: "small", "thp" or "hugetlb" for the page size;
+ * "local", "interleave" or "node=N" for placement; "pin" to pin
+ * workers; "off" for the default policy.
+ *
+ * @param text Policy text
+ * @param policy Receives the parsed policy
+ * @return 0 on success, -1 on an unknown word
+ */
+int Pages_ParsePolicy(const char *text, PagesPolicy *policy);
+
+/**
+ * @brief Write a policy back in the form Pages_ParsePolicy reads
+ */
+void Pages_FormatPolicy(const PagesPolicy *policy, char *out, size_t out_len);
+
+/**
+ * @brief Set the process-wide policy; not thread-safe
+ */
+void Pages_SetPolicy(const PagesPolicy *policy);
+
+/**
+ * @brief Copy the current policy
+ */
+void Pages_GetPolicy(PagesPolicy *policy);
+
+/**
+ * @brief Whether the policy asks for huge pages or a NUMA placement
+ *
+ * Arenas allocate as before when this is 0.
+ */
+int Pages_Enabled(void);
+
+/**
+ * @brief Map zeroed memory placed by the policy
+ * @param size Bytes needed
+ * @param mapped Receives the bytes actually mapped, to pass to Pages_Free
+ * @return Start of the region, or NULL on failure
+ */
+void* Pages_Alloc(size_t size, size_t *mapped);
+
+/**
+ * @brief Unmap a region from Pages_Alloc
+ */
+void Pages_Free(void *memory, size_t mapped);
+
+/**
+ * @brief Apply the policy to memory that is already allocated
+ *
+ * Only whole pages inside the range are affected, and only pages not
+ * yet touched get the NUMA placement, so call it right after
+ * allocating a large buffer.
+ */
+void Pages_Advise(void *memory, size_t size);
+
+/**
+ * @brief Pin the calling worker thread to the CPUs of its shard's node
+ * @param worker Shard index of the calling thread
+ * @return 1 if pinned, 0 if pinning is off or not possible
+ */
+int Pages_PinWorker(int worker);
+
+/**
+ * @brief Copy the policy's counters
+ */
+void Pages_GetStats(PagesStats *stats);
+
+#endif /* PAGES_H */
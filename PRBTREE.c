@@ -0,0 +1,585 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "PRBTREE.h"
+
+/* Height bound for walks: 2*log2(n+1) for any tree in memory */
+#define PRB_MAX_HEIGHT 128
+
+/*
+ * Writes should not fail halfway through a rebalance, so before each
+ * write the spare list is topped up with enough nodes for every copy
+ * and new node it can need. A delete may copy the path node, its
+ * sibling and a nephew on the way down and the other children in the
+ * rebalance on the way up; five per level covers that.
+ */
+#define PRB_NODES_PER_LEVEL 5
+
+/**
+ * Take a reference to a node
+ * @param node: The node, or NULL
+ */
+static inline void retainNode(PRBNode *node) {
+    if (node != NULL) {
+        __atomic_add_fetch(&node->refs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Drop a reference to a node, freeing it and dropping its children's
+ * references when it was the last one
+ * @param tree: The tree the node belongs to
+ * @param node: The node, or NULL
+ */
+static void dropNode(PRBTree *tree, PRBNode *node) {
+    /* Freed nodes double as stack cells holding a pending right child */
+    PRBNode *cells = NULL;
+
+    for (;;) {
+        if (node != NULL && __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+            PRBNode *left = node->left;
+            node->data = node->right;
+            node->left = cells;
+            cells = node;
+            node = left;
+            continue;
+        }
+        if (cells == NULL) {
+            break;
+        }
+
+        PRBNode *cell = cells;
+        cells = cell->left;
+        node = (PRBNode*)cell->data;
+        free(cell);
+        __atomic_sub_fetch(&tree->liveNodes, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Make sure the spare list covers the worst case of one write
+ * @param tree: Pointer to the tree
+ * @return: 0 on success, -1 on allocation failure
+ */
+static int reserveNodes(PRBTree *tree) {
+    size_t levels = 2;
+
+    for (size_t n = tree->size + 1; n > 1; n >>= 1) {
+        levels += 2;
+    }
+
+    size_t needed = levels * PRB_NODES_PER_LEVEL;
+    while (tree->spareCount < needed) {
+        PRBNode *node = (PRBNode*)malloc(sizeof(PRBNode));
+        if (node == NULL) {
+            fprintf(stderr, "Memory allocation failed for persistent tree node\n");
+            return -1;
+        }
+        node->left = tree->spare;
+        tree->spare = node;
+        tree->spareCount++;
+    }
+
+    return 0;
+}
+
+/**
+ * Take a node from the spare list (filled by reserveNodes)
+ */
+static PRBNode* takeSpare(PRBTree *tree) {
+    PRBNode *node = tree->spare;
+
+    if (node == NULL) {
+        /* Only if the reserve estimate is wrong; there is no way back */
+        node = (PRBNode*)malloc(sizeof(PRBNode));
+        if (node == NULL) {
+            fprintf(stderr, "Memory allocation failed during persistent tree rebalance\n");
+            abort();
+        }
+        __atomic_add_fetch(&tree->liveNodes, 1, __ATOMIC_RELAXED);
+        return node;
+    }
+    tree->spare = node->left;
+    tree->spareCount--;
+    __atomic_add_fetch(&tree->liveNodes, 1, __ATOMIC_RELAXED);
+
+    return node;
+}
+
+/**
+ * Free a node the writer holds the only reference to
+ */
+static void freeOwnedNode(PRBTree *tree, PRBNode *node) {
+    free(node);
+    __atomic_sub_fetch(&tree->liveNodes, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Get a version of a node the writer may modify
+ *
+ * A node with one reference belongs to the live tree alone (the caller
+ * reached it through nodes it already owns) and is returned as is.
+ * A shared node is replaced by a private copy.
+ *
+ * @param tree: Pointer to the tree
+ * @param node: The node, or NULL
+ * @return: The node itself or its copy, to be stored in the parent
+ */
+static PRBNode* ownNode(PRBTree *tree, PRBNode *node) {
+    if (node == NULL || __atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) == 1) {
+        return node;
+    }
+
+    /* Field by field: a reader may be dropping node->refs meanwhile */
+    PRBNode *copy = takeSpare(tree);
+    copy->key = node->key;
+    copy->color = node->color;
+    copy->refs = 1;
+    copy->data = node->data;
+    copy->left = node->left;
+    copy->right = node->right;
+    retainNode(copy->left);
+    retainNode(copy->right);
+    dropNode(tree, node);
+    tree->copies++;
+
+    return copy;
+}
+
+static inline int isRed(const PRBNode *node) {
+    return node != NULL && node->color == RED;
+}
+
+/**
+ * Rotate an owned node's right child up
+ * @return: The new subtree root
+ */
+static PRBNode* rotateLeft(PRBTree *tree, PRBNode *node) {
+    PRBNode *child = ownNode(tree, node->right);
+
+    node->right = child->left;
+    child->left = node;
+    child->color = node->color;
+    node->color = RED;
+
+    return child;
+}
+
+/**
+ * Rotate an owned node's left child up
+ * @return: The new subtree root
+ */
+static PRBNode* rotateRight(PRBTree *tree, PRBNode *node) {
+    PRBNode *child = ownNode(tree, node->left);
+
+    node->left = child->right;
+    child->right = node;
+    child->color = node->color;
+    node->color = RED;
+
+    return child;
+}
+
+/**
+ * Flip the colors of an owned node and its two children
+ */
+static void flipColors(PRBTree *tree, PRBNode *node) {
+    node->left = ownNode(tree, node->left);
+    node->right = ownNode(tree, node->right);
+
+    node->color = node->color == RED ? BLACK : RED;
+    node->left->color = node->left->color == RED ? BLACK : RED;
+    node->right->color = node->right->color == RED ? BLACK : RED;
+}
+
+/**
+ * Restore the left-leaning invariants at an owned node
+ * @return: The new subtree root
+ */
+static PRBNode* balance(PRBTree *tree, PRBNode *node) {
+    if (isRed(node->right) && !isRed(node->left)) {
+        node = rotateLeft(tree, node);
+    }
+    if (isRed(node->left) && isRed(node->left->left)) {
+        node = rotateRight(tree, node);
+    }
+    if (isRed(node->left) && isRed(node->right)) {
+        flipColors(tree, node);
+    }
+
+    return node;
+}
+
+/**
+ * Insert a key that is not in the subtree
+ * @return: The new subtree root
+ */
+static PRBNode* insertAt(PRBTree *tree, PRBNode *node, int key, void *data) {
+    if (node == NULL) {
+        node = takeSpare(tree);
+        node->key = key;
+        node->color = RED;
+        node->refs = 1;
+        node->data = data;
+        node->left = NULL;
+        node->right = NULL;
+        return node;
+    }
+
+    node = ownNode(tree, node);
+    if (key < node->key) {
+        node->left = insertAt(tree, node->left, key, data);
+    } else {
+        node->right = insertAt(tree, node->right, key, data);
+    }
+
+    return balance(tree, node);
+}
+
+/**
+ * Borrow a red link from the right for a descent to the left
+ */
+static PRBNode* moveRedLeft(PRBTree *tree, PRBNode *node) {
+    flipColors(tree, node);
+    if (isRed(node->right->left)) {
+        node->right = rotateRight(tree, node->right);
+        node = rotateLeft(tree, node);
+        flipColors(tree, node);
+    }
+
+    return node;
+}
+
+/**
+ * Borrow a red link from the left for a descent to the right
+ */
+static PRBNode* moveRedRight(PRBTree *tree, PRBNode *node) {
+    flipColors(tree, node);
+    if (isRed(node->left->left)) {
+        node = rotateRight(tree, node);
+        flipColors(tree, node);
+    }
+
+    return node;
+}
+
+/**
+ * Delete the smallest key of an owned subtree
+ * @param removed: Out: the detached node, for the caller to free
+ * @return: The new subtree root
+ */
+static PRBNode* deleteMin(PRBTree *tree, PRBNode *node, PRBNode **removed) {
+    if (node->left == NULL) {
+        *removed = node;
+        return NULL;
+    }
+
+    if (!isRed(node->left) && !isRed(node->left->left)) {
+        node = moveRedLeft(tree, node);
+    }
+    node->left = ownNode(tree, node->left);
+    node->left = deleteMin(tree, node->left, removed);
+
+    return balance(tree, node);
+}
+
+/**
+ * Delete a key known to be in the subtree
+ * @return: The new subtree root
+ */
+static PRBNode* deleteAt(PRBTree *tree, PRBNode *node, int key) {
+    node = ownNode(tree, node);
+
+    if (key < node->key) {
+        if (!isRed(node->left) && !isRed(node->left->left)) {
+            node = moveRedLeft(tree, node);
+        }
+        node->left = deleteAt(tree, node->left, key);
+    } else {
+        if (isRed(node->left)) {
+            node = rotateRight(tree, node);
+        }
+        if (key == node->key && node->right == NULL) {
+            freeOwnedNode(tree, node);
+            return NULL;
+        }
+        if (!isRed(node->right) && !isRed(node->right->left)) {
+            node = moveRedRight(tree, node);
+        }
+        if (key == node->key) {
+            PRBNode *successor = NULL;
+            node->right = ownNode(tree, node->right);
+            node->right = deleteMin(tree, node->right, &successor);
+            node->key = successor->key;
+            node->data = successor->data;
+            freeOwnedNode(tree, successor);
+        } else {
+            node->right = deleteAt(tree, node->right, key);
+        }
+    }
+
+    return balance(tree, node);
+}
+
+/**
+ * Find the node holding a key below a root
+ */
+static PRBNode* findNode(PRBNode *node, int key) {
+    while (node != NULL && node->key != key) {
+        node = key < node->key ? node->left : node->right;
+    }
+
+    return node;
+}
+
+PRBTree* PRBTree_Create(void) {
+    PRBTree *tree = (PRBTree*)calloc(1, sizeof(PRBTree));
+    if (tree == NULL) {
+        fprintf(stderr, "Memory allocation failed for persistent tree\n");
+        return NULL;
+    }
+
+    return tree;
+}
+
+void PRBTree_Destroy(PRBTree *tree) {
+    if (tree == NULL) {
+        return;
+    }
+
+    dropNode(tree, tree->root);
+    while (tree->spare != NULL) {
+        PRBNode *next = tree->spare->left;
+        free(tree->spare);
+        tree->spare = next;
+    }
+    free(tree);
+}
+
+int PRBTree_Insert(PRBTree *tree, int key, void *data) {
+    if (tree == NULL || data == NULL) {
+        return -1;
+    }
+    if (findNode(tree->root, key) != NULL) {
+        return 0;
+    }
+    if (reserveNodes(tree) != 0) {
+        return -1;
+    }
+
+    tree->root = insertAt(tree, tree->root, key, data);
+    tree->root->color = BLACK;
+    tree->size++;
+
+    return 1;
+}
+
+int PRBTree_Update(PRBTree *tree, int key, void *data) {
+    if (tree == NULL || data == NULL) {
+        return -1;
+    }
+    if (findNode(tree->root, key) == NULL) {
+        return 0;
+    }
+    if (reserveNodes(tree) != 0) {
+        return -1;
+    }
+
+    /* Copy the path down to the node, then change the owned copy */
+    PRBNode **link = &tree->root;
+    for (;;) {
+        PRBNode *node = ownNode(tree, *link);
+        *link = node;
+        if (node->key == key) {
+            node->data = data;
+            return 1;
+        }
+        link = key < node->key ? &node->left : &node->right;
+    }
+}
+
+int PRBTree_Delete(PRBTree *tree, int key) {
+    if (tree == NULL) {
+        return -1;
+    }
+    if (findNode(tree->root, key) == NULL) {
+        return 0;
+    }
+    if (reserveNodes(tree) != 0) {
+        return -1;
+    }
+
+    tree->root = ownNode(tree, tree->root);
+    if (!isRed(tree->root->left) && !isRed(tree->root->right)) {
+        tree->root->color = RED;
+    }
+    tree->root = deleteAt(tree, tree->root, key);
+    if (tree->root != NULL) {
+        tree->root->color = BLACK;
+    }
+    tree->size--;
+
+    return 1;
+}
+
+void* PRBTree_Search(const PRBTree *tree, int key) {
+    PRBNode *node = tree != NULL ? findNode(tree->root, key) : NULL;
+    return node != NULL ? node->data : NULL;
+}
+
+int PRBTree_Snapshot(PRBTree *tree, PRBSnapshot *snapshot) {
+    if (tree == NULL || snapshot == NULL) {
+        return -1;
+    }
+
+    retainNode(tree->root);
+    snapshot->tree = tree;
+    snapshot->root = tree->root;
+    snapshot->size = tree->size;
+
+    return 0;
+}
+
+void PRBSnapshot_Release(PRBSnapshot *snapshot) {
+    if (snapshot == NULL || snapshot->tree == NULL) {
+        return;
+    }
+
+    dropNode(snapshot->tree, snapshot->root);
+    snapshot->tree = NULL;
+    snapshot->root = NULL;
+    snapshot->size = 0;
+}
+
+void* PRBSnapshot_Search(const PRBSnapshot *snapshot, int key) {
+    PRBNode *node = snapshot != NULL ? findNode(snapshot->root, key) : NULL;
+    return node != NULL ? node->data : NULL;
+}
+
+size_t PRBSnapshot_InOrder(const PRBSnapshot *snapshot,
+                           void (*callback)(int, void*)) {
+    if (snapshot == NULL || callback == NULL) {
+        return 0;
+    }
+
+    PRBNode *stack[PRB_MAX_HEIGHT];
+    PRBNode *node = snapshot->root;
+    int top = 0;
+    size_t count = 0;
+
+    for (;;) {
+        while (node != NULL) {
+            stack[top++] = node;
+            node = node->left;
+        }
+        if (top == 0) {
+            break;
+        }
+        node = stack[--top];
+        callback(node->key, node->data);
+        count++;
+        node = node->right;
+    }
+
+    return count;
+}
+
+size_t PRBSnapshot_Values(const PRBSnapshot *snapshot, void **values,
+                          size_t capacity) {
+    if (snapshot == NULL || values == NULL) {
+        return 0;
+    }
+
+    PRBNode *stack[PRB_MAX_HEIGHT];
+    PRBNode *node = snapshot->root;
+    int top = 0;
+    size_t count = 0;
+
+    while (count < capacity) {
+        while (node != NULL) {
+            stack[top++] = node;
+            node = node->left;
+        }
+        if (top == 0) {
+            break;
+        }
+        node = stack[--top];
+        values[count++] = node->data;
+        node = node->right;
+    }
+
+    return count;
+}
+
+int PRBSnapshot_Verify(const PRBSnapshot *snapshot) {
+    if (snapshot == NULL) {
+        return 0;
+    }
+    if (isRed(snapshot->root)) {
+        fprintf(stderr, "Validation Error: Root is not BLACK\n");
+        return 0;
+    }
+
+    /* In-order pass remembering the black count down to each node */
+    PRBNode *stack[PRB_MAX_HEIGHT];
+    int blackStack[PRB_MAX_HEIGHT];
+    int top = 0;
+    int blacks = 0;
+    int leafBlacks = -1;
+    size_t count = 0;
+    PRBNode *previous = NULL;
+    PRBNode *node = snapshot->root;
+
+    for (;;) {
+        while (node != NULL) {
+            if (top == PRB_MAX_HEIGHT) {
+                fprintf(stderr, "Validation Error: Tree deeper than %d levels\n", PRB_MAX_HEIGHT);
+                return 0;
+            }
+            if (isRed(node->right) || (isRed(node) && isRed(node->left))) {
+                fprintf(stderr, "Validation Error: Red link misplaced at %d\n", node->key);
+                return 0;
+            }
+            blacks += !isRed(node);
+            if (node->left == NULL) {
+                if (leafBlacks < 0) {
+                    leafBlacks = blacks;
+                } else if (blacks != leafBlacks) {
+                    fprintf(stderr, "Validation Error: Unequal black height below %d\n", node->key);
+                    return 0;
+                }
+            }
+            stack[top] = node;
+            blackStack[top++] = blacks;
+            node = node->left;
+        }
+        if (top == 0) {
+            break;
+        }
+
+        node = stack[--top];
+        blacks = blackStack[top];
+        if (previous != NULL && previous->key >= node->key) {
+            fprintf(stderr, "Validation Error: Key %d follows %d in order\n",
+                    node->key, previous->key);
+            return 0;
+        }
+        if (node->right == NULL && blacks != leafBlacks) {
+            fprintf(stderr, "Validation Error: Unequal black height below %d\n", node->key);
+            return 0;
+        }
+        if (++count > snapshot->size) {
+            fprintf(stderr, "Validation Error: More nodes than size %zu\n", snapshot->size);
+            return 0;
+        }
+        previous = node;
+        node = node->right;
+    }
+
+    if (count != snapshot->size) {
+        fprintf(stderr, "Validation Error: Found %zu nodes, size is %zu\n", count, snapshot->size);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,142 @@
+#ifndef PRBTREE_H
+#define PRBTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "RBTREE.h"
+
+/**
+ * @file PRBTREE.h
+ * @brief Persistent (copy-on-write) red-black tree with O(1) snapshots
+ *
+ * A left-leaning red-black tree whose nodes are reference counted. A
+ * snapshot pins the current root by taking one more reference; later
+ * writes copy each shared node on their path (path copying) and leave
+ * the snapshot's version untouched. A node held only by the live tree
+ * has a single reference and is updated in place, so writes with no
+ * snapshot outstanding copy nothing.
+ *
+ * A node is freed when its last reference goes, whether that is the
+ * writer replacing it or a snapshot being released. Reference counts
+ * are atomic, so snapshots may be read and released on other threads
+ * while the single writer continues. The writer itself is not
+ * thread-safe, and every snapshot must be released before the tree is
+ * destroyed.
+ *
+ * Data pointers are borrowed: neither the tree nor its snapshots free
+ * them, since several versions may share one.
+ */
+
+/* Node of the persistent tree; immutable once shared */
+typedef struct PRBNode {
+    int key;                          /* Unique key for the node */
+    Color color;                      /* RED or BLACK (of the link above) */
+    uint32_t refs;                    /* Parents and versions holding it */
+    void *data;                       /* Pointer to associated data */
+    struct PRBNode *left;             /* Pointer to left child */
+    struct PRBNode *right;            /* Pointer to right child */
+} PRBNode;
+
+/* The live, writable version */
+typedef struct {
+    PRBNode *root;                    /* Pointer to root node */
+    size_t size;                      /* Number of keys */
+    size_t liveNodes;                 /* Nodes allocated across all versions */
+    size_t copies;                    /* Nodes copied because they were shared */
+    PRBNode *spare;                   /* Preallocated nodes, linked via left */
+    size_t spareCount;                /* Nodes on the spare list */
+} PRBTree;
+
+/* A frozen version of a tree */
+typedef struct {
+    PRBTree *tree;                    /* Tree the version came from */
+    PRBNode *root;                    /* Pinned root, or NULL if empty */
+    size_t size;                      /* Number of keys in the version */
+} PRBSnapshot;
+
+/**
+ * @brief Create an empty persistent tree
+ * @return Pointer to the new tree, or NULL on failure
+ */
+PRBTree* PRBTree_Create(void);
+
+/**
+ * @brief Destroy a persistent tree
+ * @param tree Pointer to the tree; all its snapshots must be released
+ */
+void PRBTree_Destroy(PRBTree *tree);
+
+/**
+ * @brief Insert a key-value pair
+ * @param tree Pointer to the tree
+ * @param key The key to insert
+ * @param data Pointer to the data associated with the key
+ * @return 1 on success, 0 if key already exists, -1 on failure
+ */
+int PRBTree_Insert(PRBTree *tree, int key, void *data);
+
+/**
+ * @brief Replace the data of an existing key
+ * @return 1 if updated, 0 if key not found, -1 on failure
+ */
+int PRBTree_Update(PRBTree *tree, int key, void *data);
+
+/**
+ * @brief Delete a key
+ * @return 1 if key was deleted, 0 if key not found, -1 on failure
+ */
+int PRBTree_Delete(PRBTree *tree, int key);
+
+/**
+ * @brief Search the live version for a key
+ * @return Data pointer if found, NULL otherwise
+ */
+void* PRBTree_Search(const PRBTree *tree, int key);
+
+/**
+ * @brief Pin the current version of a tree in O(1)
+ * @param tree Pointer to the tree
+ * @param snapshot Filled with the new snapshot
+ * @return 0 on success, -1 on failure
+ */
+int PRBTree_Snapshot(PRBTree *tree, PRBSnapshot *snapshot);
+
+/**
+ * @brief Release a snapshot, freeing nodes no other version uses
+ * @param snapshot The snapshot; emptied on return
+ */
+void PRBSnapshot_Release(PRBSnapshot *snapshot);
+
+/**
+ * @brief Search a snapshot for a key
+ * @return Data pointer if found, NULL otherwise
+ */
+void* PRBSnapshot_Search(const PRBSnapshot *snapshot, int key);
+
+/**
+ * @brief Call a callback for every key of a snapshot in key order
+ * @return Number of keys visited
+ */
+size_t PRBSnapshot_InOrder(const PRBSnapshot *snapshot,
+                           void (*callback)(int, void*));
+
+/**
+ * @brief Copy a snapshot's data pointers in key order
+ * @param values Receives up to capacity pointers; snapshot->size suffices
+ * @return Number of pointers stored
+ */
+size_t PRBSnapshot_Values(const PRBSnapshot *snapshot, void **values,
+                          size_t capacity);
+
+/**
+ * @brief Check a snapshot's red-black invariants (for debugging)
+ *
+ * Checks key order, left-leaning red links, black height and the
+ * stored size, printing the first violation to stderr.
+ *
+ * @return 1 if valid, 0 otherwise
+ */
+int PRBSnapshot_Verify(const PRBSnapshot *snapshot);
+
+#endif /* PRBTREE_H */
@@ -0,0 +1,808 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "METRICS.h"
+#include "QUERY.h"
+#include "SORT.h"
+#include "TEXT.h"
+
+/* ============= Predicate Construction ============= */
+
+static int isTextField(BookField field) {
+    return field == FIELD_TITLE || field == FIELD_AUTHOR || field == FIELD_ISBN;
+}
+
+/**
+ * Convert a numeric bound to the integer domain the executor compares in
+ * @param field: The field the bound applies to
+ * @param value: The bound as given by the caller
+ * @return: The bound (price in cents, other fields truncated)
+ */
+static long fieldKey(BookField field, double value) {
+    if (field == FIELD_PRICE) {
+        return (long)libraryPriceKey((float)value);
+    }
+    if (value <= (double)LONG_MIN) {
+        return LONG_MIN;
+    }
+    if (value >= (double)LONG_MAX) {
+        return LONG_MAX;
+    }
+    return (long)value;
+}
+
+static Predicate* newPredicate(PredicateKind kind, BookField field) {
+    Predicate *predicate = (Predicate*)calloc(1, sizeof(Predicate));
+    if (predicate == NULL) {
+        fprintf(stderr, "Memory allocation failed for predicate\n");
+        return NULL;
+    }
+
+    predicate->kind = kind;
+    predicate->field = field;
+
+    return predicate;
+}
+
+static Predicate* newTextPredicate(PredicateKind kind, BookField field,
+                                   const char *text) {
+    if (!isTextField(field) || text == NULL) {
+        return NULL;
+    }
+
+    Predicate *predicate = newPredicate(kind, field);
+    if (predicate == NULL) {
+        return NULL;
+    }
+
+    /* A stray Latin-1 byte can fold to two letters */
+    size_t len = strlen(text);
+    size_t size = field == FIELD_ISBN ? len + 1 : 2 * len + 1;
+    predicate->text = (char*)malloc(size);
+    if (predicate->text == NULL) {
+        fprintf(stderr, "Memory allocation failed for predicate\n");
+        free(predicate);
+        return NULL;
+    }
+
+    /*
+     * ISBN equality compares normalized forms on both sides; titles and
+     * authors are matched against their folded columns
+     */
+    if (field != FIELD_ISBN) {
+        Text_Fold(text, predicate->text, size);
+    } else if (kind == PRED_EQ) {
+        Index_NormalizeIsbn(text, predicate->text, size);
+    } else {
+        memcpy(predicate->text, text, size);
+    }
+    StrKey_Make(&predicate->key, predicate->text);
+
+    return predicate;
+}
+
+Predicate* Predicate_Equals(BookField field, double value) {
+    return Predicate_Range(field, value, value);
+}
+
+Predicate* Predicate_EqualsText(BookField field, const char *text) {
+    return newTextPredicate(PRED_EQ, field, text);
+}
+
+Predicate* Predicate_Range(BookField field, double lo, double hi) {
+    if (isTextField(field)) {
+        return NULL;
+    }
+
+    Predicate *predicate = newPredicate(lo == hi ? PRED_EQ : PRED_RANGE, field);
+    if (predicate == NULL) {
+        return NULL;
+    }
+
+    predicate->lo = fieldKey(field, lo);
+    predicate->hi = fieldKey(field, hi);
+
+    return predicate;
+}
+
+Predicate* Predicate_Contains(BookField field, const char *text) {
+    return newTextPredicate(PRED_SUBSTRING, field, text);
+}
+
+static Predicate* combine(PredicateKind kind, Predicate *left, Predicate *right) {
+    Predicate *predicate = NULL;
+
+    if (left != NULL && right != NULL) {
+        predicate = newPredicate(kind, FIELD_ID);
+    }
+    if (predicate == NULL) {
+        Predicate_Free(left);
+        Predicate_Free(right);
+        return NULL;
+    }
+
+    predicate->left = left;
+    predicate->right = right;
+
+    return predicate;
+}
+
+Predicate* Predicate_And(Predicate *left, Predicate *right) {
+    return combine(PRED_AND, left, right);
+}
+
+Predicate* Predicate_Or(Predicate *left, Predicate *right) {
+    return combine(PRED_OR, left, right);
+}
+
+void Predicate_Free(Predicate *predicate) {
+    if (predicate == NULL) {
+        return;
+    }
+
+    Predicate_Free(predicate->left);
+    Predicate_Free(predicate->right);
+    free(predicate->text);
+    free(predicate);
+}
+
+Predicate* Predicate_Copy(const Predicate *predicate) {
+    if (predicate == NULL) {
+        return NULL;
+    }
+
+    Predicate *copy = newPredicate(predicate->kind, predicate->field);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    copy->lo = predicate->lo;
+    copy->hi = predicate->hi;
+    if (predicate->text != NULL) {
+        copy->text = strdup(predicate->text);
+        if (copy->text == NULL) {
+            fprintf(stderr, "Memory allocation failed for predicate\n");
+            free(copy);
+            return NULL;
+        }
+        StrKey_Make(&copy->key, copy->text);
+    }
+    if (predicate->left != NULL) {
+        copy->left = Predicate_Copy(predicate->left);
+        copy->right = Predicate_Copy(predicate->right);
+        if (copy->left == NULL || copy->right == NULL) {
+            Predicate_Free(copy);
+            return NULL;
+        }
+    }
+
+    return copy;
+}
+
+void Query_Init(Query *query) {
+    query->where = NULL;
+    query->ordered = 0;
+    query->orderBy = FIELD_ID;
+    query->descending = 0;
+    query->offset = 0;
+    query->limit = QUERY_NO_LIMIT;
+}
+
+/* ============= Planning ============= */
+
+static int clampInt(long value) {
+    if (value < INT_MIN) {
+        return INT_MIN;
+    }
+    if (value > INT_MAX) {
+        return INT_MAX;
+    }
+    return (int)value;
+}
+
+/**
+ * Narrow an index probe range with another conjunct's bounds
+ */
+static void intersectRange(int *has, int *min, int *max, long lo, long hi) {
+    if (!*has) {
+        *has = 1;
+        *min = INT_MIN;
+        *max = INT_MAX;
+    }
+    if (clampInt(lo) > *min) {
+        *min = clampInt(lo);
+    }
+    if (clampInt(hi) < *max) {
+        *max = clampInt(hi);
+    }
+}
+
+/**
+ * Collect indexable bounds from the AND-connected leaves of a predicate
+ * @param predicate: The predicate (sub)tree
+ * @param probe: Filter receiving the pushed-down bounds
+ */
+static void pushDown(const Predicate *predicate, BookFilter *probe) {
+    if (predicate == NULL) {
+        return;
+    }
+
+    switch (predicate->kind) {
+        case PRED_AND:
+            pushDown(predicate->left, probe);
+            pushDown(predicate->right, probe);
+            break;
+        case PRED_EQ:
+            if (predicate->field == FIELD_ID && !probe->hasId) {
+                probe->hasId = 1;
+                probe->id = clampInt(predicate->lo);
+                break;
+            }
+            if (predicate->field == FIELD_ISBN) {
+                probe->isbn = predicate->text;
+                break;
+            }
+            /* fall through */
+        case PRED_RANGE:
+            if (predicate->field == FIELD_YEAR) {
+                intersectRange(&probe->hasYear, &probe->yearMin,
+                               &probe->yearMax, predicate->lo, predicate->hi);
+            } else if (predicate->field == FIELD_PRICE) {
+                intersectRange(&probe->hasPrice, &probe->priceMin,
+                               &probe->priceMax, predicate->lo, predicate->hi);
+            }
+            break;
+        case PRED_SUBSTRING:
+        case PRED_OR:
+            /* Not answerable by a single index probe */
+            break;
+    }
+}
+
+/**
+ * Get the index whose key order matches a field's listing order
+ */
+static AccessPath orderingIndex(BookField field) {
+    switch (field) {
+        case FIELD_ID:
+            return ACCESS_ID_INDEX;
+        case FIELD_YEAR:
+            return ACCESS_YEAR_INDEX;
+        case FIELD_PRICE:
+            return ACCESS_PRICE_INDEX;
+        default:
+            return ACCESS_FULL_SCAN;
+    }
+}
+
+void Query_Plan(const Library *library, const Query *query, QueryPlan *plan) {
+    memset(&plan->probe, 0, sizeof(plan->probe));
+    pushDown(query->where, &plan->probe);
+    plan->access = libraryChooseIndex(library, &plan->probe, &plan->estimate);
+    plan->ordered = 0;
+
+    /*
+     * Walking the sort field's index replaces the sort, unless a
+     * different index already narrows the candidates further.
+     */
+    if (query->ordered) {
+        AccessPath order = orderingIndex(query->orderBy);
+        if (order != ACCESS_FULL_SCAN &&
+            (plan->access == ACCESS_FULL_SCAN || plan->access == order)) {
+            plan->access = order;
+            plan->ordered = 1;
+        }
+    }
+}
+
+const char* Query_AccessPathName(AccessPath access) {
+    switch (access) {
+        case ACCESS_ID_INDEX:
+            return "id index";
+        case ACCESS_ISBN_INDEX:
+            return "isbn index";
+        case ACCESS_YEAR_INDEX:
+            return "year index";
+        case ACCESS_PRICE_INDEX:
+            return "price index";
+        case ACCESS_FULL_SCAN:
+        default:
+            return "full scan";
+    }
+}
+
+/* ============= Batch Filtering ============= */
+
+/* One batch of candidate rows and the arrays used to filter it */
+typedef struct {
+    const Book *books;                /* library->books */
+    const BookKeys *keys;             /* library->keys, or NULL for a lone book */
+    int rows[QUERY_BATCH_SIZE];       /* Positions in library->books */
+    long values[QUERY_BATCH_SIZE];    /* Materialized numeric column */
+} Batch;
+
+/**
+ * Gather one numeric field for the selected rows of a batch
+ */
+static void gatherColumn(Batch *batch, BookField field, const int *sel, int n) {
+    const Book *books = batch->books;
+    const int *rows = batch->rows;
+    long *values = batch->values;
+
+    switch (field) {
+        case FIELD_ID:
+            for (int i = 0; i < n; i++) values[i] = books[rows[sel[i]]].id;
+            break;
+        case FIELD_YEAR:
+            for (int i = 0; i < n; i++) values[i] = books[rows[sel[i]]].year;
+            break;
+        case FIELD_QUANTITY:
+            for (int i = 0; i < n; i++) values[i] = books[rows[sel[i]]].quantity;
+            break;
+        case FIELD_PRICE:
+            for (int i = 0; i < n; i++) {
+                values[i] = libraryPriceKey(books[rows[sel[i]]].price);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static const char* textField(const Book *book, BookField field) {
+    switch (field) {
+        case FIELD_TITLE:
+            return book->titleFolded;
+        case FIELD_AUTHOR:
+            return book->authorFolded;
+        default:
+            return book->isbn;
+    }
+}
+
+/* Header column compared with a text predicate's own header */
+static const StrKey* keyColumn(const BookKeys *keys, BookField field) {
+    switch (field) {
+        case FIELD_TITLE:
+            return keys->titleFolded;
+        case FIELD_AUTHOR:
+            return keys->authorFolded;
+        default:
+            return keys->isbnNormal;
+    }
+}
+
+/**
+ * Test a text equality predicate on the strings alone
+ */
+static int textEquals(const Predicate *predicate, const char *value) {
+    if (predicate->field == FIELD_ISBN) {
+        char isbn[INDEX_KEY_LEN];
+        Index_NormalizeIsbn(value, isbn, sizeof(isbn));
+        return strcmp(isbn, predicate->text) == 0;
+    }
+    return strcmp(value, predicate->text) == 0;
+}
+
+/**
+ * Evaluate a leaf predicate over a selection vector
+ * @param batch: The batch being filtered
+ * @param predicate: A leaf predicate
+ * @param sel: Ascending offsets into batch->rows
+ * @param n: Number of offsets in sel
+ * @param out: Receives the offsets that pass (may alias sel)
+ * @return: Number of offsets written to out
+ */
+static int filterLeaf(Batch *batch, const Predicate *predicate,
+                      const int *sel, int n, int *out) {
+    int kept = 0;
+
+    if (!isTextField(predicate->field)) {
+        long lo = predicate->lo;
+        long hi = predicate->hi;
+
+        gatherColumn(batch, predicate->field, sel, n);
+        for (int i = 0; i < n; i++) {
+            long value = batch->values[i];
+            out[kept] = sel[i];
+            kept += (value >= lo) & (value <= hi);
+        }
+        return kept;
+    }
+
+    const StrKey *wanted = &predicate->key;
+    const StrKey *column = batch->keys != NULL
+                           ? keyColumn(batch->keys, predicate->field) : NULL;
+
+    for (int i = 0; i < n; i++) {
+        int row = batch->rows[sel[i]];
+        const char *value = textField(&batch->books[row], predicate->field);
+        int match;
+
+        if (predicate->kind == PRED_SUBSTRING) {
+            match = strstr(value, predicate->text) != NULL;
+        } else if (column == NULL) {
+            match = textEquals(predicate, value);
+        } else if (predicate->field == FIELD_ISBN) {
+            /* The normalized text is not kept: rebuild it on a header match */
+            match = StrKey_SameHeader(&column[row], wanted) &&
+                    (wanted->length <= STRKEY_PREFIX_LEN ||
+                     textEquals(predicate, value));
+        } else {
+            match = StrKey_Equal(&column[row], value, wanted, predicate->text);
+        }
+
+        out[kept] = sel[i];
+        kept += match;
+    }
+
+    return kept;
+}
+
+/**
+ * Evaluate a predicate tree over a selection vector
+ * @return: Number of offsets written to out (out may alias sel)
+ */
+static int filterBatch(Batch *batch, const Predicate *predicate,
+                       const int *sel, int n, int *out) {
+    if (n == 0) {
+        return 0;
+    }
+
+    if (predicate->kind == PRED_AND) {
+        n = filterBatch(batch, predicate->left, sel, n, out);
+        return filterBatch(batch, predicate->right, out, n, out);
+    }
+
+    if (predicate->kind == PRED_OR) {
+        int left[QUERY_BATCH_SIZE];
+        int right[QUERY_BATCH_SIZE];
+        int nl = filterBatch(batch, predicate->left, sel, n, left);
+        int nr = filterBatch(batch, predicate->right, sel, n, right);
+        int i = 0, j = 0, kept = 0;
+
+        /* Both sides are ascending subsets of sel: merge without duplicates */
+        while (i < nl || j < nr) {
+            if (j == nr || (i < nl && left[i] < right[j])) {
+                out[kept++] = left[i++];
+            } else if (i == nl || right[j] < left[i]) {
+                out[kept++] = right[j++];
+            } else {
+                out[kept++] = left[i++];
+                j++;
+            }
+        }
+        return kept;
+    }
+
+    return filterLeaf(batch, predicate, sel, n, out);
+}
+
+int Predicate_Matches(const Predicate *predicate, const Book *book) {
+    Batch batch;
+    int sel = 0;
+
+    if (predicate == NULL) {
+        return 1;
+    }
+
+    batch.books = book;
+    batch.keys = NULL;
+    batch.rows[0] = 0;
+    return filterBatch(&batch, predicate, &sel, 1, &sel);
+}
+
+/* ============= Result Collection ============= */
+
+/* Destination for rows that pass the filter */
+typedef struct {
+    const Library *library;
+    const Query *query;
+    int *rows;                        /* Collected positions */
+    int count;
+    int capacity;
+    int sortAtEnd;                    /* Rows arrive unordered and need sorting */
+    int keep;                         /* Bounded heap size, or 0 if unbounded */
+    int skipped;                      /* Streaming: rows skipped for offset */
+    int done;                         /* Streaming: limit reached */
+} Sink;
+
+/**
+ * Compare two rows in result order
+ * @return: Negative if row a comes first, positive if row b does
+ */
+static int compareRows(const Sink *sink, int a, int b) {
+    return Sort_CompareRows(sink->library, a, b, sink->query->orderBy,
+                            sink->query->descending);
+}
+
+/**
+ * Restore the heap property below position i (root = last in result order)
+ */
+static void siftDown(const Sink *sink, int *heap, int n, int i) {
+    for (;;) {
+        int largest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+
+        if (left < n && compareRows(sink, heap[left], heap[largest]) > 0) {
+            largest = left;
+        }
+        if (right < n && compareRows(sink, heap[right], heap[largest]) > 0) {
+            largest = right;
+        }
+        if (largest == i) {
+            return;
+        }
+
+        int tmp = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = tmp;
+        i = largest;
+    }
+}
+
+static void siftUp(const Sink *sink, int *heap, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (compareRows(sink, heap[i], heap[parent]) <= 0) {
+            return;
+        }
+
+        int tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+/**
+ * Hand one batch's surviving rows to the sink
+ * @return: 0 on success, -1 on allocation failure
+ */
+static int emitRows(Sink *sink, const int *rows, const int *sel, int n) {
+    const Query *query = sink->query;
+
+    for (int i = 0; i < n && !sink->done; i++) {
+        int row = rows[sel[i]];
+
+        if (!sink->sortAtEnd) {
+            /* Rows already in result order: apply offset and limit as they pass */
+            if (sink->skipped < query->offset) {
+                sink->skipped++;
+                continue;
+            }
+        } else if (sink->keep > 0 && sink->count == sink->keep) {
+            /* Bounded top-k: replace the worst kept row if this one is better */
+            if (compareRows(sink, row, sink->rows[0]) < 0) {
+                sink->rows[0] = row;
+                siftDown(sink, sink->rows, sink->count, 0);
+            }
+            continue;
+        }
+
+        if (sink->count == sink->capacity) {
+            int capacity = sink->capacity > 0 ? sink->capacity * 2 : QUERY_BATCH_SIZE;
+            int *grown = (int*)realloc(sink->rows, (size_t)capacity * sizeof(int));
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed for query results\n");
+                return -1;
+            }
+            sink->rows = grown;
+            sink->capacity = capacity;
+        }
+
+        sink->rows[sink->count++] = row;
+        if (sink->sortAtEnd && sink->keep > 0) {
+            siftUp(sink, sink->rows, sink->count - 1);
+        }
+        if (!sink->sortAtEnd && query->limit != QUERY_NO_LIMIT &&
+            sink->count >= query->limit) {
+            sink->done = 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Filter one batch and pass the survivors to the sink
+ * @return: 0 on success, -1 on allocation failure
+ */
+static int processBatch(Sink *sink, Batch *batch, int n) {
+    int sel[QUERY_BATCH_SIZE];
+
+    for (int i = 0; i < n; i++) {
+        sel[i] = i;
+    }
+    if (sink->query->where != NULL) {
+        n = filterBatch(batch, sink->query->where, sel, n, sel);
+    }
+
+    return emitRows(sink, batch->rows, sel, n);
+}
+
+/* ============= Execution ============= */
+
+/**
+ * Feed rows to the sink in the key order of the plan's index
+ *
+ * Rows sharing a key are emitted in ID order to match Sort_Compare;
+ * posting lists are kept in that order.
+ *
+ * @return: 0 on success, -1 on allocation failure
+ */
+static int scanIndexOrdered(Sink *sink, Batch *batch, const QueryPlan *plan) {
+    const Library *library = sink->library;
+    const BookFilter *probe = &plan->probe;
+    RBTree *tree = library->idIndex;
+    int descending = sink->query->descending;
+    int lo = INT_MIN, hi = INT_MAX;
+    int status = 0;
+    int n = 0;
+
+    if (plan->access == ACCESS_ID_INDEX && probe->hasId) {
+        lo = hi = probe->id;
+    } else if (plan->access == ACCESS_YEAR_INDEX) {
+        tree = library->yearIndex.tree;
+        if (probe->hasYear) {
+            lo = probe->yearMin;
+            hi = probe->yearMax;
+        }
+    } else if (plan->access == ACCESS_PRICE_INDEX) {
+        tree = library->priceIndex.tree;
+        if (probe->hasPrice) {
+            lo = probe->priceMin;
+            hi = probe->priceMax;
+        }
+    }
+
+    RBNode *node = descending ? RBTree_Floor(tree, hi) : RBTree_LowerBound(tree, lo);
+
+    while (node != NULL && node->key >= lo && node->key <= hi &&
+           !sink->done && status == 0) {
+        if (plan->access == ACCESS_ID_INDEX) {
+            batch->rows[n++] = (int)((const Book*)node->data - library->books);
+            if (n == QUERY_BATCH_SIZE) {
+                status = processBatch(sink, batch, n);
+                n = 0;
+            }
+        } else {
+            const PostingList *list = (const PostingList*)node->data;
+
+            for (int i = 0; i < list->count && status == 0;) {
+                int take = list->count - i < QUERY_BATCH_SIZE - n
+                         ? list->count - i : QUERY_BATCH_SIZE - n;
+                libraryFindManyById(library, list->ids + i, batch->rows + n, take);
+                i += take;
+                n += take;
+                if (n == QUERY_BATCH_SIZE) {
+                    status = processBatch(sink, batch, n);
+                    n = 0;
+                }
+            }
+        }
+
+        node = descending ? RBTree_Prev(node) : RBTree_Next(node);
+    }
+
+    if (n > 0 && status == 0) {
+        status = processBatch(sink, batch, n);
+    }
+
+    return status;
+}
+
+/**
+ * Run a query (untimed)
+ */
+static int executeQuery(const Library *library, const Query *query,
+                        int *positions, int max_positions) {
+    QueryPlan plan;
+    Sink sink = {0};
+    int status = 0;
+    int stored = 0;
+
+    if (query->limit == 0) {
+        return 0;
+    }
+
+    Query_Plan(library, query, &plan);
+
+    sink.library = library;
+    sink.query = query;
+    sink.sortAtEnd = query->ordered && !plan.ordered;
+    if (sink.sortAtEnd && query->limit != QUERY_NO_LIMIT) {
+        /* Top-k: only offset + limit rows, and never more than exist */
+        long keep = (long)query->offset + (long)query->limit;
+        sink.keep = keep < library->count ? (int)keep : library->count;
+    }
+
+    Batch *batch = (Batch*)malloc(sizeof(Batch));
+    if (batch == NULL) {
+        fprintf(stderr, "Memory allocation failed for query batch\n");
+        return -1;
+    }
+    batch->books = library->books;
+    batch->keys = &library->keys;
+
+    if (plan.ordered) {
+        status = scanIndexOrdered(&sink, batch, &plan);
+    } else if (plan.access == ACCESS_FULL_SCAN) {
+        for (int start = 0; start < library->count && !sink.done && status == 0;
+             start += QUERY_BATCH_SIZE) {
+            int n = library->count - start;
+            if (n > QUERY_BATCH_SIZE) {
+                n = QUERY_BATCH_SIZE;
+            }
+            for (int i = 0; i < n; i++) {
+                batch->rows[i] = start + i;
+            }
+            status = processBatch(&sink, batch, n);
+        }
+    } else {
+        int capacity = plan.estimate > 0 ? plan.estimate : 1;
+        int *ids = (int*)malloc((size_t)capacity * sizeof(int));
+        if (ids == NULL) {
+            fprintf(stderr, "Memory allocation failed for query candidates\n");
+            free(batch);
+            return -1;
+        }
+
+        int candidates = libraryIndexScan(library, &plan.probe, plan.access,
+                                          ids, capacity);
+        for (int start = 0; start < candidates && !sink.done && status == 0;
+             start += QUERY_BATCH_SIZE) {
+            int take = candidates - start < QUERY_BATCH_SIZE
+                     ? candidates - start : QUERY_BATCH_SIZE;
+            int n = 0;
+            libraryFindManyById(library, ids + start, batch->rows, take);
+            for (int i = 0; i < take; i++) {
+                if (batch->rows[i] != -1) {
+                    batch->rows[n++] = batch->rows[i];
+                }
+            }
+            status = processBatch(&sink, batch, n);
+        }
+        free(ids);
+    }
+
+    free(batch);
+
+    if (status == 0 && sink.sortAtEnd) {
+        status = Sort_Positions(library, query->orderBy, query->descending,
+                                sink.rows, (size_t)sink.count);
+    }
+
+    if (status == 0) {
+        int first = 0;
+        int count = sink.count;
+
+        if (sink.sortAtEnd) {
+            first = query->offset < count ? query->offset : count;
+            count -= first;
+            if (query->limit != QUERY_NO_LIMIT && count > query->limit) {
+                count = query->limit;
+            }
+        }
+        stored = count < max_positions ? count : max_positions;
+        if (stored > 0) {
+            memcpy(positions, sink.rows + first, (size_t)stored * sizeof(int));
+        }
+    }
+
+    free(sink.rows);
+
+    return status == 0 ? stored : -1;
+}
+
+int Query_Execute(const Library *library, const Query *query,
+                  int *positions, int max_positions) {
+    METRICS_START(METRIC_QUERY_EXECUTE);
+    int result = executeQuery(library, query, positions, max_positions);
+    METRICS_STOP(METRIC_QUERY_EXECUTE);
+
+    return result;
+}
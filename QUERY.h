@@ -0,0 +1,154 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "LIBRARY.h"
+
+/**
+ * @file QUERY.h
+ * @brief Predicate queries over the book catalog
+ *
+ * A query is a predicate tree over Book fields plus optional ordering,
+ * offset and limit. The planner pushes the indexable conjuncts of the
+ * predicate down to the most selective catalog index (or a full scan),
+ * and the executor filters candidate rows in batches of
+ * QUERY_BATCH_SIZE, evaluating one predicate at a time over a
+ * selection vector instead of the whole tree once per row.
+ *
+ * Orderings on an indexed field (ID, year, price) walk that index in
+ * key order and stop as soon as offset + limit rows have passed the
+ * filter; other orderings keep a bounded heap when a limit is given
+ * and sort the surviving rows otherwise.
+ *
+ * Text equality over catalog rows compares the StrKey headers in
+ * library->keys before the text, so it is usually settled without
+ * reading the row; an ISBN row is only normalized when its header
+ * matches. Predicate_Matches, given a lone book, compares the strings.
+ */
+
+#define QUERY_BATCH_SIZE 1024
+#define QUERY_NO_LIMIT (-1)
+
+/* Book fields addressable by a predicate or an ordering */
+typedef enum {
+    FIELD_ID = 0,
+    FIELD_TITLE,
+    FIELD_AUTHOR,
+    FIELD_ISBN,
+    FIELD_YEAR,
+    FIELD_PRICE,
+    FIELD_QUANTITY
+} BookField;
+
+typedef enum {
+    PRED_EQ = 0,                      /* field == value */
+    PRED_RANGE,                       /* lo <= field <= hi (numeric fields) */
+    PRED_SUBSTRING,                   /* text occurs in field (text fields) */
+    PRED_AND,
+    PRED_OR
+} PredicateKind;
+
+/* Predicate tree node */
+typedef struct Predicate {
+    PredicateKind kind;
+    BookField field;                  /* Leaf predicates only */
+    long lo;                          /* Numeric bound; price is in cents */
+    long hi;
+    char *text;                       /* Owned copy for text predicates */
+    StrKey key;                       /* Header of text */
+    struct Predicate *left;           /* AND/OR operands */
+    struct Predicate *right;
+} Predicate;
+
+typedef struct {
+    Predicate *where;                 /* NULL matches every book */
+    int ordered;                      /* Nonzero to sort by orderBy */
+    BookField orderBy;
+    int descending;
+    int offset;                       /* Rows to skip */
+    int limit;                        /* Rows to return, or QUERY_NO_LIMIT */
+} Query;
+
+/* Access path chosen by the planner */
+typedef struct {
+    AccessPath access;
+    BookFilter probe;                 /* Index bounds pushed down */
+    int estimate;                     /* Expected candidate rows */
+    int ordered;                      /* Index yields rows in result order */
+} QueryPlan;
+
+/**
+ * Create a predicate field == value for a numeric field
+ * @return: New predicate, or NULL on allocation failure
+ */
+Predicate* Predicate_Equals(BookField field, double value);
+
+/**
+ * Create a predicate field == text for a text field (ISBN compares
+ * normalized, title and author compare folded as by Text_Fold)
+ * @return: New predicate, or NULL on allocation failure
+ */
+Predicate* Predicate_EqualsText(BookField field, const char *text);
+
+/**
+ * Create a predicate lo <= field <= hi for a numeric field
+ * @return: New predicate, or NULL on allocation failure
+ */
+Predicate* Predicate_Range(BookField field, double lo, double hi);
+
+/**
+ * Create a predicate matching text anywhere in a text field (folded
+ * for title and author)
+ * @return: New predicate, or NULL on allocation failure
+ */
+Predicate* Predicate_Contains(BookField field, const char *text);
+
+/**
+ * Combine two predicates; takes ownership of both operands
+ * @return: New predicate, or NULL on failure (operands are freed)
+ */
+Predicate* Predicate_And(Predicate *left, Predicate *right);
+Predicate* Predicate_Or(Predicate *left, Predicate *right);
+
+/**
+ * Free a predicate tree
+ */
+void Predicate_Free(Predicate *predicate);
+
+/**
+ * Deep-copy a predicate tree
+ * @return: The copy (NULL for a NULL predicate), or NULL on allocation failure
+ */
+Predicate* Predicate_Copy(const Predicate *predicate);
+
+/**
+ * Test one book against a predicate; a NULL predicate matches every book
+ * @return: Nonzero if the book matches
+ */
+int Predicate_Matches(const Predicate *predicate, const Book *book);
+
+/**
+ * Initialize a query matching every book, unordered and unlimited
+ */
+void Query_Init(Query *query);
+
+/**
+ * Choose how a query reads the catalog
+ * @param plan: Receives the chosen access path and pushed-down bounds
+ */
+void Query_Plan(const Library *library, const Query *query, QueryPlan *plan);
+
+/**
+ * Run a query
+ * @param positions: Receives indexes into library->books, in result order
+ * @param max_positions: Capacity of positions
+ * @return: Number of rows stored, or -1 on allocation failure
+ */
+int Query_Execute(const Library *library, const Query *query,
+                  int *positions, int max_positions);
+
+/**
+ * Get a printable name for an access path
+ */
+const char* Query_AccessPathName(AccessPath access);
+
+#endif /* QUERY_H */
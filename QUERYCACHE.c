@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "METRICS.h"
+#include "QUERYCACHE.h"
+
+/* ============= Query Normalization ============= */
+
+/* Growable string used to build a normalized key */
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+    int failed;                       /* An allocation failed; text is stale */
+} KeyBuffer;
+
+static void appendText(KeyBuffer *key, const char *text, size_t length) {
+    if (key->failed) {
+        return;
+    }
+
+    if (key->length + length + 1 > key->capacity) {
+        size_t capacity = key->capacity ? key->capacity : 64;
+        while (capacity < key->length + length + 1) {
+            capacity *= 2;
+        }
+
+        char *grown = (char*)realloc(key->text, capacity);
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed for query cache key\n");
+            key->failed = 1;
+            return;
+        }
+        key->text = grown;
+        key->capacity = capacity;
+    }
+
+    memcpy(key->text + key->length, text, length);
+    key->length += length;
+    key->text[key->length] = '\0';
+}
+
+static void appendFormat(KeyBuffer *key, const char *format, long a, long b) {
+    char part[64];
+    int length = snprintf(part, sizeof(part), format, a, b);
+
+    appendText(key, part, (size_t)length);
+}
+
+/**
+ * Append the normalized form of a predicate
+ *
+ * Leaves are written as kind, field and bounds; text is length-prefixed
+ * so no character in it can be mistaken for syntax. The operands of AND
+ * and OR are written in lexical order of their own normalized forms.
+ *
+ * @param key: Buffer to append to
+ * @param predicate: Predicate to normalize
+ */
+static void appendPredicate(KeyBuffer *key, const Predicate *predicate) {
+    if (predicate->kind == PRED_AND || predicate->kind == PRED_OR) {
+        KeyBuffer left = {0};
+        KeyBuffer right = {0};
+
+        appendPredicate(&left, predicate->left);
+        appendPredicate(&right, predicate->right);
+        if (left.failed || right.failed) {
+            key->failed = 1;
+        } else {
+            int swap = strcmp(left.text, right.text) > 0;
+            appendText(key, predicate->kind == PRED_AND ? "(&" : "(|", 2);
+            appendText(key, swap ? right.text : left.text,
+                       swap ? right.length : left.length);
+            appendText(key, swap ? left.text : right.text,
+                       swap ? left.length : right.length);
+            appendText(key, ")", 1);
+        }
+        free(left.text);
+        free(right.text);
+        return;
+    }
+
+    appendFormat(key, "(%ld:%ld", (long)predicate->kind, (long)predicate->field);
+    if (predicate->text != NULL) {
+        size_t length = strlen(predicate->text);
+        appendFormat(key, "'%ld:", (long)length, 0);
+        appendText(key, predicate->text, length);
+    } else {
+        appendFormat(key, "[%ld,%ld]", predicate->lo, predicate->hi);
+    }
+    appendText(key, ")", 1);
+}
+
+/**
+ * Build the normalized key of a query
+ * @return: Newly allocated key, or NULL on allocation failure
+ */
+static char* buildKey(const Query *query) {
+    KeyBuffer key = {0};
+
+    if (query->where != NULL) {
+        appendPredicate(&key, query->where);
+    } else {
+        appendText(&key, "*", 1);
+    }
+    if (query->ordered) {
+        appendFormat(&key, " order %ld %ld", (long)query->orderBy,
+                     (long)query->descending);
+    }
+    appendFormat(&key, " offset %ld limit %ld", (long)query->offset,
+                 (long)query->limit);
+
+    if (key.failed) {
+        free(key.text);
+        return NULL;
+    }
+
+    return key.text;
+}
+
+/**
+ * FNV-1a hash of a key
+ */
+static uint32_t hashKey(const char *key) {
+    uint32_t hash = 2166136261u;
+
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* ============= Entry Management ============= */
+
+static void unlinkLru(QueryCache *cache, QueryCacheEntry *entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+}
+
+/**
+ * Take an entry out of its hash chain and the LRU list
+ */
+static void unlinkEntry(QueryCache *cache, QueryCacheEntry *entry) {
+    QueryCacheEntry **link = &cache->buckets[entry->hash & cache->bucketMask];
+
+    while (*link != entry) {
+        link = &(*link)->hashNext;
+    }
+    *link = entry->hashNext;
+    unlinkLru(cache, entry);
+
+    cache->entries--;
+    cache->ids -= (size_t)entry->count;
+}
+
+static void freeEntry(QueryCacheEntry *entry) {
+    free(entry->key);
+    Predicate_Free(entry->where);
+    free(entry->ids);
+    free(entry);
+}
+
+static void pushFront(QueryCache *cache, QueryCacheEntry *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+static QueryCacheEntry* findEntry(const QueryCache *cache, const char *key,
+                                  uint32_t hash) {
+    QueryCacheEntry *entry = cache->buckets[hash & cache->bucketMask];
+
+    while (entry != NULL && (entry->hash != hash || strcmp(entry->key, key) != 0)) {
+        entry = entry->hashNext;
+    }
+
+    return entry;
+}
+
+/**
+ * Cache the result of a query run at the current library state
+ *
+ * Least recently used entries are evicted to make room. A result too
+ * large for the cache, or one that cannot be allocated, is not cached.
+ *
+ * @param key: Normalized key; ownership passes to the cache
+ * @param positions: Result rows
+ * @param count: Number of rows
+ * @param complete: Nonzero if the result was not cut off by capacity
+ */
+static void storeResult(QueryCache *cache, const Query *query, char *key,
+                        uint32_t hash, const int *positions, int count,
+                        int complete) {
+    QueryCacheEntry *entry = NULL;
+
+    if ((size_t)count > cache->maxIds || cache->maxEntries == 0) {
+        free(key);
+        return;
+    }
+
+    entry = (QueryCacheEntry*)calloc(1, sizeof(QueryCacheEntry));
+    if (entry == NULL ||
+        (count > 0 && (entry->ids = (int*)malloc(2 * (size_t)count * sizeof(int))) == NULL) ||
+        (query->where != NULL && (entry->where = Predicate_Copy(query->where)) == NULL)) {
+        fprintf(stderr, "Memory allocation failed for query cache entry\n");
+        free(key);
+        if (entry != NULL) {
+            free(entry->ids);
+            free(entry);
+        }
+        return;
+    }
+
+    while (cache->entries >= cache->maxEntries ||
+           cache->ids + (size_t)count > cache->maxIds) {
+        QueryCacheEntry *victim = cache->tail;
+        unlinkEntry(cache, victim);
+        freeEntry(victim);
+        cache->evictions++;
+        METRICS_INC(COUNTER_QCACHE_EVICTIONS);
+    }
+
+    entry->key = key;
+    entry->hash = hash;
+    entry->count = count;
+    entry->complete = complete;
+    entry->positions = entry->ids + count;
+    entry->layout = cache->layout;
+    for (int i = 0; i < count; i++) {
+        entry->ids[i] = cache->library->books[positions[i]].id;
+    }
+    if (count > 0) {
+        memcpy(entry->positions, positions, (size_t)count * sizeof(int));
+    }
+
+    QueryCacheEntry **bucket = &cache->buckets[hash & cache->bucketMask];
+    entry->hashNext = *bucket;
+    *bucket = entry;
+    pushFront(cache, entry);
+    cache->entries++;
+    cache->ids += (size_t)count;
+}
+
+/**
+ * Library observer: drop the entries a mutation could have changed
+ */
+static void invalidate(void *context, const Book *before, const Book *after) {
+    QueryCache *cache = (QueryCache*)context;
+    QueryCacheEntry *entry = cache->head;
+
+    if (after == NULL) {
+        cache->layout++;
+    }
+
+    while (entry != NULL) {
+        QueryCacheEntry *next = entry->next;
+
+        if ((before != NULL && Predicate_Matches(entry->where, before)) ||
+            (after != NULL && Predicate_Matches(entry->where, after))) {
+            unlinkEntry(cache, entry);
+            freeEntry(entry);
+            cache->invalidations++;
+            METRICS_INC(COUNTER_QCACHE_INVALIDATIONS);
+        }
+        entry = next;
+    }
+}
+
+/* ============= Public API ============= */
+
+int QueryCache_Init(QueryCache *cache, Library *library, size_t max_entries,
+                    size_t max_ids) {
+    size_t buckets = 1;
+
+    memset(cache, 0, sizeof(*cache));
+    while (buckets < max_entries * 2) {
+        buckets <<= 1;
+    }
+
+    cache->buckets = (QueryCacheEntry**)calloc(buckets, sizeof(QueryCacheEntry*));
+    if (cache->buckets == NULL) {
+        fprintf(stderr, "Memory allocation failed for query cache\n");
+        return -1;
+    }
+    if (libraryAddObserver(library, invalidate, cache) != 0) {
+        fprintf(stderr, "Too many library observers for query cache\n");
+        free(cache->buckets);
+        cache->buckets = NULL;
+        return -1;
+    }
+
+    cache->library = library;
+    cache->bucketMask = buckets - 1;
+    cache->maxEntries = max_entries;
+    cache->maxIds = max_ids;
+
+    return 0;
+}
+
+void QueryCache_Clear(QueryCache *cache) {
+    while (cache->head != NULL) {
+        QueryCacheEntry *entry = cache->head;
+        unlinkEntry(cache, entry);
+        freeEntry(entry);
+    }
+}
+
+void QueryCache_Free(QueryCache *cache) {
+    if (cache->buckets == NULL) {
+        return;
+    }
+
+    QueryCache_Clear(cache);
+    libraryRemoveObserver(cache->library, invalidate, cache);
+    free(cache->buckets);
+    cache->buckets = NULL;
+}
+
+int QueryCache_Execute(QueryCache *cache, const Query *query,
+                       int *positions, int max_positions) {
+    char *key = buildKey(query);
+    if (key == NULL) {
+        return Query_Execute(cache->library, query, positions, max_positions);
+    }
+
+    uint32_t hash = hashKey(key);
+    QueryCacheEntry *entry = findEntry(cache, key, hash);
+
+    if (entry != NULL && (entry->complete || entry->count >= max_positions)) {
+        int count = entry->count < max_positions ? entry->count : max_positions;
+
+        /* A delete since the result was stored may have moved its rows */
+        if (entry->layout != cache->layout) {
+            libraryFindManyById(cache->library, entry->ids, entry->positions,
+                                entry->count);
+            entry->layout = cache->layout;
+        }
+        if (count > 0) {
+            memcpy(positions, entry->positions, (size_t)count * sizeof(int));
+        }
+        if (entry != cache->head) {
+            unlinkLru(cache, entry);
+            pushFront(cache, entry);
+        }
+        cache->hits++;
+        METRICS_INC(COUNTER_QCACHE_HITS);
+        free(key);
+        return count;
+    }
+
+    cache->misses++;
+    METRICS_INC(COUNTER_QCACHE_MISSES);
+
+    int found = Query_Execute(cache->library, query, positions, max_positions);
+    if (found == -1) {
+        free(key);
+        return -1;
+    }
+
+    if (entry != NULL) {
+        unlinkEntry(cache, entry);
+        freeEntry(entry);
+    }
+    storeResult(cache, query, key, hash, positions, found, found < max_positions);
+
+    return found;
+}
@@ -0,0 +1,99 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "QUERY.h"
+
+/**
+ * @file QUERYCACHE.h
+ * @brief Result cache for repeated catalog queries
+ *
+ * Results are cached as lists of book IDs, keyed by a normalized form
+ * of the query: predicate operands of AND and OR are put in a fixed
+ * order and ISBNs are normalized, so equivalent queries share an entry.
+ * Each entry also keeps the rows' positions; a delete (which shifts
+ * later rows down) makes entries remap their IDs through the ID index
+ * on their next hit, while other hits copy positions directly.
+ *
+ * The cache observes its library. After each add, update or delete it
+ * drops exactly the entries whose predicate matches the record before
+ * or after the change; a change that no cached query could see keeps
+ * every entry. The cache is bounded by entry count and by the total
+ * number of IDs held, evicting least recently used entries.
+ */
+
+/* Defaults used by the interactive program */
+#define QUERY_CACHE_DEFAULT_ENTRIES 256
+#define QUERY_CACHE_DEFAULT_IDS (1 << 20)
+
+/* One cached result */
+typedef struct QueryCacheEntry {
+    char *key;                        /* Normalized query */
+    uint32_t hash;                    /* Hash of key */
+    Predicate *where;                 /* Copy of the filter, for invalidation */
+    int *ids;                         /* Result IDs in result order */
+    int *positions;                   /* Their rows, valid at layout */
+    uint64_t layout;                  /* Cache layout the rows belong to */
+    int count;                        /* Number of IDs */
+    int complete;                     /* Result was not cut off by capacity */
+    struct QueryCacheEntry *prev;     /* LRU neighbours */
+    struct QueryCacheEntry *next;
+    struct QueryCacheEntry *hashNext; /* Next entry in the same bucket */
+} QueryCacheEntry;
+
+typedef struct {
+    Library *library;                 /* Library being observed */
+    QueryCacheEntry **buckets;        /* Hash chains */
+    size_t bucketMask;                /* Bucket count - 1 */
+    QueryCacheEntry *head;            /* Most recently used */
+    QueryCacheEntry *tail;            /* Least recently used */
+    size_t entries;                   /* Cached results */
+    size_t maxEntries;
+    size_t ids;                       /* IDs held across all entries */
+    size_t maxIds;
+    uint64_t layout;                  /* Deletes seen; each may move rows */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;           /* Entries dropped by a mutation */
+    uint64_t evictions;               /* Entries dropped for space */
+} QueryCache;
+
+/**
+ * @brief Create an empty cache and start observing a library
+ * @param cache Cache to initialize
+ * @param library Library whose queries are cached
+ * @param max_entries Most results held at once
+ * @param max_ids Most IDs held across all results
+ * @return 0 on success, -1 on failure
+ */
+int QueryCache_Init(QueryCache *cache, Library *library, size_t max_entries,
+                    size_t max_ids);
+
+/**
+ * @brief Stop observing the library and free every entry
+ */
+void QueryCache_Free(QueryCache *cache);
+
+/**
+ * @brief Run a query, answering from the cache when possible
+ *
+ * Returns the rows Query_Execute would. An unordered result is the
+ * one stored when it was cached, so if the planner would now choose a
+ * different index it may come back in a different order (or, with a
+ * limit, be a different subset of the matching rows).
+ *
+ * @param positions Receives indexes into library->books, in result order
+ * @param max_positions Capacity of positions
+ * @return Number of rows stored, or -1 on allocation failure
+ */
+int QueryCache_Execute(QueryCache *cache, const Query *query,
+                       int *positions, int max_positions);
+
+/**
+ * @brief Drop every cached result
+ */
+void QueryCache_Clear(QueryCache *cache);
+
+#endif /* QUERYCACHE_H */
@@ -1,45 +1,90 @@
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-/* Red-Black Tree Color Enumeration */
-typedef enum {
-    RED = 0,
-    BLACK = 1
-} Color;
-
-/* Red-Black Tree Node Structure */
-typedef struct RBNode {
-    int key;                    /* Book ID or unique key */
-    char data[256];             /* Book information/data */
-    Color color;                /* Node color: RED or BLACK */
-    struct RBNode *left;        /* Left child pointer */
-    struct RBNode *right;       /* Right child pointer */
-    struct RBNode *parent;      /* Parent node pointer */
-} RBNode;
-
-/* Red-Black Tree Structure */
-typedef struct {
-    RBNode *root;               /* Root of the tree */
-    int size;                   /* Number of nodes in tree */
-} RBTree;
+#include "METRICS.h"
+#include "PAGES.h"
+#include "RBTREE.h"
+
+#define RB_SLAB_MIN_NODES 16
+#define RB_SLAB_MAX_NODES 4096
+
+/* Height bound for walks and checks: 2*log2(n+1) for any tree in memory */
+#define RB_MAX_HEIGHT 128
+
+/* With -DRB_DEBUG, check the mutated path on one in 2^k inserts/deletes */
+#ifndef RB_DEBUG_CHECK_MASK
+#define RB_DEBUG_CHECK_MASK 15
+#endif
+
+/*
+ * Node storage. Each tree carves its nodes out of slabs that double in
+ * size up to RB_SLAB_MAX_NODES. Deleted nodes are recycled through a
+ * free list (linked via left, marked by parent pointing at the node
+ * itself), and teardown releases whole slabs instead of single nodes.
+ *
+ * When a PAGES policy is set, slabs keep doubling until they fill a
+ * huge page, and those full-size slabs come from Pages_Alloc so a large
+ * tree's descents hit a few 2 MiB TLB entries instead of many 4 KiB.
+ */
+struct RBSlab {
+    struct RBSlab *next;
+    size_t capacity;
+    size_t used;
+    size_t mapped;                    /* Bytes from Pages_Alloc, 0 if malloc'd */
+    RBNode nodes[];
+};
+
+#define RB_SLAB_HUGE_NODES ((PAGES_HUGE_SIZE - sizeof(struct RBSlab)) / sizeof(RBNode))
 
 /**
  * Create a new Red-Black Tree node
+ * @param tree: The tree whose slabs provide the node
  * @param key: The key value for the node
  * @param data: The data to store in the node
  * @return: Pointer to the newly created node, or NULL on failure
  */
-RBNode* createNode(int key, const char *data) {
-    RBNode *node = (RBNode*)malloc(sizeof(RBNode));
-    if (node == NULL) {
-        fprintf(stderr, "Memory allocation failed for new node\n");
-        return NULL;
+RBNode* createNode(RBTree *tree, int key, void *data) {
+    RBNode *node = tree->freeNodes;
+    
+    if (node != NULL) {
+        tree->freeNodes = node->left;
+    } else {
+        struct RBSlab *slab = tree->slabs;
+        if (slab == NULL || slab->used == slab->capacity) {
+            size_t limit = Pages_Enabled() ? RB_SLAB_HUGE_NODES : RB_SLAB_MAX_NODES;
+            size_t capacity = slab == NULL ? RB_SLAB_MIN_NODES : slab->capacity * 2;
+            size_t mapped = 0;
+            if (capacity > limit) {
+                capacity = limit;
+            }
+            
+            if (capacity == RB_SLAB_HUGE_NODES) {
+                slab = (struct RBSlab*)Pages_Alloc(sizeof(struct RBSlab) +
+                                                   capacity * sizeof(RBNode), &mapped);
+            } else {
+                slab = (struct RBSlab*)malloc(sizeof(struct RBSlab) +
+                                              capacity * sizeof(RBNode));
+            }
+            if (slab == NULL) {
+                fprintf(stderr, "Memory allocation failed for new node\n");
+                return NULL;
+            }
+            slab->mapped = mapped;
+            slab->next = tree->slabs;
+            slab->capacity = capacity;
+            slab->used = 0;
+            tree->slabs = slab;
+        }
+        node = &slab->nodes[slab->used++];
     }
+    METRICS_INC(COUNTER_RB_NODE_ALLOCS);
     
     node->key = key;
-    strncpy(node->data, data, sizeof(node->data) - 1);
-    node->data[sizeof(node->data) - 1] = '\0';
+    node->data = data;
     node->color = RED;
     node->left = NULL;
     node->right = NULL;
@@ -48,6 +93,52 @@ RBNode* createNode(int key, const char *data) {
     return node;
 }
 
+/**
+ * Return a node to its tree's free list
+ * @param tree: The tree that owns the node
+ * @param node: The unlinked node
+ */
+static void releaseNode(RBTree *tree, RBNode *node) {
+    node->parent = node;
+    node->left = tree->freeNodes;
+    tree->freeNodes = node;
+    METRICS_INC(COUNTER_RB_NODE_FREES);
+}
+
+/**
+ * Release every node of a tree by freeing its slabs
+ * @param tree: Pointer to the tree; left empty
+ * @param free_data: Function to free node data, or NULL
+ */
+static void releaseAllNodes(RBTree *tree, FreeDataFunc free_data) {
+    struct RBSlab *slab = tree->slabs;
+    
+    while (slab != NULL) {
+        struct RBSlab *next = slab->next;
+        
+        if (free_data != NULL) {
+            for (size_t i = 0; i < slab->used; i++) {
+                RBNode *node = &slab->nodes[i];
+                if (node->parent != node) {
+                    free_data(node->data);
+                }
+            }
+        }
+        if (slab->mapped != 0) {
+            Pages_Free(slab, slab->mapped);
+        } else {
+            free(slab);
+        }
+        slab = next;
+    }
+    METRICS_ADD(COUNTER_RB_NODE_FREES, tree->size);
+    
+    tree->root = NULL;
+    tree->size = 0;
+    tree->slabs = NULL;
+    tree->freeNodes = NULL;
+}
+
 /**
  * Create an empty Red-Black Tree
  * @return: Pointer to the newly created tree
@@ -61,6 +152,8 @@ RBTree* createTree() {
     
     tree->root = NULL;
     tree->size = 0;
+    tree->slabs = NULL;
+    tree->freeNodes = NULL;
     
     return tree;
 }
@@ -70,7 +163,7 @@ RBTree* createTree() {
  * @param node: The node whose uncle is to be found
  * @return: Pointer to the uncle node, or NULL if it doesn't exist
  */
-RBNode* getUncle(RBNode *node) {
+static inline RBNode* getUncle(RBNode *node) {
     if (node == NULL || node->parent == NULL || node->parent->parent == NULL) {
         return NULL;
     }
@@ -90,7 +183,7 @@ RBNode* getUncle(RBNode *node) {
  * @param node: The node whose sibling is to be found
  * @return: Pointer to the sibling node, or NULL if it doesn't exist
  */
-RBNode* getSibling(RBNode *node) {
+static inline RBNode* getSibling(RBNode *node) {
     if (node == NULL || node->parent == NULL) {
         return NULL;
     }
@@ -102,16 +195,35 @@ RBNode* getSibling(RBNode *node) {
     }
 }
 
+/**
+ * Pick the child on the path toward a key, without a branch
+ *
+ * On random keys the comparison is a coin flip. Compilers turn the
+ * plain ternary into a conditional move at -O2 but into a mispredicted
+ * jump under profile feedback, so the select is spelled out as masks.
+ *
+ * @param node: The node to step down from
+ * @param key: The key being searched for
+ * @return: node->left if key < node->key, otherwise node->right
+ */
+static inline RBNode* childToward(const RBNode *node, int key) {
+    uintptr_t mask = (uintptr_t)0 - (uintptr_t)(key < node->key);
+
+    return (RBNode*)(((uintptr_t)node->left & mask) |
+                     ((uintptr_t)node->right & ~mask));
+}
+
 /**
  * Perform left rotation on a node
  * @param tree: Pointer to the tree
  * @param node: The node to rotate left
  */
-void rotateLeft(RBTree *tree, RBNode *node) {
+static inline void rotateLeft(RBTree *tree, RBNode *node) {
     if (node == NULL || node->right == NULL) {
         return;
     }
     
+    METRICS_INC(COUNTER_RB_ROTATIONS);
     RBNode *right_child = node->right;
     node->right = right_child->left;
     
@@ -138,11 +250,12 @@ void rotateLeft(RBTree *tree, RBNode *node) {
  * @param tree: Pointer to the tree
  * @param node: The node to rotate right
  */
-void rotateRight(RBTree *tree, RBNode *node) {
+static inline void rotateRight(RBTree *tree, RBNode *node) {
     if (node == NULL || node->left == NULL) {
         return;
     }
     
+    METRICS_INC(COUNTER_RB_ROTATIONS);
     RBNode *left_child = node->left;
     node->left = left_child->right;
     
@@ -164,12 +277,130 @@ void rotateRight(RBTree *tree, RBNode *node) {
     node->parent = left_child;
 }
 
+/**
+ * Check the invariants that hold between a node and its children:
+ * parent pointers, no red child under a red node, and key order
+ * @param node: The node to check
+ * @return: 1 if valid, 0 if invalid (the problem is printed)
+ */
+static int checkNodeLinks(const RBNode *node) {
+    const RBNode *children[2] = {node->left, node->right};
+    
+    if (node->color != RED && node->color != BLACK) {
+        fprintf(stderr, "Validation Error: Node %d has no valid color\n", node->key);
+        return 0;
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        const RBNode *child = children[i];
+        if (child == NULL) {
+            continue;
+        }
+        if (child->parent != node) {
+            fprintf(stderr, "Validation Error: Node %d does not point back to parent %d\n",
+                    child->key, node->key);
+            return 0;
+        }
+        if (node->color == RED && child->color == RED) {
+            fprintf(stderr, "Validation Error: Red node %d has red child %d\n",
+                    node->key, child->key);
+            return 0;
+        }
+        if (i == 0 ? child->key >= node->key : child->key <= node->key) {
+            fprintf(stderr, "Validation Error: Node %d is on the wrong side of %d\n",
+                    child->key, node->key);
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+/**
+ * Count the black nodes down the leftmost path of a subtree
+ * @param node: The root of the subtree
+ * @return: Black height of that path
+ */
+static int leftBlackHeight(const RBNode *node) {
+    int height = 0;
+    
+    for (; node != NULL; node = node->left) {
+        height += node->color == BLACK;
+    }
+    
+    return height;
+}
+
+#ifdef RB_DEBUG
+
+/* Per thread: the batch thread mutates trees alongside the caller */
+static __thread unsigned long debugMutations;
+
+/**
+ * Check the path from a mutated node up to the root (debug builds)
+ *
+ * Runs on one in RB_DEBUG_CHECK_MASK + 1 mutations. Each node on the
+ * path gets the local checks plus a black-height comparison of the
+ * leftmost paths of its two subtrees, O(log^2 n) in all. Aborts on the
+ * first violation so the failing operation is on the stack.
+ *
+ * @param tree: Pointer to the tree
+ * @param node: A node on the mutated path, or NULL for the root
+ * @param operation: Name of the mutation, for the report
+ * @param key: Key that was inserted or deleted
+ */
+static void checkMutatedPath(RBTree *tree, RBNode *node,
+                             const char *operation, int key) {
+    if ((debugMutations++ & RB_DEBUG_CHECK_MASK) != 0) {
+        return;
+    }
+    
+    int valid = tree->root == NULL ||
+        (tree->root->color == BLACK && tree->root->parent == NULL);
+    int depth = 0;
+    
+    for (node = node != NULL ? node : tree->root;
+         valid && node != NULL; node = node->parent) {
+        RBNode *parent = node->parent;
+        
+        if (++depth > RB_MAX_HEIGHT || !checkNodeLinks(node)) {
+            valid = 0;
+        } else if (leftBlackHeight(node->left) != leftBlackHeight(node->right)) {
+            fprintf(stderr, "Validation Error: Unequal black height below %d\n", node->key);
+            valid = 0;
+        } else if (parent == NULL && node != tree->root) {
+            fprintf(stderr, "Validation Error: Node %d is detached from the root\n", node->key);
+            valid = 0;
+        } else if (parent != NULL && parent->left != node && parent->right != node) {
+            fprintf(stderr, "Validation Error: Parent %d does not link child %d\n",
+                    parent->key, node->key);
+            valid = 0;
+        }
+    }
+    
+    if (!valid) {
+        fprintf(stderr, "RB_DEBUG: tree corrupted after %s of key %d\n", operation, key);
+        abort();
+    }
+}
+
+#define RB_CHECK_PATH(tree, node, operation, key) \
+    checkMutatedPath((tree), (node), (operation), (key))
+
+#else
+
+#define RB_CHECK_PATH(tree, node, operation, key) ((void)(node))
+
+#endif /* RB_DEBUG */
+
 /**
  * Fix Red-Black Tree violations after insertion
  * @param tree: Pointer to the tree
  * @param node: The newly inserted node
  */
 void fixInsert(RBTree *tree, RBNode *node) {
+    METRICS_TREE_START(METRIC_RB_FIX_INSERT);
+    
     while (node != tree->root && node->parent->color == RED) {
         RBNode *parent = node->parent;
         RBNode *grandparent = parent->parent;
@@ -221,32 +452,21 @@ void fixInsert(RBTree *tree, RBNode *node) {
     }
     
     tree->root->color = BLACK;
+    METRICS_TREE_STOP(METRIC_RB_FIX_INSERT);
 }
 
 /**
- * Insert a new node into the Red-Black Tree
+ * Insert a new node into the Red-Black Tree (untimed)
  * @param tree: Pointer to the tree
  * @param key: The key value for the new node
  * @param data: The data to store in the node
  * @return: 1 on success, 0 on failure
  */
-int insertNode(RBTree *tree, int key, const char *data) {
+static int doInsertNode(RBTree *tree, int key, void *data) {
     if (tree == NULL || data == NULL) {
         return 0;
     }
     
-    RBNode *new_node = createNode(key, data);
-    if (new_node == NULL) {
-        return 0;
-    }
-    
-    if (tree->root == NULL) {
-        tree->root = new_node;
-        new_node->color = BLACK;
-        tree->size++;
-        return 1;
-    }
-    
     RBNode *current = tree->root;
     RBNode *parent = NULL;
     
@@ -259,13 +479,24 @@ int insertNode(RBTree *tree, int key, const char *data) {
             current = current->right;
         } else {
             /* Key already exists - update data */
-            strncpy(current->data, data, sizeof(current->data) - 1);
-            current->data[sizeof(current->data) - 1] = '\0';
-            free(new_node);
+            current->data = data;
             return 1;
         }
     }
     
+    RBNode *new_node = createNode(tree, key, data);
+    if (new_node == NULL) {
+        return 0;
+    }
+    
+    if (parent == NULL) {
+        tree->root = new_node;
+        new_node->color = BLACK;
+        tree->size++;
+        RB_CHECK_PATH(tree, new_node, "insert", key);
+        return 1;
+    }
+    
     new_node->parent = parent;
     if (key < parent->key) {
         parent->left = new_node;
@@ -275,10 +506,57 @@ int insertNode(RBTree *tree, int key, const char *data) {
     
     tree->size++;
     fixInsert(tree, new_node);
+    RB_CHECK_PATH(tree, new_node, "insert", key);
     
     return 1;
 }
 
+/**
+ * Insert a new node into the Red-Black Tree
+ * @param tree: Pointer to the tree
+ * @param key: The key value for the new node
+ * @param data: The data to store in the node
+ * @return: 1 on success, 0 on failure
+ */
+int insertNode(RBTree *tree, int key, void *data) {
+    METRICS_TREE_START(METRIC_RB_INSERT);
+    int result = doInsertNode(tree, key, data);
+    METRICS_TREE_STOP(METRIC_RB_INSERT);
+    
+    return result;
+}
+
+/**
+ * Link an allocated node into the tree unless its key is present
+ * @param tree: Pointer to the tree
+ * @param node: Unlinked node from createNode
+ * @return: The node already holding the key, or NULL if node was linked
+ */
+static RBNode* linkNewNode(RBTree *tree, RBNode *node) {
+    RBNode *current = tree->root;
+    RBNode *parent = NULL;
+    
+    while (current != NULL && current->key != node->key) {
+        parent = current;
+        current = childToward(current, node->key);
+    }
+    if (current != NULL) {
+        return current;
+    }
+    
+    node->parent = parent;
+    if (parent == NULL) {
+        tree->root = node;
+    } else if (node->key < parent->key) {
+        parent->left = node;
+    } else {
+        parent->right = node;
+    }
+    fixInsert(tree, node);
+    
+    return NULL;
+}
+
 /**
  * Find the node with minimum key in a subtree
  * @param node: The root of the subtree
@@ -336,6 +614,29 @@ RBNode* findSuccessor(RBNode *node) {
     return successor;
 }
 
+/**
+ * Find the in-order predecessor of a node
+ * @param node: The node whose predecessor is to be found
+ * @return: Pointer to the predecessor node
+ */
+RBNode* findPredecessor(RBNode *node) {
+    if (node == NULL) {
+        return NULL;
+    }
+    
+    if (node->left != NULL) {
+        return findMaximum(node->left);
+    }
+    
+    RBNode *predecessor = node->parent;
+    while (predecessor != NULL && node == predecessor->left) {
+        node = predecessor;
+        predecessor = predecessor->parent;
+    }
+    
+    return predecessor;
+}
+
 /**
  * Fix Red-Black Tree violations after deletion
  * @param tree: Pointer to the tree
@@ -343,12 +644,15 @@ RBNode* findSuccessor(RBNode *node) {
  * @param parent: The parent of the node
  */
 void fixDelete(RBTree *tree, RBNode *node, RBNode *parent) {
+    METRICS_TREE_START(METRIC_RB_FIX_DELETE);
+    
     while (node != tree->root && (node == NULL || node->color == BLACK)) {
         if (node != NULL && node->parent != NULL) {
             parent = node->parent;
         }
         
-        if (node == NULL || node == parent->left) {
+        /* A NULL node is the left child only if parent->left is NULL */
+        if (node == parent->left) {
             RBNode *sibling = parent->right;
             
             if (sibling == NULL) {
@@ -446,35 +750,16 @@ void fixDelete(RBTree *tree, RBNode *node, RBNode *parent) {
     if (node != NULL) {
         node->color = BLACK;
     }
+    METRICS_TREE_STOP(METRIC_RB_FIX_DELETE);
 }
 
 /**
- * Delete a node with a given key from the tree
+ * Unlink a node from the tree and rebalance, leaving the node unused
  * @param tree: Pointer to the tree
- * @param key: The key value to delete
- * @return: 1 on success, 0 if key not found
+ * @param node: The node to remove
+ * @return: The parent of the spliced position, where fix-up started
  */
-int deleteNode(RBTree *tree, int key) {
-    if (tree == NULL || tree->root == NULL) {
-        return 0;
-    }
-    
-    /* Find the node to delete */
-    RBNode *node = tree->root;
-    while (node != NULL) {
-        if (key < node->key) {
-            node = node->left;
-        } else if (key > node->key) {
-            node = node->right;
-        } else {
-            break;
-        }
-    }
-    
-    if (node == NULL) {
-        return 0; /* Key not found */
-    }
-    
+static RBNode* unlinkNode(RBTree *tree, RBNode *node) {
     RBNode *replacement;
     RBNode *fix_node;
     RBNode *fix_parent;
@@ -562,16 +847,62 @@ int deleteNode(RBTree *tree, int key) {
         successor->color = node->color;
     }
     
-    free(node);
-    tree->size--;
-    
     if (original_color == BLACK) {
         fixDelete(tree, fix_node, fix_parent);
     }
     
+    return fix_parent;
+}
+
+/**
+ * Delete a node with a given key from the tree (untimed)
+ * @param tree: Pointer to the tree
+ * @param key: The key value to delete
+ * @return: 1 on success, 0 if key not found
+ */
+static int doDeleteNode(RBTree *tree, int key) {
+    if (tree == NULL || tree->root == NULL) {
+        return 0;
+    }
+    
+    /* Find the node to delete */
+    RBNode *node = tree->root;
+    while (node != NULL) {
+        if (key < node->key) {
+            node = node->left;
+        } else if (key > node->key) {
+            node = node->right;
+        } else {
+            break;
+        }
+    }
+    
+    if (node == NULL) {
+        return 0; /* Key not found */
+    }
+    
+    RBNode *fix_parent = unlinkNode(tree, node);
+    releaseNode(tree, node);
+    tree->size--;
+    RB_CHECK_PATH(tree, fix_parent, "delete", key);
+    
     return 1;
 }
 
+/**
+ * Delete a node with a given key from the tree
+ * @param tree: Pointer to the tree
+ * @param key: The key value to delete
+ * @return: 1 on success, 0 if key not found
+ */
+int deleteNode(RBTree *tree, int key) {
+    METRICS_TREE_START(METRIC_RB_DELETE);
+    int result = doDeleteNode(tree, key);
+    METRICS_TREE_STOP(METRIC_RB_DELETE);
+    
+    return result;
+}
+
 /**
  * Search for a node with a given key
  * @param tree: Pointer to the tree
@@ -585,62 +916,185 @@ RBNode* searchNode(RBTree *tree, int key) {
     
     RBNode *current = tree->root;
     
-    while (current != NULL) {
-        if (key < current->key) {
-            current = current->left;
-        } else if (key > current->key) {
-            current = current->right;
-        } else {
-            return current;
-        }
+    while (current != NULL && key != current->key) {
+        current = childToward(current, key);
     }
     
-    return NULL;
+    return current;
 }
 
+/*
+ * Traversals keep their own fixed-size stack of ancestors instead of
+ * recursing. A red-black tree with n nodes is at most 2*log2(n+1) high,
+ * so RB_MAX_HEIGHT entries cover any tree that fits in memory. Stepping
+ * through parent pointers instead was measured 3x slower on 10M nodes:
+ * it re-reads every ancestor on the way up, and on large trees those
+ * reads are cache misses. The tree must not be modified during a walk.
+ *
+ * The walk helpers are always inlined with a constant order, so each
+ * order gets its own loop without a per-node dispatch.
+ */
+
+typedef struct {
+    RBNode *stack[RB_MAX_HEIGHT];
+    int top;
+} RBWalk;
+
 /**
- * In-order traversal of the tree (Left-Root-Right)
- * @param node: The root node of the subtree to traverse
- * @param callback: Function pointer to call for each node
+ * Push a node and its chain of first children for a walk
+ * @param walk: The walk state
+ * @param node: The subtree root to descend from
+ * @param order: Traversal order
  */
-void inOrderTraversal(RBNode *node, void (*callback)(RBNode*)) {
-    if (node == NULL) {
-        return;
+static inline __attribute__((always_inline))
+void descend(RBWalk *walk, RBNode *node, RBOrder order) {
+    while (node != NULL) {
+        walk->stack[walk->top++] = node;
+        if (order == RB_POST_ORDER && node->left == NULL) {
+            node = node->right;
+        } else {
+            /* Needed when this node is popped again */
+            __builtin_prefetch(node->right);
+            node = node->left;
+        }
     }
-    
-    inOrderTraversal(node->left, callback);
-    callback(node);
-    inOrderTraversal(node->right, callback);
 }
 
 /**
- * Pre-order traversal of the tree (Root-Left-Right)
- * @param node: The root node of the subtree to traverse
- * @param callback: Function pointer to call for each node
+ * Take the next node of a walk
+ * @param walk: The walk state
+ * @param order: Traversal order
+ * @return: Pointer to the next node, or NULL when the walk is done
  */
-void preOrderTraversal(RBNode *node, void (*callback)(RBNode*)) {
-    if (node == NULL) {
-        return;
+static inline __attribute__((always_inline))
+RBNode* nextInWalk(RBWalk *walk, RBOrder order) {
+    if (walk->top == 0) {
+        return NULL;
+    }
+    
+    RBNode *node = walk->stack[--walk->top];
+    
+    if (order == RB_PRE_ORDER) {
+        if (node->right != NULL) {
+            walk->stack[walk->top++] = node->right;
+        }
+        if (node->left != NULL) {
+            walk->stack[walk->top++] = node->left;
+        }
+    } else if (order == RB_POST_ORDER) {
+        if (walk->top > 0) {
+            RBNode *parent = walk->stack[walk->top - 1];
+            if (parent->left == node && parent->right != NULL) {
+                descend(walk, parent->right, order);
+            }
+        }
+    } else {
+        if (walk->top > 0) {
+            __builtin_prefetch(walk->stack[walk->top - 1]);
+        }
+        descend(walk, node->right, order);
     }
     
-    callback(node);
-    preOrderTraversal(node->left, callback);
-    preOrderTraversal(node->right, callback);
+    return node;
 }
 
 /**
- * Post-order traversal of the tree (Left-Right-Root)
- * @param node: The root node of the subtree to traverse
- * @param callback: Function pointer to call for each node
+ * Hand every node of a subtree to a batch callback in a given order
+ * @param root: The root node of the subtree to traverse
+ * @param order: Traversal order
+ * @param callback: Function to call with each batch of nodes
+ * @param context: Passed through to the callback
+ * @return: Number of nodes visited
  */
-void postOrderTraversal(RBNode *node, void (*callback)(RBNode*)) {
-    if (node == NULL) {
-        return;
+static inline __attribute__((always_inline))
+size_t walkBatches(RBNode *root, RBOrder order, RBBatchFunc callback,
+                   void *context) {
+    RBNode *batch[RB_VISIT_BATCH];
+    RBWalk walk;
+    size_t filled = 0;
+    size_t total = 0;
+    
+    walk.top = 0;
+    if (order != RB_PRE_ORDER) {
+        descend(&walk, root, order);
+    } else if (root != NULL) {
+        walk.stack[walk.top++] = root;
+    }
+    
+    while ((batch[filled] = nextInWalk(&walk, order)) != NULL) {
+        if (++filled == RB_VISIT_BATCH) {
+            callback(batch, filled, context);
+            total += filled;
+            filled = 0;
+        }
+    }
+    if (filled > 0) {
+        callback(batch, filled, context);
+        total += filled;
+    }
+    
+    return total;
+}
+
+/**
+ * Walk a subtree with the loop specialized for its order
+ * @return: Number of nodes visited
+ */
+static size_t walkSubtree(RBNode *root, RBOrder order, RBBatchFunc callback,
+                          void *context) {
+    switch (order) {
+        case RB_PRE_ORDER:
+            return walkBatches(root, RB_PRE_ORDER, callback, context);
+        case RB_POST_ORDER:
+            return walkBatches(root, RB_POST_ORDER, callback, context);
+        default:
+            return walkBatches(root, RB_IN_ORDER, callback, context);
     }
+}
+
+/* Batch callback that forwards each node to a node callback */
+static void callEachNode(RBNode **nodes, size_t count, void *context) {
+    void (*callback)(RBNode*) = *(void (**)(RBNode*))context;
     
-    postOrderTraversal(node->left, callback);
-    postOrderTraversal(node->right, callback);
-    callback(node);
+    for (size_t i = 0; i < count; i++) {
+        callback(nodes[i]);
+    }
+}
+
+/* Batch callback that forwards each node to a key/data callback */
+static void callEachEntry(RBNode **nodes, size_t count, void *context) {
+    void (*callback)(int, void*) = *(void (**)(int, void*))context;
+    
+    for (size_t i = 0; i < count; i++) {
+        callback(nodes[i]->key, nodes[i]->data);
+    }
+}
+
+/**
+ * In-order traversal of the tree (Left-Root-Right)
+ * @param node: The root node of the subtree to traverse
+ * @param callback: Function pointer to call for each node
+ */
+void inOrderTraversal(RBNode *node, void (*callback)(RBNode*)) {
+    walkSubtree(node, RB_IN_ORDER, callEachNode, &callback);
+}
+
+/**
+ * Pre-order traversal of the tree (Root-Left-Right)
+ * @param node: The root node of the subtree to traverse
+ * @param callback: Function pointer to call for each node
+ */
+void preOrderTraversal(RBNode *node, void (*callback)(RBNode*)) {
+    walkSubtree(node, RB_PRE_ORDER, callEachNode, &callback);
+}
+
+/**
+ * Post-order traversal of the tree (Left-Right-Root)
+ * @param node: The root node of the subtree to traverse
+ * @param callback: Function pointer to call for each node
+ */
+void postOrderTraversal(RBNode *node, void (*callback)(RBNode*)) {
+    walkSubtree(node, RB_POST_ORDER, callEachNode, &callback);
 }
 
 /**
@@ -649,18 +1103,63 @@ void postOrderTraversal(RBNode *node, void (*callback)(RBNode*)) {
  * @return: The height of the tree
  */
 int getHeight(RBNode *node) {
-    if (node == NULL) {
-        return 0;
+    RBNode *stack[RB_MAX_HEIGHT];
+    int depths[RB_MAX_HEIGHT];
+    int top = 0;
+    int height = 0;
+    
+    /* Pre-order walk that remembers the depth of each pending subtree */
+    if (node != NULL) {
+        stack[top] = node;
+        depths[top++] = 1;
+    }
+    while (top > 0) {
+        node = stack[--top];
+        int depth = depths[top];
+        
+        if (depth > height) {
+            height = depth;
+        }
+        if (node->right != NULL) {
+            stack[top] = node->right;
+            depths[top++] = depth + 1;
+        }
+        if (node->left != NULL) {
+            stack[top] = node->left;
+            depths[top++] = depth + 1;
+        }
     }
     
-    int left_height = getHeight(node->left);
-    int right_height = getHeight(node->right);
+    return height;
+}
+
+/**
+ * Check that a leaf (NULL child) sits below the same number of black
+ * nodes as every other leaf seen so far
+ * @param blacks: Black nodes from the root down to the leaf's parent
+ * @param expected: Black height of the first leaf, or -1 before it
+ * @return: 1 if valid, 0 if invalid
+ */
+static int checkLeafHeight(const RBNode *parent, int blacks, int *expected) {
+    if (*expected < 0) {
+        *expected = blacks;
+    } else if (blacks != *expected) {
+        fprintf(stderr, "Validation Error: Black height %d below %d, expected %d\n",
+                blacks, parent->key, *expected);
+        return 0;
+    }
     
-    return (left_height > right_height ? left_height : right_height) + 1;
+    return 1;
 }
 
 /**
  * Validate Red-Black Tree properties
+ *
+ * One in-order pass checks that the root is black, no red node has a
+ * red child, every root-to-leaf path has the same black height, keys
+ * strictly increase, parent pointers match child links and the node
+ * count matches tree->size. Stops at the first violation and prints it.
+ *
  * @param tree: Pointer to the tree
  * @return: 1 if valid, 0 if invalid
  */
@@ -670,6 +1169,10 @@ int validateRBTree(RBTree *tree) {
     }
     
     if (tree->root == NULL) {
+        if (tree->size != 0) {
+            fprintf(stderr, "Validation Error: Empty tree has size %zu\n", tree->size);
+            return 0;
+        }
         return 1;
     }
     
@@ -678,22 +1181,69 @@ int validateRBTree(RBTree *tree) {
         fprintf(stderr, "Validation Error: Root is not BLACK\n");
         return 0;
     }
+    if (tree->root->parent != NULL) {
+        fprintf(stderr, "Validation Error: Root has a parent\n");
+        return 0;
+    }
     
-    return 1;
-}
-
-/**
- * Free all nodes in the tree recursively
- * @param node: The root node of the subtree to free
- */
-void freeTree(RBNode *node) {
-    if (node == NULL) {
-        return;
+    /* Each stack entry remembers the black count from the root to it */
+    RBNode *stack[RB_MAX_HEIGHT];
+    int blackStack[RB_MAX_HEIGHT];
+    int top = 0;
+    int blacks = 0;
+    int leafBlacks = -1;
+    size_t count = 0;
+    RBNode *previous = NULL;
+    RBNode *node = tree->root;
+    
+    for (;;) {
+        while (node != NULL) {
+            if (top == RB_MAX_HEIGHT) {
+                fprintf(stderr, "Validation Error: Tree deeper than %d levels\n", RB_MAX_HEIGHT);
+                return 0;
+            }
+            if (!checkNodeLinks(node)) {
+                return 0;
+            }
+            blacks += node->color == BLACK;
+            if (node->left == NULL && !checkLeafHeight(node, blacks, &leafBlacks)) {
+                return 0;
+            }
+            stack[top] = node;
+            blackStack[top++] = blacks;
+            node = node->left;
+        }
+        if (top == 0) {
+            break;
+        }
+        
+        node = stack[--top];
+        blacks = blackStack[top];
+        
+        if (previous != NULL && previous->key >= node->key) {
+            fprintf(stderr, "Validation Error: Key %d follows %d in order\n",
+                    node->key, previous->key);
+            return 0;
+        }
+        /* Also stops a walk that a corrupted link sends in a cycle */
+        if (++count > tree->size) {
+            fprintf(stderr, "Validation Error: More nodes than size %zu\n", tree->size);
+            return 0;
+        }
+        if (node->right == NULL && !checkLeafHeight(node, blacks, &leafBlacks)) {
+            return 0;
+        }
+        
+        previous = node;
+        node = node->right;
     }
     
-    freeTree(node->left);
-    freeTree(node->right);
-    free(node);
+    if (count != tree->size) {
+        fprintf(stderr, "Validation Error: Found %zu nodes, size is %zu\n", count, tree->size);
+        return 0;
+    }
+    
+    return 1;
 }
 
 /**
@@ -705,7 +1255,7 @@ void destroyTree(RBTree *tree) {
         return;
     }
     
-    freeTree(tree->root);
+    releaseAllNodes(tree, NULL);
     free(tree);
 }
 
@@ -719,7 +1269,7 @@ int getTreeSize(RBTree *tree) {
         return 0;
     }
     
-    return tree->size;
+    return (int)tree->size;
 }
 
 /**
@@ -735,8 +1285,787 @@ int isEmpty(RBTree *tree) {
     return tree->root == NULL;
 }
 
+/* ============= Batch Operations ============= */
+
+/*
+ * Batches are merged with split and join (Blelloch, Ferizovic and Sun,
+ * "Just Join for Parallel Ordered Sets"). The tree is split at the
+ * batch's middle key, each half of the batch is merged into its half of
+ * the tree, and the halves are joined back around the middle node, for
+ * O(m log(n/m + 1)) work in all. The two halves share no nodes, so the
+ * top levels of the recursion run in their own threads.
+ *
+ * A subtree between split and join is detached from its parent and
+ * always has a black root, so its black height (the black nodes on any
+ * root-to-leaf path) is carried alongside instead of recomputed.
+ */
+
+typedef struct {
+    RBNode *root;
+    int blackHeight;
+} RBSubtree;
+
+typedef struct {
+    RBSubtree tree;                   /* Subtree to merge into; the result */
+    const int *keys;                  /* Delete: sorted unique keys */
+    RBNode **nodes;                   /* Insert: new nodes sorted by key */
+    RBNode **hits;                    /* Out: tree node found per key */
+    size_t count;
+    int spawnLevels;                  /* Levels that may start a thread */
+} RBBatchTask;
+
+static inline int isRed(const RBNode *node) {
+    return node != NULL && node->color == RED;
+}
+
+static inline void linkChildren(RBNode *node, RBNode *left, RBNode *right) {
+    node->left = left;
+    node->right = right;
+    if (left != NULL) {
+        left->parent = node;
+    }
+    if (right != NULL) {
+        right->parent = node;
+    }
+}
+
+/**
+ * Detach a child from its parent as a subtree with a black root
+ * @param root: The child, or NULL
+ * @param blackHeight: Its black height, counting itself if black
+ * @return: The detached subtree
+ */
+static RBSubtree detachSubtree(RBNode *root, int blackHeight) {
+    RBSubtree subtree = {root, blackHeight};
+    
+    if (root != NULL) {
+        root->parent = NULL;
+        if (root->color == RED) {
+            root->color = BLACK;
+            subtree.blackHeight++;
+        }
+    }
+    
+    return subtree;
+}
+
+/**
+ * Join node and right below the right spine of a taller left subtree
+ * @param left: Node on the right spine of the left subtree
+ * @param leftHeight: Black height of left
+ * @param rightHeight: Black height of right, at most leftHeight
+ * @return: New root of the subtree that replaces left
+ */
+static RBNode* joinRight(RBNode *left, int leftHeight, RBNode *node,
+                         RBNode *right, int rightHeight) {
+    if (!isRed(left) && leftHeight == rightHeight) {
+        node->color = RED;
+        linkChildren(node, left, right);
+        return node;
+    }
+    
+    RBNode *child = joinRight(left->right, leftHeight - (left->color == BLACK),
+                              node, right, rightHeight);
+    linkChildren(left, left->left, child);
+    
+    /* A red pair below a black node: rotate left and recolor */
+    if (left->color == BLACK && isRed(child) && isRed(child->right)) {
+        child->right->color = BLACK;
+        linkChildren(left, left->left, child->left);
+        linkChildren(child, left, child->right);
+        return child;
+    }
+    
+    return left;
+}
+
+/**
+ * Mirror image of joinRight for a taller right subtree
+ */
+static RBNode* joinLeft(RBNode *right, int rightHeight, RBNode *node,
+                        RBNode *left, int leftHeight) {
+    if (!isRed(right) && rightHeight == leftHeight) {
+        node->color = RED;
+        linkChildren(node, left, right);
+        return node;
+    }
+    
+    RBNode *child = joinLeft(right->left, rightHeight - (right->color == BLACK),
+                             node, left, leftHeight);
+    linkChildren(right, child, right->right);
+    
+    if (right->color == BLACK && isRed(child) && isRed(child->left)) {
+        child->left->color = BLACK;
+        linkChildren(right, child->right, right->right);
+        linkChildren(child, child->left, right);
+        return child;
+    }
+    
+    return right;
+}
+
+/**
+ * Join two subtrees around a node whose key lies between them
+ * @return: The joined subtree, with a black root
+ */
+static RBSubtree joinSubtrees(RBSubtree left, RBNode *node, RBSubtree right) {
+    RBNode *root;
+    int height;
+    
+    if (left.blackHeight > right.blackHeight) {
+        root = joinRight(left.root, left.blackHeight, node, right.root, right.blackHeight);
+        height = left.blackHeight;
+    } else if (right.blackHeight > left.blackHeight) {
+        root = joinLeft(right.root, right.blackHeight, node, left.root, left.blackHeight);
+        height = right.blackHeight;
+    } else {
+        node->color = BLACK;
+        linkChildren(node, left.root, right.root);
+        node->parent = NULL;
+        return (RBSubtree){node, left.blackHeight + 1};
+    }
+    
+    return detachSubtree(root, height);
+}
+
+/**
+ * Split a subtree into the keys below and above a key
+ * @param node: Root of the subtree
+ * @param blackHeight: Its black height, counting itself if black
+ * @param below: Out: subtree of smaller keys
+ * @param above: Out: subtree of larger keys
+ * @return: The node holding key (now detached), or NULL if absent
+ */
+static RBNode* splitSubtree(RBNode *node, int blackHeight, int key,
+                            RBSubtree *below, RBSubtree *above) {
+    if (node == NULL) {
+        below->root = above->root = NULL;
+        below->blackHeight = above->blackHeight = 0;
+        return NULL;
+    }
+    
+    int childHeight = blackHeight - (node->color == BLACK);
+    RBNode *found;
+    
+    if (key < node->key) {
+        RBSubtree upper = detachSubtree(node->right, childHeight);
+        found = splitSubtree(node->left, childHeight, key, below, above);
+        *above = joinSubtrees(*above, node, upper);
+    } else if (key > node->key) {
+        RBSubtree lower = detachSubtree(node->left, childHeight);
+        found = splitSubtree(node->right, childHeight, key, below, above);
+        *below = joinSubtrees(lower, node, *below);
+    } else {
+        *below = detachSubtree(node->left, childHeight);
+        *above = detachSubtree(node->right, childHeight);
+        found = node;
+    }
+    
+    return found;
+}
+
+/**
+ * Remove the node with the largest key from a subtree
+ * @param rest: Out: the remaining subtree
+ * @return: The removed node
+ */
+static RBNode* splitLast(RBNode *node, int blackHeight, RBSubtree *rest) {
+    int childHeight = blackHeight - (node->color == BLACK);
+    
+    if (node->right == NULL) {
+        *rest = detachSubtree(node->left, childHeight);
+        return node;
+    }
+    
+    RBSubtree lower = detachSubtree(node->left, childHeight);
+    RBNode *last = splitLast(node->right, childHeight, rest);
+    *rest = joinSubtrees(lower, node, *rest);
+    
+    return last;
+}
+
+/**
+ * Join two subtrees whose keys are all smaller in left
+ */
+static RBSubtree concatSubtrees(RBSubtree left, RBSubtree right) {
+    if (left.root == NULL) {
+        return right;
+    }
+    if (right.root == NULL) {
+        return left;
+    }
+    
+    RBSubtree rest;
+    RBNode *last = splitLast(left.root, left.blackHeight, &rest);
+    
+    return joinSubtrees(rest, last, right);
+}
+
+/**
+ * Link sorted nodes into a balanced subtree, reddening the deepest level
+ * @param depth: Depth of this subtree's root
+ * @param redDepth: floor(log2(total nodes)); nodes there are red
+ * @return: Root of the subtree
+ */
+static RBNode* buildBalanced(RBNode **nodes, size_t count, int depth, int redDepth) {
+    if (count == 0) {
+        return NULL;
+    }
+    
+    size_t mid = count / 2;
+    RBNode *node = nodes[mid];
+    
+    linkChildren(node,
+                 buildBalanced(nodes, mid, depth + 1, redDepth),
+                 buildBalanced(nodes + mid + 1, count - mid - 1, depth + 1, redDepth));
+    node->color = depth == redDepth ? RED : BLACK;
+    
+    return node;
+}
+
+static void runBatchTask(RBBatchTask *task);
+
+static void* runBatchThread(void *arg) {
+    runBatchTask((RBBatchTask*)arg);
+    return NULL;
+}
+
+/**
+ * Merge a sorted batch into a subtree: insert task->nodes, or delete
+ * task->keys when nodes is NULL. Found nodes are stored in task->hits.
+ * @param task: The batch; task->tree holds the result on return
+ */
+static void runBatchTask(RBBatchTask *task) {
+    size_t count = task->count;
+    
+    if (count == 0) {
+        return;
+    }
+    if (task->tree.root == NULL) {
+        if (task->nodes != NULL) {
+            int redDepth = 0;
+            while (((size_t)2 << redDepth) <= count) {
+                redDepth++;
+            }
+            task->tree = detachSubtree(buildBalanced(task->nodes, count, 0, redDepth),
+                                       redDepth);
+        }
+        return;
+    }
+    
+    size_t mid = count / 2;
+    int key = task->nodes != NULL ? task->nodes[mid]->key : task->keys[mid];
+    RBBatchTask halves[2];
+    RBNode *found = splitSubtree(task->tree.root, task->tree.blackHeight, key,
+                                 &halves[0].tree, &halves[1].tree);
+    
+    task->hits[mid] = found;
+    for (int h = 0; h < 2; h++) {
+        size_t offset = h == 0 ? 0 : mid + 1;
+        halves[h].keys = task->keys != NULL ? task->keys + offset : NULL;
+        halves[h].nodes = task->nodes != NULL ? task->nodes + offset : NULL;
+        halves[h].hits = task->hits + offset;
+        halves[h].count = h == 0 ? mid : count - mid - 1;
+        halves[h].spawnLevels = task->spawnLevels - 1;
+    }
+    
+    /* The halves touch disjoint nodes; a failed spawn runs inline */
+    pthread_t handle;
+    int started = task->spawnLevels > 0 && mid >= RB_BATCH_PARALLEL_THRESHOLD &&
+                  pthread_create(&handle, NULL, runBatchThread, &halves[0]) == 0;
+    if (!started) {
+        runBatchTask(&halves[0]);
+    }
+    runBatchTask(&halves[1]);
+    if (started) {
+        pthread_join(handle, NULL);
+    }
+    
+    if (task->nodes != NULL) {
+        task->tree = joinSubtrees(halves[0].tree, found != NULL ? found : task->nodes[mid],
+                                  halves[1].tree);
+    } else {
+        task->tree = concatSubtrees(halves[0].tree, halves[1].tree);
+    }
+}
+
+/**
+ * Run a batch over a whole tree, with threads when the batch is large
+ * @param nodes: Insert: new nodes sorted by key, or NULL to delete keys
+ * @param hits: Zeroed array of count entries for the nodes found
+ */
+static void runBatch(RBTree *tree, const int *keys, RBNode **nodes,
+                     RBNode **hits, size_t count) {
+    RBBatchTask task = {
+        {tree->root, leftBlackHeight(tree->root)}, keys, nodes, hits, count, 0
+    };
+    
+    if (count >= 2 * RB_BATCH_PARALLEL_THRESHOLD) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        while (task.spawnLevels < RB_BATCH_MAX_SPAWN_LEVELS &&
+               (2L << task.spawnLevels) <= cpus) {
+            task.spawnLevels++;
+        }
+    }
+    
+    runBatchTask(&task);
+    tree->root = task.tree.root;
+}
+
+/* Packed (key, position) words sort by key, then by batch position */
+static int compareBatchWords(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int compareKeys(const void *a, const void *b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/* ============= Public API (RBTREE.h) ============= */
+
+/**
+ * Find the first node whose key is greater than (or equal to) a key
+ * @param tree: Pointer to the tree
+ * @param key: The reference key
+ * @param inclusive: Nonzero to accept a node equal to key
+ * @return: Pointer to the node, or NULL if no such node exists
+ */
+static RBNode* upperNode(RBTree *tree, int key, int inclusive) {
+    RBNode *current = tree->root;
+    RBNode *best = NULL;
+    
+    while (current != NULL) {
+        if (current->key > key || (inclusive && current->key == key)) {
+            best = current;
+            current = current->left;
+        } else {
+            current = current->right;
+        }
+    }
+    
+    return best;
+}
+
+/**
+ * Find the last node whose key is less than (or equal to) a key
+ * @param tree: Pointer to the tree
+ * @param key: The reference key
+ * @param inclusive: Nonzero to accept a node equal to key
+ * @return: Pointer to the node, or NULL if no such node exists
+ */
+static RBNode* lowerNode(RBTree *tree, int key, int inclusive) {
+    RBNode *current = tree->root;
+    RBNode *best = NULL;
+    
+    while (current != NULL) {
+        if (current->key < key || (inclusive && current->key == key)) {
+            best = current;
+            current = current->right;
+        } else {
+            current = current->left;
+        }
+    }
+    
+    return best;
+}
+
+RBTree* RBTree_Create(void) {
+    return createTree();
+}
+
+void RBTree_Destroy(RBTree *tree, FreeDataFunc free_data) {
+    if (tree == NULL) {
+        return;
+    }
+    
+    releaseAllNodes(tree, free_data);
+    free(tree);
+}
+
+int RBTree_Insert(RBTree *tree, int key, void *data) {
+    if (tree == NULL || data == NULL) {
+        return -1;
+    }
+    
+    if (searchNode(tree, key) != NULL) {
+        return 0;
+    }
+    
+    return insertNode(tree, key, data) ? 1 : -1;
+}
+
+void* RBTree_Search(RBTree *tree, int key) {
+    /* Timed here, not in searchNode: insert and delete descend through
+     * searchNode too, and a hook inside the descent slowed every one.
+     * Only -DMETRICS_TREE builds time it; see METRICS.h */
+    METRICS_TREE_START(METRIC_RB_SEARCH);
+    RBNode *node = searchNode(tree, key);
+    METRICS_TREE_STOP(METRIC_RB_SEARCH);
+    return node != NULL ? node->data : NULL;
+}
+
+size_t RBTree_SearchBatch(RBTree *tree, const int *keys, void **results,
+                          size_t count) {
+    RBNode *cursor[RB_SEARCH_GROUP];
+    size_t slot[RB_SEARCH_GROUP];
+    size_t active = 0;
+    size_t next = 0;
+    size_t found = 0;
+    
+    if (tree == NULL) {
+        for (size_t i = 0; i < count; i++) {
+            results[i] = NULL;
+        }
+        return 0;
+    }
+    
+    while (active < RB_SEARCH_GROUP && next < count) {
+        cursor[active] = tree->root;
+        slot[active++] = next++;
+    }
+    
+    /*
+     * Each pass moves every descent in the group one level down and
+     * prefetches the node it lands on; by the time the pass comes back
+     * to that descent the node is usually in cache. A finished descent
+     * hands its place to the next key, so the group stays full.
+     */
+    while (active > 0) {
+        size_t g = 0;
+        while (g < active) {
+            RBNode *node = cursor[g];
+            int key = keys[slot[g]];
+            
+            if (node != NULL && node->key != key) {
+                node = childToward(node, key);
+                __builtin_prefetch(node);
+                cursor[g++] = node;
+                continue;
+            }
+            
+            results[slot[g]] = node != NULL ? node->data : NULL;
+            found += node != NULL;
+            if (next < count) {
+                cursor[g] = tree->root;
+                slot[g++] = next++;
+            } else {
+                active--;
+                cursor[g] = cursor[active];
+                slot[g] = slot[active];
+            }
+        }
+    }
+    
+    return found;
+}
+
+int RBTree_Delete(RBTree *tree, int key, FreeDataFunc free_data) {
+    if (tree == NULL) {
+        return -1;
+    }
+    
+    RBNode *node = searchNode(tree, key);
+    if (node == NULL) {
+        return 0;
+    }
+    
+    void *data = node->data;
+    deleteNode(tree, key);
+    if (free_data != NULL) {
+        free_data(data);
+    }
+    
+    return 1;
+}
+
+int RBTree_InsertBatch(RBTree *tree, const int *keys, void *const *data,
+                       size_t count) {
+    if (tree == NULL || (count > 0 && (keys == NULL || data == NULL)) ||
+        count > UINT32_MAX) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (data[i] == NULL) {
+            return -1;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    
+    uint64_t *words = (uint64_t*)malloc(count * sizeof(uint64_t));
+    RBNode **nodes = (RBNode**)malloc(count * sizeof(RBNode*));
+    RBNode **hits = (RBNode**)calloc(count, sizeof(RBNode*));
+    if (words == NULL || nodes == NULL || hits == NULL) {
+        fprintf(stderr, "Memory allocation failed for insert batch\n");
+        free(words);
+        free(nodes);
+        free(hits);
+        return -1;
+    }
+    
+    /* Sort by key; the first of several equal keys wins, as with Insert */
+    int sorted = 1;
+    for (size_t i = 0; i < count; i++) {
+        words[i] = ((uint64_t)((uint32_t)keys[i] ^ 0x80000000u) << 32) | i;
+        sorted = sorted && (i == 0 || words[i - 1] < words[i]);
+    }
+    if (!sorted) {
+        qsort(words, count, sizeof(uint64_t), compareBatchWords);
+    }
+    
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && (words[i] >> 32) == (words[i - 1] >> 32)) {
+            continue;
+        }
+        size_t position = (size_t)(uint32_t)words[i];
+        nodes[unique] = createNode(tree, keys[position], data[position]);
+        if (nodes[unique] == NULL) {
+            while (unique > 0) {
+                releaseNode(tree, nodes[--unique]);
+            }
+            free(words);
+            free(nodes);
+            free(hits);
+            return -1;
+        }
+        unique++;
+    }
+    free(words);
+    
+    if (unique >= tree->size / RB_BATCH_JOIN_RATIO) {
+        runBatch(tree, NULL, nodes, hits, unique);
+    } else {
+        for (size_t i = 0; i < unique; i++) {
+            hits[i] = linkNewNode(tree, nodes[i]);
+        }
+    }
+    RB_CHECK_PATH(tree, hits[unique / 2] != NULL ? hits[unique / 2] : nodes[unique / 2],
+                  "insert batch", nodes[unique / 2]->key);
+    
+    /* Keys already present keep their data; drop their spare nodes */
+    int inserted = 0;
+    for (size_t i = 0; i < unique; i++) {
+        if (hits[i] != NULL) {
+            releaseNode(tree, nodes[i]);
+        } else {
+            inserted++;
+        }
+    }
+    tree->size += (size_t)inserted;
+    
+    free(nodes);
+    free(hits);
+    return inserted;
+}
+
+int RBTree_DeleteBatch(RBTree *tree, const int *keys, size_t count,
+                       FreeDataFunc free_data) {
+    if (tree == NULL || (count > 0 && keys == NULL)) {
+        return -1;
+    }
+    if (count == 0 || tree->root == NULL) {
+        return 0;
+    }
+    
+    int *sortedKeys = (int*)malloc(count * sizeof(int));
+    RBNode **hits = (RBNode**)calloc(count, sizeof(RBNode*));
+    if (sortedKeys == NULL || hits == NULL) {
+        fprintf(stderr, "Memory allocation failed for delete batch\n");
+        free(sortedKeys);
+        free(hits);
+        return -1;
+    }
+    
+    int sorted = 1;
+    for (size_t i = 0; i < count; i++) {
+        sortedKeys[i] = keys[i];
+        sorted = sorted && (i == 0 || keys[i - 1] <= keys[i]);
+    }
+    if (!sorted) {
+        qsort(sortedKeys, count, sizeof(int), compareKeys);
+    }
+    
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique == 0 || sortedKeys[unique - 1] != sortedKeys[i]) {
+            sortedKeys[unique++] = sortedKeys[i];
+        }
+    }
+    
+    if (unique >= tree->size / RB_BATCH_JOIN_RATIO) {
+        runBatch(tree, sortedKeys, NULL, hits, unique);
+    } else {
+        for (size_t i = 0; i < unique; i++) {
+            hits[i] = searchNode(tree, sortedKeys[i]);
+            if (hits[i] != NULL) {
+                unlinkNode(tree, hits[i]);
+            }
+        }
+    }
+    RB_CHECK_PATH(tree, tree->root != NULL ? findMinimum(tree->root) : NULL,
+                  "delete batch", sortedKeys[unique / 2]);
+    
+    int deleted = 0;
+    for (size_t i = 0; i < unique; i++) {
+        if (hits[i] != NULL) {
+            void *data = hits[i]->data;
+            releaseNode(tree, hits[i]);
+            if (free_data != NULL) {
+                free_data(data);
+            }
+            deleted++;
+        }
+    }
+    tree->size -= (size_t)deleted;
+    
+    free(sortedKeys);
+    free(hits);
+    return deleted;
+}
+
+size_t RBTree_Size(RBTree *tree) {
+    return tree != NULL ? tree->size : 0;
+}
+
+int RBTree_IsEmpty(RBTree *tree) {
+    return isEmpty(tree);
+}
+
+int RBTree_Height(RBTree *tree) {
+    return tree != NULL ? getHeight(tree->root) : 0;
+}
+
+void* RBTree_FindMin(RBTree *tree) {
+    RBNode *node = tree != NULL ? findMinimum(tree->root) : NULL;
+    return node != NULL ? node->data : NULL;
+}
+
+void* RBTree_FindMax(RBTree *tree) {
+    RBNode *node = tree != NULL ? findMaximum(tree->root) : NULL;
+    return node != NULL ? node->data : NULL;
+}
+
+int RBTree_InOrderTraversal(RBTree *tree, void (*callback)(int, void*)) {
+    if (tree == NULL || callback == NULL) {
+        return -1;
+    }
+    
+    return (int)walkSubtree(tree->root, RB_IN_ORDER, callEachEntry, &callback);
+}
+
+int RBTree_PreOrderTraversal(RBTree *tree, void (*callback)(int, void*)) {
+    if (tree == NULL || callback == NULL) {
+        return -1;
+    }
+    
+    return (int)walkSubtree(tree->root, RB_PRE_ORDER, callEachEntry, &callback);
+}
+
+int RBTree_PostOrderTraversal(RBTree *tree, void (*callback)(int, void*)) {
+    if (tree == NULL || callback == NULL) {
+        return -1;
+    }
+    
+    return (int)walkSubtree(tree->root, RB_POST_ORDER, callEachEntry, &callback);
+}
+
+size_t RBTree_VisitBatch(RBTree *tree, RBOrder order,
+                        RBBatchFunc callback, void *context) {
+    if (tree == NULL || callback == NULL) {
+        return 0;
+    }
+    
+    return walkSubtree(tree->root, order, callback, context);
+}
+
+int RBTree_Clear(RBTree *tree, FreeDataFunc free_data) {
+    if (tree == NULL) {
+        return -1;
+    }
+    
+    releaseAllNodes(tree, free_data);
+    
+    return 0;
+}
+
+int RBTree_Contains(RBTree *tree, int key) {
+    METRICS_TREE_START(METRIC_RB_SEARCH);
+    RBNode *node = searchNode(tree, key);
+    METRICS_TREE_STOP(METRIC_RB_SEARCH);
+    return node != NULL;
+}
+
+int RBTree_Update(RBTree *tree, int key, void *data) {
+    if (tree == NULL || data == NULL) {
+        return -1;
+    }
+    
+    RBNode *node = searchNode(tree, key);
+    if (node == NULL) {
+        return 0;
+    }
+    
+    node->data = data;
+    return 1;
+}
+
+void* RBTree_Successor(RBTree *tree, int key) {
+    RBNode *node = tree != NULL ? upperNode(tree, key, 0) : NULL;
+    return node != NULL ? node->data : NULL;
+}
+
+void* RBTree_Predecessor(RBTree *tree, int key) {
+    RBNode *node = tree != NULL ? lowerNode(tree, key, 0) : NULL;
+    return node != NULL ? node->data : NULL;
+}
+
+int RBTree_RangeSearch(RBTree *tree, int min_key, int max_key,
+                       void **results, size_t max_results) {
+    if (tree == NULL || (results == NULL && max_results > 0)) {
+        return -1;
+    }
+    
+    size_t count = 0;
+    RBNode *node = upperNode(tree, min_key, 1);
+    
+    while (node != NULL && node->key <= max_key && count < max_results) {
+        results[count++] = node->data;
+        node = findSuccessor(node);
+    }
+    
+    return (int)count;
+}
+
+RBNode* RBTree_LowerBound(RBTree *tree, int key) {
+    return tree != NULL ? upperNode(tree, key, 1) : NULL;
+}
+
+RBNode* RBTree_Next(RBNode *node) {
+    return findSuccessor(node);
+}
+
+RBNode* RBTree_Floor(RBTree *tree, int key) {
+    return tree != NULL ? lowerNode(tree, key, 1) : NULL;
+}
+
+RBNode* RBTree_Prev(RBNode *node) {
+    return findPredecessor(node);
+}
+
+int RBTree_Verify(RBTree *tree) {
+    return validateRBTree(tree);
+}
+
 /* ============= Example Usage and Testing ============= */
 
+#ifdef RBTREE_DEMO
+
 /**
  * Callback function to print node information
  */
@@ -746,7 +2075,7 @@ void printNode(RBNode *node) {
     }
     
     const char *color = (node->color == RED) ? "RED" : "BLACK";
-    printf("Key: %d | Data: %s | Color: %s\n", node->key, node->data, color);
+    printf("Key: %d | Data: %s | Color: %s\n", node->key, (const char*)node->data, color);
 }
 
 /**
@@ -816,3 +2145,5 @@ int main() {
     
     return 0;
 }
+
+#endif /* RBTREE_DEMO */
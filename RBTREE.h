@@ -11,6 +11,10 @@
  * 
  * This header file defines the data structures and function declarations
  * for a self-balancing Red-Black Tree (RBT) data structure.
+ *
+ * Nodes are allocated from per-tree slabs and recycled on delete; a
+ * node pointer stays valid until its key is deleted or the tree is
+ * cleared or destroyed.
  */
 
 /* Color enumeration for Red-Black Tree nodes */
@@ -29,12 +33,39 @@ typedef struct RBNode {
     Color color;                      /* Color of the node (RED or BLACK) */
 } RBNode;
 
+/* Slab of node storage (defined in RBTREE.c) */
+struct RBSlab;
+
 /* Red-Black Tree structure */
 typedef struct {
     RBNode *root;                     /* Pointer to root node */
     size_t size;                      /* Number of nodes in the tree */
+    struct RBSlab *slabs;             /* Node storage, newest slab first */
+    RBNode *freeNodes;                /* Recycled nodes, linked via left */
 } RBTree;
 
+/* Traversal orders for RBTree_VisitBatch */
+typedef enum {
+    RB_IN_ORDER = 0,
+    RB_PRE_ORDER,
+    RB_POST_ORDER
+} RBOrder;
+
+/* Most nodes handed to one RBTree_VisitBatch callback */
+#define RB_VISIT_BATCH 256
+
+/* Lookups RBTree_SearchBatch keeps in flight at once */
+#define RB_SEARCH_GROUP 16
+
+/* Batches smaller than tree size / ratio are applied key by key in order */
+#ifndef RB_BATCH_JOIN_RATIO
+#define RB_BATCH_JOIN_RATIO 32
+#endif
+/* Batch keys per half before RBTree_InsertBatch/DeleteBatch use a thread */
+#define RB_BATCH_PARALLEL_THRESHOLD 65536
+/* Split levels that may start threads: up to 2^levels threads */
+#define RB_BATCH_MAX_SPAWN_LEVELS 3
+
 /* Comparison function type for custom key comparison */
 typedef int (*CompareFunc)(int, int);
 
@@ -44,6 +75,9 @@ typedef void* (*CopyDataFunc)(void*);
 /* Data free function type for freeing node data */
 typedef void (*FreeDataFunc)(void*);
 
+/* Batch visitor: receives up to RB_VISIT_BATCH nodes per call */
+typedef void (*RBBatchFunc)(RBNode **nodes, size_t count, void *context);
+
 /**
  * @brief Create a new Red-Black Tree
  * @return Pointer to newly created RBTree, or NULL on failure
@@ -74,6 +108,43 @@ int RBTree_Insert(RBTree *tree, int key, void *data);
  */
 void* RBTree_Search(RBTree *tree, int key);
 
+/**
+ * @brief Search for many keys at once
+ *
+ * Runs up to RB_SEARCH_GROUP descents interleaved, one level of each
+ * in turn, and prefetches the next node of every descent before coming
+ * back to it. On a tree larger than the cache the misses of the group
+ * overlap instead of stalling one lookup at a time. Keys may come in
+ * any order and repeat.
+ *
+ * @param tree Pointer to the RBTree
+ * @param keys Keys to look up
+ * @param results Receives the data for each key, or NULL if not found
+ * @param count Number of keys
+ * @return Number of keys found
+ */
+size_t RBTree_SearchBatch(RBTree *tree, const int *keys, void **results,
+                          size_t count);
+
+/**
+ * @brief Insert many key-value pairs at once
+ *
+ * Sorts the batch and merges it into the tree with split and join in
+ * O(m log(n/m + 1)) for m keys, instead of m separate descents and
+ * fix-ups. Large batches are merged in parallel over disjoint subtrees.
+ * Keys already in the tree are left unchanged, and of several equal keys
+ * in the batch the first wins, as with repeated RBTree_Insert calls.
+ * Node pointers into the tree stay valid.
+ *
+ * @param tree Pointer to the RBTree
+ * @param keys Keys to insert, in any order
+ * @param data Data for each key; no entry may be NULL
+ * @param count Number of keys
+ * @return Number of keys inserted, or -1 on failure (tree unchanged)
+ */
+int RBTree_InsertBatch(RBTree *tree, const int *keys, void *const *data,
+                       size_t count);
+
 /**
  * @brief Delete a key from the Red-Black Tree
  * @param tree Pointer to the RBTree
@@ -83,6 +154,21 @@ void* RBTree_Search(RBTree *tree, int key);
  */
 int RBTree_Delete(RBTree *tree, int key, FreeDataFunc free_data);
 
+/**
+ * @brief Delete many keys at once
+ *
+ * The batch counterpart of RBTree_Delete, merged like
+ * RBTree_InsertBatch. Keys not in the tree and repeated keys are skipped.
+ *
+ * @param tree Pointer to the RBTree
+ * @param keys Keys to delete, in any order
+ * @param count Number of keys
+ * @param free_data Function pointer to free node data, or NULL
+ * @return Number of keys deleted, or -1 on failure (tree unchanged)
+ */
+int RBTree_DeleteBatch(RBTree *tree, const int *keys, size_t count,
+                       FreeDataFunc free_data);
+
 /**
  * @brief Get the number of nodes in the Red-Black Tree
  * @param tree Pointer to the RBTree
@@ -142,6 +228,23 @@ int RBTree_PreOrderTraversal(RBTree *tree, void (*callback)(int, void*));
  */
 int RBTree_PostOrderTraversal(RBTree *tree, void (*callback)(int, void*));
 
+/**
+ * @brief Visit every node in a given order, a batch of nodes at a time
+ *
+ * Walks without recursion, keeping the ancestors of the current node
+ * on a fixed-size stack of RB_MAX_HEIGHT entries, so stack use does not
+ * grow with the tree. The tree must not change during the walk: the
+ * callback must not insert into or delete from it.
+ *
+ * @param tree Pointer to the RBTree
+ * @param order RB_IN_ORDER, RB_PRE_ORDER or RB_POST_ORDER
+ * @param callback Function receiving consecutive nodes of the walk
+ * @param context Passed through to callback
+ * @return Number of nodes visited
+ */
+size_t RBTree_VisitBatch(RBTree *tree, RBOrder order,
+                        RBBatchFunc callback, void *context);
+
 /**
  * @brief Clear all nodes from the Red-Black Tree
  * @param tree Pointer to the RBTree
@@ -195,8 +298,44 @@ void* RBTree_Predecessor(RBTree *tree, int key);
 int RBTree_RangeSearch(RBTree *tree, int min_key, int max_key, 
                        void **results, size_t max_results);
 
+/**
+ * @brief Find the first node whose key is not less than a given key
+ * @param tree Pointer to the RBTree
+ * @param key The lower bound (inclusive)
+ * @return Pointer to the node, or NULL if every key is smaller
+ */
+RBNode* RBTree_LowerBound(RBTree *tree, int key);
+
+/**
+ * @brief Get the in-order successor of a node
+ * @param node Pointer to a node owned by an RBTree
+ * @return Pointer to the next node in key order, or NULL at the end
+ */
+RBNode* RBTree_Next(RBNode *node);
+
+/**
+ * @brief Find the last node whose key is not greater than a given key
+ * @param tree Pointer to the RBTree
+ * @param key The upper bound (inclusive)
+ * @return Pointer to the node, or NULL if every key is larger
+ */
+RBNode* RBTree_Floor(RBTree *tree, int key);
+
+/**
+ * @brief Get the in-order predecessor of a node
+ * @param node Pointer to a node owned by an RBTree
+ * @return Pointer to the previous node in key order, or NULL at the start
+ */
+RBNode* RBTree_Prev(RBNode *node);
+
 /**
  * @brief Verify Red-Black Tree properties (for debugging)
+ *
+ * Checks node colors, black height, key order, parent pointers and
+ * the stored size in one O(n) pass, printing the first violation to
+ * stderr. Builds with -DRB_DEBUG also check the mutated path after a
+ * sample of inserts and deletes and abort on a violation.
+ *
  * @param tree Pointer to the RBTree
  * @return 1 if tree satisfies all RB properties, 0 otherwise
  */
@@ -0,0 +1,237 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "RENDER.h"
+
+#define LITERAL(buffer, text) Render_Append((buffer), (text), sizeof(text) - 1)
+
+static const char spaces[64] =
+    "                                                                ";
+
+static const char digitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* ============= Buffer ============= */
+
+int Render_Init(RenderBuffer *buffer, int fd, size_t capacity) {
+    if (capacity < 256) {
+        capacity = 256;
+    }
+
+    buffer->data = (char*)malloc(capacity);
+    if (buffer->data == NULL) {
+        fprintf(stderr, "Memory allocation failed for render buffer\n");
+        return -1;
+    }
+
+    buffer->length = 0;
+    buffer->capacity = capacity;
+    buffer->fd = fd;
+    buffer->failed = 0;
+
+    return 0;
+}
+
+void Render_Free(RenderBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+/**
+ * Write bytes to the buffer's descriptor, retrying short writes
+ * @return: 0 on success, -1 on error
+ */
+static int writeAll(int fd, const char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+int Render_Flush(RenderBuffer *buffer) {
+    if (buffer->length > 0 &&
+        writeAll(buffer->fd, buffer->data, buffer->length) != 0) {
+        buffer->failed = 1;
+    }
+    buffer->length = 0;
+
+    int failed = buffer->failed;
+    buffer->failed = 0;
+    return failed ? -1 : 0;
+}
+
+/**
+ * Make room for length more bytes, flushing if needed
+ * @return: Where to write them (length must not exceed the capacity)
+ */
+static char* reserve(RenderBuffer *buffer, size_t length) {
+    if (buffer->capacity - buffer->length < length) {
+        if (writeAll(buffer->fd, buffer->data, buffer->length) != 0) {
+            buffer->failed = 1;
+        }
+        buffer->length = 0;
+    }
+    return buffer->data + buffer->length;
+}
+
+void Render_Append(RenderBuffer *buffer, const char *bytes, size_t length) {
+    if (length > buffer->capacity) {
+        reserve(buffer, buffer->capacity);
+        if (writeAll(buffer->fd, bytes, length) != 0) {
+            buffer->failed = 1;
+        }
+        return;
+    }
+
+    memcpy(reserve(buffer, length), bytes, length);
+    buffer->length += length;
+}
+
+void Render_Text(RenderBuffer *buffer, const char *text) {
+    Render_Append(buffer, text, strlen(text));
+}
+
+static void appendSpaces(RenderBuffer *buffer, size_t count) {
+    while (count > 0) {
+        size_t chunk = count < sizeof(spaces) ? count : sizeof(spaces);
+        Render_Append(buffer, spaces, chunk);
+        count -= chunk;
+    }
+}
+
+/* ============= Field Formatters ============= */
+
+void Render_Padded(RenderBuffer *buffer, const char *text, int width) {
+    size_t length = strlen(text);
+
+    Render_Append(buffer, text, length);
+    if (width > 0 && length < (size_t)width) {
+        appendSpaces(buffer, (size_t)width - length);
+    }
+}
+
+/**
+ * Write the decimal digits of a value ending just before end
+ * @return: Start of the digits
+ */
+static char* formatDigits(unsigned long value, char *end) {
+    while (value >= 100) {
+        unsigned long pair = value % 100;
+        value /= 100;
+        end -= 2;
+        memcpy(end, digitPairs + 2 * pair, 2);
+    }
+    if (value >= 10) {
+        end -= 2;
+        memcpy(end, digitPairs + 2 * value, 2);
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+void Render_Int(RenderBuffer *buffer, long value, int width) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value
+                                        : (unsigned long)value;
+    char *start = formatDigits(magnitude, end);
+
+    if (value < 0) {
+        *--start = '-';
+    }
+
+    size_t length = (size_t)(end - start);
+    if (width > 0 && length < (size_t)width) {
+        appendSpaces(buffer, (size_t)width - length);
+    }
+    Render_Append(buffer, start, length);
+}
+
+void Render_Price(RenderBuffer *buffer, float price, int width) {
+    double magnitude = fabs((double)price);
+    char text[48];
+    size_t length;
+
+    /*
+     * A float times 100 is exact in a double, so rounding it to even
+     * matches printf's rounding of the exact value
+     */
+    if (isfinite(price) && magnitude < 1e15) {
+        unsigned long cents = (unsigned long)nearbyint(magnitude * 100.0);
+        char *end = text + sizeof(text);
+        char *start;
+
+        end -= 2;
+        memcpy(end, digitPairs + 2 * (cents % 100), 2);
+        *--end = '.';
+        start = formatDigits(cents / 100, end);
+        if (signbit(price)) {
+            *--start = '-';
+        }
+        length = (size_t)(text + sizeof(text) - start);
+        memmove(text, start, length);
+    } else {
+        length = (size_t)snprintf(text, sizeof(text), "%.2f", price);
+        if (length >= sizeof(text)) {
+            length = sizeof(text) - 1;
+        }
+    }
+
+    Render_Append(buffer, text, length);
+    if (width > 0 && length < (size_t)width) {
+        appendSpaces(buffer, (size_t)width - length);
+    }
+}
+
+/* ============= Book Layouts ============= */
+
+void Render_BookRow(RenderBuffer *buffer, const Book *book) {
+    LITERAL(buffer, "| ");
+    Render_Int(buffer, book->id, 2);
+    LITERAL(buffer, " | ");
+    Render_Padded(buffer, book->title, 24);
+    LITERAL(buffer, " | ");
+    Render_Padded(buffer, book->author, 19);
+    LITERAL(buffer, " | ");
+    Render_Padded(buffer, book->isbn, 13);
+    LITERAL(buffer, " | ");
+    Render_Int(buffer, book->year, 4);
+    LITERAL(buffer, " | $");
+    Render_Price(buffer, book->price, 5);
+    LITERAL(buffer, " |\n");
+}
+
+void Render_BookDetails(RenderBuffer *buffer, const Book *book) {
+    LITERAL(buffer, "\nBook ID: ");
+    Render_Int(buffer, book->id, 0);
+    LITERAL(buffer, "\nTitle: ");
+    Render_Text(buffer, book->title);
+    LITERAL(buffer, "\nAuthor: ");
+    Render_Text(buffer, book->author);
+    LITERAL(buffer, "\nISBN: ");
+    Render_Text(buffer, book->isbn);
+    LITERAL(buffer, "\nYear: ");
+    Render_Int(buffer, book->year, 0);
+    LITERAL(buffer, "\nPrice: $");
+    Render_Price(buffer, book->price, 0);
+    LITERAL(buffer, "\nQuantity: ");
+    Render_Int(buffer, book->quantity, 0);
+    LITERAL(buffer, "\n─────────────────────────────────────────────────────────────────────\n");
+}
@@ -0,0 +1,90 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stddef.h>
+
+#include "LIBRARY.h"
+
+/**
+ * @file RENDER.h
+ * @brief Buffered rendering of catalog output
+ *
+ * A RenderBuffer collects formatted output in one reusable block and
+ * hands it to the kernel with a single write when the block fills or
+ * the caller flushes. Rows are built with specialized formatters
+ * (integers from a two-digit table, prices from their cent count,
+ * padding copied from a run of spaces), not by parsing printf format
+ * strings, and produce the same bytes as the printf formats they
+ * replace.
+ *
+ * The buffer writes to a file descriptor directly. When that
+ * descriptor is also used through stdio, fflush the stream before
+ * rendering and flush the buffer before printing again.
+ */
+
+#define RENDER_DEFAULT_CAPACITY (64 * 1024)
+
+typedef struct {
+    char *data;
+    size_t length;                    /* Bytes waiting to be written */
+    size_t capacity;
+    int fd;                           /* Destination */
+    int failed;                       /* A write failed; output was dropped */
+} RenderBuffer;
+
+/**
+ * @brief Create an empty buffer writing to a file descriptor
+ * @param capacity Buffer size in bytes (at least 256)
+ * @return 0 on success, -1 on allocation failure
+ */
+int Render_Init(RenderBuffer *buffer, int fd, size_t capacity);
+
+/**
+ * @brief Free the buffer without writing what it holds
+ */
+void Render_Free(RenderBuffer *buffer);
+
+/**
+ * @brief Write everything buffered
+ * @return 0 on success, -1 if any write since the last flush failed
+ */
+int Render_Flush(RenderBuffer *buffer);
+
+/**
+ * @brief Append raw bytes
+ */
+void Render_Append(RenderBuffer *buffer, const char *bytes, size_t length);
+
+/**
+ * @brief Append a NUL-terminated string
+ */
+void Render_Text(RenderBuffer *buffer, const char *text);
+
+/**
+ * @brief Append a string left-justified in width bytes, as "%-*s"
+ */
+void Render_Padded(RenderBuffer *buffer, const char *text, int width);
+
+/**
+ * @brief Append an integer right-justified in width bytes, as "%*ld"
+ */
+void Render_Int(RenderBuffer *buffer, long value, int width);
+
+/**
+ * @brief Append a price left-justified in width bytes, as "%-*.2f"
+ */
+void Render_Price(RenderBuffer *buffer, float price, int width);
+
+/**
+ * @brief Append one row of the book table
+ *
+ * Same bytes as "| %2d | %-24s | %-19s | %-13s | %4d | $%-5.2f |\n".
+ */
+void Render_BookRow(RenderBuffer *buffer, const Book *book);
+
+/**
+ * @brief Append the multi-line description of one book
+ */
+void Render_BookDetails(RenderBuffer *buffer, const Book *book);
+
+#endif /* RENDER_H */
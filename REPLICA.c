@@ -0,0 +1,829 @@
+#define _GNU_SOURCE                   /* pthread_rwlockattr_setkind_np */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "REPLICA.h"
+
+#define RECEIVE_BUFFER (256 * 1024)
+
+static int64_t nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void deadlineAfter(struct timespec *deadline, int ms) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+static void initFrame(ReplicaFrame *frame, ReplicaOp op, uint64_t lsn) {
+    memset(frame, 0, sizeof(*frame));
+    frame->magic = REPLICA_MAGIC;
+    frame->op = op;
+    frame->lsn = lsn;
+    frame->timeNs = nowNs();
+    frame->recordSize = sizeof(Book);
+}
+
+/**
+ * Fill a Unix socket address from a path
+ * @return: 0 on success, -1 if the path is too long
+ */
+static int socketAddress(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Replica socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+/* ============= Leader ============= */
+
+/**
+ * Position of an ID in the leader's copy of the catalog
+ * @return: Index of the book, or -1 if absent
+ */
+static int findCopy(const ReplicaLeader *leader, int id) {
+    int lo = 0;
+    int hi = leader->count - 1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (leader->books[mid].id == id) {
+            return mid;
+        }
+        if (leader->books[mid].id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Cut a follower off; its thread notices and exits. Caller holds the lock.
+ */
+static void closePeer(ReplicaLeader *leader, ReplicaPeer *peer) {
+    if (!peer->closed) {
+        peer->closed = 1;
+        leader->followers--;
+        shutdown(peer->fd, SHUT_RDWR);
+    }
+}
+
+/**
+ * Queue bytes for one follower. Caller holds the lock.
+ * @return: 0 on success, -1 if the follower was cut off instead
+ */
+static int queueBytes(ReplicaLeader *leader, ReplicaPeer *peer,
+                      const void *bytes, size_t length) {
+    if (peer->closed) {
+        return -1;
+    }
+
+    if (peer->queued + length > peer->snapshotBytes + REPLICA_MAX_BACKLOG) {
+        fprintf(stderr, "Replica follower fell too far behind; disconnecting\n");
+        leader->dropped++;
+        closePeer(leader, peer);
+        return -1;
+    }
+
+    if (peer->queued + length > peer->queueCapacity) {
+        size_t capacity = peer->queueCapacity ? peer->queueCapacity : 4096;
+        while (capacity < peer->queued + length) {
+            capacity *= 2;
+        }
+
+        char *queue = (char*)realloc(peer->queue, capacity);
+        if (queue == NULL) {
+            fprintf(stderr, "Memory allocation failed for replica queue\n");
+            closePeer(leader, peer);
+            return -1;
+        }
+        peer->queue = queue;
+        peer->queueCapacity = capacity;
+    }
+
+    memcpy(peer->queue + peer->queued, bytes, length);
+    peer->queued += length;
+    return 0;
+}
+
+/**
+ * Queue a frame and its records for one follower. Caller holds the lock.
+ */
+static void queueFrame(ReplicaLeader *leader, ReplicaPeer *peer,
+                       const ReplicaFrame *frame, const Book *books) {
+    if (queueBytes(leader, peer, frame, sizeof(*frame)) == 0 &&
+        frame->count > 0) {
+        queueBytes(leader, peer, books, frame->count * sizeof(Book));
+    }
+}
+
+/**
+ * Library observer: apply a mutation to the leader's copy and log it
+ */
+static void logMutation(void *context, const Book *before, const Book *after) {
+    ReplicaLeader *leader = (ReplicaLeader*)context;
+    ReplicaFrame frame;
+
+    pthread_mutex_lock(&leader->lock);
+
+    if (before == NULL) {
+        /* IDs only grow, so an added book goes last */
+        leader->books[leader->count++] = *after;
+        leader->nextId = after->id + 1;
+        initFrame(&frame, REPLICA_ADD, ++leader->lsn);
+        frame.count = 1;
+    } else if (after == NULL) {
+        int index = findCopy(leader, before->id);
+        if (index != -1) {
+            memmove(&leader->books[index], &leader->books[index + 1],
+                    (size_t)(leader->count - index - 1) * sizeof(Book));
+            leader->count--;
+        }
+        initFrame(&frame, REPLICA_DELETE, ++leader->lsn);
+        frame.id = before->id;
+    } else {
+        int index = findCopy(leader, after->id);
+        if (index != -1) {
+            leader->books[index] = *after;
+        }
+        initFrame(&frame, REPLICA_UPDATE, ++leader->lsn);
+        frame.count = 1;
+    }
+
+    for (ReplicaPeer *peer = leader->peers; peer != NULL; peer = peer->next) {
+        queueFrame(leader, peer, &frame, after);
+    }
+    pthread_cond_broadcast(&leader->wake);
+
+    pthread_mutex_unlock(&leader->lock);
+}
+
+/**
+ * Send bytes to a socket, retrying short sends
+ * @return: 0 on success, -1 if the connection failed
+ */
+static int sendAll(int fd, const char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+typedef struct {
+    ReplicaLeader *leader;
+    ReplicaPeer *peer;
+} PeerThread;
+
+/**
+ * Per-follower thread: send queued frames, or a heartbeat when idle
+ */
+static void* sendToPeer(void *arg) {
+    PeerThread self = *(PeerThread*)arg;
+    ReplicaLeader *leader = self.leader;
+    ReplicaPeer *peer = self.peer;
+
+    free(arg);
+    pthread_mutex_lock(&leader->lock);
+
+    while (!peer->closed && !leader->stopping) {
+        if (peer->queued == 0) {
+            struct timespec deadline;
+            deadlineAfter(&deadline, REPLICA_HEARTBEAT_MS);
+
+            int waited = pthread_cond_timedwait(&leader->wake, &leader->lock,
+                                                &deadline);
+            if (waited == ETIMEDOUT && peer->queued == 0 && !peer->closed) {
+                ReplicaFrame frame;
+                initFrame(&frame, REPLICA_HEARTBEAT, leader->lsn);
+                queueFrame(leader, peer, &frame, NULL);
+            }
+            continue;
+        }
+
+        /* Take the whole queue and send it without holding the lock */
+        char *batch = peer->queue;
+        size_t length = peer->queued;
+        peer->queue = NULL;
+        peer->queued = 0;
+        peer->queueCapacity = 0;
+        peer->snapshotBytes = 0;
+
+        pthread_mutex_unlock(&leader->lock);
+        int sent = sendAll(peer->fd, batch, length);
+        free(batch);
+        pthread_mutex_lock(&leader->lock);
+
+        if (sent != 0) {
+            closePeer(leader, peer);
+        }
+    }
+
+    pthread_mutex_unlock(&leader->lock);
+    return NULL;
+}
+
+static void freePeer(ReplicaPeer *peer) {
+    pthread_join(peer->thread, NULL);
+    close(peer->fd);
+    free(peer->queue);
+    free(peer);
+}
+
+/**
+ * Accept followers until stopped, queueing a snapshot for each
+ */
+static void* acceptFollowers(void *arg) {
+    ReplicaLeader *leader = (ReplicaLeader*)arg;
+
+    for (;;) {
+        int fd = accept(leader->listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        ReplicaPeer *peer = (ReplicaPeer*)calloc(1, sizeof(ReplicaPeer));
+        PeerThread *start = (PeerThread*)malloc(sizeof(PeerThread));
+        if (peer == NULL || start == NULL) {
+            fprintf(stderr, "Memory allocation failed for replica follower\n");
+            free(peer);
+            free(start);
+            close(fd);
+            continue;
+        }
+        peer->fd = fd;
+        start->leader = leader;
+        start->peer = peer;
+
+        pthread_mutex_lock(&leader->lock);
+        if (leader->stopping) {
+            pthread_mutex_unlock(&leader->lock);
+            free(peer);
+            free(start);
+            close(fd);
+            break;
+        }
+
+        /* Reap followers that have gone away */
+        ReplicaPeer **link = &leader->peers;
+        while (*link != NULL) {
+            ReplicaPeer *old = *link;
+            if (old->closed) {
+                *link = old->next;
+                pthread_mutex_unlock(&leader->lock);
+                freePeer(old);
+                pthread_mutex_lock(&leader->lock);
+            } else {
+                link = &old->next;
+            }
+        }
+
+        ReplicaFrame frame;
+        initFrame(&frame, REPLICA_SNAPSHOT, leader->lsn);
+        frame.nextId = leader->nextId;
+        frame.count = (uint32_t)leader->count;
+        leader->followers++;
+        /* Only the changes queued behind the snapshot count as backlog */
+        peer->snapshotBytes = sizeof(frame) + (size_t)leader->count * sizeof(Book);
+        queueFrame(leader, peer, &frame, leader->books);
+
+        if (pthread_create(&peer->thread, NULL, sendToPeer, start) != 0) {
+            fprintf(stderr, "Failed to start replica sender thread\n");
+            closePeer(leader, peer);
+            pthread_mutex_unlock(&leader->lock);
+            free(start);
+            close(fd);
+            free(peer->queue);
+            free(peer);
+            continue;
+        }
+        peer->next = leader->peers;
+        leader->peers = peer;
+        pthread_mutex_unlock(&leader->lock);
+    }
+
+    return NULL;
+}
+
+int ReplicaLeader_Start(ReplicaLeader *leader, Library *library,
+                        const char *path) {
+    struct sockaddr_un address;
+
+    memset(leader, 0, sizeof(*leader));
+    leader->library = library;
+    leader->listenFd = -1;
+    if (socketAddress(path, &address) != 0) {
+        return -1;
+    }
+    strcpy(leader->path, path);
+
+    /* A copy of the catalog at full capacity never needs to grow */
+    leader->books = (Book*)malloc((size_t)MAX_BOOKS * sizeof(Book));
+    if (leader->books == NULL) {
+        fprintf(stderr, "Memory allocation failed for replica catalog\n");
+        return -1;
+    }
+    memcpy(leader->books, library->books, (size_t)library->count * sizeof(Book));
+    leader->count = library->count;
+    leader->nextId = library->nextId;
+
+    leader->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (leader->listenFd < 0) {
+        perror("Replica socket");
+        goto fail;
+    }
+    unlink(path);
+    if (bind(leader->listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(leader->listenFd, 16) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+
+    pthread_mutex_init(&leader->lock, NULL);
+    pthread_cond_init(&leader->wake, NULL);
+
+    if (libraryAddObserver(library, logMutation, leader) != 0) {
+        fprintf(stderr, "Too many library observers for replication\n");
+        goto fail_sync;
+    }
+    if (pthread_create(&leader->acceptThread, NULL, acceptFollowers, leader) != 0) {
+        fprintf(stderr, "Failed to start replica accept thread\n");
+        libraryRemoveObserver(library, logMutation, leader);
+        goto fail_sync;
+    }
+
+    return 0;
+
+fail_sync:
+    pthread_cond_destroy(&leader->wake);
+    pthread_mutex_destroy(&leader->lock);
+    unlink(path);
+fail:
+    if (leader->listenFd >= 0) {
+        close(leader->listenFd);
+    }
+    free(leader->books);
+    leader->books = NULL;
+    return -1;
+}
+
+void ReplicaLeader_Stop(ReplicaLeader *leader) {
+    libraryRemoveObserver(leader->library, logMutation, leader);
+
+    pthread_mutex_lock(&leader->lock);
+    leader->stopping = 1;
+    pthread_cond_broadcast(&leader->wake);
+    pthread_mutex_unlock(&leader->lock);
+
+    shutdown(leader->listenFd, SHUT_RDWR);
+    pthread_join(leader->acceptThread, NULL);
+
+    ReplicaPeer *peer = leader->peers;
+    while (peer != NULL) {
+        ReplicaPeer *next = peer->next;
+        shutdown(peer->fd, SHUT_RDWR);
+        freePeer(peer);
+        peer = next;
+    }
+    leader->peers = NULL;
+
+    close(leader->listenFd);
+    unlink(leader->path);
+    pthread_cond_destroy(&leader->wake);
+    pthread_mutex_destroy(&leader->lock);
+    free(leader->books);
+    leader->books = NULL;
+}
+
+void ReplicaLeader_GetStatus(ReplicaLeader *leader, uint64_t *lsn,
+                             int *followers) {
+    pthread_mutex_lock(&leader->lock);
+    *lsn = leader->lsn;
+    *followers = leader->followers;
+    pthread_mutex_unlock(&leader->lock);
+}
+
+/* ============= Follower ============= */
+
+/**
+ * Receive exactly length bytes
+ * @return: 0 on success, -1 if the connection closed or failed
+ */
+static int receiveAll(int fd, void *buffer, size_t length) {
+    char *bytes = (char*)buffer;
+
+    while (length > 0) {
+        ssize_t got = recv(fd, bytes, length, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        bytes += got;
+        length -= (size_t)got;
+    }
+    return 0;
+}
+
+static int connectTo(const char *path) {
+    struct sockaddr_un address;
+
+    if (socketAddress(path, &address) != 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int validFrame(const ReplicaFrame *frame) {
+    return frame->magic == REPLICA_MAGIC && frame->recordSize == sizeof(Book) &&
+           frame->op >= REPLICA_SNAPSHOT && frame->op <= REPLICA_HEARTBEAT &&
+           frame->count <= MAX_BOOKS;
+}
+
+/**
+ * Receive the leader's snapshot and replace the replica's contents
+ * @return: 0 on success, -1 on a protocol, connection or capacity error
+ */
+static int bootstrap(ReplicaFollower *follower, int fd) {
+    ReplicaFrame frame;
+
+    if (receiveAll(fd, &frame, sizeof(frame)) != 0) {
+        return -1;
+    }
+    if (!validFrame(&frame) || frame.op != REPLICA_SNAPSHOT) {
+        fprintf(stderr, "Replica leader sent an incompatible snapshot\n");
+        return -1;
+    }
+
+    Book *books = (Book*)malloc((frame.count > 0 ? frame.count : 1) * sizeof(Book));
+    if (books == NULL) {
+        fprintf(stderr, "Memory allocation failed for replica snapshot\n");
+        return -1;
+    }
+    if (receiveAll(fd, books, frame.count * sizeof(Book)) != 0) {
+        free(books);
+        return -1;
+    }
+
+    Library *library = follower->library;
+    int restored = 0;
+
+    pthread_rwlock_wrlock(&follower->lock);
+    /* Deleting from the end moves nothing */
+    while (library->count > 0) {
+        libraryDeleteBook(library, library->books[library->count - 1].id);
+    }
+    library->nextId = 1;
+    for (uint32_t i = 0; i < frame.count; i++) {
+        if (libraryRestoreBook(library, &books[i]) == -1) {
+            break;
+        }
+        restored++;
+    }
+    if (library->nextId < frame.nextId) {
+        library->nextId = frame.nextId;
+    }
+    pthread_rwlock_unlock(&follower->lock);
+    free(books);
+
+    if ((uint32_t)restored != frame.count) {
+        fprintf(stderr, "Replica could not load the leader's snapshot\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&follower->statusLock);
+    follower->status.connected = 1;
+    follower->status.appliedLsn = frame.lsn;
+    if (follower->status.leaderLsn < frame.lsn) {
+        follower->status.leaderLsn = frame.lsn;
+    }
+    follower->status.bootstraps++;
+    pthread_cond_broadcast(&follower->progress);
+    pthread_mutex_unlock(&follower->statusLock);
+
+    return 0;
+}
+
+/**
+ * Apply one delta frame to the replica. Caller holds the write lock.
+ * @return: 0 on success, -1 if the replica no longer matches the leader
+ */
+static int applyFrame(Library *library, const ReplicaFrame *frame,
+                      const Book *book) {
+    switch (frame->op) {
+        case REPLICA_ADD:
+            return libraryRestoreBook(library, book) == book->id ? 0 : -1;
+        case REPLICA_UPDATE:
+            return libraryUpdateBook(library, book) == 1 ? 0 : -1;
+        case REPLICA_DELETE:
+            return libraryDeleteBook(library, frame->id) == 1 ? 0 : -1;
+        case REPLICA_HEARTBEAT:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Apply every complete frame at the start of a buffer
+ * @return: Bytes consumed, or -1 if the stream is unusable
+ */
+static long applyFrames(ReplicaFollower *follower, const char *buffer,
+                        size_t length) {
+    size_t offset = 0;
+    int failed = 0;
+    int64_t appliedAt;
+    uint64_t lastLsn = 0;
+    uint64_t leaderLsn = 0;
+    uint64_t frames = 0;
+    int64_t lastLag = 0;
+    int64_t maxLag = 0;
+    int64_t totalLag = 0;
+
+    pthread_rwlock_wrlock(&follower->lock);
+    while (length - offset >= sizeof(ReplicaFrame)) {
+        ReplicaFrame frame;
+        memcpy(&frame, buffer + offset, sizeof(frame));
+        if (!validFrame(&frame) || frame.op == REPLICA_SNAPSHOT || frame.count > 1) {
+            failed = 1;
+            break;
+        }
+
+        size_t size = sizeof(frame) + frame.count * sizeof(Book);
+        if (length - offset < size) {
+            break;
+        }
+
+        Book book;
+        if (frame.count == 1) {
+            memcpy(&book, buffer + offset + sizeof(frame), sizeof(Book));
+        }
+        if (applyFrame(follower->library, &frame, &book) != 0) {
+            fprintf(stderr, "Replica diverged from its leader at LSN %llu\n",
+                    (unsigned long long)frame.lsn);
+            failed = 1;
+            break;
+        }
+
+        offset += size;
+        leaderLsn = frame.lsn;
+        if (frame.op != REPLICA_HEARTBEAT) {
+            lastLsn = frame.lsn;
+            frames++;
+        }
+    }
+    pthread_rwlock_unlock(&follower->lock);
+    appliedAt = nowNs();
+
+    /* Lag of each frame in the batch, measured once the batch is visible */
+    for (size_t at = 0; at < offset; ) {
+        ReplicaFrame frame;
+        memcpy(&frame, buffer + at, sizeof(frame));
+        if (frame.op != REPLICA_HEARTBEAT) {
+            lastLag = appliedAt - frame.timeNs;
+            totalLag += lastLag;
+            if (lastLag > maxLag) {
+                maxLag = lastLag;
+            }
+        }
+        at += sizeof(frame) + frame.count * sizeof(Book);
+    }
+
+    pthread_mutex_lock(&follower->statusLock);
+    if (frames > 0) {
+        follower->status.appliedLsn = lastLsn;
+        follower->status.frames += frames;
+        follower->status.lastLagNs = lastLag;
+        follower->status.totalLagNs += totalLag;
+        if (maxLag > follower->status.maxLagNs) {
+            follower->status.maxLagNs = maxLag;
+        }
+    } else if (offset > 0 && leaderLsn == follower->status.appliedLsn) {
+        follower->status.lastLagNs = 0;
+    }
+    if (leaderLsn > follower->status.leaderLsn) {
+        follower->status.leaderLsn = leaderLsn;
+    }
+    pthread_cond_broadcast(&follower->progress);
+    pthread_mutex_unlock(&follower->statusLock);
+
+    return failed ? -1 : (long)offset;
+}
+
+static void disconnect(ReplicaFollower *follower) {
+    pthread_mutex_lock(&follower->statusLock);
+    if (follower->fd >= 0) {
+        close(follower->fd);
+        follower->fd = -1;
+    }
+    follower->status.connected = 0;
+    pthread_mutex_unlock(&follower->statusLock);
+}
+
+/**
+ * Connect and bootstrap unless stopping
+ * @return: 0 when connected, -1 otherwise
+ */
+static int reconnect(ReplicaFollower *follower) {
+    int fd = connectTo(follower->path);
+    if (fd < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&follower->statusLock);
+    if (follower->stopping) {
+        pthread_mutex_unlock(&follower->statusLock);
+        close(fd);
+        return -1;
+    }
+    follower->fd = fd;
+    pthread_mutex_unlock(&follower->statusLock);
+
+    if (bootstrap(follower, fd) != 0) {
+        disconnect(follower);
+        return -1;
+    }
+    return 0;
+}
+
+static int stopping(ReplicaFollower *follower) {
+    pthread_mutex_lock(&follower->statusLock);
+    int result = follower->stopping;
+    pthread_mutex_unlock(&follower->statusLock);
+    return result;
+}
+
+/**
+ * Follower thread: receive frames and apply them in batches
+ */
+static void* followLeader(void *arg) {
+    ReplicaFollower *follower = (ReplicaFollower*)arg;
+    char *buffer = (char*)malloc(RECEIVE_BUFFER);
+    size_t buffered = 0;
+
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed for replica buffer\n");
+        disconnect(follower);
+        return NULL;
+    }
+
+    while (!stopping(follower)) {
+        if (follower->fd < 0) {
+            buffered = 0;
+            if (reconnect(follower) != 0) {
+                usleep(REPLICA_RECONNECT_MS * 1000);
+            }
+            continue;
+        }
+
+        ssize_t got = recv(follower->fd, buffer + buffered,
+                           RECEIVE_BUFFER - buffered, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            disconnect(follower);
+            continue;
+        }
+        buffered += (size_t)got;
+
+        long used = applyFrames(follower, buffer, buffered);
+        if (used < 0) {
+            disconnect(follower);
+            continue;
+        }
+        memmove(buffer, buffer + used, buffered - (size_t)used);
+        buffered -= (size_t)used;
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+int ReplicaFollower_Start(ReplicaFollower *follower, Library *library,
+                          const char *path) {
+    pthread_rwlockattr_t attributes;
+
+    memset(follower, 0, sizeof(*follower));
+    follower->library = library;
+    follower->fd = -1;
+    if (strlen(path) >= sizeof(follower->path)) {
+        fprintf(stderr, "Replica socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(follower->path, path);
+
+    /* Readers must not starve the apply thread */
+    pthread_rwlockattr_init(&attributes);
+    pthread_rwlockattr_setkind_np(&attributes,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&follower->lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+    pthread_mutex_init(&follower->statusLock, NULL);
+    pthread_cond_init(&follower->progress, NULL);
+
+    if (reconnect(follower) != 0) {
+        fprintf(stderr, "Cannot follow replica leader at %s\n", path);
+        goto fail;
+    }
+    if (pthread_create(&follower->thread, NULL, followLeader, follower) != 0) {
+        fprintf(stderr, "Failed to start replica apply thread\n");
+        disconnect(follower);
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    pthread_cond_destroy(&follower->progress);
+    pthread_mutex_destroy(&follower->statusLock);
+    pthread_rwlock_destroy(&follower->lock);
+    return -1;
+}
+
+void ReplicaFollower_Stop(ReplicaFollower *follower) {
+    pthread_mutex_lock(&follower->statusLock);
+    follower->stopping = 1;
+    if (follower->fd >= 0) {
+        shutdown(follower->fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&follower->statusLock);
+
+    pthread_join(follower->thread, NULL);
+    disconnect(follower);
+
+    pthread_cond_destroy(&follower->progress);
+    pthread_mutex_destroy(&follower->statusLock);
+    pthread_rwlock_destroy(&follower->lock);
+}
+
+void ReplicaFollower_ReadLock(ReplicaFollower *follower) {
+    pthread_rwlock_rdlock(&follower->lock);
+}
+
+void ReplicaFollower_ReadUnlock(ReplicaFollower *follower) {
+    pthread_rwlock_unlock(&follower->lock);
+}
+
+void ReplicaFollower_GetStatus(ReplicaFollower *follower, ReplicaStatus *status) {
+    pthread_mutex_lock(&follower->statusLock);
+    *status = follower->status;
+    pthread_mutex_unlock(&follower->statusLock);
+}
+
+int ReplicaFollower_WaitFor(ReplicaFollower *follower, uint64_t lsn,
+                            int timeout_ms) {
+    struct timespec deadline;
+    int applied;
+
+    deadlineAfter(&deadline, timeout_ms);
+    pthread_mutex_lock(&follower->statusLock);
+    while (follower->status.appliedLsn < lsn &&
+           pthread_cond_timedwait(&follower->progress, &follower->statusLock,
+                                  &deadline) != ETIMEDOUT) {
+    }
+    applied = follower->status.appliedLsn >= lsn;
+    pthread_mutex_unlock(&follower->statusLock);
+
+    return applied;
+}
@@ -0,0 +1,193 @@
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LIBRARY.h"
+
+/**
+ * @file REPLICA.h
+ * @brief Streaming a library's mutations to read-only replicas
+ *
+ * A ReplicaLeader observes a library and serves followers on a Unix
+ * domain socket. Every add, update and delete becomes one frame of a
+ * mutation log, numbered by a log sequence number (LSN). A follower
+ * that connects first receives a snapshot (every book, stamped with
+ * the LSN it reflects) and then every frame after that LSN, in order,
+ * so snapshot plus deltas always rebuild the leader's catalog exactly.
+ *
+ * The leader keeps its own copy of the catalog, maintained by the
+ * observer, so snapshots are taken under the leader's lock without
+ * touching the library while it is being mutated. Frames for each
+ * follower are queued in memory and written by a per-follower thread,
+ * so a slow follower never blocks the mutating thread; one that falls
+ * more than REPLICA_MAX_BACKLOG bytes behind is disconnected and
+ * bootstraps again when it reconnects. The bootstrap snapshot itself
+ * does not count against that cap, so a catalog of any size can be
+ * sent. When idle the leader sends a
+ * heartbeat every REPLICA_HEARTBEAT_MS carrying its current LSN.
+ *
+ * A ReplicaFollower applies frames to a library it is given, under a
+ * reader-writer lock: readers hold the lock shared around lookups and
+ * queries, and the apply thread holds it exclusively for each batch of
+ * frames it has received. It reconnects (and bootstraps again) if the
+ * leader goes away. Lag is reported both in frames (leader LSN minus
+ * applied LSN) and in time (apply time minus the leader's log time for
+ * each frame; both run on the same host clock).
+ *
+ * Frames are raw Book records, so leader and followers must be the
+ * same build; the handshake rejects a different record size.
+ */
+
+#define REPLICA_MAGIC 0x4C505252u     /* "RRPL" in a little-endian frame */
+#define REPLICA_HEARTBEAT_MS 100
+#define REPLICA_MAX_BACKLOG (64u << 20)
+#define REPLICA_RECONNECT_MS 200
+
+/* Kinds of log frame */
+typedef enum {
+    REPLICA_SNAPSHOT = 1,             /* count books, replacing everything */
+    REPLICA_ADD,                      /* One new book */
+    REPLICA_UPDATE,                   /* One replaced book */
+    REPLICA_DELETE,                   /* id removed */
+    REPLICA_HEARTBEAT                 /* No change; carries the leader LSN */
+} ReplicaOp;
+
+/* Header of every frame on the wire; Book records follow it */
+typedef struct {
+    uint32_t magic;                   /* REPLICA_MAGIC */
+    uint32_t op;                      /* ReplicaOp */
+    uint64_t lsn;                     /* Log position after this frame */
+    int64_t timeNs;                   /* Leader clock when it was logged */
+    int32_t id;                       /* Book removed by REPLICA_DELETE */
+    int32_t nextId;                   /* Leader's next ID, for a snapshot */
+    uint32_t count;                   /* Book records that follow */
+    uint32_t recordSize;              /* sizeof(Book) on the leader */
+} ReplicaFrame;
+
+/* One connected follower, as seen by the leader */
+typedef struct ReplicaPeer {
+    int fd;
+    pthread_t thread;                 /* Writes queued frames */
+    char *queue;                      /* Frames waiting to be sent */
+    size_t queued;
+    size_t queueCapacity;
+    size_t snapshotBytes;             /* Queued snapshot, exempt from the backlog cap */
+    int closed;                       /* Leader or follower hung up */
+    struct ReplicaPeer *next;
+} ReplicaPeer;
+
+typedef struct {
+    Library *library;                 /* Library being observed */
+    int listenFd;
+    char path[108];                   /* Socket path, unlinked on stop */
+    pthread_t acceptThread;
+    pthread_mutex_t lock;             /* Guards everything below */
+    pthread_cond_t wake;              /* Frames queued or stopping */
+    Book *books;                      /* Copy of the catalog, by ID */
+    int count;
+    int nextId;
+    uint64_t lsn;                     /* Frames logged so far */
+    ReplicaPeer *peers;
+    int followers;                    /* Peers currently connected */
+    uint64_t dropped;                 /* Peers cut off for backlog */
+    int stopping;
+} ReplicaLeader;
+
+/* Follower progress */
+typedef struct {
+    int connected;
+    uint64_t appliedLsn;              /* Last frame applied */
+    uint64_t leaderLsn;               /* Latest LSN the leader announced */
+    uint64_t frames;                  /* Frames applied, heartbeats excluded */
+    uint64_t bootstraps;              /* Snapshots loaded */
+    int64_t lastLagNs;                /* Log-to-apply delay of the last frame */
+    int64_t maxLagNs;
+    int64_t totalLagNs;               /* Sum over frames, for the mean */
+} ReplicaStatus;
+
+typedef struct {
+    Library *library;                 /* Replica being maintained */
+    char path[108];
+    int fd;
+    pthread_t thread;                 /* Receives and applies frames */
+    pthread_rwlock_t lock;            /* Shared by readers, held by apply */
+    pthread_mutex_t statusLock;
+    pthread_cond_t progress;          /* Signalled after each batch */
+    ReplicaStatus status;
+    int stopping;
+} ReplicaFollower;
+
+/**
+ * @brief Start serving a library's mutation log on a Unix socket
+ *
+ * Takes the current contents of the library as the starting snapshot
+ * and observes it from then on. Mutations must keep coming from one
+ * thread at a time, as for any library.
+ *
+ * @param leader Leader to initialize
+ * @param library Library to replicate
+ * @param path Socket path; an existing socket file is replaced
+ * @return 0 on success, -1 on failure
+ */
+int ReplicaLeader_Start(ReplicaLeader *leader, Library *library,
+                        const char *path);
+
+/**
+ * @brief Disconnect every follower, stop observing and remove the socket
+ */
+void ReplicaLeader_Stop(ReplicaLeader *leader);
+
+/**
+ * @brief Current LSN and number of connected followers
+ */
+void ReplicaLeader_GetStatus(ReplicaLeader *leader, uint64_t *lsn,
+                             int *followers);
+
+/**
+ * @brief Connect to a leader and load its snapshot into a library
+ *
+ * Returns once the snapshot is applied; from then on a background
+ * thread applies the leader's frames. The library must be empty and
+ * must not be mutated by anyone else. Observers registered on it see
+ * every replicated change.
+ *
+ * @param follower Follower to initialize
+ * @param library Empty library to hold the replica
+ * @param path Leader's socket path
+ * @return 0 on success, -1 on failure
+ */
+int ReplicaFollower_Start(ReplicaFollower *follower, Library *library,
+                          const char *path);
+
+/**
+ * @brief Stop applying frames and disconnect; the library keeps its rows
+ */
+void ReplicaFollower_Stop(ReplicaFollower *follower);
+
+/**
+ * @brief Hold the replica still for reading
+ *
+ * Every read of the follower's library (lookups, queries, listings)
+ * must happen between ReplicaFollower_ReadLock and
+ * ReplicaFollower_ReadUnlock. Any number of readers may hold it.
+ */
+void ReplicaFollower_ReadLock(ReplicaFollower *follower);
+void ReplicaFollower_ReadUnlock(ReplicaFollower *follower);
+
+/**
+ * @brief Copy the follower's progress counters
+ */
+void ReplicaFollower_GetStatus(ReplicaFollower *follower, ReplicaStatus *status);
+
+/**
+ * @brief Wait until a given LSN has been applied
+ * @param timeout_ms Longest wait
+ * @return 1 if applied, 0 on timeout
+ */
+int ReplicaFollower_WaitFor(ReplicaFollower *follower, uint64_t lsn,
+                            int timeout_ms);
+
+#endif /* REPLICA_H */
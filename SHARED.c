@@ -0,0 +1,621 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SHARED.h"
+
+/* Slots copied per read section of a scan */
+#define SCAN_CHUNK 32
+
+/* Dead arena bytes tolerated before they must also outnumber live ones */
+#define COMPACT_MIN_DEAD (64u << 10)
+
+/* Spins on an odd sequence before yielding to the writer */
+#define READ_SPINS 64
+
+/* Where each text field lives in a Book, and its size there */
+static const size_t textOffsets[SHARED_TEXT_FIELDS] = {
+    offsetof(Book, title), offsetof(Book, author), offsetof(Book, isbn),
+    offsetof(Book, titleFolded), offsetof(Book, authorFolded)
+};
+static const uint32_t textWidths[SHARED_TEXT_FIELDS] = {
+    MAX_TITLE_LEN, MAX_AUTHOR_LEN, MAX_ISBN_LEN, MAX_TITLE_LEN, MAX_AUTHOR_LEN
+};
+
+/* ============= Layout ============= */
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + 63) & ~(uint64_t)63;
+}
+
+/**
+ * Longest text one book can store, over all its fields
+ */
+static uint64_t rowTextMax(void) {
+    uint64_t total = 0;
+    for (int field = 0; field < SHARED_TEXT_FIELDS; field++) {
+        total += textWidths[field] - 1;
+    }
+    return total;
+}
+
+/**
+ * Lay out a segment for capacity books in a header
+ */
+static void planLayout(SharedHeader *header, uint32_t capacity) {
+    uint32_t tableSize = 16;
+    while (tableSize < 2 * capacity) {
+        tableSize <<= 1;
+    }
+
+    header->magic = SHARED_MAGIC;
+    header->version = SHARED_VERSION;
+    memcpy(header->textWidths, textWidths, sizeof(textWidths));
+    header->capacity = capacity;
+    header->tableSize = tableSize;
+
+    uint64_t offset = alignUp(sizeof(SharedHeader));
+    header->idsOffset = offset;
+    offset = alignUp(offset + (uint64_t)capacity * sizeof(int32_t));
+    header->yearsOffset = offset;
+    offset = alignUp(offset + (uint64_t)capacity * sizeof(int32_t));
+    header->pricesOffset = offset;
+    offset = alignUp(offset + (uint64_t)capacity * sizeof(float));
+    header->quantitiesOffset = offset;
+    offset = alignUp(offset + (uint64_t)capacity * sizeof(int32_t));
+    header->textOffset = offset;
+    offset = alignUp(offset + (uint64_t)capacity * SHARED_TEXT_FIELDS * sizeof(SharedText));
+    header->tableOffset = offset;
+    offset = alignUp(offset + (uint64_t)tableSize * sizeof(int32_t));
+    header->arenaOffset = offset;
+    /* One spare row so an update can append after a full compaction */
+    header->arenaCapacity = ((uint64_t)capacity + 1) * rowTextMax();
+    header->segmentSize = alignUp(offset + header->arenaCapacity);
+}
+
+/**
+ * Check that a section lies inside the mapping
+ */
+static int sectionFits(uint64_t offset, uint64_t count, uint64_t size,
+                       uint64_t segment) {
+    return offset % 8 == 0 && offset <= segment &&
+           (count == 0 || size <= (segment - offset) / count);
+}
+
+/**
+ * Validate a mapped header's layout and point the handle at its sections
+ * @return: 0 on success, -1 if the segment is not one this build can read
+ */
+static int bindSections(SharedCatalog *shared) {
+    const SharedHeader *header = shared->header;
+    uint64_t size = shared->size;
+
+    if (header->version != SHARED_VERSION ||
+        memcmp(header->textWidths, textWidths, sizeof(textWidths)) != 0) {
+        return -1;
+    }
+    if (header->segmentSize != size || header->capacity == 0 ||
+        header->tableSize < header->capacity ||
+        (header->tableSize & (header->tableSize - 1)) != 0 ||
+        header->capacity > INT32_MAX - 1 ||
+        !sectionFits(header->idsOffset, header->capacity, sizeof(int32_t), size) ||
+        !sectionFits(header->yearsOffset, header->capacity, sizeof(int32_t), size) ||
+        !sectionFits(header->pricesOffset, header->capacity, sizeof(float), size) ||
+        !sectionFits(header->quantitiesOffset, header->capacity, sizeof(int32_t), size) ||
+        !sectionFits(header->textOffset, (uint64_t)header->capacity * SHARED_TEXT_FIELDS,
+                     sizeof(SharedText), size) ||
+        !sectionFits(header->tableOffset, header->tableSize, sizeof(int32_t), size) ||
+        !sectionFits(header->arenaOffset, header->arenaCapacity, 1, size) ||
+        header->arenaCapacity > UINT32_MAX) {
+        return -1;
+    }
+
+    shared->ids = (int32_t*)(shared->base + header->idsOffset);
+    shared->years = (int32_t*)(shared->base + header->yearsOffset);
+    shared->prices = (float*)(shared->base + header->pricesOffset);
+    shared->quantities = (int32_t*)(shared->base + header->quantitiesOffset);
+    shared->text = (SharedText*)(shared->base + header->textOffset);
+    shared->table = (int32_t*)(shared->base + header->tableOffset);
+    shared->arena = (char*)(shared->base + header->arenaOffset);
+    shared->capacity = header->capacity;
+    shared->tableMask = header->tableSize - 1;
+    shared->arenaCapacity = header->arenaCapacity;
+
+    return 0;
+}
+
+/* ============= Sequence Lock ============= */
+
+static void beginWrite(SharedHeader *header) {
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void endWrite(SharedHeader *header) {
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Wait for the writer to be outside a change
+ * @return: The even sequence the read section starts from
+ */
+static uint64_t beginRead(const SharedCatalog *shared) {
+    unsigned spins = 0;
+
+    for (;;) {
+        uint64_t sequence = __atomic_load_n(&shared->header->sequence, __ATOMIC_ACQUIRE);
+        if ((sequence & 1) == 0) {
+            return sequence;
+        }
+        if (++spins % READ_SPINS == 0) {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * Check that nothing changed during a read section
+ * @return: 1 if the data read is consistent, 0 if it must be read again
+ */
+static int endRead(SharedCatalog *shared, uint64_t sequence) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shared->header->sequence, __ATOMIC_RELAXED) == sequence) {
+        return 1;
+    }
+    shared->retries++;
+    return 0;
+}
+
+/* ============= Rows and ID Index ============= */
+
+static uint32_t hashId(int id, uint32_t mask) {
+    return ((uint32_t)id * 2654435761u) & mask;
+}
+
+/**
+ * Find the table bucket holding an ID; bounded so a torn read ends
+ * @return: Bucket index, or -1 if the ID is not indexed
+ */
+static int64_t findBucket(const SharedCatalog *shared, int id) {
+    uint32_t bucket = hashId(id, shared->tableMask);
+
+    for (uint32_t probes = 0; probes <= shared->tableMask; probes++) {
+        uint32_t entry = (uint32_t)shared->table[bucket];
+        if (entry == 0) {
+            return -1;
+        }
+        if (entry - 1 < shared->capacity && shared->ids[entry - 1] == id) {
+            return bucket;
+        }
+        bucket = (bucket + 1) & shared->tableMask;
+    }
+
+    return -1;
+}
+
+/**
+ * Copy the record in a slot into a Book, clamping anything a torn read
+ * could have made out of range
+ */
+static void readRow(const SharedCatalog *shared, uint32_t slot, Book *book) {
+    const SharedText *text = shared->text + (size_t)slot * SHARED_TEXT_FIELDS;
+
+    book->id = shared->ids[slot];
+    book->year = shared->years[slot];
+    book->price = shared->prices[slot];
+    book->quantity = shared->quantities[slot];
+
+    for (int field = 0; field < SHARED_TEXT_FIELDS; field++) {
+        char *out = (char*)book + textOffsets[field];
+        uint64_t offset = text[field].offset;
+        uint64_t length = text[field].length;
+
+        if (length >= textWidths[field]) {
+            length = textWidths[field] - 1;
+        }
+        if (offset > shared->arenaCapacity || length > shared->arenaCapacity - offset) {
+            length = 0;
+        }
+        memcpy(out, shared->arena + offset, length);
+        out[length] = '\0';
+    }
+}
+
+static void indexSlot(SharedCatalog *shared, int id, uint32_t slot) {
+    uint32_t bucket = hashId(id, shared->tableMask);
+
+    while (shared->table[bucket] != 0) {
+        bucket = (bucket + 1) & shared->tableMask;
+    }
+    shared->table[bucket] = (int32_t)(slot + 1);
+}
+
+/**
+ * Remove an ID from the table, shifting later entries of its probe run
+ * back so no tombstones are needed
+ */
+static void unindexId(SharedCatalog *shared, int id) {
+    int64_t found = findBucket(shared, id);
+    if (found < 0) {
+        return;
+    }
+
+    uint32_t hole = (uint32_t)found;
+    uint32_t next = hole;
+    for (;;) {
+        next = (next + 1) & shared->tableMask;
+        int32_t entry = shared->table[next];
+        if (entry == 0) {
+            break;
+        }
+
+        /* An entry may fill the hole unless its home lies after the hole */
+        uint32_t home = hashId(shared->ids[entry - 1], shared->tableMask);
+        if (((next - home) & shared->tableMask) >= ((next - hole) & shared->tableMask)) {
+            shared->table[hole] = entry;
+            hole = next;
+        }
+    }
+    shared->table[hole] = 0;
+}
+
+/* ============= Writer ============= */
+
+/**
+ * Move every live string to the front of the arena, in slot order
+ */
+static void compactArena(SharedCatalog *shared) {
+    SharedHeader *header = shared->header;
+    uint64_t live = 0;
+
+    for (uint32_t slot = 0; slot < header->slotsUsed; slot++) {
+        if (shared->ids[slot] == 0) {
+            continue;
+        }
+        SharedText *text = shared->text + (size_t)slot * SHARED_TEXT_FIELDS;
+        for (int field = 0; field < SHARED_TEXT_FIELDS; field++) {
+            memcpy(shared->scratch + live, shared->arena + text[field].offset,
+                   text[field].length);
+            text[field].offset = (uint32_t)live;
+            live += text[field].length;
+        }
+    }
+
+    memcpy(shared->arena, shared->scratch, live);
+    header->arenaUsed = live;
+    header->arenaDead = 0;
+    header->compactions++;
+}
+
+/**
+ * Store a book's fields in a slot; fresh when the slot held no book
+ */
+static void writeRow(SharedCatalog *shared, uint32_t slot, const Book *book,
+                     int fresh) {
+    SharedHeader *header = shared->header;
+    SharedText *text = shared->text + (size_t)slot * SHARED_TEXT_FIELDS;
+
+    if (shared->arenaCapacity - header->arenaUsed < rowTextMax()) {
+        compactArena(shared);
+    }
+
+    shared->ids[slot] = book->id;
+    shared->years[slot] = book->year;
+    shared->prices[slot] = book->price;
+    shared->quantities[slot] = book->quantity;
+
+    for (int field = 0; field < SHARED_TEXT_FIELDS; field++) {
+        const char *value = (const char*)book + textOffsets[field];
+        uint32_t length = (uint32_t)strnlen(value, textWidths[field] - 1);
+
+        if (!fresh) {
+            if (text[field].length == length &&
+                memcmp(shared->arena + text[field].offset, value, length) == 0) {
+                continue;
+            }
+            header->arenaDead += text[field].length;
+        }
+        memcpy(shared->arena + header->arenaUsed, value, length);
+        text[field].offset = (uint32_t)header->arenaUsed;
+        text[field].length = length;
+        header->arenaUsed += length;
+    }
+}
+
+/**
+ * Library observer mirroring every mutation into the segment
+ */
+static void publishMutation(void *context, const Book *before, const Book *after) {
+    SharedCatalog *shared = (SharedCatalog*)context;
+    SharedHeader *header = shared->header;
+
+    beginWrite(header);
+
+    if (before == NULL) {
+        uint32_t slot = shared->freeCount > 0
+                            ? (uint32_t)shared->freeSlots[--shared->freeCount]
+                            : header->slotsUsed++;
+        writeRow(shared, slot, after, 1);
+        indexSlot(shared, after->id, slot);
+        header->count++;
+    } else {
+        int64_t bucket = findBucket(shared, before->id);
+        if (bucket >= 0) {
+            uint32_t slot = (uint32_t)shared->table[bucket] - 1;
+            if (after != NULL) {
+                writeRow(shared, slot, after, 0);
+            } else {
+                const SharedText *text = shared->text + (size_t)slot * SHARED_TEXT_FIELDS;
+                for (int field = 0; field < SHARED_TEXT_FIELDS; field++) {
+                    header->arenaDead += text[field].length;
+                }
+                unindexId(shared, before->id);
+                shared->ids[slot] = 0;
+                shared->freeSlots[shared->freeCount++] = (int)slot;
+                header->count--;
+            }
+        }
+    }
+    header->nextId = shared->library->nextId;
+
+    if (header->arenaDead > COMPACT_MIN_DEAD &&
+        header->arenaDead > header->arenaUsed - header->arenaDead) {
+        compactArena(shared);
+    }
+
+    endWrite(header);
+}
+
+SharedCatalog* SharedCatalog_Publish(Library *library, const char *name) {
+    SharedCatalog *shared = (SharedCatalog*)calloc(1, sizeof(SharedCatalog));
+    SharedHeader layout;
+
+    if (shared == NULL) {
+        fprintf(stderr, "Memory allocation failed for shared catalog\n");
+        return NULL;
+    }
+    if (snprintf(shared->name, sizeof(shared->name), "%s", name) >= (int)sizeof(shared->name)) {
+        fprintf(stderr, "Shared catalog name too long: %s\n", name);
+        free(shared);
+        return NULL;
+    }
+    shared->fd = -1;
+
+    memset(&layout, 0, sizeof(layout));
+    planLayout(&layout, MAX_BOOKS);
+
+    shared->freeSlots = (int*)malloc(sizeof(int) * MAX_BOOKS);
+    shared->scratch = (char*)malloc(layout.arenaCapacity);
+    if (shared->freeSlots == NULL || shared->scratch == NULL) {
+        fprintf(stderr, "Memory allocation failed for shared catalog\n");
+        goto fail;
+    }
+
+    /* A fresh segment each time; readers of an old one keep theirs */
+    shm_unlink(name);
+    shared->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (shared->fd < 0) {
+        fprintf(stderr, "Cannot create shared catalog %s: %s\n", name, strerror(errno));
+        goto fail;
+    }
+    if (ftruncate(shared->fd, (off_t)layout.segmentSize) != 0) {
+        fprintf(stderr, "Cannot size shared catalog %s: %s\n", name, strerror(errno));
+        goto fail_unlink;
+    }
+    shared->base = (unsigned char*)mmap(NULL, layout.segmentSize, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED, shared->fd, 0);
+    if (shared->base == MAP_FAILED) {
+        fprintf(stderr, "Cannot map shared catalog %s: %s\n", name, strerror(errno));
+        shared->base = NULL;
+        goto fail_unlink;
+    }
+    shared->size = layout.segmentSize;
+    shared->header = (SharedHeader*)shared->base;
+    shared->writable = 1;
+    shared->library = library;
+
+    /* Everything but the magic, which is stored once the rows are in */
+    layout.magic = 0;
+    memcpy(shared->header, &layout, sizeof(layout));
+    bindSections(shared);
+
+    for (int i = 0; i < library->count; i++) {
+        writeRow(shared, (uint32_t)i, &library->books[i], 1);
+        indexSlot(shared, library->books[i].id, (uint32_t)i);
+    }
+    shared->header->count = library->count;
+    shared->header->slotsUsed = (uint32_t)library->count;
+    shared->header->nextId = library->nextId;
+
+    if (libraryAddObserver(library, publishMutation, shared) != 0) {
+        fprintf(stderr, "Too many library observers for a shared catalog\n");
+        goto fail_unlink;
+    }
+    __atomic_store_n(&shared->header->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+
+    return shared;
+
+fail_unlink:
+    shm_unlink(name);
+fail:
+    if (shared->base != NULL) {
+        munmap(shared->base, shared->size);
+    }
+    if (shared->fd >= 0) {
+        close(shared->fd);
+    }
+    free(shared->scratch);
+    free(shared->freeSlots);
+    free(shared);
+    return NULL;
+}
+
+void SharedCatalog_Unpublish(SharedCatalog *shared) {
+    if (shared == NULL) {
+        return;
+    }
+
+    libraryRemoveObserver(shared->library, publishMutation, shared);
+    shm_unlink(shared->name);
+    munmap(shared->base, shared->size);
+    close(shared->fd);
+    free(shared->scratch);
+    free(shared->freeSlots);
+    free(shared);
+}
+
+/* ============= Readers ============= */
+
+SharedCatalog* SharedCatalog_Attach(const char *name) {
+    SharedCatalog *shared = (SharedCatalog*)calloc(1, sizeof(SharedCatalog));
+    struct stat info;
+
+    if (shared == NULL) {
+        fprintf(stderr, "Memory allocation failed for shared catalog\n");
+        return NULL;
+    }
+
+    shared->fd = shm_open(name, O_RDONLY, 0);
+    if (shared->fd < 0) {
+        fprintf(stderr, "Cannot open shared catalog %s: %s\n", name, strerror(errno));
+        free(shared);
+        return NULL;
+    }
+    if (fstat(shared->fd, &info) != 0 || (size_t)info.st_size < sizeof(SharedHeader)) {
+        fprintf(stderr, "Shared catalog %s is not ready\n", name);
+        goto fail;
+    }
+
+    shared->size = (size_t)info.st_size;
+    shared->base = (unsigned char*)mmap(NULL, shared->size, PROT_READ, MAP_SHARED,
+                                        shared->fd, 0);
+    if (shared->base == MAP_FAILED) {
+        fprintf(stderr, "Cannot map shared catalog %s: %s\n", name, strerror(errno));
+        goto fail;
+    }
+    shared->header = (SharedHeader*)shared->base;
+
+    if (__atomic_load_n(&shared->header->magic, __ATOMIC_ACQUIRE) != SHARED_MAGIC ||
+        bindSections(shared) != 0) {
+        fprintf(stderr, "Shared catalog %s is not ready or from a different build\n", name);
+        munmap(shared->base, shared->size);
+        goto fail;
+    }
+
+    return shared;
+
+fail:
+    close(shared->fd);
+    free(shared);
+    return NULL;
+}
+
+void SharedCatalog_Detach(SharedCatalog *shared) {
+    if (shared == NULL) {
+        return;
+    }
+
+    munmap(shared->base, shared->size);
+    close(shared->fd);
+    free(shared);
+}
+
+int SharedCatalog_FindById(SharedCatalog *shared, int id, Book *book) {
+    int found;
+
+    if (id <= 0) {
+        return 0;
+    }
+
+    do {
+        uint64_t sequence = beginRead(shared);
+        int64_t bucket = findBucket(shared, id);
+
+        found = bucket >= 0;
+        if (found) {
+            uint32_t slot = (uint32_t)shared->table[bucket] - 1;
+            if (slot < shared->capacity) {
+                readRow(shared, slot, book);
+            }
+        }
+        if (endRead(shared, sequence)) {
+            break;
+        }
+    } while (1);
+
+    return found;
+}
+
+int SharedCatalog_Scan(SharedCatalog *shared, SharedCatalogVisitor visit,
+                       void *context) {
+    Book chunk[SCAN_CHUNK];
+    uint64_t first = 0;
+    int consistent = 1;
+
+    for (uint32_t start = 0;; start += SCAN_CHUNK) {
+        uint64_t sequence;
+        uint32_t end;
+        int rows;
+
+        do {
+            sequence = beginRead(shared);
+            uint32_t used = shared->header->slotsUsed;
+            if (used > shared->capacity) {
+                used = shared->capacity;
+            }
+
+            end = start + SCAN_CHUNK < used ? start + SCAN_CHUNK : used;
+            rows = 0;
+            for (uint32_t slot = start; slot < end; slot++) {
+                if (shared->ids[slot] != 0) {
+                    readRow(shared, slot, &chunk[rows++]);
+                }
+            }
+        } while (!endRead(shared, sequence));
+
+        if (start == 0) {
+            first = sequence;
+        } else if (sequence != first) {
+            consistent = 0;
+        }
+
+        for (int i = 0; i < rows; i++) {
+            if (visit(context, &chunk[i]) != 0) {
+                return consistent;
+            }
+        }
+        if (end < start + SCAN_CHUNK) {
+            return consistent;
+        }
+    }
+}
+
+int SharedCatalog_Count(SharedCatalog *shared, int *next_id) {
+    int count;
+    int nextId;
+
+    do {
+        uint64_t sequence = beginRead(shared);
+        count = shared->header->count;
+        nextId = shared->header->nextId;
+        if (endRead(shared, sequence)) {
+            break;
+        }
+    } while (1);
+
+    if (next_id != NULL) {
+        *next_id = nextId;
+    }
+    return count;
+}
+
+uint64_t SharedCatalog_Version(const SharedCatalog *shared) {
+    return __atomic_load_n(&shared->header->sequence, __ATOMIC_ACQUIRE) / 2;
+}
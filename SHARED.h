@@ -0,0 +1,194 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LIBRARY.h"
+
+/**
+ * @file SHARED.h
+ * @brief Library catalog published in POSIX shared memory
+ *
+ * One writer process publishes its library into a shared-memory
+ * segment (shm_open) and keeps it current through a library observer.
+ * Any number of other processes attach the segment read-only and look
+ * books up or scan them in place, without loading a copy of their own.
+ *
+ * The segment holds no pointers, only offsets from its start, so it
+ * can be mapped at any address. After a fixed header come the columns
+ * (one array per field, indexed by slot), a string arena holding the
+ * text fields back to back, and an ID index: an open-addressing hash
+ * table mapping an ID to its slot. A deleted book's slot is marked
+ * free and reused by a later add, so a book keeps its slot for life
+ * and slots are in no particular order.
+ *
+ * Updates are protected by a sequence lock. The writer makes the
+ * header's sequence odd, changes the segment and makes it even again;
+ * a reader notes the sequence, copies what it needs and retries if the
+ * sequence was odd or has moved on. Readers never block the writer and
+ * never write to the segment. A lookup returns one consistent record;
+ * a scan reads a chunk of slots at a time, so a book present for the
+ * whole scan is seen exactly once, and one added or deleted during it
+ * may or may not be.
+ *
+ * Text fields are stored at their length rather than the fixed widths
+ * of a Book. Updated text is appended to the arena and the old bytes
+ * left behind; when the dead bytes outgrow the live ones, or an append
+ * does not fit, the writer compacts the arena in place. The arena is
+ * sized so every slot can hold full-width text, so compaction always
+ * makes room.
+ *
+ * The layout depends on MAX_TITLE_LEN and friends, which the header
+ * records; a reader built differently refuses to attach. If the writer
+ * dies mid-update the sequence stays odd and readers wait until the
+ * segment is published again.
+ */
+
+#define SHARED_MAGIC 0x4D485342u      /* "BSHM" in a little-endian segment */
+#define SHARED_VERSION 1u
+
+/* Text columns kept in the arena */
+typedef enum {
+    SHARED_TITLE = 0,
+    SHARED_AUTHOR,
+    SHARED_ISBN,
+    SHARED_TITLE_FOLDED,
+    SHARED_AUTHOR_FOLDED,
+    SHARED_TEXT_FIELDS
+} SharedTextField;
+
+/* A text field: bytes at offset in the arena, without a terminator */
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} SharedText;
+
+/* Start of the segment; offsets are from the start of the segment */
+typedef struct {
+    /* Fixed when the segment is created */
+    uint32_t magic;                   /* SHARED_MAGIC */
+    uint32_t version;                 /* SHARED_VERSION */
+    uint32_t textWidths[SHARED_TEXT_FIELDS]; /* Field sizes in a Book */
+    uint32_t capacity;                /* Slots */
+    uint32_t tableSize;               /* ID index buckets; a power of two */
+    uint64_t segmentSize;
+    uint64_t idsOffset;               /* int32_t[capacity]; 0 = free slot */
+    uint64_t yearsOffset;             /* int32_t[capacity] */
+    uint64_t pricesOffset;            /* float[capacity] */
+    uint64_t quantitiesOffset;        /* int32_t[capacity] */
+    uint64_t textOffset;              /* SharedText[capacity][SHARED_TEXT_FIELDS] */
+    uint64_t tableOffset;             /* int32_t[tableSize]; slot + 1, 0 = empty */
+    uint64_t arenaOffset;
+    uint64_t arenaCapacity;
+
+    /* Changed by the writer under the sequence lock */
+    uint64_t sequence __attribute__((aligned(64))); /* Odd while writing */
+    int32_t count;                    /* Books present */
+    int32_t nextId;                   /* Writer library's next ID */
+    uint32_t slotsUsed;               /* Slots below this have been used */
+    uint32_t padding;
+    uint64_t arenaUsed;               /* Bytes appended since compaction */
+    uint64_t arenaDead;               /* Of those, bytes no longer referenced */
+    uint64_t compactions;
+} SharedHeader;
+
+typedef struct {
+    int fd;
+    unsigned char *base;              /* The mapped segment */
+    size_t size;
+    SharedHeader *header;
+    int writable;                     /* Publisher's mapping */
+    /* Sections and sizes, checked once so the header is not trusted again */
+    int32_t *ids;
+    int32_t *years;
+    float *prices;
+    int32_t *quantities;
+    SharedText *text;
+    int32_t *table;
+    char *arena;
+    uint32_t capacity;
+    uint32_t tableMask;
+    uint64_t arenaCapacity;
+    char name[256];                   /* Segment name, for unlinking */
+    Library *library;                 /* Library observed by a publisher */
+    int *freeSlots;                   /* Publisher's stack of free slots */
+    int freeCount;
+    char *scratch;                    /* Publisher's compaction buffer */
+    uint64_t retries;                 /* Reader sections that had to repeat */
+} SharedCatalog;
+
+/* Called for each book of a scan; return nonzero to stop early */
+typedef int (*SharedCatalogVisitor)(void *context, const Book *book);
+
+/**
+ * @brief Publish a library in a new shared-memory segment
+ *
+ * Copies the current contents of the library and observes it from
+ * then on, so every add, update and delete reaches the segment.
+ * An existing segment of the same name is replaced; readers that
+ * still have the old one mapped keep it, but it no longer changes.
+ *
+ * @param library Library to publish; mutations must come from one thread
+ * @param name Segment name for shm_open, such as "/book-catalog"
+ * @return Pointer to the publisher, or NULL on failure
+ */
+SharedCatalog* SharedCatalog_Publish(Library *library, const char *name);
+
+/**
+ * @brief Stop publishing and remove the segment's name
+ *
+ * Readers that have it attached keep the last published contents.
+ */
+void SharedCatalog_Unpublish(SharedCatalog *shared);
+
+/**
+ * @brief Map a published segment read-only
+ * @param name Name the segment was published under
+ * @return Pointer to the reader, or NULL on failure
+ */
+SharedCatalog* SharedCatalog_Attach(const char *name);
+
+/**
+ * @brief Unmap a segment attached with SharedCatalog_Attach
+ */
+void SharedCatalog_Detach(SharedCatalog *shared);
+
+/**
+ * @brief Look up a book by ID through the shared ID index
+ *
+ * A reader handle is for one thread; attach once per thread.
+ *
+ * @param shared Attached or published segment
+ * @param id Book ID to find
+ * @param book Receives a copy of the record when found
+ * @return 1 if found, 0 if not
+ */
+int SharedCatalog_FindById(SharedCatalog *shared, int id, Book *book);
+
+/**
+ * @brief Visit every book in slot order
+ * @param shared Attached or published segment
+ * @param visit Called with each book; its copy is only valid during the call
+ * @param context Passed to visit
+ * @return 1 if nothing changed during the scan, so the books seen were
+ *         one consistent catalog; 0 if the writer changed it meanwhile
+ */
+int SharedCatalog_Scan(SharedCatalog *shared, SharedCatalogVisitor visit,
+                       void *context);
+
+/**
+ * @brief Number of books and the writer's next ID, read consistently
+ * @param next_id Receives the next ID, or NULL
+ * @return Number of books
+ */
+int SharedCatalog_Count(SharedCatalog *shared, int *next_id);
+
+/**
+ * @brief Number of changes published so far
+ *
+ * Readers can compare versions to tell whether anything changed.
+ */
+uint64_t SharedCatalog_Version(const SharedCatalog *shared);
+
+#endif /* SHARED_H */
@@ -0,0 +1,438 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SKETCH.h"
+#include "TEXT.h"
+
+#define KLL_SEED 0x9E3779B97F4A7C15ull   /* Also the row increment of count-min */
+
+/* ============= Hashing ============= */
+
+/* Final avalanche of splitmix64, so every output bit depends on every input bit */
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * FNV-1a hash of a string, mixed
+ */
+static uint64_t hashText(const char *text) {
+    uint64_t hash = 14695981039346656037ull;
+
+    while (*text != '\0') {
+        hash ^= (unsigned char)*text++;
+        hash *= 1099511628211ull;
+    }
+
+    return mix64(hash);
+}
+
+/* ============= HyperLogLog ============= */
+
+void Hll_Init(HyperLogLog *hll) {
+    memset(hll, 0, sizeof(*hll));
+}
+
+void Hll_AddHash(HyperLogLog *hll, uint64_t hash) {
+    uint32_t index = (uint32_t)(hash >> (64 - HLL_PRECISION));
+    /* The guard bit caps the rank at 64 - HLL_PRECISION + 1 */
+    uint64_t rest = (hash << HLL_PRECISION) | ((uint64_t)1 << (HLL_PRECISION - 1));
+    uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+
+    if (rank > hll->registers[index]) {
+        hll->registers[index] = rank;
+    }
+}
+
+double Hll_Estimate(const HyperLogLog *hll) {
+    double m = HLL_REGISTERS;
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double sum = 0.0;
+    int zeros = 0;
+
+    for (int r = 0; r < HLL_REGISTERS; r++) {
+        sum += ldexp(1.0, -hll->registers[r]);
+        zeros += hll->registers[r] == 0;
+    }
+
+    double estimate = alpha * m * m / sum;
+    /* Small cardinalities: count empty registers instead (linear counting) */
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
+}
+
+void Hll_Merge(HyperLogLog *hll, const HyperLogLog *other) {
+    for (int r = 0; r < HLL_REGISTERS; r++) {
+        if (other->registers[r] > hll->registers[r]) {
+            hll->registers[r] = other->registers[r];
+        }
+    }
+}
+
+/* ============= KLL Quantiles ============= */
+
+static int compareFloats(const void *a, const void *b) {
+    float left = *(const float*)a;
+    float right = *(const float*)b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * Items level h may hold before it is compacted
+ */
+static int levelCapacity(const KllSketch *kll, int h) {
+    double capacity = KLL_K;
+
+    for (int depth = kll->levels - 1 - h; depth > 0; depth--) {
+        capacity *= 2.0 / 3.0;
+    }
+    return capacity < 2.0 ? 2 : (int)capacity;
+}
+
+static int coinFlip(KllSketch *kll) {
+    kll->random ^= kll->random << 13;
+    kll->random ^= kll->random >> 7;
+    kll->random ^= kll->random << 17;
+    return (int)(kll->random >> 63);
+}
+
+/**
+ * Sort a level and promote every other item; an odd one out stays
+ */
+static void compactLevel(KllSketch *kll, int h) {
+    if (h + 1 >= KLL_MAX_LEVELS) {
+        return;
+    }
+    if (h + 1 == kll->levels) {
+        kll->levels++;
+    }
+
+    float *items = kll->items[h];
+    int count = kll->counts[h];
+    int keep = count % 2;
+    int offset = coinFlip(kll);
+    float *up = kll->items[h + 1];
+
+    qsort(items, (size_t)count, sizeof(float), compareFloats);
+    for (int i = keep + offset; i < count; i += 2) {
+        up[kll->counts[h + 1]++] = items[i];
+    }
+    kll->counts[h] = keep;
+}
+
+/**
+ * Insert an item standing for 2^h values, compacting full levels upward
+ */
+static void addAtLevel(KllSketch *kll, int h, float value) {
+    kll->items[h][kll->counts[h]++] = value;
+
+    for (int level = h; level < kll->levels; level++) {
+        if (kll->counts[level] < levelCapacity(kll, level)) {
+            break;
+        }
+        compactLevel(kll, level);
+    }
+}
+
+void Kll_Init(KllSketch *kll, uint64_t seed) {
+    memset(kll->counts, 0, sizeof(kll->counts));
+    kll->levels = 1;
+    kll->n = 0;
+    kll->min = 0.0f;
+    kll->max = 0.0f;
+    kll->random = seed != 0 ? seed : KLL_SEED;
+}
+
+void Kll_Add(KllSketch *kll, float value) {
+    if (kll->n == 0 || value < kll->min) {
+        kll->min = value;
+    }
+    if (kll->n == 0 || value > kll->max) {
+        kll->max = value;
+    }
+    kll->n++;
+    addAtLevel(kll, 0, value);
+}
+
+/* One retained item and the number of values it stands for */
+typedef struct {
+    float value;
+    uint64_t weight;
+} WeightedItem;
+
+static int compareWeighted(const void *a, const void *b) {
+    return compareFloats(&((const WeightedItem*)a)->value,
+                         &((const WeightedItem*)b)->value);
+}
+
+float Kll_Quantile(const KllSketch *kll, double q) {
+    WeightedItem *items;
+    uint64_t total = 0;
+    size_t count = 0;
+
+    if (kll->n == 0) {
+        return 0.0f;
+    }
+    if (q <= 0.0) {
+        return kll->min;
+    }
+    if (q >= 1.0) {
+        return kll->max;
+    }
+
+    for (int h = 0; h < kll->levels; h++) {
+        count += (size_t)kll->counts[h];
+    }
+    items = (WeightedItem*)malloc(count * sizeof(WeightedItem));
+    if (items == NULL) {
+        fprintf(stderr, "Memory allocation failed for quantile query\n");
+        return 0.0f;
+    }
+
+    count = 0;
+    for (int h = 0; h < kll->levels; h++) {
+        for (int i = 0; i < kll->counts[h]; i++) {
+            items[count].value = kll->items[h][i];
+            items[count].weight = (uint64_t)1 << h;
+            total += items[count].weight;
+            count++;
+        }
+    }
+    qsort(items, count, sizeof(WeightedItem), compareWeighted);
+
+    /* First item whose cumulative weight reaches the rank */
+    double target = q * (double)total;
+    uint64_t seen = 0;
+    float value = kll->max;
+    for (size_t i = 0; i < count; i++) {
+        seen += items[i].weight;
+        if ((double)seen >= target) {
+            value = items[i].value;
+            break;
+        }
+    }
+
+    free(items);
+    return value;
+}
+
+void Kll_Merge(KllSketch *kll, const KllSketch *other) {
+    if (other->n == 0) {
+        return;
+    }
+    if (kll->n == 0 || other->min < kll->min) {
+        kll->min = other->min;
+    }
+    if (kll->n == 0 || other->max > kll->max) {
+        kll->max = other->max;
+    }
+    kll->n += other->n;
+
+    for (int h = 0; h < other->levels; h++) {
+        if (h >= kll->levels) {
+            kll->levels = h + 1;
+        }
+        for (int i = 0; i < other->counts[h]; i++) {
+            addAtLevel(kll, h, other->items[h][i]);
+        }
+    }
+}
+
+/* ============= Count-Min ============= */
+
+/**
+ * Counter of a term in one row. Each row remixes the hash with its own
+ * constant: deriving rows as h1 + row * h2 would make two terms that
+ * collide in the first two rows collide in all of them.
+ */
+static uint32_t rowColumn(uint64_t hash, int row) {
+    return (uint32_t)(mix64(hash + (uint64_t)(row + 1) * KLL_SEED) % COUNT_MIN_WIDTH);
+}
+
+static uint32_t estimateHash(const CountMinSketch *sketch, uint64_t hash) {
+    uint32_t estimate = UINT32_MAX;
+
+    for (int r = 0; r < COUNT_MIN_DEPTH; r++) {
+        uint32_t counter = sketch->counters[r][rowColumn(hash, r)];
+        estimate = counter < estimate ? counter : estimate;
+    }
+    return estimate;
+}
+
+/**
+ * Offer a term for the frequent-term list at its current estimate
+ */
+static void offerTerm(CountMinSketch *sketch, const char *term, uint32_t estimate) {
+    int at = -1;
+
+    for (int i = 0; i < sketch->topCount; i++) {
+        if (strcmp(sketch->top[i].term, term) == 0) {
+            at = i;
+            break;
+        }
+    }
+    if (at == -1) {
+        if (sketch->topCount < COUNT_MIN_TOP) {
+            at = sketch->topCount++;
+        } else if (estimate > sketch->top[COUNT_MIN_TOP - 1].estimate) {
+            at = COUNT_MIN_TOP - 1;
+        } else {
+            return;
+        }
+        snprintf(sketch->top[at].term, sizeof(sketch->top[at].term), "%s", term);
+    }
+    sketch->top[at].estimate = estimate;
+
+    /* Keep the list ordered, most frequent first */
+    while (at > 0 && sketch->top[at].estimate > sketch->top[at - 1].estimate) {
+        CountMinTerm swap = sketch->top[at];
+        sketch->top[at] = sketch->top[at - 1];
+        sketch->top[at - 1] = swap;
+        at--;
+    }
+}
+
+void CountMin_Init(CountMinSketch *sketch) {
+    memset(sketch, 0, sizeof(*sketch));
+}
+
+void CountMin_Add(CountMinSketch *sketch, const char *term, uint32_t count) {
+    char key[COUNT_MIN_TERM_LEN];
+
+    snprintf(key, sizeof(key), "%s", term);
+    uint64_t hash = hashText(key);
+    for (int r = 0; r < COUNT_MIN_DEPTH; r++) {
+        uint32_t *counter = &sketch->counters[r][rowColumn(hash, r)];
+        *counter = *counter > UINT32_MAX - count ? UINT32_MAX : *counter + count;
+    }
+    sketch->total += count;
+    offerTerm(sketch, key, estimateHash(sketch, hash));
+}
+
+uint32_t CountMin_Estimate(const CountMinSketch *sketch, const char *term) {
+    char key[COUNT_MIN_TERM_LEN];
+
+    snprintf(key, sizeof(key), "%s", term);
+    return estimateHash(sketch, hashText(key));
+}
+
+void CountMin_Merge(CountMinSketch *sketch, const CountMinSketch *other) {
+    CountMinTerm candidates[2 * COUNT_MIN_TOP];
+    int count = 0;
+
+    for (int r = 0; r < COUNT_MIN_DEPTH; r++) {
+        for (int c = 0; c < COUNT_MIN_WIDTH; c++) {
+            uint32_t *counter = &sketch->counters[r][c];
+            uint32_t add = other->counters[r][c];
+            *counter = *counter > UINT32_MAX - add ? UINT32_MAX : *counter + add;
+        }
+    }
+    sketch->total += other->total;
+
+    /* Both lists compete again at their merged estimates */
+    memcpy(candidates, sketch->top, (size_t)sketch->topCount * sizeof(CountMinTerm));
+    count = sketch->topCount;
+    memcpy(candidates + count, other->top, (size_t)other->topCount * sizeof(CountMinTerm));
+    count += other->topCount;
+
+    sketch->topCount = 0;
+    for (int i = 0; i < count; i++) {
+        offerTerm(sketch, candidates[i].term,
+                  estimateHash(sketch, hashText(candidates[i].term)));
+    }
+}
+
+/* ============= Catalog Sketches ============= */
+
+static void followMutation(void *context, const Book *before, const Book *after) {
+    CatalogSketches *sketches = (CatalogSketches*)context;
+    int authorChanged = before == NULL || after == NULL ||
+                        strcmp(before->authorFolded, after->authorFolded) != 0;
+    int priceChanged = before == NULL || after == NULL || before->price != after->price;
+
+    if (after != NULL && authorChanged) {
+        Hll_AddHash(&sketches->authors, hashText(after->authorFolded));
+    }
+    if (after != NULL && priceChanged) {
+        Kll_Add(&sketches->prices, after->price);
+    }
+    if (before != NULL && (authorChanged || priceChanged)) {
+        sketches->stale++;
+    }
+}
+
+/**
+ * Reset the book sketches and count every book of the library
+ */
+static void sketchLibrary(CatalogSketches *sketches) {
+    Hll_Init(&sketches->authors);
+    Kll_Init(&sketches->prices, KLL_SEED);
+    sketches->stale = 0;
+
+    if (sketches->library == NULL) {
+        return;
+    }
+    for (int i = 0; i < sketches->library->count; i++) {
+        CatalogSketches_AddBook(sketches, &sketches->library->books[i]);
+    }
+}
+
+int CatalogSketches_Init(CatalogSketches *sketches, Library *library) {
+    sketches->library = library;
+    sketches->rebuilds = 0;
+    CountMin_Init(&sketches->searches);
+    sketchLibrary(sketches);
+
+    if (library != NULL && libraryAddObserver(library, followMutation, sketches) != 0) {
+        fprintf(stderr, "Too many library observers for catalog sketches\n");
+        return -1;
+    }
+    return 0;
+}
+
+void CatalogSketches_Free(CatalogSketches *sketches) {
+    if (sketches->library != NULL) {
+        libraryRemoveObserver(sketches->library, followMutation, sketches);
+        sketches->library = NULL;
+    }
+}
+
+void CatalogSketches_AddBook(CatalogSketches *sketches, const Book *book) {
+    Hll_AddHash(&sketches->authors, hashText(book->authorFolded));
+    Kll_Add(&sketches->prices, book->price);
+}
+
+void CatalogSketches_RecordSearch(CatalogSketches *sketches, const char *term) {
+    char folded[COUNT_MIN_TERM_LEN];
+
+    if (Text_Fold(term, folded, sizeof(folded)) > 0) {
+        CountMin_Add(&sketches->searches, folded, 1);
+    }
+}
+
+int CatalogSketches_Refresh(CatalogSketches *sketches) {
+    if (sketches->library == NULL || sketches->stale == 0 ||
+        sketches->stale * SKETCH_STALE_DIVISOR <= (uint64_t)sketches->library->count) {
+        return 0;
+    }
+
+    sketchLibrary(sketches);
+    sketches->rebuilds++;
+    return 1;
+}
+
+void CatalogSketches_Merge(CatalogSketches *sketches, const CatalogSketches *other) {
+    Hll_Merge(&sketches->authors, &other->authors);
+    Kll_Merge(&sketches->prices, &other->prices);
+    CountMin_Merge(&sketches->searches, &other->searches);
+    sketches->stale += other->stale;
+}
@@ -0,0 +1,194 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LIBRARY.h"
+
+/**
+ * @file SKETCH.h
+ * @brief Fixed-size approximate summaries of a catalog
+ *
+ * Three sketches answer dashboard questions without touching every
+ * book, each in constant memory however large the catalog grows:
+ *
+ *   - HyperLogLog estimates the number of distinct authors (by handle,
+ *     the folded author) with a standard error of about 1.04 / sqrt(2^p),
+ *     1.6% at HLL_PRECISION 12;
+ *   - a KLL sketch answers price quantiles (median, p90, ...) to within
+ *     about 2% in rank at KLL_K 200;
+ *   - a count-min sketch counts how often each search term was used,
+ *     never undercounting, and overcounting by at most e / width of all
+ *     searches (0.27%) with probability 1 - e^-depth (98%); it also
+ *     keeps a list of the COUNT_MIN_TOP most frequent terms seen.
+ *
+ * Every sketch can be merged with another of the same kind, so shards
+ * of a catalog can be summarized separately and combined; the merge
+ * answers as if one sketch had seen everything.
+ *
+ * The sketches only grow: a deleted book, or the old price of an
+ * updated one, is still counted. CatalogSketches tracks how many such
+ * stale values it holds and CatalogSketches_Refresh rebuilds the book
+ * sketches from the library when they exceed a fraction of the catalog.
+ */
+
+#define HLL_PRECISION 12
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+#define KLL_K 200                     /* Capacity of the top level */
+#define KLL_MAX_LEVELS 32
+#define KLL_LEVEL_SLOTS (2 * KLL_K)   /* A full level plus a promoted one */
+
+#define COUNT_MIN_DEPTH 4
+#define COUNT_MIN_WIDTH 1024
+#define COUNT_MIN_TOP 8               /* Frequent terms remembered */
+#define COUNT_MIN_TERM_LEN 64
+
+/* Rebuild when stale values exceed 1 / SKETCH_STALE_DIVISOR of the books */
+#define SKETCH_STALE_DIVISOR 10
+
+typedef struct {
+    uint8_t registers[HLL_REGISTERS]; /* Longest run of leading zeros + 1 */
+} HyperLogLog;
+
+/**
+ * Levels of values; an item at level h stands for 2^h inserted values.
+ * Level h holds up to KLL_K * (2/3)^(top - h) items (at least 2); a
+ * full level is sorted and every other item (odd or even positions,
+ * chosen at random) moves up a level.
+ */
+typedef struct {
+    float items[KLL_MAX_LEVELS][KLL_LEVEL_SLOTS];
+    int counts[KLL_MAX_LEVELS];
+    int levels;                       /* Levels in use, at least 1 */
+    uint64_t n;                       /* Values inserted */
+    float min, max;
+    uint64_t random;                  /* State for the compaction coin */
+} KllSketch;
+
+/* One frequent search term */
+typedef struct {
+    char term[COUNT_MIN_TERM_LEN];
+    uint32_t estimate;                /* Count when last seen */
+} CountMinTerm;
+
+typedef struct {
+    uint32_t counters[COUNT_MIN_DEPTH][COUNT_MIN_WIDTH];
+    uint64_t total;                   /* Everything counted */
+    CountMinTerm top[COUNT_MIN_TOP];  /* Highest estimates, most frequent first */
+    int topCount;
+} CountMinSketch;
+
+/* Sketches of one catalog, or of several merged */
+typedef struct {
+    Library *library;                 /* Library observed, or NULL */
+    HyperLogLog authors;
+    KllSketch prices;
+    CountMinSketch searches;
+    uint64_t stale;                   /* Deleted or replaced values counted */
+    uint64_t rebuilds;
+} CatalogSketches;
+
+/* ============= HyperLogLog ============= */
+
+void Hll_Init(HyperLogLog *hll);
+
+/**
+ * @brief Count a value given by its 64-bit hash
+ */
+void Hll_AddHash(HyperLogLog *hll, uint64_t hash);
+
+/**
+ * @brief Estimate the number of distinct values added
+ */
+double Hll_Estimate(const HyperLogLog *hll);
+
+/**
+ * @brief Fold another sketch into hll (register-wise maximum)
+ */
+void Hll_Merge(HyperLogLog *hll, const HyperLogLog *other);
+
+/* ============= KLL Quantiles ============= */
+
+void Kll_Init(KllSketch *kll, uint64_t seed);
+
+void Kll_Add(KllSketch *kll, float value);
+
+/**
+ * @brief Estimate the value at a rank
+ * @param q Rank between 0 (minimum) and 1 (maximum)
+ * @return The value, or 0 if the sketch is empty
+ */
+float Kll_Quantile(const KllSketch *kll, double q);
+
+/**
+ * @brief Fold another sketch into kll
+ */
+void Kll_Merge(KllSketch *kll, const KllSketch *other);
+
+/* ============= Count-Min ============= */
+
+void CountMin_Init(CountMinSketch *sketch);
+
+/**
+ * @brief Count occurrences of a term and update the frequent-term list
+ *
+ * Terms are counted as given; longer than COUNT_MIN_TERM_LEN - 1 bytes
+ * they are cut short.
+ */
+void CountMin_Add(CountMinSketch *sketch, const char *term, uint32_t count);
+
+/**
+ * @brief Estimated occurrences of a term; never below the true count
+ */
+uint32_t CountMin_Estimate(const CountMinSketch *sketch, const char *term);
+
+/**
+ * @brief Fold another sketch into sketch, re-ranking both term lists
+ */
+void CountMin_Merge(CountMinSketch *sketch, const CountMinSketch *other);
+
+/* ============= Catalog Sketches ============= */
+
+/**
+ * @brief Sketch a library's books and follow its mutations
+ * @param library Library to observe, or NULL for sketches fed by hand
+ *                (CatalogSketches_AddBook) or by merging
+ * @return 0 on success, -1 on failure
+ */
+int CatalogSketches_Init(CatalogSketches *sketches, Library *library);
+
+/**
+ * @brief Stop following the library
+ */
+void CatalogSketches_Free(CatalogSketches *sketches);
+
+/**
+ * @brief Count one book's author and price
+ *
+ * The author is taken from authorFolded, which storing a book in a
+ * library fills in; books fed by hand need it set (Text_Fold).
+ */
+void CatalogSketches_AddBook(CatalogSketches *sketches, const Book *book);
+
+/**
+ * @brief Count a search; the term is folded first and empty terms skipped
+ */
+void CatalogSketches_RecordSearch(CatalogSketches *sketches, const char *term);
+
+/**
+ * @brief Rebuild the author and price sketches if too many values are stale
+ *
+ * Search counts are kept.
+ *
+ * @return 1 if rebuilt, 0 if still fresh enough or not observing a library
+ */
+int CatalogSketches_Refresh(CatalogSketches *sketches);
+
+/**
+ * @brief Fold the sketches of another shard into sketches
+ */
+void CatalogSketches_Merge(CatalogSketches *sketches, const CatalogSketches *other);
+
+#endif /* SKETCH_H */
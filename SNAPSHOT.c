@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SNAPSHOT.h"
+
+/* ============= Book Copies ============= */
+
+static Book* copyBook(const Book *book) {
+    Book *copy = (Book*)malloc(sizeof(Book));
+    if (copy != NULL) {
+        *copy = *book;
+    }
+    return copy;
+}
+
+/**
+ * Free the retired copies if no snapshot can still be reading them
+ *
+ * Snapshots are taken while the writer is kept out, so with none open
+ * nothing but the writer can reach a retired copy.
+ */
+static void reclaimRetired(CatalogVersions *versions) {
+    if (__atomic_load_n(&versions->open, __ATOMIC_ACQUIRE) != 0) {
+        return;
+    }
+    for (int i = 0; i < versions->retiredCount; i++) {
+        free(versions->retired[i]);
+    }
+    versions->retiredCount = 0;
+}
+
+/**
+ * Retire a copy the live tree no longer holds
+ */
+static void retireBook(CatalogVersions *versions, Book *book) {
+    if (__atomic_load_n(&versions->open, __ATOMIC_ACQUIRE) == 0) {
+        free(book);
+        return;
+    }
+
+    if (versions->retiredCount == versions->retiredCapacity) {
+        int capacity = versions->retiredCapacity > 0 ? versions->retiredCapacity * 2 : 64;
+        Book **retired = (Book**)realloc(versions->retired,
+                                         (size_t)capacity * sizeof(Book*));
+        if (retired == NULL) {
+            /* Leaked rather than freed under a reader */
+            fprintf(stderr, "Memory allocation failed for retired book versions\n");
+            return;
+        }
+        versions->retired = retired;
+        versions->retiredCapacity = capacity;
+    }
+    versions->retired[versions->retiredCount++] = book;
+}
+
+static void followMutation(void *context, const Book *before, const Book *after) {
+    CatalogVersions *versions = (CatalogVersions*)context;
+    int id = after != NULL ? after->id : before->id;
+    Book *old = before != NULL ? (Book*)PRBTree_Search(versions->tree, id) : NULL;
+
+    reclaimRetired(versions);
+
+    if (after == NULL) {
+        if (PRBTree_Delete(versions->tree, id) != 1) {
+            versions->failed = 1;
+            return;
+        }
+    } else {
+        Book *copy = copyBook(after);
+        int result = copy == NULL ? -1
+                   : old != NULL ? PRBTree_Update(versions->tree, id, copy)
+                   : PRBTree_Insert(versions->tree, id, copy);
+        if (result != 1) {
+            free(copy);
+            versions->failed = 1;
+            return;
+        }
+    }
+
+    if (old != NULL) {
+        retireBook(versions, old);
+    }
+}
+
+/* ============= Public API ============= */
+
+int CatalogVersions_Init(CatalogVersions *versions, Library *library) {
+    memset(versions, 0, sizeof(*versions));
+    versions->library = library;
+    versions->tree = PRBTree_Create();
+    if (versions->tree == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < library->count; i++) {
+        Book *copy = copyBook(&library->books[i]);
+        if (copy == NULL || PRBTree_Insert(versions->tree, copy->id, copy) != 1) {
+            fprintf(stderr, "Memory allocation failed for book versions\n");
+            free(copy);
+            CatalogVersions_Free(versions);
+            return -1;
+        }
+    }
+
+    if (libraryAddObserver(library, followMutation, versions) != 0) {
+        fprintf(stderr, "Too many library observers for book versions\n");
+        CatalogVersions_Free(versions);
+        return -1;
+    }
+    versions->observing = 1;
+
+    return 0;
+}
+
+void CatalogVersions_Free(CatalogVersions *versions) {
+    if (versions->observing) {
+        libraryRemoveObserver(versions->library, followMutation, versions);
+        versions->observing = 0;
+    }
+
+    if (versions->tree != NULL) {
+        PRBSnapshot all;
+        void **books = (void**)malloc((versions->tree->size > 0
+                                       ? versions->tree->size : 1) * sizeof(void*));
+
+        /* Without room to list them the copies leak, not the tree */
+        if (books != NULL && PRBTree_Snapshot(versions->tree, &all) == 0) {
+            size_t count = PRBSnapshot_Values(&all, books, versions->tree->size);
+            for (size_t i = 0; i < count; i++) {
+                free(books[i]);
+            }
+            PRBSnapshot_Release(&all);
+        }
+        free(books);
+        PRBTree_Destroy(versions->tree);
+        versions->tree = NULL;
+    }
+
+    for (int i = 0; i < versions->retiredCount; i++) {
+        free(versions->retired[i]);
+    }
+    free(versions->retired);
+    versions->retired = NULL;
+    versions->retiredCount = 0;
+    versions->retiredCapacity = 0;
+}
+
+int CatalogVersions_Snapshot(CatalogVersions *versions, CatalogSnapshot *snapshot) {
+    snapshot->versions = NULL;
+    if (versions->failed || PRBTree_Snapshot(versions->tree, &snapshot->snapshot) != 0) {
+        return -1;
+    }
+
+    __atomic_add_fetch(&versions->open, 1, __ATOMIC_ACQ_REL);
+    snapshot->versions = versions;
+    return 0;
+}
+
+int CatalogSnapshot_Count(const CatalogSnapshot *snapshot) {
+    return (int)snapshot->snapshot.size;
+}
+
+int CatalogSnapshot_Books(const CatalogSnapshot *snapshot, const Book **books,
+                          int capacity) {
+    return (int)PRBSnapshot_Values(&snapshot->snapshot, (void**)books,
+                                   capacity > 0 ? (size_t)capacity : 0);
+}
+
+void CatalogSnapshot_Release(CatalogSnapshot *snapshot) {
+    if (snapshot->versions == NULL) {
+        return;
+    }
+
+    PRBSnapshot_Release(&snapshot->snapshot);
+    /* Only now may the writer free copies this snapshot could reach */
+    __atomic_sub_fetch(&snapshot->versions->open, 1, __ATOMIC_RELEASE);
+    snapshot->versions = NULL;
+}
@@ -0,0 +1,89 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+
+#include "LIBRARY.h"
+#include "PRBTREE.h"
+
+/**
+ * @file SNAPSHOT.h
+ * @brief Frozen views of a library for long reads during writes
+ *
+ * CatalogVersions observes a library and keeps a copy of every book in
+ * a persistent tree (PRBTREE.h) keyed by ID. A book copy is never
+ * changed: an update stores a new copy and retires the old one, so a
+ * snapshot of the tree sees every book exactly as it was when the
+ * snapshot was taken, however the library changes afterwards.
+ *
+ * Taking a snapshot is O(1) but must not race the writer: take it
+ * under whatever lock guards the library (a replica follower's read
+ * lock). Reading and releasing it need no lock, so an export or report
+ * can walk the snapshot while the writer carries on. Retired copies are
+ * freed by the writer at its next change once no snapshot is open.
+ *
+ * The copies double the memory the books take; the tree adds one node
+ * per book plus the path copies of writes made while a snapshot is open.
+ */
+
+typedef struct {
+    Library *library;
+    PRBTree *tree;                    /* ID -> immutable Book copy */
+    Book **retired;                   /* Replaced copies a snapshot may read */
+    int retiredCount;
+    int retiredCapacity;
+    int open;                         /* Snapshots not yet released (atomic) */
+    int observing;                    /* Registered as a library observer */
+    int failed;                       /* A change could not be recorded */
+} CatalogVersions;
+
+/* One frozen version of the library's books */
+typedef struct {
+    CatalogVersions *versions;
+    PRBSnapshot snapshot;
+} CatalogSnapshot;
+
+/**
+ * @brief Copy a library's books and follow its mutations
+ * @return 0 on success, -1 on failure
+ */
+int CatalogVersions_Init(CatalogVersions *versions, Library *library);
+
+/**
+ * @brief Stop following the library and free every copy
+ *
+ * Every snapshot must be released first.
+ */
+void CatalogVersions_Free(CatalogVersions *versions);
+
+/**
+ * @brief Pin the library's current books in O(1)
+ *
+ * The caller must keep the library's writer out while this runs.
+ *
+ * @param snapshot Filled with the new snapshot
+ * @return 0 on success, -1 if a change could not be recorded (the
+ *         versions no longer match the library)
+ */
+int CatalogVersions_Snapshot(CatalogVersions *versions, CatalogSnapshot *snapshot);
+
+/**
+ * @brief Number of books in a snapshot
+ */
+int CatalogSnapshot_Count(const CatalogSnapshot *snapshot);
+
+/**
+ * @brief Collect a snapshot's books in ID order
+ * @param books Receives up to capacity pointers, valid until the
+ *              snapshot is released
+ * @return Number of books stored
+ */
+int CatalogSnapshot_Books(const CatalogSnapshot *snapshot, const Book **books,
+                          int capacity);
+
+/**
+ * @brief Release a snapshot; may be called without the library's lock
+ */
+void CatalogSnapshot_Release(CatalogSnapshot *snapshot);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,851 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "METRICS.h"
+#include "PAGES.h"
+#include "SORT.h"
+
+#define INSERTION_SORT_CUTOFF 16
+
+/* What a sort is ordering by */
+typedef struct {
+    const Library *library;
+    BookField field;
+    int descending;
+} SortSpec;
+
+/* ============= Comparison ============= */
+
+static int isNumericField(BookField field) {
+    return field == FIELD_ID || field == FIELD_YEAR ||
+           field == FIELD_PRICE || field == FIELD_QUANTITY;
+}
+
+/**
+ * Get the integer sort key of a numeric field (price in cents)
+ */
+static int numericField(const Book *book, BookField field) {
+    switch (field) {
+        case FIELD_YEAR:
+            return book->year;
+        case FIELD_PRICE:
+            return libraryPriceKey(book->price);
+        case FIELD_QUANTITY:
+            return book->quantity;
+        default:
+            return book->id;
+    }
+}
+
+static const char* textField(const Book *book, BookField field) {
+    switch (field) {
+        case FIELD_TITLE:
+            return book->title;
+        case FIELD_AUTHOR:
+            return book->author;
+        default:
+            return book->isbn;
+    }
+}
+
+int Sort_Compare(const Book *a, const Book *b, BookField field, int descending) {
+    int cmp;
+
+    if (isNumericField(field)) {
+        int x = numericField(a, field);
+        int y = numericField(b, field);
+        cmp = (x > y) - (x < y);
+    } else {
+        cmp = strcmp(textField(a, field), textField(b, field));
+    }
+
+    if (descending) {
+        cmp = -cmp;
+    }
+    if (cmp == 0) {
+        cmp = (a->id > b->id) - (a->id < b->id);
+    }
+
+    return cmp;
+}
+
+static const StrKey* keyColumn(const Library *library, BookField field) {
+    switch (field) {
+        case FIELD_TITLE:
+            return library->keys.title;
+        case FIELD_AUTHOR:
+            return library->keys.author;
+        default:
+            return library->keys.isbn;
+    }
+}
+
+int Sort_CompareRows(const Library *library, int a, int b, BookField field,
+                     int descending) {
+    const Book *x = &library->books[a];
+    const Book *y = &library->books[b];
+
+    if (isNumericField(field)) {
+        return Sort_Compare(x, y, field, descending);
+    }
+
+    const StrKey *keys = keyColumn(library, field);
+    int cmp = StrKey_Compare(&keys[a], textField(x, field),
+                             &keys[b], textField(y, field));
+
+    if (descending) {
+        cmp = -cmp;
+    }
+    if (cmp == 0) {
+        cmp = (x->id > y->id) - (x->id < y->id);
+    }
+
+    return cmp;
+}
+
+static int compareRows(const SortSpec *spec, int a, int b) {
+    return Sort_CompareRows(spec->library, a, b, spec->field, spec->descending);
+}
+
+/* ============= Radix Sort (numeric fields) ============= */
+
+/**
+ * Pack a row into a word whose unsigned order is the listing order
+ *
+ * The high half is the field value, biased to sort unsigned and
+ * inverted for descending order; the low half is the position, which
+ * breaks ties in ID order because books are stored in ID order.
+ */
+static uint64_t packKey(const SortSpec *spec, int row) {
+    uint32_t key = (uint32_t)numericField(&spec->library->books[row],
+                                          spec->field) ^ 0x80000000u;
+    if (spec->descending) {
+        key = ~key;
+    }
+
+    return ((uint64_t)key << 32) | (uint32_t)row;
+}
+
+/**
+ * LSD radix sort of 64-bit words, one byte per pass
+ * @param keys: Words to sort; holds the result on return
+ * @param tmp: Scratch buffer of n words
+ * @param n: Number of words
+ */
+static void radixSort(uint64_t *keys, uint64_t *tmp, size_t n) {
+    uint64_t *src = keys;
+    uint64_t *dst = tmp;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {0};
+
+        for (size_t i = 0; i < n; i++) {
+            counts[(src[i] >> shift) & 0xFF]++;
+        }
+
+        /* Every word shares this byte: the pass would be a copy */
+        if (n == 0 || counts[(src[0] >> shift) & 0xFF] == n) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t count = counts[b];
+            counts[b] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < n; i++) {
+            dst[counts[(src[i] >> shift) & 0xFF]++] = src[i];
+        }
+
+        uint64_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != keys) {
+        memcpy(keys, src, n * sizeof(uint64_t));
+    }
+}
+
+/* ============= Prefix Radix Sort (text fields) ============= */
+
+/* A row tagged with the inline prefix of its sort text */
+typedef struct {
+    uint64_t prefix;                  /* StrKey_PrefixWord, inverted when descending */
+    int row;
+} PrefixRow;
+
+/**
+ * LSD radix sort of tagged rows by prefix, one byte per pass; stable,
+ * so rows with equal prefixes keep their order
+ * @param rows: Rows to sort; holds the result on return
+ * @param tmp: Scratch buffer of n rows
+ */
+static void radixSortPrefixes(PrefixRow *rows, PrefixRow *tmp, size_t n) {
+    PrefixRow *src = rows;
+    PrefixRow *dst = tmp;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {0};
+
+        for (size_t i = 0; i < n; i++) {
+            counts[(src[i].prefix >> shift) & 0xFF]++;
+        }
+
+        /* Every prefix shares this byte (often a leading "The "): skip */
+        if (n == 0 || counts[(src[0].prefix >> shift) & 0xFF] == n) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t count = counts[b];
+            counts[b] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < n; i++) {
+            dst[counts[(src[i].prefix >> shift) & 0xFF]++] = src[i];
+        }
+
+        PrefixRow *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != rows) {
+        memcpy(rows, src, n * sizeof(PrefixRow));
+    }
+}
+
+/* ============= Merge Sort (text fields) ============= */
+
+static void mergeSortRows(const SortSpec *spec, int *rows, int *tmp, size_t n) {
+    if (n <= INSERTION_SORT_CUTOFF) {
+        for (size_t i = 1; i < n; i++) {
+            int row = rows[i];
+            size_t j = i;
+            while (j > 0 && compareRows(spec, rows[j - 1], row) > 0) {
+                rows[j] = rows[j - 1];
+                j--;
+            }
+            rows[j] = row;
+        }
+        return;
+    }
+
+    size_t half = n / 2;
+    mergeSortRows(spec, rows, tmp, half);
+    mergeSortRows(spec, rows + half, tmp + half, n - half);
+
+    /* Already in order: skip the merge */
+    if (compareRows(spec, rows[half - 1], rows[half]) <= 0) {
+        return;
+    }
+
+    size_t i = 0, j = half, k = 0;
+    while (i < half && j < n) {
+        tmp[k++] = compareRows(spec, rows[j], rows[i]) < 0 ? rows[j++] : rows[i++];
+    }
+    while (i < half) {
+        tmp[k++] = rows[i++];
+    }
+    while (j < n) {
+        tmp[k++] = rows[j++];
+    }
+    memcpy(rows, tmp, n * sizeof(int));
+}
+
+/* ============= Parallel Driver ============= */
+
+/* One chunk of a parallel sort */
+typedef struct {
+    const SortSpec *spec;
+    uint64_t *keys;                   /* Numeric sorts */
+    uint64_t *keyTmp;
+    int *rows;                        /* Text sorts */
+    int *rowTmp;
+    size_t n;
+    int worker;                       /* Chunk index, for pinning */
+} SortTask;
+
+static void* runSortTask(void *arg) {
+    SortTask *task = (SortTask*)arg;
+
+    if (task->keys != NULL) {
+        radixSort(task->keys, task->keyTmp, task->n);
+    } else {
+        mergeSortRows(task->spec, task->rows, task->rowTmp, task->n);
+    }
+
+    return NULL;
+}
+
+/* Thread entry: run a chunk on the CPUs its shard is pinned to */
+static void* runSortWorker(void *arg) {
+    Pages_PinWorker(((SortTask*)arg)->worker);
+    return runSortTask(arg);
+}
+
+static int threadCount(size_t n) {
+    if (n < SORT_PARALLEL_THRESHOLD) {
+        return 1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        return 1;
+    }
+
+    return cpus < SORT_MAX_THREADS ? (int)cpus : SORT_MAX_THREADS;
+}
+
+/**
+ * Merge two adjacent sorted runs of src into dst
+ */
+static void mergeRuns(const SortSpec *spec, int numeric, void *src, void *dst,
+                      size_t lo, size_t mid, size_t hi) {
+    size_t i = lo, j = mid, k = lo;
+
+    if (numeric) {
+        uint64_t *s = (uint64_t*)src;
+        uint64_t *d = (uint64_t*)dst;
+        while (i < mid && j < hi) {
+            d[k++] = s[j] < s[i] ? s[j++] : s[i++];
+        }
+        while (i < mid) d[k++] = s[i++];
+        while (j < hi) d[k++] = s[j++];
+    } else {
+        int *s = (int*)src;
+        int *d = (int*)dst;
+        while (i < mid && j < hi) {
+            d[k++] = compareRows(spec, s[j], s[i]) < 0 ? s[j++] : s[i++];
+        }
+        while (i < mid) d[k++] = s[i++];
+        while (j < hi) d[k++] = s[j++];
+    }
+}
+
+/**
+ * Sort data in threads chunks, then merge the runs pairwise
+ * @param data: Words (numeric) or positions (text) to sort
+ * @param tmp: Scratch buffer of the same size
+ */
+static void sortParallel(const SortSpec *spec, int numeric, void *data,
+                         void *tmp, size_t n, int threads) {
+    size_t width = numeric ? sizeof(uint64_t) : sizeof(int);
+    SortTask tasks[SORT_MAX_THREADS];
+    pthread_t handles[SORT_MAX_THREADS];
+    int started[SORT_MAX_THREADS] = {0};
+    size_t bounds[SORT_MAX_THREADS + 1];
+
+    for (int t = 0; t <= threads; t++) {
+        bounds[t] = n * (size_t)t / (size_t)threads;
+    }
+
+    for (int t = 0; t < threads; t++) {
+        char *base = (char*)data + bounds[t] * width;
+        char *scratch = (char*)tmp + bounds[t] * width;
+
+        tasks[t].spec = spec;
+        tasks[t].keys = numeric ? (uint64_t*)base : NULL;
+        tasks[t].keyTmp = numeric ? (uint64_t*)scratch : NULL;
+        tasks[t].rows = numeric ? NULL : (int*)base;
+        tasks[t].rowTmp = numeric ? NULL : (int*)scratch;
+        tasks[t].n = bounds[t + 1] - bounds[t];
+        tasks[t].worker = t;
+
+        /* The last chunk runs here; a failed spawn also falls back inline */
+        if (t == threads - 1 ||
+            pthread_create(&handles[t], NULL, runSortWorker, &tasks[t]) != 0) {
+            runSortTask(&tasks[t]);
+        } else {
+            started[t] = 1;
+        }
+    }
+    for (int t = 0; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(handles[t], NULL);
+        }
+    }
+
+    void *src = data;
+    void *dst = tmp;
+    int runs = threads;
+
+    while (runs > 1) {
+        int merged = 0;
+        for (int r = 0; r < runs; r += 2) {
+            if (r + 1 < runs) {
+                mergeRuns(spec, numeric, src, dst, bounds[r], bounds[r + 1],
+                          bounds[r + 2]);
+            } else {
+                memcpy((char*)dst + bounds[r] * width,
+                       (char*)src + bounds[r] * width,
+                       (bounds[r + 1] - bounds[r]) * width);
+            }
+            bounds[merged++] = bounds[r];
+        }
+        bounds[merged] = n;
+        runs = merged;
+
+        void *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != data) {
+        memcpy(data, src, n * width);
+    }
+}
+
+/**
+ * Sort catalog positions by a field (untimed)
+ */
+static int sortPositions(const Library *library, BookField field,
+                         int descending, int *positions, size_t n) {
+    SortSpec spec = {library, field, descending};
+    int threads = threadCount(n);
+
+    if (n < 2) {
+        return 0;
+    }
+
+    if (isNumericField(field)) {
+        uint64_t *keys = (uint64_t*)malloc(2 * n * sizeof(uint64_t));
+        if (keys == NULL) {
+            fprintf(stderr, "Memory allocation failed for sort keys\n");
+            return -1;
+        }
+        Pages_Advise(keys, 2 * n * sizeof(uint64_t));
+
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = packKey(&spec, positions[i]);
+        }
+        sortParallel(&spec, 1, keys, keys + n, n, threads);
+        for (size_t i = 0; i < n; i++) {
+            positions[i] = (int)(uint32_t)keys[i];
+        }
+
+        free(keys);
+        return 0;
+    }
+
+    PrefixRow *tagged = (PrefixRow*)malloc(2 * n * sizeof(PrefixRow));
+    int *tmp = (int*)malloc(n * sizeof(int));
+    if (tagged == NULL || tmp == NULL) {
+        fprintf(stderr, "Memory allocation failed for sort buffer\n");
+        free(tagged);
+        free(tmp);
+        return -1;
+    }
+    Pages_Advise(tagged, 2 * n * sizeof(PrefixRow));
+    Pages_Advise(tmp, n * sizeof(int));
+
+    /* Order by the inline prefixes alone, which decide most pairs */
+    const StrKey *keys = keyColumn(library, field);
+    uint64_t flip = descending ? ~(uint64_t)0 : 0;
+    for (size_t i = 0; i < n; i++) {
+        tagged[i].prefix = StrKey_PrefixWord(&keys[positions[i]]) ^ flip;
+        tagged[i].row = positions[i];
+    }
+    radixSortPrefixes(tagged, tagged + n, n);
+    for (size_t i = 0; i < n; i++) {
+        positions[i] = tagged[i].row;
+    }
+
+    /* Then order each run of rows sharing a prefix by the whole text */
+    size_t end;
+    for (size_t start = 0; start < n; start = end) {
+        end = start + 1;
+        while (end < n && tagged[end].prefix == tagged[start].prefix) {
+            end++;
+        }
+        if (end - start > 1) {
+            sortParallel(&spec, 0, positions + start, tmp + start, end - start,
+                         threadCount(end - start));
+        }
+    }
+
+    free(tagged);
+    free(tmp);
+    return 0;
+}
+
+int Sort_Positions(const Library *library, BookField field, int descending,
+                   int *positions, size_t n) {
+    METRICS_START(METRIC_SORT);
+    int result = sortPositions(library, field, descending, positions, n);
+    METRICS_STOP(METRIC_SORT);
+
+    return result;
+}
+
+/* ============= Sorted Export ============= */
+
+static void writeCsvText(FILE *out, const char *text) {
+    fputc('"', out);
+    for (; *text != '\0'; text++) {
+        if (*text == '"') {
+            fputc('"', out);
+        }
+        fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+static void writeCsvRow(FILE *out, const Book *book) {
+    fprintf(out, "%d,", book->id);
+    writeCsvText(out, book->title);
+    fputc(',', out);
+    writeCsvText(out, book->author);
+    fputc(',', out);
+    writeCsvText(out, book->isbn);
+    fprintf(out, ",%d,%.2f,%d\n", book->year, book->price, book->quantity);
+}
+
+/* Current head of one spilled run during the merge */
+typedef struct {
+    Book book;
+    FILE *file;
+} RunHead;
+
+static void siftRunHeads(RunHead *heap, int n, int i, BookField field,
+                         int descending) {
+    for (;;) {
+        int least = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+
+        if (left < n && Sort_Compare(&heap[left].book, &heap[least].book,
+                                     field, descending) < 0) {
+            least = left;
+        }
+        if (right < n && Sort_Compare(&heap[right].book, &heap[least].book,
+                                      field, descending) < 0) {
+            least = right;
+        }
+        if (least == i) {
+            return;
+        }
+
+        RunHead tmp = heap[i];
+        heap[i] = heap[least];
+        heap[least] = tmp;
+        i = least;
+    }
+}
+
+/* SortSink writing CSV rows to the FILE in context */
+static int writeCsvSink(void *context, const Book *book) {
+    writeCsvRow((FILE*)context, book);
+    return 0;
+}
+
+/**
+ * Merge sorted runs of Book records from rewound files into a sink
+ * @param heap: One entry per run, with its file set; the caller closes them
+ * @return: Number of books passed to emit, or -1 on failure
+ */
+static int mergeSpilledRuns(RunHead *heap, int live, BookField field,
+                            int descending, SortSink emit, void *sink) {
+    for (int r = 0; r < live; r++) {
+        if (fread(&heap[r].book, sizeof(Book), 1, heap[r].file) != 1) {
+            return -1;
+        }
+    }
+    for (int i = live / 2 - 1; i >= 0; i--) {
+        siftRunHeads(heap, live, i, field, descending);
+    }
+
+    int written = 0;
+    int active = live;
+    while (active > 0) {
+        written++;
+        if (emit(sink, &heap[0].book) != 0) {
+            break;
+        }
+
+        if (fread(&heap[0].book, sizeof(Book), 1, heap[0].file) != 1) {
+            /* Run exhausted: move it past the active heap */
+            RunHead done = heap[0];
+            heap[0] = heap[active - 1];
+            heap[active - 1] = done;
+            active--;
+        }
+        siftRunHeads(heap, active, 0, field, descending);
+    }
+
+    return written;
+}
+
+/**
+ * Sort the catalog in budget-sized runs, spill each run, then merge
+ * @param positions: Every catalog position, in storage order
+ * @param run_rows: Rows per run
+ * @return: Number of rows written, or -1 on failure
+ */
+static int exportExternal(const Library *library, BookField field,
+                          int descending, FILE *out, int *positions,
+                          size_t run_rows) {
+    size_t count = (size_t)library->count;
+    int runs = (int)((count + run_rows - 1) / run_rows);
+    RunHead *heap = (RunHead*)calloc((size_t)runs, sizeof(RunHead));
+    int live = 0;
+    int written = -1;
+
+    if (heap == NULL) {
+        fprintf(stderr, "Memory allocation failed for export merge\n");
+        return -1;
+    }
+
+    /* Phase 1: sorted runs on disk */
+    for (int r = 0; r < runs; r++) {
+        size_t start = (size_t)r * run_rows;
+        size_t len = count - start < run_rows ? count - start : run_rows;
+        FILE *file = tmpfile();
+
+        if (file == NULL) {
+            perror("tmpfile");
+            goto cleanup;
+        }
+        heap[live++].file = file;
+
+        if (Sort_Positions(library, field, descending, positions + start, len) != 0) {
+            goto cleanup;
+        }
+        for (size_t i = 0; i < len; i++) {
+            if (fwrite(&library->books[positions[start + i]], sizeof(Book), 1,
+                       file) != 1) {
+                perror("fwrite");
+                goto cleanup;
+            }
+        }
+        rewind(file);
+    }
+
+    /* Phase 2: k-way merge of the run heads */
+    written = mergeSpilledRuns(heap, live, field, descending, writeCsvSink, out);
+
+cleanup:
+    for (int r = 0; r < live; r++) {
+        fclose(heap[r].file);
+    }
+    free(heap);
+
+    return written;
+}
+
+int Sort_ExportCsv(const Library *library, BookField field, int descending,
+                   FILE *out, size_t memory_budget) {
+    size_t count = (size_t)library->count;
+    size_t run_rows = memory_budget / sizeof(Book);
+    int written = 0;
+
+    if (run_rows == 0) {
+        run_rows = 1;
+    }
+
+    fprintf(out, "id,title,author,isbn,year,price,quantity\n");
+    if (count == 0) {
+        return 0;
+    }
+
+    int *positions = (int*)malloc(count * sizeof(int));
+    if (positions == NULL) {
+        fprintf(stderr, "Memory allocation failed for export\n");
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        positions[i] = (int)i;
+    }
+
+    if (count <= run_rows) {
+        if (Sort_Positions(library, field, descending, positions, count) != 0) {
+            written = -1;
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                writeCsvRow(out, &library->books[positions[i]]);
+            }
+            written = (int)count;
+        }
+    } else {
+        written = exportExternal(library, field, descending, out, positions,
+                                 run_rows);
+    }
+
+    free(positions);
+    if (written >= 0 && ferror(out)) {
+        written = -1;
+    }
+
+    return written;
+}
+
+/* ============= Sorting a Source ============= */
+
+#define SOURCE_INITIAL_ROWS 1024
+
+/**
+ * Stable merge sort of book pointers in listing order (Sort_Compare)
+ */
+static void mergeSortBooks(const Book **rows, const Book **tmp, size_t n,
+                           BookField field, int descending) {
+    if (n <= INSERTION_SORT_CUTOFF) {
+        for (size_t i = 1; i < n; i++) {
+            const Book *row = rows[i];
+            size_t j = i;
+            while (j > 0 && Sort_Compare(rows[j - 1], row, field, descending) > 0) {
+                rows[j] = rows[j - 1];
+                j--;
+            }
+            rows[j] = row;
+        }
+        return;
+    }
+
+    size_t half = n / 2;
+    mergeSortBooks(rows, tmp, half, field, descending);
+    mergeSortBooks(rows + half, tmp + half, n - half, field, descending);
+
+    if (Sort_Compare(rows[half - 1], rows[half], field, descending) <= 0) {
+        return;
+    }
+
+    size_t i = 0, j = half, k = 0;
+    while (i < half && j < n) {
+        tmp[k++] = Sort_Compare(rows[j], rows[i], field, descending) < 0
+                 ? rows[j++] : rows[i++];
+    }
+    while (i < half) {
+        tmp[k++] = rows[i++];
+    }
+    while (j < n) {
+        tmp[k++] = rows[j++];
+    }
+    memcpy(rows, tmp, n * sizeof(rows[0]));
+}
+
+int Sort_Source(SortSource next, void *context, BookField field, int descending,
+                size_t memory_budget, SortSink emit, void *sink) {
+    /* A buffered row costs its record and two sort pointers */
+    size_t run_rows = memory_budget / (sizeof(Book) + 2 * sizeof(Book*));
+    size_t capacity = 0;
+    Book *books = NULL;
+    const Book **rows = NULL;
+    const Book **tmp = NULL;
+    RunHead *heap = NULL;
+    int live = 0;
+    int written = -1;
+    int status = 1;
+
+    if (run_rows == 0) {
+        run_rows = 1;
+    }
+
+    while (status > 0) {
+        size_t n = 0;
+
+        /* Fill one run, growing the buffers up to the budget */
+        while (n < run_rows) {
+            if (n == capacity) {
+                size_t grown = capacity == 0 ? SOURCE_INITIAL_ROWS : capacity * 2;
+                if (grown > run_rows) {
+                    grown = run_rows;
+                }
+                Book *more = (Book*)realloc(books, grown * sizeof(Book));
+                if (more != NULL) {
+                    books = more;
+                }
+                const Book **moreRows = (const Book**)realloc(rows, grown * sizeof(Book*));
+                if (moreRows != NULL) {
+                    rows = moreRows;
+                }
+                const Book **moreTmp = (const Book**)realloc(tmp, grown * sizeof(Book*));
+                if (moreTmp != NULL) {
+                    tmp = moreTmp;
+                }
+                if (more == NULL || moreRows == NULL || moreTmp == NULL) {
+                    fprintf(stderr, "Memory allocation failed for export\n");
+                    goto cleanup;
+                }
+                capacity = grown;
+            }
+            status = next(context, &books[n]);
+            if (status <= 0) {
+                break;
+            }
+            n++;
+        }
+        if (status < 0) {
+            goto cleanup;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            rows[i] = &books[i];
+        }
+        mergeSortBooks(rows, tmp, n, field, descending);
+
+        /* Everything fit in one run: no files */
+        if (live == 0 && status == 0) {
+            for (written = 0; (size_t)written < n;) {
+                if (emit(sink, rows[written++]) != 0) {
+                    break;
+                }
+            }
+            goto cleanup;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        RunHead *grownHeap = (RunHead*)realloc(heap, (size_t)(live + 1) * sizeof(RunHead));
+        if (grownHeap == NULL) {
+            fprintf(stderr, "Memory allocation failed for export merge\n");
+            goto cleanup;
+        }
+        heap = grownHeap;
+        heap[live].file = tmpfile();
+        if (heap[live].file == NULL) {
+            perror("tmpfile");
+            goto cleanup;
+        }
+        live++;
+        for (size_t i = 0; i < n; i++) {
+            if (fwrite(rows[i], sizeof(Book), 1, heap[live - 1].file) != 1) {
+                perror("fwrite");
+                goto cleanup;
+            }
+        }
+        rewind(heap[live - 1].file);
+    }
+
+    written = mergeSpilledRuns(heap, live, field, descending, emit, sink);
+
+cleanup:
+    for (int r = 0; r < live; r++) {
+        fclose(heap[r].file);
+    }
+    free(heap);
+    free(books);
+    free(rows);
+    free(tmp);
+
+    return written;
+}
+
+int Sort_ExportSource(SortSource next, void *context, BookField field,
+                      int descending, FILE *out, size_t memory_budget) {
+    fprintf(out, "id,title,author,isbn,year,price,quantity\n");
+    int written = Sort_Source(next, context, field, descending, memory_budget,
+                              writeCsvSink, out);
+    if (written >= 0 && ferror(out)) {
+        written = -1;
+    }
+
+    return written;
+}
@@ -0,0 +1,110 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "LIBRARY.h"
+#include "QUERY.h"
+
+/**
+ * @file SORT.h
+ * @brief Sorting and sorted export of catalog rows
+ *
+ * Numeric fields are sorted with an LSD radix sort on packed
+ * (key, position) words; text fields use a stable merge sort comparing
+ * StrKey headers (Sort_CompareRows). Inputs of at least
+ * SORT_PARALLEL_THRESHOLD rows are split across worker threads and the
+ * sorted runs merged. Exports that would need more
+ * than their memory budget are sorted in runs spilled to temporary
+ * files and merged back with a k-way heap merge.
+ */
+
+#define SORT_PARALLEL_THRESHOLD 65536
+#define SORT_MAX_THREADS 8
+#define SORT_DEFAULT_MEMORY_BUDGET (64u * 1024u * 1024u)
+
+/**
+ * Compare two books in listing order
+ *
+ * Ties on the sort field are broken by ascending ID, so every listing
+ * order is total and repeatable.
+ *
+ * @return: Negative if a comes first, positive if b does, 0 if same book
+ */
+int Sort_Compare(const Book *a, const Book *b, BookField field, int descending);
+
+/**
+ * Compare two catalog positions in listing order
+ *
+ * Same order as Sort_Compare, but text fields are compared by their
+ * StrKey headers in library->keys, reading the strings only when the
+ * inline prefixes tie.
+ *
+ * @param a, b: Indexes into library->books
+ */
+int Sort_CompareRows(const Library *library, int a, int b, BookField field,
+                     int descending);
+
+/**
+ * Sort catalog positions by a field
+ * @param positions: Indexes into library->books, sorted in place
+ * @param n: Number of positions
+ * @return: 0 on success, -1 on allocation failure (positions unchanged)
+ */
+int Sort_Positions(const Library *library, BookField field, int descending,
+                   int *positions, size_t n);
+
+/**
+ * Write the whole catalog as CSV in sorted order
+ * @param out: Destination stream
+ * @param memory_budget: Bytes of book records to sort in memory at once
+ * @return: Number of rows written, or -1 on failure
+ */
+int Sort_ExportCsv(const Library *library, BookField field, int descending,
+                   FILE *out, size_t memory_budget);
+
+/**
+ * Produce the next book of an export
+ * @param book: Receives the book
+ * @return: 1 if a book was produced, 0 at the end, -1 on failure
+ */
+typedef int (*SortSource)(void *context, Book *book);
+
+/**
+ * Receive the next book of a sorted stream
+ * @param book: Valid only during the call
+ * @return: 0 for the next book, nonzero to stop
+ */
+typedef int (*SortSink)(void *context, const Book *book);
+
+/**
+ * Pass the books of a source to a sink in sorted order
+ *
+ * The source is read to its end and sorted in runs of at most the
+ * memory budget, spilled to temporary files when there is more than
+ * one; text fields compare the strings themselves (Sort_Compare).
+ *
+ * @param next: Called until it returns 0 or -1
+ * @param memory_budget: Bytes of buffered books to sort in memory at once
+ * @param emit: Called for each book in order, until it returns nonzero
+ * @param sink: Passed to emit
+ * @return: Number of books passed to emit, or -1 on failure
+ */
+int Sort_Source(SortSource next, void *context, BookField field, int descending,
+                size_t memory_budget, SortSink emit, void *sink);
+
+/**
+ * Write books from a source as CSV in sorted order
+ *
+ * For books that are not in a library's array, such as a snapshot or
+ * a catalog file (see Sort_Source). Same output as Sort_ExportCsv.
+ *
+ * @param next: Called until it returns 0 or -1
+ * @param memory_budget: Bytes of buffered books to sort in memory at once
+ * @return: Number of rows written, or -1 on failure
+ */
+int Sort_ExportSource(SortSource next, void *context, BookField field,
+                      int descending, FILE *out, size_t memory_budget);
+
+#endif /* SORT_H */
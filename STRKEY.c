@@ -0,0 +1,43 @@
+#include <string.h>
+
+#include "STRKEY.h"
+
+/*
+ * Multiply-xorshift over the string eight bytes at a time (the last
+ * word zero-padded), finished with the splitmix64 avalanche so the low
+ * bits, which pick hash slots, depend on every byte
+ */
+static uint32_t hashBytes(const char *text, size_t length) {
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ length;
+    uint64_t word;
+    size_t at = 0;
+
+    for (; at + sizeof(word) <= length; at += sizeof(word)) {
+        memcpy(&word, text + at, sizeof(word));
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+    }
+    if (at < length) {
+        word = 0;
+        memcpy(&word, text + at, length - at);
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+    }
+
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 32;
+    return (uint32_t)hash;
+}
+
+uint32_t StrKey_Hash(const char *text) {
+    return hashBytes(text, strlen(text));
+}
+
+void StrKey_Make(StrKey *key, const char *text) {
+    size_t length = strlen(text);
+
+    memset(key->prefix, 0, sizeof(key->prefix));
+    memcpy(key->prefix, text, length < STRKEY_PREFIX_LEN ? length : STRKEY_PREFIX_LEN);
+    key->length = (uint32_t)length;
+    key->hash = hashBytes(text, length);
+}
@@ -0,0 +1,110 @@
+#ifndef STRKEY_H
+#define STRKEY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @file STRKEY.h
+ * @brief Fixed-size string headers for fast equality and ordering
+ *
+ * A StrKey is a 16-byte header describing a NUL-terminated string: its
+ * length, a hash of the whole string and its first STRKEY_PREFIX_LEN
+ * bytes inline (NUL-padded), after the "German string" layout of the
+ * Umbra database. Most comparisons are settled by the header alone:
+ *
+ *   - equality compares the two headers in one 16-byte SIMD compare and
+ *     only reads the strings when the headers match and the strings are
+ *     longer than the prefix;
+ *   - ordering compares the prefixes as one big-endian 64-bit word and
+ *     only reads the strings past the prefix when those tie.
+ *
+ * Ordering and equality agree with strcmp on the strings the headers
+ * were made from. A header holds no pointer to its string: callers
+ * pass the string alongside, so headers can live in a column of their
+ * own while the strings stay in their records.
+ */
+
+#define STRKEY_PREFIX_LEN 8
+
+typedef struct {
+    uint32_t length;                  /* Bytes before the NUL */
+    uint32_t hash;                    /* StrKey_Hash of the whole string */
+    char prefix[STRKEY_PREFIX_LEN];   /* First bytes, NUL-padded */
+} StrKey;
+
+/**
+ * @brief Hash of a NUL-terminated string, as stored in its header
+ *
+ * Read eight bytes at a time; in-memory use only (the value depends on
+ * byte order).
+ */
+uint32_t StrKey_Hash(const char *text);
+
+/**
+ * @brief Fill in the header of a string
+ */
+void StrKey_Make(StrKey *key, const char *text);
+
+/**
+ * @brief Whether two headers are identical (length, hash and prefix)
+ *
+ * Equal strings always have identical headers; strings longer than
+ * STRKEY_PREFIX_LEN with identical headers are almost always equal.
+ */
+static inline int StrKey_SameHeader(const StrKey *a, const StrKey *b) {
+#if defined(__SSE2__)
+    __m128i x = _mm_loadu_si128((const __m128i*)a);
+    __m128i y = _mm_loadu_si128((const __m128i*)b);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+#else
+    return memcmp(a, b, sizeof(StrKey)) == 0;
+#endif
+}
+
+/**
+ * @brief Whether two strings are equal, given their headers
+ */
+static inline int StrKey_Equal(const StrKey *a, const char *aText,
+                               const StrKey *b, const char *bText) {
+    return StrKey_SameHeader(a, b) &&
+           (a->length <= STRKEY_PREFIX_LEN ||
+            memcmp(aText + STRKEY_PREFIX_LEN, bText + STRKEY_PREFIX_LEN,
+                   a->length - STRKEY_PREFIX_LEN) == 0);
+}
+
+/* Prefix as a word whose integer order is the byte order */
+static inline uint64_t StrKey_PrefixWord(const StrKey *key) {
+    uint64_t word;
+
+    memcpy(&word, key->prefix, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/**
+ * @brief Compare two strings in strcmp order, given their headers
+ * @return Negative, zero or positive as aText sorts before, with or after bText
+ */
+static inline int StrKey_Compare(const StrKey *a, const char *aText,
+                                 const StrKey *b, const char *bText) {
+    uint64_t x = StrKey_PrefixWord(a);
+    uint64_t y = StrKey_PrefixWord(b);
+
+    if (x != y) {
+        return x < y ? -1 : 1;
+    }
+    /* Same prefix: a string that ends inside it sorts first */
+    if (a->length <= STRKEY_PREFIX_LEN || b->length <= STRKEY_PREFIX_LEN) {
+        return (a->length > b->length) - (a->length < b->length);
+    }
+    return strcmp(aText + STRKEY_PREFIX_LEN, bText + STRKEY_PREFIX_LEN);
+}
+
+#endif /* STRKEY_H */
@@ -0,0 +1,235 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "TEXT.h"
+
+/* Search form of U+00C0..U+017F; NULL keeps the character */
+static const char *latinFold[] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c",    /* U+00C0 */
+    "e", "e", "e", "e", "i", "i", "i", "i",     /* U+00C8 */
+    "d", "n", "o", "o", "o", "o", "o", NULL,    /* U+00D0 */
+    "o", "u", "u", "u", "u", "y", "th", "ss",   /* U+00D8 */
+    "a", "a", "a", "a", "a", "a", "ae", "c",    /* U+00E0 */
+    "e", "e", "e", "e", "i", "i", "i", "i",     /* U+00E8 */
+    "d", "n", "o", "o", "o", "o", "o", NULL,    /* U+00F0 */
+    "o", "u", "u", "u", "u", "y", "th", "y",    /* U+00F8 */
+    "a", "a", "a", "a", "a", "a", "c", "c",     /* U+0100 */
+    "c", "c", "c", "c", "c", "c", "d", "d",     /* U+0108 */
+    "d", "d", "e", "e", "e", "e", "e", "e",     /* U+0110 */
+    "e", "e", "e", "e", "g", "g", "g", "g",     /* U+0118 */
+    "g", "g", "g", "g", "h", "h", "h", "h",     /* U+0120 */
+    "i", "i", "i", "i", "i", "i", "i", "i",     /* U+0128 */
+    "i", "i", "ij", "ij", "j", "j", "k", "k",    /* U+0130 */
+    "k", "l", "l", "l", "l", "l", "l", "l",     /* U+0138 */
+    "l", "l", "l", "n", "n", "n", "n", "n",     /* U+0140 */
+    "n", "n", "ng", "ng", "o", "o", "o", "o",   /* U+0148 */
+    "o", "o", "oe", "oe", "r", "r", "r", "r",   /* U+0150 */
+    "r", "r", "s", "s", "s", "s", "s", "s",     /* U+0158 */
+    "s", "s", "t", "t", "t", "t", "t", "t",     /* U+0160 */
+    "u", "u", "u", "u", "u", "u", "u", "u",     /* U+0168 */
+    "u", "u", "u", "u", "w", "w", "y", "y",     /* U+0170 */
+    "y", "z", "z", "z", "z", "z", "z", "s"      /* U+0178 */
+};
+
+/* Greek letters with tonos, U+0386..U+038F and U+03AC..U+03CE, unaccented */
+static uint32_t greekBase(uint32_t cp) {
+    switch (cp) {
+        case 0x0386: case 0x03AC: return 0x03B1;
+        case 0x0388: case 0x03AD: return 0x03B5;
+        case 0x0389: case 0x03AE: return 0x03B7;
+        case 0x038A: case 0x03AF: return 0x03B9;
+        case 0x038C: case 0x03CC: return 0x03BF;
+        case 0x038E: case 0x03CD: return 0x03C5;
+        case 0x038F: case 0x03CE: return 0x03C9;
+        default: return cp;
+    }
+}
+
+static int isSpaceCodePoint(uint32_t cp) {
+    return cp <= 0x20 || (cp >= 0x80 && cp <= 0xA0) || cp == 0x1680 ||
+           (cp >= 0x2000 && cp <= 0x200A) || cp == 0x2028 || cp == 0x2029 ||
+           cp == 0x202F || cp == 0x205F || cp == 0x3000;
+}
+
+/**
+ * Decode one UTF-8 character, validating it
+ * @param text: Start of the character; not at the terminating NUL
+ * @param cp: Receives the code point (the byte itself if invalid)
+ * @return: Bytes consumed
+ */
+static size_t decodeUtf8(const unsigned char *text, uint32_t *cp) {
+    unsigned char lead = text[0];
+    size_t length;
+    uint32_t value;
+    uint32_t minimum;
+
+    if (lead < 0x80) {
+        *cp = lead;
+        return 1;
+    }
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        value = lead & 0x1Fu;
+        minimum = 0x80;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        value = lead & 0x0Fu;
+        minimum = 0x800;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        value = lead & 0x07u;
+        minimum = 0x10000;
+    } else {
+        *cp = lead;                   /* Stray byte: read as Latin-1 */
+        return 1;
+    }
+
+    for (size_t i = 1; i < length; i++) {
+        if ((text[i] & 0xC0) != 0x80) {
+            *cp = lead;
+            return 1;
+        }
+        value = (value << 6) | (text[i] & 0x3Fu);
+    }
+    if (value < minimum || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+        *cp = lead;
+        return 1;
+    }
+
+    *cp = value;
+    return length;
+}
+
+static size_t encodeUtf8(uint32_t cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/**
+ * Fold one non-ASCII code point
+ * @param folded: Receives the folded UTF-8 bytes (at most 4)
+ * @return: Number of bytes, 0 for a character that is dropped
+ */
+static size_t foldCodePoint(uint32_t cp, char *folded) {
+    if (cp >= 0x0300 && cp <= 0x036F) {
+        return 0;                     /* Combining mark */
+    }
+    if (cp >= 0x00C0 && cp <= 0x017F && latinFold[cp - 0x00C0] != NULL) {
+        const char *ascii = latinFold[cp - 0x00C0];
+        size_t length = strlen(ascii);
+        memcpy(folded, ascii, length);
+        return length;
+    }
+
+    cp = greekBase(cp);
+    if ((cp >= 0x0391 && cp <= 0x03A9) || (cp >= 0x0410 && cp <= 0x042F)) {
+        cp += 0x20;                   /* Greek and basic Cyrillic capitals */
+    } else if (cp >= 0x0400 && cp <= 0x040F) {
+        cp += 0x50;                   /* Cyrillic capitals with marks */
+    } else if (cp == 0x03C2) {
+        cp = 0x03C3;                  /* Final sigma */
+    }
+
+    return encodeUtf8(cp, folded);
+}
+
+size_t Text_Fold(const char *text, char *out, size_t out_len) {
+    const unsigned char *in = (const unsigned char*)text;
+    const unsigned char *end = in + strlen(text);
+    size_t length = 0;
+    int pendingSpace = 0;
+
+    if (out_len == 0) {
+        return 0;
+    }
+
+    while (in < end) {
+#if defined(__SSE2__)
+        /*
+         * A chunk of printable ASCII whose spaces are single needs only
+         * lower-casing. A space that ends the chunk is left for the next
+         * round, which drops it at the end of the text.
+         */
+        if (end - in >= 16 && length + 17 < out_len) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)in);
+            int printable = _mm_movemask_epi8(
+                _mm_cmpgt_epi8(chunk, _mm_set1_epi8(' ' - 1)));
+            int spaces = _mm_movemask_epi8(
+                _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+            int leadingSpace = (pendingSpace || length == 0) && (spaces & 1);
+
+            if (printable == 0xFFFF && (spaces & (spaces >> 1)) == 0 &&
+                !leadingSpace) {
+                __m128i upper = _mm_and_si128(
+                    _mm_cmpgt_epi8(chunk, _mm_set1_epi8('A' - 1)),
+                    _mm_cmplt_epi8(chunk, _mm_set1_epi8('Z' + 1)));
+                size_t taken = (spaces & 0x8000) ? 15 : 16;
+
+                if (pendingSpace) {
+                    out[length++] = ' ';
+                }
+                chunk = _mm_add_epi8(chunk, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+                _mm_storeu_si128((__m128i*)(out + length), chunk);
+                length += taken;
+                in += taken;
+                pendingSpace = taken == 15;
+                continue;
+            }
+        }
+#endif
+
+        char folded[4];
+        size_t foldedLen;
+        uint32_t cp;
+
+        in += decodeUtf8(in, &cp);
+        if (isSpaceCodePoint(cp)) {
+            pendingSpace = length > 0;
+            continue;
+        }
+        if (cp < 0x80) {
+            folded[0] = (char)(cp >= 'A' && cp <= 'Z' ? cp + ('a' - 'A') : cp);
+            foldedLen = 1;
+        } else {
+            foldedLen = foldCodePoint(cp, folded);
+        }
+        if (foldedLen == 0) {
+            continue;
+        }
+
+        if (length + (size_t)pendingSpace + foldedLen >= out_len) {
+            break;
+        }
+        if (pendingSpace) {
+            out[length++] = ' ';
+            pendingSpace = 0;
+        }
+        memcpy(out + length, folded, foldedLen);
+        length += foldedLen;
+    }
+
+    out[length] = '\0';
+    return length;
+}
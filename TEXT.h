@@ -0,0 +1,42 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stddef.h>
+
+/**
+ * @file TEXT.h
+ * @brief Text normalization for indexed and searched fields
+ *
+ * Text_Fold turns free text into the form every search path compares:
+ * case folded, accents stripped and whitespace collapsed. The library
+ * folds titles and authors once when a record is stored (the
+ * titleFolded and authorFolded shadow columns of Book), and queries fold
+ * their search text once when built, so no comparison pays for it.
+ *
+ * Input is read as UTF-8. Each multi-byte sequence is validated as it
+ * is decoded (no overlong forms, surrogates or code points past
+ * U+10FFFF); a byte that does not start a valid sequence is read as a
+ * Latin-1 character instead, which is what legacy catalog data usually
+ * is. Runs of plain ASCII are checked and lower-cased 16 bytes at a
+ * time where SSE2 is available.
+ *
+ * Folding covers ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic:
+ * letters become lower case without diacritics ("Émile Zola" folds to
+ * "emile zola", "Straße" to "strasse"), combining marks are dropped, and
+ * Unicode spaces count as whitespace. Other characters are kept as
+ * they are.
+ */
+
+/**
+ * @brief Fold text to its search form
+ *
+ * Output stops at a character boundary if out is too small.
+ *
+ * @param text NUL-terminated input
+ * @param out Buffer receiving the folded text, NUL-terminated
+ * @param out_len Size of out
+ * @return Length of the folded text
+ */
+size_t Text_Fold(const char *text, char *out, size_t out_len);
+
+#endif /* TEXT_H */
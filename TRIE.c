@@ -0,0 +1,1085 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TEXT.h"
+#include "TRIE.h"
+
+#define TRIE_MAX_KEY 256              /* Longest key, in bytes */
+#define NO_SCORE INT_MIN              /* best of a subtree with no postings */
+
+/* ============= Normalization ============= */
+
+/**
+ * Turn folded text into a trie key: every ASCII character other than a
+ * letter or digit separates words, and words are joined by one space
+ * @param folded: Text already passed through Text_Fold
+ * @param out: Receives the key; may be the same buffer as folded
+ * @param out_len: Size of out
+ * @return: Length of the key
+ */
+static size_t keyFromFolded(const char *folded, char *out, size_t out_len) {
+    size_t length = 0;
+    int pendingSpace = 0;
+
+    if (out_len == 0) {
+        return 0;
+    }
+
+    for (; *folded != '\0'; folded++) {
+        unsigned char c = (unsigned char)*folded;
+
+        if (c < 0x80 && !(c >= 'a' && c <= 'z') && !(c >= '0' && c <= '9')) {
+            pendingSpace = length > 0;
+            continue;
+        }
+
+        if (length + pendingSpace + 1 >= out_len) {
+            break;
+        }
+        if (pendingSpace) {
+            out[length++] = ' ';
+            pendingSpace = 0;
+        }
+        out[length++] = (char)c;
+    }
+
+    out[length] = '\0';
+    return length;
+}
+
+size_t Trie_Normalize(const char *text, char *out, size_t out_len) {
+    if (out_len == 0) {
+        return 0;
+    }
+
+    Text_Fold(text, out, out_len);
+    return keyFromFolded(out, out, out_len);
+}
+
+/* ============= Node Management ============= */
+
+static TrieNode* newNode(const char *label, size_t length) {
+    TrieNode *node = (TrieNode*)calloc(1, sizeof(TrieNode));
+    if (node == NULL) {
+        fprintf(stderr, "Memory allocation failed for trie node\n");
+        return NULL;
+    }
+
+    if (length > 0) {
+        node->label = (char*)malloc(length);
+        if (node->label == NULL) {
+            fprintf(stderr, "Memory allocation failed for trie node\n");
+            free(node);
+            return NULL;
+        }
+        memcpy(node->label, label, length);
+    }
+    node->labelLen = (uint32_t)length;
+    node->best = NO_SCORE;
+
+    return node;
+}
+
+static void freeNode(TrieNode *node) {
+    free(node->label);
+    free(node->postings);
+    free(node->children);
+    free(node);
+}
+
+/**
+ * Free a subtree with an explicit stack rather than recursion
+ */
+static void freeSubtree(TrieNode *root) {
+    size_t capacity = 64;
+    size_t depth = 0;
+    TrieNode **stack = (TrieNode**)malloc(capacity * sizeof(TrieNode*));
+
+    if (stack == NULL) {
+        fprintf(stderr, "Memory allocation failed for trie teardown\n");
+        return;
+    }
+
+    stack[depth++] = root;
+    while (depth > 0) {
+        TrieNode *node = stack[--depth];
+
+        if (depth + (size_t)node->childCount > capacity) {
+            while (depth + (size_t)node->childCount > capacity) {
+                capacity *= 2;
+            }
+            TrieNode **grown = (TrieNode**)realloc(stack, capacity * sizeof(TrieNode*));
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed for trie teardown\n");
+                free(stack);
+                return;
+            }
+            stack = grown;
+        }
+        for (int c = 0; c < node->childCount; c++) {
+            stack[depth++] = node->children[c];
+        }
+        freeNode(node);
+    }
+
+    free(stack);
+}
+
+/**
+ * Find the child whose label starts with a byte
+ * @param slot: Receives the child's index, or where it would be inserted
+ * @return: The child, or NULL if there is none
+ */
+static TrieNode* findChild(const TrieNode *node, unsigned char byte, int *slot) {
+    int low = 0;
+    int high = node->childCount - 1;
+
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        unsigned char first = (unsigned char)node->children[mid]->label[0];
+
+        if (first == byte) {
+            *slot = mid;
+            return node->children[mid];
+        }
+        if (first < byte) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    *slot = low;
+    return NULL;
+}
+
+static int insertChild(TrieNode *node, int slot, TrieNode *child) {
+    if (node->childCount == node->childCapacity) {
+        int capacity = node->childCapacity ? node->childCapacity * 2 : 2;
+        TrieNode **grown = (TrieNode**)realloc(node->children,
+                                               (size_t)capacity * sizeof(TrieNode*));
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed for trie children\n");
+            return -1;
+        }
+        node->children = grown;
+        node->childCapacity = capacity;
+    }
+
+    memmove(&node->children[slot + 1], &node->children[slot],
+            (size_t)(node->childCount - slot) * sizeof(TrieNode*));
+    node->children[slot] = child;
+    node->childCount++;
+
+    return 0;
+}
+
+static void removeChild(TrieNode *node, int slot) {
+    node->childCount--;
+    memmove(&node->children[slot], &node->children[slot + 1],
+            (size_t)(node->childCount - slot) * sizeof(TrieNode*));
+}
+
+/**
+ * Whether one posting ranks ahead of another: higher score, then lower ID
+ */
+static int ranksBefore(int score, int id, int otherScore, int otherId) {
+    return score > otherScore || (score == otherScore && id < otherId);
+}
+
+/**
+ * Find where a posting belongs in a node's score order
+ * @return: Index of the first posting that does not rank ahead of it
+ */
+static int postingSlot(const TrieNode *node, int id, int score) {
+    int low = 0;
+    int high = node->postingCount;
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+
+        if (ranksBefore(node->postings[mid].score, node->postings[mid].id, score, id)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Add a posting in score order, or at the end while the trie is loading
+ */
+static int addPosting(TrieNode *node, int id, int score, int append) {
+    if (node->postingCount == node->postingCapacity) {
+        int capacity = node->postingCapacity ? node->postingCapacity * 2 : 1;
+        TriePosting *grown = (TriePosting*)realloc(node->postings,
+                                                   (size_t)capacity * sizeof(TriePosting));
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed for trie postings\n");
+            return -1;
+        }
+        node->postings = grown;
+        node->postingCapacity = capacity;
+    }
+
+    int p = append ? node->postingCount : postingSlot(node, id, score);
+    memmove(&node->postings[p + 1], &node->postings[p],
+            (size_t)(node->postingCount - p) * sizeof(TriePosting));
+    node->postings[p].id = id;
+    node->postings[p].score = score;
+    node->postingCount++;
+
+    return 0;
+}
+
+/**
+ * Find a posting by the ID and score it was stored with
+ * @return: Its index, or -1 if it is not there
+ */
+static int findPosting(const TrieNode *node, int id, int score) {
+    int p = postingSlot(node, id, score);
+
+    if (p < node->postingCount && node->postings[p].id == id &&
+        node->postings[p].score == score) {
+        return p;
+    }
+    return -1;
+}
+
+/**
+ * Recompute a node's best score from its first posting and its children
+ */
+static void updateBest(TrieNode *node) {
+    int best = node->postingCount > 0 ? node->postings[0].score : NO_SCORE;
+
+    for (int c = 0; c < node->childCount; c++) {
+        if (node->children[c]->best > best) {
+            best = node->children[c]->best;
+        }
+    }
+
+    node->best = best;
+}
+
+static int comparePostings(const void *a, const void *b) {
+    const TriePosting *left = (const TriePosting*)a;
+    const TriePosting *right = (const TriePosting*)b;
+
+    if (ranksBefore(left->score, left->id, right->score, right->id)) {
+        return -1;
+    }
+    return ranksBefore(right->score, right->id, left->score, left->id);
+}
+
+/**
+ * Put every posting list of a subtree in score order
+ */
+static void sortSubtree(TrieNode *node) {
+    /* A node without postings has no array to hand qsort */
+    if (node->postingCount > 0) {
+        qsort(node->postings, (size_t)node->postingCount, sizeof(TriePosting),
+              comparePostings);
+    }
+    for (int c = 0; c < node->childCount; c++) {
+        sortSubtree(node->children[c]);
+    }
+}
+
+/**
+ * Split a child's edge so its first `length` label bytes get a node
+ * @return: The new node between node and child, or NULL on failure
+ */
+static TrieNode* splitChild(Trie *trie, TrieNode *node, int slot, uint32_t length) {
+    TrieNode *child = node->children[slot];
+    TrieNode *middle = newNode(child->label, length);
+
+    if (middle == NULL) {
+        return NULL;
+    }
+    if (insertChild(middle, 0, child) != 0) {
+        freeNode(middle);
+        return NULL;
+    }
+
+    memmove(child->label, child->label + length, child->labelLen - length);
+    child->labelLen -= length;
+    middle->best = child->best;
+    node->children[slot] = middle;
+    trie->nodes++;
+
+    return middle;
+}
+
+/**
+ * Fold a node's only child into it, concatenating their labels
+ */
+static void mergeWithChild(Trie *trie, TrieNode *node) {
+    TrieNode *child = node->children[0];
+    char *label = (char*)realloc(node->label, node->labelLen + child->labelLen);
+
+    if (label == NULL) {
+        return;                       /* Unmerged is still a valid trie */
+    }
+    memcpy(label + node->labelLen, child->label, child->labelLen);
+    node->label = label;
+    node->labelLen += child->labelLen;
+
+    free(node->postings);
+    free(node->children);
+    node->postings = child->postings;
+    node->postingCount = child->postingCount;
+    node->postingCapacity = child->postingCapacity;
+    node->children = child->children;
+    node->childCount = child->childCount;
+    node->childCapacity = child->childCapacity;
+    node->best = child->best;
+
+    free(child->label);
+    free(child);
+    trie->nodes--;
+}
+
+/**
+ * Find the node a whole key ends at, recording the path to it
+ * @param path: Receives root..node; at least TRIE_MAX_KEY + 1 entries
+ * @param slots: Receives each path node's index in its parent
+ * @return: Depth of the node in path, or -1 if the key is not stored
+ */
+static int findKey(const Trie *trie, const char *key, TrieNode **path, int *slots) {
+    TrieNode *node = trie->root;
+    int depth = 0;
+
+    path[0] = node;
+    while (*key != '\0') {
+        int slot;
+        TrieNode *child = findChild(node, (unsigned char)*key, &slot);
+
+        if (child == NULL || strncmp(child->label, key, child->labelLen) != 0) {
+            return -1;
+        }
+        key += child->labelLen;
+        node = child;
+        path[++depth] = node;
+        slots[depth] = slot;
+    }
+
+    return depth;
+}
+
+/* ============= Trie Operations ============= */
+
+int Trie_Init(Trie *trie) {
+    trie->root = newNode(NULL, 0);
+    trie->keys = 0;
+    trie->nodes = trie->root != NULL ? 1 : 0;
+    trie->loading = 0;
+
+    return trie->root != NULL ? 0 : -1;
+}
+
+void Trie_Free(Trie *trie) {
+    if (trie->root != NULL) {
+        freeSubtree(trie->root);
+    }
+    trie->root = NULL;
+    trie->keys = 0;
+    trie->nodes = 0;
+}
+
+void Trie_BeginLoad(Trie *trie) {
+    trie->loading = 1;
+}
+
+void Trie_EndLoad(Trie *trie) {
+    if (trie->loading && trie->root != NULL) {
+        sortSubtree(trie->root);
+    }
+    trie->loading = 0;
+}
+
+int Trie_Insert(Trie *trie, const char *key, int id, int score) {
+    TrieNode *node = trie->root;
+    size_t remaining = strlen(key);
+
+    if (remaining > TRIE_MAX_KEY) {
+        fprintf(stderr, "Trie key too long (%zu bytes)\n", remaining);
+        return -1;
+    }
+
+    /*
+     * Completion only needs best to bound its subtree from above, so
+     * raising it on the way down is harmless if an allocation fails
+     */
+    while (remaining > 0) {
+        int slot;
+        TrieNode *child = findChild(node, (unsigned char)*key, &slot);
+
+        if (score > node->best) {
+            node->best = score;
+        }
+        if (child == NULL) {
+            TrieNode *leaf = newNode(key, remaining);
+            if (leaf == NULL) {
+                return -1;
+            }
+            if (addPosting(leaf, id, score, trie->loading) != 0 ||
+                insertChild(node, slot, leaf) != 0) {
+                freeNode(leaf);
+                return -1;
+            }
+            leaf->best = score;
+            trie->nodes++;
+            node = leaf;
+            break;
+        }
+
+        uint32_t common = 0;
+        while (common < child->labelLen && common < remaining &&
+               child->label[common] == key[common]) {
+            common++;
+        }
+        if (common < child->labelLen) {
+            child = splitChild(trie, node, slot, common);
+            if (child == NULL) {
+                return -1;
+            }
+        }
+
+        node = child;
+        key += common;
+        remaining -= common;
+    }
+
+    if (remaining == 0 && addPosting(node, id, score, trie->loading) != 0) {
+        return -1;
+    }
+
+    if (score > node->best) {
+        node->best = score;
+    }
+    trie->keys++;
+
+    return 0;
+}
+
+int Trie_Remove(Trie *trie, const char *key, int id, int score) {
+    TrieNode *path[TRIE_MAX_KEY + 1];
+    int slots[TRIE_MAX_KEY + 1];
+    int depth = strlen(key) <= TRIE_MAX_KEY ? findKey(trie, key, path, slots) : -1;
+
+    if (depth < 0) {
+        return 0;
+    }
+
+    TrieNode *node = path[depth];
+    int p = findPosting(node, id, score);
+    if (p < 0) {
+        return 0;
+    }
+    node->postingCount--;
+    memmove(&node->postings[p], &node->postings[p + 1],
+            (size_t)(node->postingCount - p) * sizeof(TriePosting));
+    trie->keys--;
+
+    /* Keep the trie compressed: no empty leaves, no pass-through nodes */
+    if (depth > 0 && node->postingCount == 0) {
+        if (node->childCount == 0) {
+            removeChild(path[depth - 1], slots[depth]);
+            freeNode(node);
+            trie->nodes--;
+            depth--;
+
+            TrieNode *parent = path[depth];
+            if (depth > 0 && parent->postingCount == 0 && parent->childCount == 1) {
+                mergeWithChild(trie, parent);
+            }
+        } else if (node->childCount == 1) {
+            mergeWithChild(trie, node);
+        }
+    }
+
+    for (; depth >= 0; depth--) {
+        updateBest(path[depth]);
+    }
+
+    return 1;
+}
+
+int Trie_SetScore(Trie *trie, const char *key, int id, int old_score, int score) {
+    TrieNode *path[TRIE_MAX_KEY + 1];
+    int slots[TRIE_MAX_KEY + 1];
+    int depth = strlen(key) <= TRIE_MAX_KEY ? findKey(trie, key, path, slots) : -1;
+
+    if (depth < 0) {
+        return 0;
+    }
+
+    TrieNode *node = path[depth];
+    int p = findPosting(node, id, old_score);
+    if (p < 0) {
+        return 0;
+    }
+
+    /* Shift only the postings between the old and the new place */
+    int slot = postingSlot(node, id, score);
+    if (slot > p) {
+        slot--;
+        memmove(&node->postings[p], &node->postings[p + 1],
+                (size_t)(slot - p) * sizeof(TriePosting));
+    } else {
+        memmove(&node->postings[slot + 1], &node->postings[slot],
+                (size_t)(p - slot) * sizeof(TriePosting));
+    }
+    node->postings[slot].id = id;
+    node->postings[slot].score = score;
+
+    for (; depth >= 0; depth--) {
+        updateBest(path[depth]);
+    }
+
+    return 1;
+}
+
+/* ============= Prefix Completion ============= */
+
+/* Best-first frontier entry: a subtree (posting < 0) or a posting cursor */
+typedef struct {
+    int score;
+    int posting;                      /* Next posting of node to return */
+    const TrieNode *node;
+} Candidate;
+
+typedef struct {
+    Candidate *items;
+    int count;
+    int capacity;
+} CandidateHeap;
+
+static int heapPush(CandidateHeap *heap, int score, int posting, const TrieNode *node) {
+    if (heap->count == heap->capacity) {
+        int capacity = heap->capacity ? heap->capacity * 2 : 64;
+        Candidate *grown = (Candidate*)realloc(heap->items,
+                                               (size_t)capacity * sizeof(Candidate));
+        if (grown == NULL) {
+            fprintf(stderr, "Memory allocation failed for trie search\n");
+            return -1;
+        }
+        heap->items = grown;
+        heap->capacity = capacity;
+    }
+
+    int i = heap->count++;
+    while (i > 0 && heap->items[(i - 1) / 2].score < score) {
+        heap->items[i] = heap->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->items[i].score = score;
+    heap->items[i].posting = posting;
+    heap->items[i].node = node;
+
+    return 0;
+}
+
+static Candidate heapPop(CandidateHeap *heap) {
+    Candidate top = heap->items[0];
+    Candidate last = heap->items[--heap->count];
+    int i = 0;
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count &&
+            heap->items[child + 1].score > heap->items[child].score) {
+            child++;
+        }
+        if (heap->items[child].score <= last.score) {
+            break;
+        }
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->count > 0) {
+        heap->items[i] = last;
+    }
+
+    return top;
+}
+
+/**
+ * Find the subtree holding every key that starts with a prefix
+ * @return: Its root, or NULL if no key has the prefix
+ */
+static const TrieNode* findPrefix(const Trie *trie, const char *prefix) {
+    const TrieNode *node = trie->root;
+
+    while (*prefix != '\0') {
+        int slot;
+        const TrieNode *child = findChild(node, (unsigned char)*prefix, &slot);
+        uint32_t matched = 0;
+
+        if (child == NULL) {
+            return NULL;
+        }
+        while (matched < child->labelLen && prefix[matched] != '\0' &&
+               child->label[matched] == prefix[matched]) {
+            matched++;
+        }
+        if (prefix[matched] == '\0') {
+            return child;             /* Prefix ends on or inside this edge */
+        }
+        if (matched < child->labelLen) {
+            return NULL;
+        }
+        prefix += matched;
+        node = child;
+    }
+
+    return node;
+}
+
+int Trie_Complete(const Trie *trie, const char *prefix, TrieMatch *matches,
+                  int max_matches) {
+    const TrieNode *start = findPrefix(trie, prefix);
+    CandidateHeap heap = {NULL, 0, 0};
+    int found = 0;
+
+    if (start == NULL || max_matches <= 0 || start->best == NO_SCORE) {
+        return 0;
+    }
+    if (heapPush(&heap, start->best, -1, start) != 0) {
+        return -1;
+    }
+
+    /*
+     * A posting leaves the heap only once no subtree can beat it. Each
+     * node's postings are in score order, so a node enters the heap as
+     * one cursor that moves to its next posting when popped, and a long
+     * posting list costs only the postings actually returned.
+     */
+    while (heap.count > 0 && found < max_matches) {
+        Candidate top = heapPop(&heap);
+        const TrieNode *node = top.node;
+
+        if (top.posting >= 0) {
+            const TriePosting *posting = &node->postings[top.posting];
+            int next = top.posting + 1;
+            int seen = 0;
+
+            if (next < node->postingCount &&
+                heapPush(&heap, node->postings[next].score, next, node) != 0) {
+                free(heap.items);
+                return -1;
+            }
+            for (int m = 0; m < found && !seen; m++) {
+                seen = matches[m].id == posting->id;
+            }
+            if (seen) {
+                continue;             /* Also posted under a better key */
+            }
+            matches[found].id = posting->id;
+            matches[found].score = posting->score;
+            matches[found].distance = 0;
+            found++;
+            continue;
+        }
+
+        if (node->postingCount > 0 &&
+            heapPush(&heap, node->postings[0].score, 0, node) != 0) {
+            free(heap.items);
+            return -1;
+        }
+        for (int c = 0; c < node->childCount; c++) {
+            const TrieNode *child = node->children[c];
+            if (child->best != NO_SCORE &&
+                heapPush(&heap, child->best, -1, child) != 0) {
+                free(heap.items);
+                return -1;
+            }
+        }
+    }
+
+    free(heap.items);
+    return found;
+}
+
+/* ============= Fuzzy Lookup ============= */
+
+typedef struct {
+    const char *word;
+    int length;                       /* Bytes in word */
+    int maxEdits;
+    int *rows;                        /* (TRIE_MAX_KEY + 1) rows of length + 1 */
+    TrieMatch *kept;                  /* limit slots per distance, best first */
+    int counts[TRIE_MAX_EDITS + 1];   /* Matches kept at each distance */
+    int limit;                        /* Matches kept per distance */
+} FuzzySearch;
+
+/**
+ * Offer a node's postings to the best matches kept at one distance.
+ * Postings come in score order, so the first one that misses the cut
+ * ends the scan; an ID already kept at this distance is skipped, so
+ * each distance holds `limit` distinct IDs.
+ */
+static void collectPostings(FuzzySearch *search, const TrieNode *node, int distance) {
+    TrieMatch *kept = &search->kept[distance * search->limit];
+    int *count = &search->counts[distance];
+
+    for (int p = 0; p < node->postingCount; p++) {
+        const TriePosting *posting = &node->postings[p];
+        int seen = 0;
+
+        if (*count == search->limit &&
+            !ranksBefore(posting->score, posting->id,
+                         kept[*count - 1].score, kept[*count - 1].id)) {
+            break;
+        }
+        for (int k = 0; k < *count && !seen; k++) {
+            seen = kept[k].id == posting->id;
+        }
+        if (seen) {
+            continue;                 /* Also posted under another key */
+        }
+
+        int slot = *count < search->limit ? (*count)++ : search->limit - 1;
+        while (slot > 0 && ranksBefore(posting->score, posting->id,
+                                       kept[slot - 1].score, kept[slot - 1].id)) {
+            kept[slot] = kept[slot - 1];
+            slot--;
+        }
+        kept[slot].id = posting->id;
+        kept[slot].score = posting->score;
+        kept[slot].distance = distance;
+    }
+}
+
+/**
+ * Extend the Levenshtein rows along each child edge and descend
+ * @param row: Row for the key spelled by the path to node
+ * @param depth: Row index of row (bytes from the root)
+ */
+static void fuzzyWalk(FuzzySearch *search, const TrieNode *node, int depth) {
+    int width = search->length + 1;
+
+    for (int c = 0; c < node->childCount; c++) {
+        const TrieNode *child = node->children[c];
+        int rowDepth = depth;
+        int pruned = 0;
+
+        for (uint32_t b = 0; b < child->labelLen; b++) {
+            const int *previous = &search->rows[rowDepth * width];
+            int *next = &search->rows[(rowDepth + 1) * width];
+            unsigned char byte = (unsigned char)child->label[b];
+            int rowMin;
+
+            next[0] = previous[0] + 1;
+            rowMin = next[0];
+            for (int j = 1; j < width; j++) {
+                int cost = previous[j - 1] +
+                           ((unsigned char)search->word[j - 1] != byte);
+                int cell = previous[j] + 1;
+
+                if (next[j - 1] + 1 < cell) {
+                    cell = next[j - 1] + 1;
+                }
+                if (cost < cell) {
+                    cell = cost;
+                }
+                next[j] = cell;
+                if (cell < rowMin) {
+                    rowMin = cell;
+                }
+            }
+            rowDepth++;
+
+            /* Every continuation of this key is already over budget */
+            if (rowMin > search->maxEdits) {
+                pruned = 1;
+                break;
+            }
+        }
+        if (pruned) {
+            continue;
+        }
+
+        int distance = search->rows[rowDepth * width + search->length];
+        if (distance <= search->maxEdits) {
+            collectPostings(search, child, distance);
+        }
+        fuzzyWalk(search, child, rowDepth);
+    }
+}
+
+static int compareMatches(const void *a, const void *b) {
+    const TrieMatch *left = (const TrieMatch*)a;
+    const TrieMatch *right = (const TrieMatch*)b;
+
+    if (left->distance != right->distance) {
+        return left->distance < right->distance ? -1 : 1;
+    }
+    if (left->score != right->score) {
+        return left->score > right->score ? -1 : 1;
+    }
+    return (left->id > right->id) - (left->id < right->id);
+}
+
+int Trie_Fuzzy(const Trie *trie, const char *word, int max_edits,
+               TrieMatch *matches, int max_matches) {
+    FuzzySearch search = {0};
+    size_t length = strlen(word);
+
+    if (length > TRIE_MAX_KEY || max_edits < 0 || max_edits > TRIE_MAX_EDITS) {
+        return -1;
+    }
+
+    if (max_matches <= 0) {
+        return 0;
+    }
+
+    search.word = word;
+    search.length = (int)length;
+    search.maxEdits = max_edits;
+    search.limit = max_matches;
+    search.rows = (int*)malloc((size_t)(TRIE_MAX_KEY + 1) * (length + 1) * sizeof(int));
+    search.kept = (TrieMatch*)malloc((size_t)(max_edits + 1) * (size_t)max_matches *
+                                     sizeof(TrieMatch));
+    if (search.rows == NULL || search.kept == NULL) {
+        fprintf(stderr, "Memory allocation failed for trie search\n");
+        free(search.rows);
+        free(search.kept);
+        return -1;
+    }
+    for (int j = 0; j <= search.length; j++) {
+        search.rows[j] = j;
+    }
+
+    if (search.length <= max_edits) {
+        collectPostings(&search, trie->root, search.length);
+    }
+    fuzzyWalk(&search, trie->root, 0);
+
+    /* Each distance holds enough distinct IDs to fill the result alone */
+    int stored = 0;
+    for (int d = 0; d <= max_edits; d++) {
+        memmove(&search.kept[stored], &search.kept[d * search.limit],
+                (size_t)search.counts[d] * sizeof(TrieMatch));
+        stored += search.counts[d];
+    }
+    stored = Trie_MergeMatches(search.kept, stored, max_matches);
+    if (stored > 0) {
+        memcpy(matches, search.kept, (size_t)stored * sizeof(TrieMatch));
+    }
+
+    free(search.rows);
+    free(search.kept);
+    return stored;
+}
+
+int Trie_MergeMatches(TrieMatch *matches, int count, int max_matches) {
+    int kept = 0;
+
+    qsort(matches, (size_t)count, sizeof(TrieMatch), compareMatches);
+    for (int i = 0; i < count && kept < max_matches; i++) {
+        int seen = 0;
+        for (int k = 0; k < kept && !seen; k++) {
+            seen = matches[k].id == matches[i].id;
+        }
+        if (!seen) {
+            matches[kept++] = matches[i];
+        }
+    }
+
+    return kept;
+}
+
+/* ============= Library Text Index ============= */
+
+/*
+ * Words too common to narrow a search. They get no posting of their
+ * own, which keeps the largest posting lists out of the trie; a title
+ * starting with one is still found through its whole key.
+ */
+static const char *const stopWords[] = {
+    "a", "an", "and", "at", "by", "de", "for", "from", "in", "la", "le",
+    "of", "on", "or", "the", "to", "with"
+};
+
+#define STOP_WORDS ((int)(sizeof(stopWords) / sizeof(stopWords[0])))
+
+static int isStopWord(const char *word, size_t length) {
+    for (int s = 0; s < STOP_WORDS; s++) {
+        if (strncmp(stopWords[s], word, length) == 0 && stopWords[s][length] == '\0') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef enum {
+    KEYS_INSERT,
+    KEYS_REMOVE,
+    KEYS_SET_SCORE
+} KeysOp;
+
+/**
+ * Apply an operation to one key of a book
+ * @param score: Score the book is posted with (inserts post with it)
+ * @param new_score: Score to move to, for KEYS_SET_SCORE
+ * @return: 0 on success, -1 if an insert failed
+ */
+static int applyKey(Trie *trie, const char *key, int id, int score,
+                    int new_score, KeysOp op) {
+    switch (op) {
+        case KEYS_INSERT:
+            return Trie_Insert(trie, key, id, score);
+        case KEYS_REMOVE:
+            Trie_Remove(trie, key, id, score);
+            return 0;
+        default:
+            Trie_SetScore(trie, key, id, score, new_score);
+            return 0;
+    }
+}
+
+/**
+ * Apply an operation to every key one book's text is posted under: the
+ * whole key, then each distinct word of it that is not a stop-word
+ * @return: 0 on success, -1 if an insert failed (earlier keys stay)
+ */
+static int applyKeys(Trie *trie, const char *key, int id, int score,
+                     int new_score, KeysOp op) {
+    char word[TRIE_MAX_KEY + 1];
+
+    if (applyKey(trie, key, id, score, new_score, op) != 0) {
+        return -1;
+    }
+    if (strchr(key, ' ') == NULL) {
+        return 0;                     /* A single word is the whole key */
+    }
+
+    for (const char *start = key; *start != '\0';) {
+        size_t length = strcspn(start, " ");
+        int repeated = 0;
+
+        for (const char *w = key; w < start && !repeated; w += strcspn(w, " ") + 1) {
+            repeated = strcspn(w, " ") == length && memcmp(w, start, length) == 0;
+        }
+        if (!repeated && !isStopWord(start, length)) {
+            memcpy(word, start, length);
+            word[length] = '\0';
+            if (applyKey(trie, word, id, score, new_score, op) != 0) {
+                return -1;
+            }
+        }
+
+        start += length;
+        if (*start == ' ') {
+            start++;
+        }
+    }
+    return 0;
+}
+
+int Trie_InsertText(Trie *trie, const char *key, int id, int score) {
+    return applyKeys(trie, key, id, score, score, KEYS_INSERT);
+}
+
+/**
+ * Move one book's keys in a trie from its old to its new folded text
+ * and score
+ */
+static void reindexText(Trie *trie, const char *before, const char *after,
+                        int id, int old_score, int score) {
+    char oldKey[TRIE_MAX_KEY + 1];
+    char newKey[TRIE_MAX_KEY + 1];
+
+    if (before != NULL) {
+        keyFromFolded(before, oldKey, sizeof(oldKey));
+    }
+    if (after != NULL) {
+        keyFromFolded(after, newKey, sizeof(newKey));
+    }
+
+    if (before != NULL && after != NULL && strcmp(oldKey, newKey) == 0) {
+        if (old_score != score) {
+            applyKeys(trie, newKey, id, old_score, score, KEYS_SET_SCORE);
+        }
+        return;
+    }
+    if (before != NULL) {
+        applyKeys(trie, oldKey, id, old_score, old_score, KEYS_REMOVE);
+    }
+    if (after != NULL && applyKeys(trie, newKey, id, score, score, KEYS_INSERT) != 0) {
+        applyKeys(trie, newKey, id, score, score, KEYS_REMOVE);
+        fprintf(stderr, "Text index lost book %d after allocation failure\n", id);
+    }
+}
+
+/**
+ * Library observer: keep both tries in step with a mutation
+ */
+static void followMutation(void *context, const Book *before, const Book *after) {
+    TextIndex *index = (TextIndex*)context;
+    const Book *book = after != NULL ? after : before;
+    int oldScore = before != NULL ? before->quantity : 0;
+    int score = after != NULL ? after->quantity : 0;
+
+    reindexText(&index->titles, before ? before->titleFolded : NULL,
+                after ? after->titleFolded : NULL, book->id, oldScore, score);
+    reindexText(&index->authors, before ? before->authorFolded : NULL,
+                after ? after->authorFolded : NULL, book->id, oldScore, score);
+}
+
+int TextIndex_Init(TextIndex *index, Library *library) {
+    char key[TRIE_MAX_KEY + 1];
+
+    index->library = library;
+    if (Trie_Init(&index->titles) != 0) {
+        return -1;
+    }
+    if (Trie_Init(&index->authors) != 0) {
+        Trie_Free(&index->titles);
+        return -1;
+    }
+
+    /* Append every posting, then sort each list once */
+    Trie_BeginLoad(&index->titles);
+    Trie_BeginLoad(&index->authors);
+    for (int i = 0; i < library->count; i++) {
+        const Book *book = &library->books[i];
+
+        keyFromFolded(book->titleFolded, key, sizeof(key));
+        if (Trie_InsertText(&index->titles, key, book->id, book->quantity) != 0) {
+            goto fail;
+        }
+        keyFromFolded(book->authorFolded, key, sizeof(key));
+        if (Trie_InsertText(&index->authors, key, book->id, book->quantity) != 0) {
+            goto fail;
+        }
+    }
+    Trie_EndLoad(&index->titles);
+    Trie_EndLoad(&index->authors);
+
+    if (libraryAddObserver(library, followMutation, index) != 0) {
+        fprintf(stderr, "Too many library observers for text index\n");
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    Trie_Free(&index->authors);
+    Trie_Free(&index->titles);
+    return -1;
+}
+
+void TextIndex_Free(TextIndex *index) {
+    libraryRemoveObserver(index->library, followMutation, index);
+    Trie_Free(&index->authors);
+    Trie_Free(&index->titles);
+}
@@ -0,0 +1,202 @@
+#ifndef TRIE_H
+#define TRIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LIBRARY.h"
+
+/**
+ * @file TRIE.h
+ * @brief Radix trie for type-ahead and typo-tolerant text search
+ *
+ * A Trie maps normalized strings to the book IDs carrying them. Chains
+ * of single-child nodes are collapsed into one edge with a multi-byte
+ * label, so a node exists only where keys branch or end. Every posting
+ * carries a score, each node keeps its postings highest score first,
+ * and every node caches the highest score below it. Prefix completion
+ * visits subtrees best-first and reads each posting list through a
+ * cursor, so it stops after the top N postings however long the lists
+ * under the prefix are.
+ *
+ * Fuzzy lookup walks the trie with one row of the Levenshtein matrix
+ * per depth, the table-driven form of a Levenshtein automaton: keys
+ * sharing a prefix share its rows, and a subtree is skipped as soon as
+ * every cell of its row exceeds the edit budget. Only the top N matches
+ * of each distance are kept, and a matching key's postings are read
+ * only until one misses that cut.
+ *
+ * A TextIndex keeps one trie over titles and one over authors, scored
+ * by quantity in stock, and follows its library's mutations. A book is
+ * posted under its whole title (or author) and under each word of it
+ * other than stop-words such as "the" and "of", so "gatsbi" finds "The
+ * Great Gatsby"; lookups return each ID once.
+ */
+
+#define TRIE_MAX_EDITS 3              /* Largest edit budget for fuzzy lookup */
+
+/* One book ID stored under a key */
+typedef struct {
+    int id;
+    int score;                        /* Ranking for completion */
+} TriePosting;
+
+typedef struct TrieNode {
+    char *label;                      /* Edge label from the parent */
+    uint32_t labelLen;
+    int best;                         /* Highest score in this subtree */
+    TriePosting *postings;            /* IDs whose key ends here, best first */
+    int postingCount;
+    int postingCapacity;
+    struct TrieNode **children;       /* Sorted by first label byte */
+    int childCount;
+    int childCapacity;
+} TrieNode;
+
+typedef struct {
+    TrieNode *root;                   /* Root with an empty label */
+    size_t keys;                      /* Postings stored */
+    size_t nodes;                     /* Nodes allocated, root included */
+    int loading;                      /* Appending unsorted; see Trie_BeginLoad */
+} Trie;
+
+/* One lookup result */
+typedef struct {
+    int id;
+    int score;
+    int distance;                     /* Edits from the query (fuzzy only) */
+} TrieMatch;
+
+/* Title and author tries kept in step with a library */
+typedef struct {
+    Library *library;
+    Trie titles;
+    Trie authors;
+} TextIndex;
+
+/**
+ * @brief Normalize text for indexing and lookup
+ *
+ * Folds the text with Text_Fold, then turns every ASCII character other
+ * than a letter or digit into a separator and collapses separator runs
+ * into one space, trimming both ends. Keys of stored books come from
+ * their folded columns, so only lookups pay for the fold.
+ *
+ * @param text Text to normalize
+ * @param out Buffer receiving the normalized key
+ * @param out_len Size of out
+ * @return Length of the normalized key
+ */
+size_t Trie_Normalize(const char *text, char *out, size_t out_len);
+
+/**
+ * @brief Initialize an empty trie
+ * @return 0 on success, -1 on allocation failure
+ */
+int Trie_Init(Trie *trie);
+
+/**
+ * @brief Free every node of a trie
+ */
+void Trie_Free(Trie *trie);
+
+/**
+ * @brief Start a bulk load
+ *
+ * Until Trie_EndLoad, inserts append to posting lists instead of
+ * keeping them in score order. Only inserts may run during a load.
+ */
+void Trie_BeginLoad(Trie *trie);
+
+/**
+ * @brief Finish a bulk load by sorting every posting list once
+ */
+void Trie_EndLoad(Trie *trie);
+
+/**
+ * @brief Add a posting under a normalized key
+ *
+ * Outside a load this shifts the postings that rank below the new one.
+ *
+ * @return 0 on success, -1 on allocation failure (trie unchanged)
+ */
+int Trie_Insert(Trie *trie, const char *key, int id, int score);
+
+/**
+ * @brief Post an ID under a normalized text the way a TextIndex does
+ *
+ * Inserts under the whole key and under each distinct word of it that
+ * is not a stop-word.
+ *
+ * @return 0 on success, -1 on allocation failure (earlier keys stay)
+ */
+int Trie_InsertText(Trie *trie, const char *key, int id, int score);
+
+/**
+ * @brief Remove a posting from a normalized key
+ * @param score Score the posting is stored with
+ * @return 1 if removed, 0 if it was not there
+ */
+int Trie_Remove(Trie *trie, const char *key, int id, int score);
+
+/**
+ * @brief Change the score of a posting
+ * @param old_score Score the posting is stored with
+ * @param score New score
+ * @return 1 if updated, 0 if the posting was not there
+ */
+int Trie_SetScore(Trie *trie, const char *key, int id, int old_score, int score);
+
+/**
+ * @brief Top postings by score among keys starting with a prefix
+ *
+ * An ID posted under several matching keys is returned once.
+ *
+ * @param prefix Normalized prefix
+ * @param matches Output array, highest score first
+ * @param max_matches Capacity of matches
+ * @return Number of matches stored, or -1 on allocation failure
+ */
+int Trie_Complete(const Trie *trie, const char *prefix, TrieMatch *matches,
+                  int max_matches);
+
+/**
+ * @brief Postings whose key is within an edit distance of a word
+ *
+ * Distance counts single-byte insertions, deletions and substitutions.
+ * Results are ordered by distance, then by score; an ID posted under
+ * several matching keys is returned once, at its closest.
+ *
+ * @param word Normalized word
+ * @param max_edits Edit budget, at most TRIE_MAX_EDITS
+ * @param matches Output array
+ * @param max_matches Capacity of matches
+ * @return Number of matches stored, or -1 on failure
+ */
+int Trie_Fuzzy(const Trie *trie, const char *word, int max_edits,
+               TrieMatch *matches, int max_matches);
+
+/**
+ * @brief Merge the results of several lookups
+ *
+ * Sorts matches by distance, then score, and keeps the first of each ID.
+ *
+ * @param matches Results of one or more lookups, concatenated
+ * @param count Number of matches
+ * @param max_matches Most matches to keep
+ * @return Number of matches kept at the start of the array
+ */
+int Trie_MergeMatches(TrieMatch *matches, int count, int max_matches);
+
+/**
+ * @brief Index a library's titles and authors and follow its mutations
+ * @return 0 on success, -1 on failure
+ */
+int TextIndex_Init(TextIndex *index, Library *library);
+
+/**
+ * @brief Stop following the library and free both tries
+ */
+void TextIndex_Free(TextIndex *index);
+
+#endif /* TRIE_H */
@@ -0,0 +1,290 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "WAL.h"
+
+/* ============= Checksum ============= */
+
+/* Slice-by-8 tables for the reflected CRC-32 polynomial */
+static uint32_t crcTable[8][256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+
+static void buildCrcTable(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+        crcTable[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            crcTable[t][i] = (crcTable[t - 1][i] >> 8) ^
+                             crcTable[0][crcTable[t - 1][i] & 0xFF];
+        }
+    }
+}
+
+/**
+ * CRC-32 of a record, taking its crc field as zero
+ */
+static uint32_t recordCrc(const WalRecord *record) {
+    WalRecord copy = *record;
+    const unsigned char *bytes = (const unsigned char*)&copy;
+    size_t length = sizeof(copy);
+    uint32_t crc = 0xFFFFFFFFu;
+
+    copy.crc = 0;
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint32_t low, high;
+        memcpy(&low, bytes, sizeof(low));
+        memcpy(&high, bytes + 4, sizeof(high));
+        low ^= crc;
+        crc = crcTable[7][low & 0xFF] ^ crcTable[6][(low >> 8) & 0xFF] ^
+              crcTable[5][(low >> 16) & 0xFF] ^ crcTable[4][low >> 24] ^
+              crcTable[3][high & 0xFF] ^ crcTable[2][(high >> 8) & 0xFF] ^
+              crcTable[1][(high >> 16) & 0xFF] ^ crcTable[0][high >> 24];
+    }
+    for (; length > 0; bytes++, length--) {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *bytes) & 0xFF];
+    }
+    return ~crc;
+}
+
+/* ============= Replay ============= */
+
+/**
+ * Apply one logged mutation to the library
+ * @return: 0 on success, -1 if the library could not take it
+ */
+static int applyRecord(Library *library, const WalRecord *record) {
+    const Book *book = &record->book;
+
+    switch (record->op) {
+        case WAL_ADD:
+            if (libraryFindById(library, book->id) != -1) {
+                return libraryUpdateBook(library, book) == -1 ? -1 : 0;
+            }
+            /* An ID below nextId was deleted again before the snapshot */
+            if (book->id < library->nextId) {
+                return 0;
+            }
+            return libraryRestoreBook(library, book) == -1 ? -1 : 0;
+        case WAL_UPDATE:
+            return libraryUpdateBook(library, book) == -1 ? -1 : 0;
+        case WAL_DELETE:
+            libraryDeleteBook(library, book->id);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Apply every complete record in the log file
+ * @return: Bytes of the file holding valid records, or -1 on failure
+ */
+static int64_t replay(Wal *wal) {
+    char *buffer = wal->buffers[0];
+    size_t have = 0;
+    int64_t valid = 0;
+
+    for (;;) {
+        ssize_t n = read(wal->fd, buffer + have, WAL_BUFFER_BYTES - have);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Cannot read the log: %s\n", strerror(errno));
+            return -1;
+        }
+        if (n == 0) {
+            return valid;
+        }
+        have += (size_t)n;
+
+        size_t used = 0;
+        while (have - used >= sizeof(WalRecord)) {
+            WalRecord record;
+            memcpy(&record, buffer + used, sizeof(record));
+            if (record.magic != WAL_MAGIC || record.recordSize != sizeof(Book)) {
+                return valid;
+            }
+            if (record.crc != recordCrc(&record)) {
+                fprintf(stderr, "Logged change %d is corrupt; it and the rest "
+                        "of the log are dropped\n", wal->replayed + 1);
+                return valid;
+            }
+            if (applyRecord(wal->library, &record) != 0) {
+                fprintf(stderr, "Cannot replay logged change to book %d\n",
+                        record.book.id);
+                return -1;
+            }
+            wal->replayed++;
+            used += sizeof(WalRecord);
+            valid += (int64_t)sizeof(WalRecord);
+        }
+        memmove(buffer, buffer + used, have - used);
+        have -= used;
+    }
+}
+
+/* ============= Logging ============= */
+
+/* Write completion: the buffer may be filled again */
+static void bufferWritten(void *context, int64_t result) {
+    int *busy = (int*)context;
+
+    *busy = result < 0 ? -1 : 0;
+}
+
+/**
+ * Wait until a buffer's write has finished
+ */
+static void waitForBuffer(Wal *wal, int b) {
+    while (wal->busy[b] > 0) {
+        Aio_Wait(wal->queue);
+    }
+    if (wal->busy[b] < 0) {
+        wal->failed = 1;
+        wal->busy[b] = 0;
+    }
+}
+
+static void logMutation(void *context, const Book *before, const Book *after) {
+    Wal *wal = (Wal*)context;
+    WalRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.magic = WAL_MAGIC;
+    record.recordSize = sizeof(Book);
+    if (after == NULL) {
+        record.op = WAL_DELETE;
+        record.book.id = before->id;
+    } else {
+        record.op = before == NULL ? WAL_ADD : WAL_UPDATE;
+        record.book = *after;
+    }
+    record.crc = recordCrc(&record);
+
+    /* A failed commit leaves the buffer full: drop the record, not the heap */
+    if (wal->used + sizeof(record) > WAL_BUFFER_BYTES && Wal_Commit(wal) != 0) {
+        wal->failed = 1;
+        fprintf(stderr, "Log is full and cannot be written; change to book %d "
+                "is not logged\n", record.book.id);
+        return;
+    }
+    memcpy(wal->buffers[wal->active] + wal->used, &record, sizeof(record));
+    wal->used += sizeof(record);
+    wal->appended++;
+}
+
+int Wal_Commit(Wal *wal) {
+    int b = wal->active;
+
+    if (wal->used == 0) {
+        return 0;
+    }
+
+    wal->busy[b] = 1;
+    if (Aio_Write(wal->queue, wal->fd, wal->buffers[b], wal->used, wal->offset,
+                  bufferWritten, &wal->busy[b]) != 0) {
+        wal->busy[b] = 0;
+        wal->failed = 1;
+        return -1;
+    }
+    wal->offset += wal->used;
+    wal->used = 0;
+    wal->active = !b;
+
+    /* Only blocks when the other buffer's write is still going */
+    waitForBuffer(wal, wal->active);
+    return 0;
+}
+
+int Wal_Sync(Wal *wal) {
+    Wal_Commit(wal);
+    waitForBuffer(wal, 0);
+    waitForBuffer(wal, 1);
+
+    int failed = wal->failed;
+    wal->failed = 0;
+    if (Aio_Sync(wal->queue, wal->fd) != 0 || failed) {
+        fprintf(stderr, "Cannot write the log: some changes may be lost\n");
+        return -1;
+    }
+    return 0;
+}
+
+int Wal_Reset(Wal *wal) {
+    Wal_Sync(wal);
+
+    if (ftruncate(wal->fd, 0) != 0 || fdatasync(wal->fd) != 0) {
+        fprintf(stderr, "Cannot empty the log: %s\n", strerror(errno));
+        return -1;
+    }
+    wal->offset = 0;
+    return 0;
+}
+
+int Wal_Open(Wal *wal, Library *library, const char *path, AioQueue *queue) {
+    memset(wal, 0, sizeof(*wal));
+    wal->fd = -1;
+    wal->library = library;
+    wal->queue = queue;
+    pthread_once(&crcTableOnce, buildCrcTable);
+
+    wal->buffers[0] = (char*)malloc(WAL_BUFFER_BYTES);
+    wal->buffers[1] = (char*)malloc(WAL_BUFFER_BYTES);
+    if (wal->buffers[0] == NULL || wal->buffers[1] == NULL) {
+        fprintf(stderr, "Memory allocation failed for log buffers\n");
+        goto fail;
+    }
+
+    wal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (wal->fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+    /* A log created just now is lost in a crash unless its entry is flushed */
+    if (Aio_SyncDirectory(path) != 0) {
+        goto fail;
+    }
+
+    int64_t valid = replay(wal);
+    if (valid < 0) {
+        goto fail;
+    }
+    if (ftruncate(wal->fd, (off_t)valid) != 0) {
+        fprintf(stderr, "Cannot trim %s: %s\n", path, strerror(errno));
+        goto fail;
+    }
+    wal->offset = (uint64_t)valid;
+
+    if (libraryAddObserver(library, logMutation, wal) != 0) {
+        fprintf(stderr, "Too many library observers for the log\n");
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (wal->fd >= 0) {
+        close(wal->fd);
+    }
+    free(wal->buffers[0]);
+    free(wal->buffers[1]);
+    return -1;
+}
+
+void Wal_Close(Wal *wal) {
+    Wal_Sync(wal);
+    libraryRemoveObserver(wal->library, logMutation, wal);
+    close(wal->fd);
+    free(wal->buffers[0]);
+    free(wal->buffers[1]);
+}
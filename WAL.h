@@ -0,0 +1,101 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "AIO.h"
+#include "LIBRARY.h"
+
+/**
+ * @file WAL.h
+ * @brief Write-ahead log of library mutations between catalog snapshots
+ *
+ * A Wal observes a library and appends one fixed-size record per add,
+ * update and delete to a log file. Records collect in one of two
+ * buffers; Wal_Commit hands the full buffer to an AioQueue and carries
+ * on in the other, so logging never waits for the disk unless both
+ * buffers are in flight. Wal_Sync waits for the writes and flushes
+ * them to disk. Committed records survive the process dying; only
+ * synced ones survive the machine going down.
+ *
+ * On open, records already in the file are replayed into the library
+ * first, so a catalog snapshot plus its log rebuild the library as it
+ * was at the last commit. Replay is idempotent: an add for an ID the
+ * snapshot already holds is applied as an update, and deletes of
+ * missing IDs are skipped, so a log that outlived the snapshot taken
+ * after it does no harm. Replay stops at the first record that is torn
+ * or fails its checksum, and the log is cut off there: later records
+ * may depend on the lost one.
+ *
+ * Records are raw Book copies, so the log is only readable by the same
+ * build; replay stops at a record of another size.
+ */
+
+#define WAL_MAGIC 0x4C415757u         /* "WWAL" in a little-endian record */
+#define WAL_BUFFER_BYTES ((size_t)256 << 10)
+
+/* Kinds of log record */
+typedef enum {
+    WAL_ADD = 1,
+    WAL_UPDATE,
+    WAL_DELETE                        /* book holds only the ID */
+} WalOp;
+
+/* One log record */
+typedef struct {
+    uint32_t magic;                   /* WAL_MAGIC */
+    uint32_t op;                      /* WalOp */
+    uint32_t recordSize;              /* sizeof(Book) of the writer */
+    uint32_t crc;                     /* CRC-32 of the record with this zero */
+    Book book;
+} WalRecord;
+
+typedef struct {
+    Library *library;
+    AioQueue *queue;
+    int fd;
+    uint64_t offset;                  /* End of the log file */
+    char *buffers[2];                 /* WAL_BUFFER_BYTES each */
+    size_t used;                      /* Bytes in the active buffer */
+    int active;                       /* Buffer being filled */
+    int busy[2];                      /* Buffer being written */
+    int failed;                       /* A write failed; Wal_Sync reports it */
+    uint64_t appended;                /* Records logged since open */
+    int replayed;                     /* Records applied on open */
+} Wal;
+
+/**
+ * @brief Replay a log into a library, then log its mutations
+ * @param wal Log to initialize
+ * @param library Library to replay into and observe
+ * @param path Log file; created if missing
+ * @param queue Queue for the log writes; must outlive the log
+ * @return 0 on success, -1 on failure
+ */
+int Wal_Open(Wal *wal, Library *library, const char *path, AioQueue *queue);
+
+/**
+ * @brief Start writing the records logged so far, without waiting
+ * @return 0 on success, -1 on failure
+ */
+int Wal_Commit(Wal *wal);
+
+/**
+ * @brief Commit, wait for every log write and flush the file to disk
+ * @return 0 on success, -1 if any write since the last sync failed
+ */
+int Wal_Sync(Wal *wal);
+
+/**
+ * @brief Empty the log after a snapshot has captured everything in it
+ * @return 0 on success, -1 on failure
+ */
+int Wal_Reset(Wal *wal);
+
+/**
+ * @brief Sync the log, stop observing and close the file
+ */
+void Wal_Close(Wal *wal);
+
+#endif /* WAL_H */
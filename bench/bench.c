@@ -0,0 +1,1644 @@
+/**
+ * @file bench.c
+ * @brief Red-black tree micro-benchmarks and catalog macro-benchmarks
+ *
+ * Every benchmark runs a fixed, seeded workload several times and keeps
+ * the fastest run. Results are printed as tab-separated lines:
+ *
+ *     benchmark  variant  size  ops  ns_per_op  ops_per_sec
+ *         dtlb_miss_per_op  faults_per_op
+ *
+ * preceded by one header line and '#' comment lines describing the
+ * configuration. Rows always come out in the same order, so two result
+ * files can be compared with bench/compare.sh. The last two columns
+ * come from perf counters over the timed part of the fastest run (data
+ * TLB load misses and page faults, user space only) and are "-" where
+ * the kernel or a virtual machine does not provide the counter.
+ *
+ * Usage: bench [-n keys] [-b books] [-q ops] [-r repeats] [-s seed]
+ *              [-f filter[,filter...]] [-P pages]
+ *
+ * -P sets the PAGES policy (such as "thp" or "hugetlb,interleave,pin")
+ * for every tree, catalog and sort buffer the benchmarks build.
+ *
+ * The catalog benchmarks need a build with -DMAX_BOOKS larger than -b
+ * (the Makefile's bench target takes care of this).
+ */
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../CATALOG.h"
+#include "../GROUPSTATS.h"
+#include "../LIBRARY.h"
+#include "../PAGES.h"
+#include "../QUERY.h"
+#include "../QUERYCACHE.h"
+#include "../RBTREE.h"
+#include "../RENDER.h"
+#include "../SORT.h"
+#include "../TEXT.h"
+#include "../TRIE.h"
+#include "bench_util.h"
+
+#define ZIPF_THETA 0.99
+
+typedef struct {
+    int keys;                         /* Tree size for micro-benchmarks */
+    int books;                        /* Catalog size for macro-benchmarks */
+    int ops;                          /* Operations per macro-benchmark run */
+    int repeats;                      /* Runs per benchmark; the best is kept */
+    uint64_t seed;
+    const char *filter;               /* Only run benchmarks containing one of these */
+} BenchConfig;
+
+typedef enum {
+    DIST_SEQUENTIAL = 0,
+    DIST_RANDOM,
+    DIST_ZIPF
+} KeyDistribution;
+
+static const char *distNames[] = {"seq", "random", "zipf"};
+static const char *walkNames[] = {"node", "batch"};
+
+/* Batch benchmarks: variant 0 loops over single operations */
+static const int batchSizes[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+static const char *batchNames[] = {"loop", "10", "100", "1k", "10k", "100k", "1M"};
+static const int searchBatchSizes[] = {1, 8, 32, 128, 1024};
+static const char *searchBatchNames[] = {"loop", "8", "32", "128", "1k"};
+
+/* Catalog cache benchmarks: cache budget in percent of the catalog */
+static const int cachePercents[] = {0, 1, 10, 50};
+static const char *cacheNames[] = {"uncached", "1%", "10%", "50%"};
+static const char *queryCacheNames[] = {"direct", "cached"};
+static const char *groupReportNames[] = {"scan", "maintained"};
+static const char *missLookupNames[] = {"index", "filtered"};
+static const char *textCompareNames[] = {"strcmp", "header"};
+static const char *sortFieldNames[] = {"title", "author", "isbn"};
+static const char *foldNames[] = {"ascii", "accented"};
+static const char *trieNames[] = {"title", "common"};
+static const char *renderNames[] = {"printf_line", "printf_full", "buffer"};
+
+/* Distinct searches repeated by the query cache benchmark */
+#define QUERY_POOL 1000
+
+/* One benchmark: runs once, returns elapsed seconds and operation count */
+typedef double (*BenchFunc)(const BenchConfig *config, int variant, long *ops);
+
+typedef struct {
+    const char *name;
+    BenchFunc run;
+    int variant;                      /* Benchmark-specific; see variantName */
+    int catalog;                      /* Nonzero if size is the catalog size */
+} Benchmark;
+
+/* ============= Perf Counters ============= */
+
+typedef enum {
+    COUNTER_DTLB_MISSES = 0,
+    COUNTER_PAGE_FAULTS,
+    COUNTER_KINDS
+} CounterKind;
+
+/* Open counter descriptors, or -1 where the counter is unavailable */
+static int counterFds[COUNTER_KINDS] = {-1, -1};
+
+/* Counts summed over the timed sections of the current run */
+static uint64_t counterTotals[COUNTER_KINDS];
+
+static int openCounter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void openCounters(void) {
+    counterFds[COUNTER_DTLB_MISSES] =
+        openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counterFds[COUNTER_PAGE_FAULTS] =
+        openCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+}
+
+/* Start of a timed section: counters run only while it lasts */
+static double startTimer(void) {
+    for (int c = 0; c < COUNTER_KINDS; c++) {
+        if (counterFds[c] >= 0) {
+            ioctl(counterFds[c], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counterFds[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    return nowSeconds();
+}
+
+/* End of a timed section; returns its seconds */
+static double stopTimer(double start) {
+    double elapsed = nowSeconds() - start;
+
+    for (int c = 0; c < COUNTER_KINDS; c++) {
+        uint64_t value;
+        if (counterFds[c] >= 0) {
+            ioctl(counterFds[c], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counterFds[c], &value, sizeof(value)) == (ssize_t)sizeof(value)) {
+                counterTotals[c] += value;
+            }
+        }
+    }
+    return elapsed;
+}
+
+/* One counter column: count per operation, or "-" if unavailable */
+static void formatCounter(char *out, size_t out_len, CounterKind kind,
+                          uint64_t total, long ops) {
+    if (counterFds[kind] < 0) {
+        snprintf(out, out_len, "-");
+    } else {
+        snprintf(out, out_len, "%.3f", (double)total / (double)ops);
+    }
+}
+
+/* Whether a benchmark label contains one of a comma-separated filter's parts */
+static int matchesFilter(const char *label, const char *filter) {
+    char part[64];
+
+    while (*filter != '\0') {
+        size_t length = strcspn(filter, ",");
+        if (length > 0 && length < sizeof(part)) {
+            memcpy(part, filter, length);
+            part[length] = '\0';
+            if (strstr(label, part) != NULL) {
+                return 1;
+            }
+        }
+        filter += length;
+        if (*filter == ',') {
+            filter++;
+        }
+    }
+    return 0;
+}
+
+static double nextUniform(uint64_t *state) {
+    return (double)(nextRandom(state) >> 11) / 9007199254740992.0;
+}
+
+/* Zipfian ranks over [0, n), after Gray et al. "Quickly generating
+   billion-record synthetic databases" */
+typedef struct {
+    long n;
+    double theta, alpha, zetan, eta;
+} Zipf;
+
+static void zipfInit(Zipf *zipf, long n, double theta) {
+    double zeta2 = 1.0 + pow(0.5, theta);
+
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->zetan = 0.0;
+    for (long i = 1; i <= n; i++) {
+        zipf->zetan += 1.0 / pow((double)i, theta);
+    }
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) /
+                (1.0 - zeta2 / zipf->zetan);
+}
+
+static long zipfNext(const Zipf *zipf, uint64_t *state) {
+    double u = nextUniform(state);
+    double uz = u * zipf->zetan;
+
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, zipf->theta)) {
+        return 1;
+    }
+
+    long rank = (long)((double)zipf->n *
+                       pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+/* Spread popular ranks over the key space (bijective for n < 2654435761) */
+static int scatterRank(long rank, long n) {
+    return (int)(((uint64_t)rank * 2654435761u) % (uint64_t)n);
+}
+
+/**
+ * Fill keys[0..n) with an operation sequence over the key space [0, n)
+ * @param dist: Sequential order, a random permutation, or Zipfian draws
+ */
+static void makeKeys(int *keys, int n, KeyDistribution dist, uint64_t seed) {
+    uint64_t state = seed;
+
+    if (dist == DIST_ZIPF) {
+        Zipf zipf;
+        zipfInit(&zipf, n, ZIPF_THETA);
+        for (int i = 0; i < n; i++) {
+            keys[i] = scatterRank(zipfNext(&zipf, &state), n);
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        keys[i] = i;
+    }
+    if (dist == DIST_RANDOM) {
+        for (int i = n - 1; i > 0; i--) {
+            int j = (int)(nextRandom(&state) % (uint64_t)(i + 1));
+            int tmp = keys[i];
+            keys[i] = keys[j];
+            keys[j] = tmp;
+        }
+    }
+}
+
+static int *allocKeys(int n) {
+    int *keys = (int*)malloc((size_t)n * sizeof(int));
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed for benchmark keys\n");
+        exit(1);
+    }
+    return keys;
+}
+
+/* Build a tree holding every key in [0, n), inserted in random order */
+static RBTree* buildTree(int n, uint64_t seed) {
+    static int payload;
+    int *keys = allocKeys(n);
+    RBTree *tree = RBTree_Create();
+
+    makeKeys(keys, n, DIST_RANDOM, seed);
+    for (int i = 0; i < n; i++) {
+        RBTree_Insert(tree, keys[i], &payload);
+    }
+
+    free(keys);
+    return tree;
+}
+
+/* ============= Tree Micro-benchmarks ============= */
+
+static double benchRbInsert(const BenchConfig *config, int variant, long *ops) {
+    static int payload;
+    int *keys = allocKeys(config->keys);
+    RBTree *tree = RBTree_Create();
+
+    makeKeys(keys, config->keys, (KeyDistribution)variant, config->seed);
+
+    double start = startTimer();
+    for (int i = 0; i < config->keys; i++) {
+        RBTree_Insert(tree, keys[i], &payload);
+    }
+    double elapsed = stopTimer(start);
+
+    RBTree_Destroy(tree, NULL);
+    free(keys);
+    *ops = config->keys;
+    return elapsed;
+}
+
+static double benchRbSearch(const BenchConfig *config, int variant, long *ops) {
+    int *keys = allocKeys(config->keys);
+    RBTree *tree = buildTree(config->keys, config->seed);
+    volatile uintptr_t sink = 0;
+
+    makeKeys(keys, config->keys, (KeyDistribution)variant, config->seed + 1);
+
+    double start = startTimer();
+    for (int i = 0; i < config->keys; i++) {
+        sink += (uintptr_t)RBTree_Search(tree, keys[i]);
+    }
+    double elapsed = stopTimer(start);
+
+    RBTree_Destroy(tree, NULL);
+    free(keys);
+    (void)sink;
+    *ops = config->keys;
+    return elapsed;
+}
+
+static double benchRbDelete(const BenchConfig *config, int variant, long *ops) {
+    int *keys = allocKeys(config->keys);
+    RBTree *tree = buildTree(config->keys, config->seed);
+
+    makeKeys(keys, config->keys, (KeyDistribution)variant, config->seed + 2);
+
+    double start = startTimer();
+    for (int i = 0; i < config->keys; i++) {
+        RBTree_Delete(tree, keys[i], NULL);
+    }
+    double elapsed = stopTimer(start);
+
+    RBTree_Destroy(tree, NULL);
+    free(keys);
+    *ops = config->keys;
+    return elapsed;
+}
+
+/* Random inserts and deletes over twice the tree's key range */
+static double benchRbChurn(const BenchConfig *config, int variant, long *ops) {
+    static int payload;
+    RBTree *tree = buildTree(config->keys, config->seed);
+    uint64_t state = config->seed + 3;
+
+    (void)variant;
+    double start = startTimer();
+    for (int i = 0; i < config->keys; i++) {
+        int key = (int)(nextRandom(&state) % (uint64_t)(2 * config->keys));
+        if (i & 1) {
+            RBTree_Insert(tree, key, &payload);
+        } else {
+            RBTree_Delete(tree, key, NULL);
+        }
+    }
+    double elapsed = stopTimer(start);
+
+    if (!RBTree_Verify(tree)) {
+        fprintf(stderr, "rb_churn left an invalid tree\n");
+        exit(1);
+    }
+    RBTree_Destroy(tree, NULL);
+    *ops = config->keys;
+    return elapsed;
+}
+
+/*
+ * Grow a tree of n keys by n new keys, in batches of batchSizes[variant]
+ * (RBTree_InsertBatch) or one RBTree_Insert at a time for variant 0
+ */
+static double benchRbInsertBatch(const BenchConfig *config, int variant,
+                                 long *ops) {
+    static int payload;
+    int n = config->keys;
+    int batch = batchSizes[variant] < n ? batchSizes[variant] : n;
+    int *keys = allocKeys(n);
+    void **data = (void**)malloc((size_t)batch * sizeof(void*));
+    RBTree *tree = buildTree(n, config->seed);
+
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation failed for batch data\n");
+        exit(1);
+    }
+    makeKeys(keys, n, DIST_RANDOM, config->seed + 1);
+    for (int i = 0; i < n; i++) {
+        keys[i] += n;
+    }
+    for (int i = 0; i < batch; i++) {
+        data[i] = &payload;
+    }
+
+    double start = startTimer();
+    for (int i = 0; i < n; i += batch) {
+        int count = n - i < batch ? n - i : batch;
+        if (variant == 0) {
+            RBTree_Insert(tree, keys[i], &payload);
+        } else {
+            RBTree_InsertBatch(tree, keys + i, data, (size_t)count);
+        }
+    }
+    double elapsed = stopTimer(start);
+
+    RBTree_Destroy(tree, NULL);
+    free(data);
+    free(keys);
+    *ops = n;
+    return elapsed;
+}
+
+/*
+ * Look up n random keys in a tree of n keys, searchBatchSizes[variant]
+ * at a time with RBTree_SearchBatch, or one RBTree_Search at a time for
+ * variant 0. At the default -n the tree is several times the size of a
+ * typical last-level cache, so most steps of a descent miss.
+ */
+static double benchRbSearchBatch(const BenchConfig *config, int variant,
+                                 long *ops) {
+    int n = config->keys;
+    int batch = searchBatchSizes[variant] < n ? searchBatchSizes[variant] : n;
+    int *keys = allocKeys(n);
+    void **results = (void**)malloc((size_t)batch * sizeof(void*));
+    RBTree *tree = buildTree(n, config->seed);
+    volatile uintptr_t sink = 0;
+
+    if (results == NULL) {
+        fprintf(stderr, "Memory allocation failed for batch results\n");
+        exit(1);
+    }
+    makeKeys(keys, n, DIST_RANDOM, config->seed + 1);
+
+    double start = startTimer();
+    for (int i = 0; i < n; i += batch) {
+        int count = n - i < batch ? n - i : batch;
+        if (variant == 0) {
+            sink += (uintptr_t)RBTree_Search(tree, keys[i]);
+        } else {
+            sink += RBTree_SearchBatch(tree, keys + i, results, (size_t)count);
+        }
+    }
+    double elapsed = stopTimer(start);
+
+    RBTree_Destroy(tree, NULL);
+    free(results);
+    free(keys);
+    *ops = n;
+    return elapsed;
+}
+
+/* Empty a tree of n keys in batches, as benchRbInsertBatch */
+static double benchRbDeleteBatch(const BenchConfig *config, int variant,
+                                 long *ops) {
+    int n = config->keys;
+    int batch = batchSizes[variant] < n ? batchSizes[variant] : n;
+    int *keys = allocKeys(n);
+    RBTree *tree = buildTree(n, config->seed);
+
+    makeKeys(keys, n, DIST_RANDOM, config->seed + 2);
+
+    double start = startTimer();
+    for (int i = 0; i < n; i += batch) {
+        int count = n - i < batch ? n - i : batch;
+        if (variant == 0) {
+            RBTree_Delete(tree, keys[i], NULL);
+        } else {
+            RBTree_DeleteBatch(tree, keys + i, (size_t)count, NULL);
+        }
+    }
+    double elapsed = stopTimer(start);
+
+    RBTree_Destroy(tree, NULL);
+    free(keys);
+    *ops = n;
+    return elapsed;
+}
+
+/* One full invariant check, reported per node */
+static double benchRbVerify(const BenchConfig *config, int variant, long *ops) {
+    RBTree *tree = buildTree(config->keys, config->seed);
+
+    (void)variant;
+    double start = startTimer();
+    int valid = RBTree_Verify(tree);
+    double elapsed = stopTimer(start);
+
+    if (!valid) {
+        fprintf(stderr, "rb_verify found an invalid tree\n");
+        exit(1);
+    }
+    RBTree_Destroy(tree, NULL);
+    *ops = config->keys;
+    return elapsed;
+}
+
+static volatile long walkSink;
+
+static void countNode(int key, void *data) {
+    (void)data;
+    walkSink += key;
+}
+
+static void countBatch(RBNode **nodes, size_t count, void *context) {
+    long sum = 0;
+
+    (void)context;
+    for (size_t i = 0; i < count; i++) {
+        sum += nodes[i]->key;
+    }
+    walkSink += sum;
+}
+
+/* Full in-order walk: variant 0 calls back per node, 1 per batch */
+static double benchRbWalk(const BenchConfig *config, int variant, long *ops) {
+    RBTree *tree = buildTree(config->keys, config->seed);
+
+    double start = startTimer();
+    if (variant == 0) {
+        RBTree_InOrderTraversal(tree, countNode);
+    } else {
+        RBTree_VisitBatch(tree, RB_IN_ORDER, countBatch, NULL);
+    }
+    double elapsed = stopTimer(start);
+
+    RBTree_Destroy(tree, NULL);
+    *ops = config->keys;
+    return elapsed;
+}
+
+static double benchRbDestroy(const BenchConfig *config, int variant, long *ops) {
+    RBTree *tree = buildTree(config->keys, config->seed);
+
+    (void)variant;
+    double start = startTimer();
+    RBTree_Destroy(tree, NULL);
+    double elapsed = stopTimer(start);
+
+    *ops = config->keys;
+    return elapsed;
+}
+
+/* ============= Text Search Micro-benchmarks ============= */
+
+static const char *titleWords[] = {
+    "History", "Garden", "Winter", "Silent", "River", "Empire", "Code",
+    "Night", "Machine", "Ocean", "Shadow", "Light", "Journey", "Stone",
+    "Mountain", "Secret", "Glass", "Iron", "Storm", "Dream"
+};
+
+#define TITLE_WORDS ((int)(sizeof(titleWords) / sizeof(titleWords[0])))
+
+static const char *accentedWords[] = {
+    "Émile", "Brontë", "Straße", "Dvořák", "Łódź", "Ærø", "Señora",
+    "Göteborg", "Čapek", "Øresund"
+};
+
+#define ACCENTED_WORDS ((int)(sizeof(accentedWords) / sizeof(accentedWords[0])))
+
+/* Ingest-time folding of -n generated titles, plain or with accents */
+static double benchTextFold(const BenchConfig *config, int variant, long *ops) {
+    uint64_t state = config->seed;
+    char (*titles)[64] = (char (*)[64])malloc((size_t)config->keys * 64);
+    char folded[MAX_TITLE_LEN];
+    size_t total = 0;
+
+    if (titles == NULL) {
+        fprintf(stderr, "Memory allocation failed for benchmark titles\n");
+        exit(1);
+    }
+    for (int i = 0; i < config->keys; i++) {
+        snprintf(titles[i], 64, "The %s of %s  %s %d",
+                 titleWords[nextRandom(&state) % TITLE_WORDS],
+                 titleWords[nextRandom(&state) % TITLE_WORDS],
+                 variant == 1 ? accentedWords[nextRandom(&state) % ACCENTED_WORDS]
+                              : titleWords[nextRandom(&state) % TITLE_WORDS],
+                 (int)(nextRandom(&state) % 100000));
+    }
+
+    double start = startTimer();
+    for (int i = 0; i < config->keys; i++) {
+        total += Text_Fold(titles[i], folded, sizeof(folded));
+    }
+    double elapsed = stopTimer(start);
+
+    if (total == 0) {
+        fprintf(stderr, "Text folding produced nothing\n");
+    }
+    free(titles);
+    *ops = config->keys;
+    return elapsed;
+}
+
+/* Prefixes of the lead "the" and of the most posted words */
+static const char *commonPrefixes[] = {"t", "th", "the", "s", "st", "m"};
+
+#define COMMON_PREFIXES ((int)(sizeof(commonPrefixes) / sizeof(commonPrefixes[0])))
+
+/*
+ * Trie over -n generated titles, indexed the way a TextIndex indexes
+ * them; title i is written into titles[i]. Every title starts with
+ * "The", and each word gets roughly 3n / TITLE_WORDS postings.
+ */
+static Trie* buildTitleTrie(const BenchConfig *config, char (*titles)[48],
+                            uint64_t *state) {
+    Trie *trie = (Trie*)malloc(sizeof(Trie));
+
+    if (trie == NULL || Trie_Init(trie) != 0) {
+        fprintf(stderr, "Failed to initialize trie\n");
+        exit(1);
+    }
+    Trie_BeginLoad(trie);
+    for (int i = 0; i < config->keys; i++) {
+        snprintf(titles[i], 48, "The %s %s %s %d",
+                 titleWords[nextRandom(state) % TITLE_WORDS],
+                 titleWords[nextRandom(state) % TITLE_WORDS],
+                 titleWords[nextRandom(state) % TITLE_WORDS],
+                 (int)(nextRandom(state) % 100000));
+        Trie_Normalize(titles[i], titles[i], 48);
+        if (Trie_InsertText(trie, titles[i], i, (int)(nextRandom(state) % 50)) != 0) {
+            exit(1);
+        }
+    }
+    Trie_EndLoad(trie);
+
+    return trie;
+}
+
+static char (*allocTitles(int n))[48] {
+    char (*titles)[48] = (char (*)[48])malloc((size_t)n * 48);
+    if (titles == NULL) {
+        fprintf(stderr, "Memory allocation failed for benchmark titles\n");
+        exit(1);
+    }
+    return titles;
+}
+
+/* One random word of a normalized title; its length goes to *length */
+static const char* pickWord(const char *title, uint64_t *state, size_t *length) {
+    int words = 1;
+
+    for (const char *c = title; *c != '\0'; c++) {
+        words += *c == ' ';
+    }
+    for (int skip = (int)(nextRandom(state) % (uint64_t)words); skip > 0; skip--) {
+        title = strchr(title, ' ') + 1;
+    }
+    *length = strcspn(title, " ");
+    return title;
+}
+
+/*
+ * Type-ahead: top 10 titles by stock for a prefix. Variant 0 types 1-12
+ * bytes from a random word of a random title, variant 1 one of
+ * commonPrefixes, whose subtrees hold most of the postings.
+ */
+static double benchTrieComplete(const BenchConfig *config, int variant,
+                                long *ops) {
+    uint64_t state = config->seed;
+    char (*titles)[48] = allocTitles(config->keys);
+    Trie *trie = buildTitleTrie(config, titles, &state);
+    TrieMatch matches[10];
+    char prefix[48];
+
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        if (variant == 1) {
+            snprintf(prefix, sizeof(prefix), "%s", commonPrefixes[i % COMMON_PREFIXES]);
+        } else {
+            const char *title = titles[nextRandom(&state) % (uint64_t)config->keys];
+            size_t length = 1 + nextRandom(&state) % 12;
+
+            snprintf(prefix, sizeof(prefix), "%.*s", (int)length,
+                     pickWord(title, &state, &length));
+        }
+        Trie_Complete(trie, prefix, matches, 10);
+    }
+    double elapsed = stopTimer(start);
+
+    Trie_Free(trie);
+    free(trie);
+    free(titles);
+    *ops = config->ops;
+    return elapsed;
+}
+
+/*
+ * Typo tolerance: one random edit of a random title, matched within 2
+ * edits (variant 0), or of one of its words, matched within 1 edit
+ * (variant 1); a word's postings cover a large part of the titles.
+ */
+static double benchTrieFuzzy(const BenchConfig *config, int variant,
+                             long *ops) {
+    uint64_t state = config->seed;
+    char (*titles)[48] = allocTitles(config->keys);
+    Trie *trie = buildTitleTrie(config, titles, &state);
+    TrieMatch matches[10];
+    char text[48];
+    char word[48];
+
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        const char *title = titles[nextRandom(&state) % (uint64_t)config->keys];
+        size_t length = strlen(title);
+
+        if (variant == 1) {
+            title = pickWord(title, &state, &length);
+        }
+        snprintf(text, sizeof(text), "%.*s", (int)length, title);
+        size_t at = nextRandom(&state) % length;
+
+        /* Substitute, drop or double one byte */
+        switch (nextRandom(&state) % 3) {
+            case 0:
+                snprintf(word, sizeof(word), "%s", text);
+                word[at] = (char)('a' + nextRandom(&state) % 26);
+                break;
+            case 1:
+                snprintf(word, sizeof(word), "%.*s%s", (int)at, text, text + at + 1);
+                break;
+            default:
+                snprintf(word, sizeof(word), "%.*s%s", (int)at + 1, text, text + at);
+                break;
+        }
+        Trie_Fuzzy(trie, word, variant == 1 ? 1 : 2, matches, 10);
+    }
+    double elapsed = stopTimer(start);
+
+    Trie_Free(trie);
+    free(trie);
+    free(titles);
+    *ops = config->ops;
+    return elapsed;
+}
+
+/* ============= Catalog Macro-benchmarks ============= */
+
+static void makeWordBook(Book *book, uint64_t *state, int authors) {
+    memset(book, 0, sizeof(*book));
+    snprintf(book->title, sizeof(book->title), "The %s of %s %d",
+             titleWords[nextRandom(state) % TITLE_WORDS],
+             titleWords[nextRandom(state) % TITLE_WORDS],
+             (int)(nextRandom(state) % 1000));
+    snprintf(book->author, sizeof(book->author), "Author %d",
+             (int)(nextRandom(state) % (uint64_t)authors));
+    randomBookNumbers(book, state);
+}
+
+static int authorCount(int books) {
+    return books / 20 > 0 ? books / 20 : 1;
+}
+
+static Library* newLibrary(void) {
+    Library *library = (Library*)calloc(1, sizeof(Library));
+    if (library == NULL || libraryInit(library) != 0) {
+        fprintf(stderr, "Failed to initialize library\n");
+        exit(1);
+    }
+    return library;
+}
+
+static void deleteLibrary(Library *library) {
+    libraryFree(library);
+    free(library);
+}
+
+/* Catalog with config->books generated books */
+static Library* loadLibrary(const BenchConfig *config, uint64_t *state) {
+    Library *library = newLibrary();
+    Book book;
+
+    for (int i = 0; i < config->books; i++) {
+        makeWordBook(&book, state, authorCount(config->books));
+        libraryAddBook(library, &book);
+    }
+
+    return library;
+}
+
+static double benchCatalogLoad(const BenchConfig *config, int variant,
+                               long *ops) {
+    uint64_t state = config->seed;
+    Library *library = newLibrary();
+    Book book;
+
+    (void)variant;
+    double start = startTimer();
+    for (int i = 0; i < config->books; i++) {
+        makeWordBook(&book, &state, authorCount(config->books));
+        libraryAddBook(library, &book);
+    }
+    double elapsed = stopTimer(start);
+
+    deleteLibrary(library);
+    *ops = config->books;
+    return elapsed;
+}
+
+/**
+ * Run one query built from a predicate and release the predicate
+ * @return: Number of matching rows
+ */
+static int runQuery(const Library *library, Predicate *where, int limit,
+                    int *positions) {
+    Query query;
+    Query_Init(&query);
+    query.where = where;
+    query.limit = limit;
+
+    int found = Query_Execute(library, &query, positions, MAX_BOOKS);
+    Predicate_Free(where);
+
+    return found;
+}
+
+/**
+ * Run one operation of the interactive search mix:
+ * 40% ID lookups, 20% ISBN, 15% year range, 15% price range and 10%
+ * title substring searches. IDs are drawn with Zipfian popularity.
+ */
+static void searchOp(const Library *library, const Zipf *zipf,
+                     uint64_t *state, int *positions) {
+    int roll = (int)(nextRandom(state) % 100);
+    int row = scatterRank(zipfNext(zipf, state), library->count);
+    const Book *book = &library->books[row];
+    char text[MAX_TITLE_LEN];
+
+    if (roll < 40) {
+        libraryFindById(library, book->id);
+    } else if (roll < 60) {
+        runQuery(library, Predicate_EqualsText(FIELD_ISBN, book->isbn),
+                 QUERY_NO_LIMIT, positions);
+    } else if (roll < 75) {
+        runQuery(library, Predicate_Range(FIELD_YEAR, book->year,
+                                          book->year + 1),
+                 QUERY_NO_LIMIT, positions);
+    } else if (roll < 90) {
+        runQuery(library, Predicate_Range(FIELD_PRICE, book->price,
+                                          book->price + 0.5),
+                 QUERY_NO_LIMIT, positions);
+    } else {
+        snprintf(text, sizeof(text), "%s",
+                 titleWords[nextRandom(state) % TITLE_WORDS]);
+        runQuery(library, Predicate_Contains(FIELD_TITLE, text), 20,
+                 positions);
+    }
+}
+
+static int *allocPositions(void) {
+    int *positions = (int*)malloc(MAX_BOOKS * sizeof(int));
+    if (positions == NULL) {
+        fprintf(stderr, "Memory allocation failed for query results\n");
+        exit(1);
+    }
+    return positions;
+}
+
+static double benchCatalogSearchMix(const BenchConfig *config, int variant,
+                                    long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    int *positions = allocPositions();
+    Zipf zipf;
+
+    (void)variant;
+    zipfInit(&zipf, library->count, ZIPF_THETA);
+
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        searchOp(library, &zipf, &state, positions);
+    }
+    double elapsed = stopTimer(start);
+
+    free(positions);
+    deleteLibrary(library);
+    *ops = config->ops;
+    return elapsed;
+}
+
+/* Dashboard-style polling: statistics refreshed while stock changes */
+static double benchCatalogStatsPoll(const BenchConfig *config, int variant,
+                                    long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    volatile float sink = 0.0f;
+    LibraryStats stats;
+
+    (void)variant;
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        if (i % 10 == 9) {
+            Book book = library->books[nextRandom(&state) % (uint64_t)library->count];
+            book.quantity = (int)(nextRandom(&state) % 50);
+            libraryUpdateBook(library, &book);
+        }
+        libraryComputeStats(library, &stats);
+        sink += stats.totalValue;
+    }
+    double elapsed = stopTimer(start);
+
+    deleteLibrary(library);
+    (void)sink;
+    *ops = config->ops;
+    return elapsed;
+}
+
+/**
+ * Sum every group of a per-year and a per-author report
+ */
+static int64_t readGroupReport(const GroupStats *stats) {
+    int64_t total = 0;
+
+    for (int g = 0; g < stats->years.count; g++) {
+        total += stats->years.groups[g].valueCents + stats->years.groups[g].books;
+    }
+    for (int g = 0; g < stats->authors.count; g++) {
+        total += stats->authors.groups[g].valueCents + stats->authors.groups[g].quantity;
+    }
+    return total;
+}
+
+/**
+ * Per-year and per-author report after every change, with one stock,
+ * price or year update per 10 reports: variant 0 recounts the groups
+ * with a full scan for each report, variant 1 reads the tables kept by
+ * a GroupStats observer (and checks them against a recount afterwards)
+ */
+static double benchCatalogGroupReport(const BenchConfig *config, int variant,
+                                      long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    volatile int64_t sink = 0;
+    GroupStats maintained;
+    GroupStats scanned;
+
+    if (variant == 1 && GroupStats_Init(&maintained, library) != 0) {
+        exit(1);
+    }
+
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        if (i % 10 == 9) {
+            Book book = library->books[nextRandom(&state) % (uint64_t)library->count];
+            book.quantity = (int)(nextRandom(&state) % 50);
+            book.price = (float)(100 + nextRandom(&state) % 9900) / 100.0f;
+            book.year = 1900 + (int)(nextRandom(&state) % 120);
+            libraryUpdateBook(library, &book);
+        }
+        if (variant == 1) {
+            sink += readGroupReport(&maintained);
+        } else {
+            if (GroupStats_Compute(&scanned, library) != 0) {
+                exit(1);
+            }
+            sink += readGroupReport(&scanned);
+            GroupStats_Free(&scanned);
+        }
+    }
+    double elapsed = stopTimer(start);
+
+    if (variant == 1) {
+        if (GroupStats_Verify(&maintained) != 0) {
+            fprintf(stderr, "Maintained group statistics differ from a recount\n");
+            exit(1);
+        }
+        GroupStats_Free(&maintained);
+    }
+    deleteLibrary(library);
+    (void)sink;
+    *ops = config->ops;
+    return elapsed;
+}
+
+/**
+ * Mixed read/write traffic at a steady catalog size:
+ * 40% updates, 20% adds, 20% deletes, 20% searches
+ */
+static double benchCatalogChurn(const BenchConfig *config, int variant,
+                                long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    int *positions = allocPositions();
+    Zipf zipf;
+    Book book;
+
+    (void)variant;
+    zipfInit(&zipf, library->count, ZIPF_THETA);
+
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        int roll = (int)(nextRandom(&state) % 100);
+        int row = (int)(nextRandom(&state) % (uint64_t)library->count);
+
+        if (roll < 40) {
+            book = library->books[row];
+            book.price += 0.25f;
+            book.quantity = (int)(nextRandom(&state) % 50);
+            libraryUpdateBook(library, &book);
+        } else if (roll < 60) {
+            if (library->count < MAX_BOOKS) {
+                makeWordBook(&book, &state, authorCount(config->books));
+                libraryAddBook(library, &book);
+            }
+        } else if (roll < 80) {
+            if (library->count > 1) {
+                libraryDeleteBook(library, library->books[row].id);
+            }
+        } else {
+            searchOp(library, &zipf, &state, positions);
+        }
+    }
+    double elapsed = stopTimer(start);
+
+    free(positions);
+    deleteLibrary(library);
+    *ops = config->ops;
+    return elapsed;
+}
+
+/*
+ * Resident kilobytes of the process from /proc/self/smaps_rollup, 0 if
+ * unknown; unlike /proc/self/status it counts the page tables exactly
+ */
+static long residentKiB(const char *field) {
+    FILE *status = fopen("/proc/self/smaps_rollup", "r");
+    size_t length = strlen(field);
+    char line[128];
+    long kib = 0;
+
+    if (status == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, field, length) == 0 && line[length] == ':') {
+            kib = strtol(line + length + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return kib;
+}
+
+/**
+ * Zipfian ID lookups through the read-through cache of an on-disk
+ * catalog; the cache is warmed with one pass of the same workload.
+ * The books are freed before the catalog is opened, as in tiered mode,
+ * and the growth of the process's resident set over the run is printed
+ * against the budget.
+ */
+static double benchCatalogCache(const BenchConfig *config, int variant,
+                                long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    char path[] = "/tmp/bench-catalog-XXXXXX";
+    int fd = mkstemp(path);
+    int count = library->count;
+    int *ids = (int*)malloc((size_t)count * sizeof(int));
+    Zipf zipf;
+    Book book;
+
+    if (fd < 0 || ids == NULL || Catalog_Save(library, path) != 0) {
+        fprintf(stderr, "Cannot write benchmark catalog\n");
+        exit(1);
+    }
+    close(fd);
+    for (int i = 0; i < count; i++) {
+        ids[i] = library->books[i].id;
+    }
+    deleteLibrary(library);
+    /* Or the cache would land in heap pages the books left resident */
+    malloc_trim(0);
+
+    size_t budget = (size_t)count * sizeof(Book) * (size_t)cachePercents[variant] / 100;
+    long rssBefore = residentKiB("Rss");
+    long anonBefore = residentKiB("Anonymous");
+    Catalog *catalog = Catalog_Open(path, budget);
+    if (catalog == NULL) {
+        exit(1);
+    }
+    zipfInit(&zipf, count, ZIPF_THETA);
+
+    for (int i = 0; i < config->ops; i++) {
+        int row = scatterRank(zipfNext(&zipf, &state), count);
+        Catalog_FindById(catalog, ids[row], &book);
+    }
+
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        int row = scatterRank(zipfNext(&zipf, &state), count);
+        Catalog_FindById(catalog, ids[row], &book);
+    }
+    double elapsed = stopTimer(start);
+
+    CatalogCacheStats cache;
+    Catalog_GetCacheStats(catalog, &cache);
+    printf("# catalog_cache/%s: budget %zu KiB, rss grew %ld KiB "
+           "(%ld KiB anonymous, %zu KiB of it cache), file %zu KiB\n",
+           cacheNames[variant], budget / 1024, residentKiB("Rss") - rssBefore,
+           residentKiB("Anonymous") - anonBefore, cache.bytes / 1024,
+           catalog->mapSize / 1024);
+
+    Catalog_Close(catalog);
+    unlink(path);
+    free(ids);
+    *ops = config->ops;
+    return elapsed;
+}
+
+/* One lookup of the miss-heavy workload */
+typedef struct {
+    int byIsbn;
+    int id;
+    char isbn[MAX_ISBN_LEN];
+} MissLookup;
+
+/**
+ * Lookups by ID and by ISBN of which 90% find nothing: IDs of deleted
+ * books (stale links) and ISBNs with one digit changed (typos). After
+ * a tenth of the catalog is deleted, variant 0 probes the ID and ISBN
+ * indexes directly, variant 1 goes through the library's Bloom filters.
+ */
+static double benchCatalogMissLookup(const BenchConfig *config, int variant,
+                                     long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    MissLookup *lookups = (MissLookup*)malloc((size_t)config->ops * sizeof(MissLookup));
+    int *deleted = allocKeys(config->books / 10 + 1);
+    int deletes = 0;
+    volatile long sink = 0;
+
+    if (lookups == NULL) {
+        fprintf(stderr, "Memory allocation failed for lookups\n");
+        exit(1);
+    }
+    while (deletes < config->books / 10 && library->count > 1) {
+        deleted[deletes] = library->books[nextRandom(&state) % (uint64_t)library->count].id;
+        libraryDeleteBook(library, deleted[deletes++]);
+    }
+
+    for (int i = 0; i < config->ops; i++) {
+        const Book *book = &library->books[nextRandom(&state) % (uint64_t)library->count];
+        int miss = nextRandom(&state) % 10 != 0;
+        MissLookup *lookup = &lookups[i];
+
+        lookup->byIsbn = (int)(nextRandom(&state) % 2);
+        lookup->id = miss && deletes > 0
+                     ? deleted[nextRandom(&state) % (uint64_t)deletes] : book->id;
+        snprintf(lookup->isbn, sizeof(lookup->isbn), "%s", book->isbn);
+        if (miss) {
+            size_t at = 4 + nextRandom(&state) % (strlen(lookup->isbn) - 4);
+            lookup->isbn[at] = (char)('0' + (lookup->isbn[at] - '0' + 1) % 10);
+        }
+    }
+
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        const MissLookup *lookup = &lookups[i];
+        int ids[4];
+
+        if (variant == 0) {
+            if (lookup->byIsbn) {
+                char key[INDEX_KEY_LEN];
+                Index_NormalizeIsbn(lookup->isbn, key, sizeof(key));
+                sink += HashIndex_Lookup(&library->isbnIndex, key, ids, 4);
+            } else {
+                sink += RBTree_Search(library->idIndex, lookup->id) != NULL;
+            }
+        } else {
+            if (lookup->byIsbn) {
+                BookFilter filter = {0};
+                filter.isbn = lookup->isbn;
+                sink += libraryIndexScan(library, &filter, ACCESS_ISBN_INDEX, ids, 4);
+            } else {
+                sink += libraryFindById(library, lookup->id) != -1;
+            }
+        }
+    }
+    double elapsed = stopTimer(start);
+
+    free(lookups);
+    free(deleted);
+    deleteLibrary(library);
+    (void)sink;
+    *ops = config->ops;
+    return elapsed;
+}
+
+/**
+ * The text comparisons behind sorting and filtering, on rows in random
+ * order: one row's title ordered against another's, and its folded
+ * author and normalized ISBN tested for equality with the other's (as
+ * a search term would be). Variant 0 compares the strings, normalizing
+ * the row's ISBN each time; variant 1 compares the StrKey headers in
+ * library->keys and reads the rows only when those cannot decide.
+ */
+static double benchCatalogTextCompare(const BenchConfig *config, int variant,
+                                      long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    int *pairs = allocKeys(2 * config->ops);
+    char (*terms)[INDEX_KEY_LEN] = malloc((size_t)config->ops * sizeof(*terms));
+    volatile long sink = 0;
+
+    if (terms == NULL) {
+        fprintf(stderr, "Memory allocation failed for search terms\n");
+        exit(1);
+    }
+    for (int i = 0; i < 2 * config->ops; i++) {
+        pairs[i] = (int)(nextRandom(&state) % (uint64_t)library->count);
+    }
+    /* Search terms are normalized once, when a query is built */
+    for (int i = 0; i < config->ops; i++) {
+        Index_NormalizeIsbn(library->books[pairs[2 * i + 1]].isbn, terms[i],
+                            sizeof(terms[i]));
+    }
+
+    const BookKeys *keys = &library->keys;
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        int x = pairs[2 * i];
+        int y = pairs[2 * i + 1];
+        const Book *a = &library->books[x];
+        const Book *b = &library->books[y];
+        char isbn[INDEX_KEY_LEN];
+
+        if (variant == 0) {
+            Index_NormalizeIsbn(a->isbn, isbn, sizeof(isbn));
+            sink += strcmp(a->title, b->title) < 0;
+            sink += strcmp(a->authorFolded, b->authorFolded) == 0;
+            sink += strcmp(isbn, terms[i]) == 0;
+        } else {
+            sink += StrKey_Compare(&keys->title[x], a->title, &keys->title[y], b->title) < 0;
+            sink += StrKey_Equal(&keys->authorFolded[x], a->authorFolded,
+                                 &keys->authorFolded[y], b->authorFolded);
+            if (StrKey_SameHeader(&keys->isbnNormal[x], &keys->isbnNormal[y])) {
+                Index_NormalizeIsbn(a->isbn, isbn, sizeof(isbn));
+                sink += strcmp(isbn, terms[i]) == 0;
+            }
+        }
+    }
+    double elapsed = stopTimer(start);
+
+    free(pairs);
+    free(terms);
+    deleteLibrary(library);
+    (void)sink;
+    *ops = config->ops;
+    return elapsed;
+}
+
+/**
+ * Sort the whole catalog by a text field (sortFieldNames[variant]),
+ * starting each time from the same shuffled positions; reported per
+ * book sorted
+ */
+static double benchCatalogSort(const BenchConfig *config, int variant,
+                               long *ops) {
+    static const BookField fields[] = {FIELD_TITLE, FIELD_AUTHOR, FIELD_ISBN};
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    int *shuffled = allocKeys(library->count);
+    int *positions = allocPositions();
+    int sorts = config->ops / library->count > 0 ? config->ops / library->count : 1;
+
+    for (int i = 0; i < library->count; i++) {
+        shuffled[i] = i;
+    }
+    for (int i = library->count - 1; i > 0; i--) {
+        int j = (int)(nextRandom(&state) % (uint64_t)(i + 1));
+        int swap = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = swap;
+    }
+
+    double elapsed = 0.0;
+    for (int s = 0; s < sorts; s++) {
+        memcpy(positions, shuffled, (size_t)library->count * sizeof(int));
+        double start = startTimer();
+        Sort_Positions(library, fields[variant], s % 2, positions,
+                       (size_t)library->count);
+        elapsed += stopTimer(start);
+    }
+
+    free(shuffled);
+    free(positions);
+    *ops = (long)sorts * library->count;
+    deleteLibrary(library);
+    return elapsed;
+}
+
+/**
+ * Build search number k of the repeated pool: an author substring, a
+ * year range, or a price range, in turn
+ */
+static Predicate* pooledSearch(int k) {
+    char text[MAX_AUTHOR_LEN];
+
+    switch (k % 3) {
+        case 0:
+            snprintf(text, sizeof(text), "Author %d", k);
+            return Predicate_Contains(FIELD_AUTHOR, text);
+        case 1:
+            return Predicate_Range(FIELD_YEAR, 1900 + k % 120, 1905 + k % 120);
+        default:
+            return Predicate_Range(FIELD_PRICE, (double)(k % 95) + 1.0,
+                                   (double)(k % 95) + 1.5);
+    }
+}
+
+/**
+ * Repeated searches drawn with Zipfian popularity from QUERY_POOL
+ * distinct ones, with one stock or price update per 50 searches;
+ * variant 0 runs each query directly and variant 1 through a QueryCache
+ */
+static double benchCatalogQueryCache(const BenchConfig *config, int variant,
+                                     long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    int *positions = allocPositions();
+    QueryCache cache;
+    Query query;
+    Zipf zipf;
+
+    if (variant == 1 &&
+        QueryCache_Init(&cache, library, QUERY_CACHE_DEFAULT_ENTRIES,
+                        QUERY_CACHE_DEFAULT_IDS) != 0) {
+        exit(1);
+    }
+    zipfInit(&zipf, QUERY_POOL, ZIPF_THETA);
+
+    double start = startTimer();
+    for (int i = 0; i < config->ops; i++) {
+        if (i % 50 == 49) {
+            Book book = library->books[nextRandom(&state) % (uint64_t)library->count];
+            book.price = (float)(100 + nextRandom(&state) % 9900) / 100.0f;
+            book.quantity = (int)(nextRandom(&state) % 50);
+            libraryUpdateBook(library, &book);
+            continue;
+        }
+
+        Query_Init(&query);
+        query.where = pooledSearch((int)zipfNext(&zipf, &state));
+        if (variant == 1) {
+            QueryCache_Execute(&cache, &query, positions, MAX_BOOKS);
+        } else {
+            Query_Execute(library, &query, positions, MAX_BOOKS);
+        }
+        Predicate_Free(query.where);
+    }
+    double elapsed = stopTimer(start);
+
+    if (variant == 1) {
+        QueryCache_Free(&cache);
+    }
+    free(positions);
+    deleteLibrary(library);
+    *ops = config->ops;
+    return elapsed;
+}
+
+/**
+ * Table rows written to /dev/null: printf per row on a line-buffered
+ * stream (as on a terminal), on a fully buffered stream, or through a
+ * RenderBuffer. Every variant writes the same bytes.
+ */
+static double benchCatalogRender(const BenchConfig *config, int variant,
+                                 long *ops) {
+    uint64_t state = config->seed;
+    Library *library = loadLibrary(config, &state);
+    RenderBuffer buffer;
+    FILE *out = NULL;
+    int fd = open("/dev/null", O_WRONLY);
+    long rows = 0;
+
+    if (fd < 0 || Render_Init(&buffer, fd, RENDER_DEFAULT_CAPACITY) != 0) {
+        fprintf(stderr, "Failed to open /dev/null for rendering\n");
+        exit(1);
+    }
+    if (variant < 2) {
+        out = fdopen(dup(fd), "w");
+        if (out == NULL) {
+            fprintf(stderr, "Failed to open /dev/null for rendering\n");
+            exit(1);
+        }
+        setvbuf(out, NULL, variant == 0 ? _IOLBF : _IOFBF, BUFSIZ);
+    }
+
+    double start = startTimer();
+    while (rows < config->ops) {
+        for (int i = 0; i < library->count && rows < config->ops; i++, rows++) {
+            const Book *book = &library->books[i];
+            if (out != NULL) {
+                fprintf(out, "| %2d | %-24s | %-19s | %-13s | %4d | $%-5.2f |\n",
+                        book->id, book->title, book->author, book->isbn,
+                        book->year, book->price);
+            } else {
+                Render_BookRow(&buffer, book);
+            }
+        }
+    }
+    if (out != NULL) {
+        fflush(out);
+    } else {
+        Render_Flush(&buffer);
+    }
+    double elapsed = stopTimer(start);
+
+    if (out != NULL) {
+        fclose(out);
+    }
+    Render_Free(&buffer);
+    close(fd);
+    deleteLibrary(library);
+    *ops = rows;
+    return elapsed;
+}
+
+/* ============= Driver ============= */
+
+static const Benchmark benchmarks[] = {
+    {"rb_insert", benchRbInsert, DIST_SEQUENTIAL, 0},
+    {"rb_insert", benchRbInsert, DIST_RANDOM, 0},
+    {"rb_insert", benchRbInsert, DIST_ZIPF, 0},
+    {"rb_search", benchRbSearch, DIST_SEQUENTIAL, 0},
+    {"rb_search", benchRbSearch, DIST_RANDOM, 0},
+    {"rb_search", benchRbSearch, DIST_ZIPF, 0},
+    {"rb_delete", benchRbDelete, DIST_SEQUENTIAL, 0},
+    {"rb_delete", benchRbDelete, DIST_RANDOM, 0},
+    {"rb_delete", benchRbDelete, DIST_ZIPF, 0},
+    {"rb_churn", benchRbChurn, -1, 0},
+    {"rb_insert_batch", benchRbInsertBatch, 0, 0},
+    {"rb_insert_batch", benchRbInsertBatch, 1, 0},
+    {"rb_insert_batch", benchRbInsertBatch, 2, 0},
+    {"rb_insert_batch", benchRbInsertBatch, 3, 0},
+    {"rb_insert_batch", benchRbInsertBatch, 4, 0},
+    {"rb_insert_batch", benchRbInsertBatch, 5, 0},
+    {"rb_insert_batch", benchRbInsertBatch, 6, 0},
+    {"rb_search_batch", benchRbSearchBatch, 0, 0},
+    {"rb_search_batch", benchRbSearchBatch, 1, 0},
+    {"rb_search_batch", benchRbSearchBatch, 2, 0},
+    {"rb_search_batch", benchRbSearchBatch, 3, 0},
+    {"rb_search_batch", benchRbSearchBatch, 4, 0},
+    {"rb_delete_batch", benchRbDeleteBatch, 0, 0},
+    {"rb_delete_batch", benchRbDeleteBatch, 1, 0},
+    {"rb_delete_batch", benchRbDeleteBatch, 2, 0},
+    {"rb_delete_batch", benchRbDeleteBatch, 3, 0},
+    {"rb_delete_batch", benchRbDeleteBatch, 4, 0},
+    {"rb_delete_batch", benchRbDeleteBatch, 5, 0},
+    {"rb_delete_batch", benchRbDeleteBatch, 6, 0},
+    {"rb_verify", benchRbVerify, -1, 0},
+    {"rb_walk", benchRbWalk, 0, 0},
+    {"rb_walk", benchRbWalk, 1, 0},
+    {"rb_destroy", benchRbDestroy, -1, 0},
+    {"text_fold", benchTextFold, 0, 0},
+    {"text_fold", benchTextFold, 1, 0},
+    {"trie_complete", benchTrieComplete, 0, 0},
+    {"trie_complete", benchTrieComplete, 1, 0},
+    {"trie_fuzzy", benchTrieFuzzy, 0, 0},
+    {"trie_fuzzy", benchTrieFuzzy, 1, 0},
+    {"catalog_load", benchCatalogLoad, -1, 1},
+    {"catalog_search_mix", benchCatalogSearchMix, -1, 1},
+    {"catalog_stats_poll", benchCatalogStatsPoll, -1, 1},
+    {"catalog_group_report", benchCatalogGroupReport, 0, 1},
+    {"catalog_group_report", benchCatalogGroupReport, 1, 1},
+    {"catalog_churn", benchCatalogChurn, -1, 1},
+    {"catalog_cache", benchCatalogCache, 0, 1},
+    {"catalog_cache", benchCatalogCache, 1, 1},
+    {"catalog_cache", benchCatalogCache, 2, 1},
+    {"catalog_cache", benchCatalogCache, 3, 1},
+    {"catalog_miss_lookup", benchCatalogMissLookup, 0, 1},
+    {"catalog_miss_lookup", benchCatalogMissLookup, 1, 1},
+    {"catalog_text_compare", benchCatalogTextCompare, 0, 1},
+    {"catalog_text_compare", benchCatalogTextCompare, 1, 1},
+    {"catalog_sort", benchCatalogSort, 0, 1},
+    {"catalog_sort", benchCatalogSort, 1, 1},
+    {"catalog_sort", benchCatalogSort, 2, 1},
+    {"catalog_query_cache", benchCatalogQueryCache, 0, 1},
+    {"catalog_query_cache", benchCatalogQueryCache, 1, 1},
+    {"catalog_render", benchCatalogRender, 0, 1},
+    {"catalog_render", benchCatalogRender, 1, 1},
+    {"catalog_render", benchCatalogRender, 2, 1}
+};
+
+#define BENCHMARK_COUNT ((int)(sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+/* Label for a benchmark's variant column */
+static const char* variantName(const Benchmark *bench) {
+    if (bench->variant < 0) {
+        return "-";
+    }
+    if (bench->run == benchRbWalk) {
+        return walkNames[bench->variant];
+    }
+    if (bench->run == benchRbInsertBatch || bench->run == benchRbDeleteBatch) {
+        return batchNames[bench->variant];
+    }
+    if (bench->run == benchRbSearchBatch) {
+        return searchBatchNames[bench->variant];
+    }
+    if (bench->run == benchCatalogCache) {
+        return cacheNames[bench->variant];
+    }
+    if (bench->run == benchCatalogQueryCache) {
+        return queryCacheNames[bench->variant];
+    }
+    if (bench->run == benchCatalogMissLookup) {
+        return missLookupNames[bench->variant];
+    }
+    if (bench->run == benchCatalogTextCompare) {
+        return textCompareNames[bench->variant];
+    }
+    if (bench->run == benchCatalogSort) {
+        return sortFieldNames[bench->variant];
+    }
+    if (bench->run == benchCatalogGroupReport) {
+        return groupReportNames[bench->variant];
+    }
+    if (bench->run == benchTextFold) {
+        return foldNames[bench->variant];
+    }
+    if (bench->run == benchTrieComplete || bench->run == benchTrieFuzzy) {
+        return trieNames[bench->variant];
+    }
+    if (bench->run == benchCatalogRender) {
+        return renderNames[bench->variant];
+    }
+    return distNames[bench->variant];
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n keys] [-b books] [-q ops] [-r repeats] [-s seed] "
+            "[-f filter[,filter...]] [-P pages]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    BenchConfig config = {1000000, 10000, 20000, 3, 42, NULL};
+    PagesPolicy pages = {PAGES_SMALL, PAGES_NUMA_DEFAULT, 0, 0};
+    char pagesText[64];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:b:q:r:s:f:P:h")) != -1) {
+        switch (opt) {
+            case 'n': config.keys = atoi(optarg); break;
+            case 'b': config.books = atoi(optarg); break;
+            case 'q': config.ops = atoi(optarg); break;
+            case 'r': config.repeats = atoi(optarg); break;
+            case 's': config.seed = strtoull(optarg, NULL, 10); break;
+            case 'f': config.filter = optarg; break;
+            case 'P':
+                if (Pages_ParsePolicy(optarg, &pages) != 0) {
+                    fprintf(stderr, "Unknown page policy: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (config.keys < 2 || config.books < 2 || config.ops < 1 ||
+        config.repeats < 1 || config.seed == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (config.books > MAX_BOOKS) {
+        fprintf(stderr, "Catalog size %d exceeds MAX_BOOKS (%d); "
+                "rebuild with -DMAX_BOOKS=%d\n",
+                config.books, MAX_BOOKS, config.books);
+        return 1;
+    }
+
+    Pages_SetPolicy(&pages);
+    Pages_FormatPolicy(&pages, pagesText, sizeof(pagesText));
+    openCounters();
+
+    printf("# keys=%d books=%d ops=%d repeats=%d seed=%llu max_books=%d pages=%s\n",
+           config.keys, config.books, config.ops, config.repeats,
+           (unsigned long long)config.seed, MAX_BOOKS, pagesText);
+    printf("benchmark\tvariant\tsize\tops\tns_per_op\tops_per_sec\t"
+           "dtlb_miss_per_op\tfaults_per_op\n");
+
+    for (int b = 0; b < BENCHMARK_COUNT; b++) {
+        const Benchmark *bench = &benchmarks[b];
+        const char *variant = variantName(bench);
+        char label[64];
+
+        snprintf(label, sizeof(label), "%s/%s", bench->name, variant);
+        if (config.filter != NULL && !matchesFilter(label, config.filter)) {
+            continue;
+        }
+
+        double best = 0.0;
+        long ops = 0;
+        uint64_t bestCounts[COUNTER_KINDS] = {0};
+        for (int r = 0; r < config.repeats; r++) {
+            memset(counterTotals, 0, sizeof(counterTotals));
+            double elapsed = bench->run(&config, bench->variant, &ops);
+            if (r == 0 || elapsed < best) {
+                best = elapsed;
+                memcpy(bestCounts, counterTotals, sizeof(bestCounts));
+            }
+        }
+
+        char tlb[32];
+        char faults[32];
+        formatCounter(tlb, sizeof(tlb), COUNTER_DTLB_MISSES,
+                      bestCounts[COUNTER_DTLB_MISSES], ops);
+        formatCounter(faults, sizeof(faults), COUNTER_PAGE_FAULTS,
+                      bestCounts[COUNTER_PAGE_FAULTS], ops);
+        printf("%s\t%s\t%d\t%ld\t%.1f\t%.0f\t%s\t%s\n", bench->name, variant,
+               bench->catalog ? config.books : config.keys, ops,
+               best * 1e9 / (double)ops, (double)ops / best, tlb, faults);
+        fflush(stdout);
+    }
+
+    if (Pages_Enabled()) {
+        PagesStats stats;
+        Pages_GetStats(&stats);
+        printf("# pages: %llu regions mapped, %llu hugetlb, %llu hugetlb fallbacks, "
+               "%llu advised, %llu numa bound, %llu numa refused, %llu workers pinned\n",
+               (unsigned long long)stats.regions, (unsigned long long)stats.hugetlbRegions,
+               (unsigned long long)stats.hugetlbFallbacks, (unsigned long long)stats.advised,
+               (unsigned long long)stats.numaBound, (unsigned long long)stats.numaFailed,
+               (unsigned long long)stats.pinned);
+    }
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../LIBRARY.h"
+
+/**
+ * @file bench_util.h
+ * @brief Clock, random numbers and book fixtures shared by the benchmarks
+ *
+ * Every benchmark program includes this header; the helpers are static
+ * inline so each program keeps its own copy without a separate object
+ * to link, including the shared objects bench/metrics_overhead.sh builds.
+ */
+
+static inline double nowSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/* xorshift64: fast and repeatable for a given seed; the state must not be 0 */
+static inline uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Draw the ISBN, year, price and quantity of a generated book, the
+ * fields every fixture fills alike
+ */
+static inline void randomBookNumbers(Book *book, uint64_t *state) {
+    snprintf(book->isbn, sizeof(book->isbn), "978-%010llu",
+             (unsigned long long)(nextRandom(state) % 10000000000ull));
+    book->year = 1900 + (int)(nextRandom(state) % 125);
+    book->price = (float)(100 + nextRandom(state) % 9900) / 100.0f;
+    book->quantity = (int)(nextRandom(state) % 50);
+}
+
+/**
+ * Generate a book titled "<titlePrefix> N", N below 100000, by one of
+ * 1000 authors
+ */
+static inline void makeBook(Book *book, uint64_t *state, const char *titlePrefix) {
+    memset(book, 0, sizeof(*book));
+    snprintf(book->title, sizeof(book->title), "%s %llu", titlePrefix,
+             (unsigned long long)(nextRandom(state) % 100000));
+    snprintf(book->author, sizeof(book->author), "Author %llu",
+             (unsigned long long)(nextRandom(state) % 1000));
+    randomBookNumbers(book, state);
+}
+
+#endif /* BENCH_UTIL_H */
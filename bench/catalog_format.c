@@ -0,0 +1,280 @@
+/**
+ * @file catalog_format.c
+ * @brief Size, load time and lookup cost of plain and packed catalogs
+ *
+ * Builds a library of BOOKS books with titles and authors drawn from
+ * small vocabularies, writes it as a plain catalog (raw Book records)
+ * and as a packed one (PACK.h), and for each format reports:
+ *
+ *   - the file size, bytes per book and size relative to the plain file;
+ *   - save: Catalog_Write, synced to disk;
+ *   - cold load: Catalog_Load after the file's pages are dropped from
+ *     the page cache with posix_fadvise (on tmpfs they cannot be, so
+ *     cold and warm match there);
+ *   - warm load: Catalog_Load with the file cached;
+ *   - lookup: Catalog_FindById of random IDs through Catalog_Open with
+ *     no record cache, so every lookup reads the file (a packed lookup
+ *     decodes one block), first with the pages dropped, then warm;
+ *   - miss: warm lookups of deleted IDs, which a packed catalog's block
+ *     filters mostly answer without decoding anything.
+ *
+ * The packed catalog is loaded back and compared with the library book
+ * by book before anything is timed.
+ *
+ * Usage: catalog_format [books] [dir]
+ */
+
+#define _GNU_SOURCE                   /* posix_fadvise */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../CATALOG.h"
+#include "../LIBRARY.h"
+#include "bench_util.h"
+
+#define BOOKS 50000
+#define REPEATS 3
+#define LOOKUPS 200000
+
+static const char *words[] = {
+    "The", "Silent", "River", "of", "Night", "Empire", "Garden", "Lost",
+    "Stars", "and", "Shadow", "House", "Winter", "Secret", "History", "Last",
+    "City", "Fire", "Glass", "Ocean", "Memory", "Iron", "Song", "Kingdom",
+    "Little", "War", "Light", "Storm", "Journey", "Hidden", "Golden", "Road"
+};
+static const char *firstNames[] = {
+    "Anna", "Boris", "Clara", "David", "Elena", "Frank", "Greta", "Hugo",
+    "Irene", "Jonas", "Karin", "Louis", "Maria", "Nikolai", "Olga", "Peter"
+};
+static const char *lastNames[] = {
+    "Andersen", "Becker", "Castillo", "Dubois", "Eriksson", "Fischer",
+    "Garcia", "Hoffmann", "Ivanova", "Jensen", "Kowalski", "Lindqvist",
+    "Moreau", "Novak", "Olsen", "Petrov", "Rossi", "Schmidt", "Tanaka", "Weber"
+};
+
+#define COUNT_OF(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+static void makeWordBook(Book *book, uint64_t *state) {
+    int titleWords = 2 + (int)(nextRandom(state) % 4);
+    size_t used = 0;
+
+    memset(book, 0, sizeof(*book));
+    for (int w = 0; w < titleWords; w++) {
+        used += (size_t)snprintf(book->title + used, sizeof(book->title) - used,
+                                 "%s%s", w > 0 ? " " : "",
+                                 words[nextRandom(state) % COUNT_OF(words)]);
+    }
+    snprintf(book->author, sizeof(book->author), "%s %s",
+             firstNames[nextRandom(state) % COUNT_OF(firstNames)],
+             lastNames[nextRandom(state) % COUNT_OF(lastNames)]);
+    randomBookNumbers(book, state);
+}
+
+static Library* newLibrary(void) {
+    Library *library = (Library*)calloc(1, sizeof(Library));
+
+    if (library == NULL || libraryInit(library) != 0) {
+        fprintf(stderr, "Failed to initialize library\n");
+        exit(1);
+    }
+    return library;
+}
+
+static void deleteLibrary(Library *library) {
+    libraryFree(library);
+    free(library);
+}
+
+/* Drop a file's pages from the page cache so the next read goes to disk */
+static void dropCache(const char *path) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static int sameBook(const Book *a, const Book *b) {
+    return a->id == b->id && strcmp(a->title, b->title) == 0 &&
+           strcmp(a->author, b->author) == 0 && strcmp(a->isbn, b->isbn) == 0 &&
+           a->year == b->year && a->price == b->price && a->quantity == b->quantity &&
+           strcmp(a->titleFolded, b->titleFolded) == 0 &&
+           strcmp(a->authorFolded, b->authorFolded) == 0;
+}
+
+/* Load a catalog and check it holds exactly the library's books */
+static void verify(const Library *library, const char *path) {
+    Library *copy = newLibrary();
+    Catalog *catalog;
+    Book book;
+
+    if (Catalog_Load(copy, path, NULL, 0) != library->count) {
+        fprintf(stderr, "%s did not load every book\n", path);
+        exit(1);
+    }
+    for (int i = 0; i < library->count; i++) {
+        if (!sameBook(&library->books[i], &copy->books[i])) {
+            fprintf(stderr, "Book %d differs after loading %s\n",
+                    library->books[i].id, path);
+            exit(1);
+        }
+    }
+    deleteLibrary(copy);
+
+    catalog = Catalog_Open(path, 0);
+    if (catalog == NULL) {
+        exit(1);
+    }
+    for (int i = 0; i < library->count; i++) {
+        if (!Catalog_FindById(catalog, library->books[i].id, &book) ||
+            !sameBook(&library->books[i], &book)) {
+            fprintf(stderr, "Lookup of book %d differs in %s\n",
+                    library->books[i].id, path);
+            exit(1);
+        }
+    }
+    if (Catalog_FindById(catalog, library->nextId, &book)) {
+        fprintf(stderr, "Lookup of a missing ID succeeded in %s\n", path);
+        exit(1);
+    }
+    Catalog_Close(catalog);
+}
+
+/* Best of REPEATS loads; returns seconds */
+static double timeLoad(const char *path, int expected, int cold) {
+    double best = 0.0;
+
+    for (int r = 0; r < REPEATS; r++) {
+        Library *copy = newLibrary();
+        if (cold) {
+            dropCache(path);
+        }
+
+        double start = nowSeconds();
+        int loaded = Catalog_Load(copy, path, NULL, 0);
+        double elapsed = nowSeconds() - start;
+
+        if (loaded != expected) {
+            fprintf(stderr, "Loaded %d books, expected %d\n", loaded, expected);
+            exit(1);
+        }
+        deleteLibrary(copy);
+        if (r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+/* Random uncached lookups among ids; returns nanoseconds per lookup */
+static double timeLookups(const int *ids, int count, const char *path, int cold) {
+    uint64_t state = 99;
+    Book book;
+
+    if (cold) {
+        dropCache(path);
+    }
+    Catalog *catalog = Catalog_Open(path, 0);
+    if (catalog == NULL) {
+        exit(1);
+    }
+
+    double start = nowSeconds();
+    for (int i = 0; i < LOOKUPS; i++) {
+        Catalog_FindById(catalog, ids[nextRandom(&state) % (uint64_t)count], &book);
+    }
+    double elapsed = nowSeconds() - start;
+
+    Catalog_Close(catalog);
+    return elapsed / LOOKUPS * 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct {
+        const char *name;
+        int flags;
+    } formats[] = {{"plain", 0}, {"packed", CATALOG_COMPRESSED}};
+    int books = argc > 1 ? atoi(argv[1]) : BOOKS;
+    const char *dir = argc > 2 ? argv[2] : getenv("TMPDIR");
+    char path[4096];
+    double plainSize = 0.0;
+
+    if (books < 1 || books > MAX_BOOKS) {
+        fprintf(stderr, "Usage: %s [books (1..%d)] [dir]\n", argv[0], MAX_BOOKS);
+        return 1;
+    }
+
+    Library *library = newLibrary();
+    uint64_t state = 42;
+    Book book;
+    for (int i = 0; i < books; i++) {
+        makeWordBook(&book, &state);
+        libraryAddBook(library, &book);
+    }
+    /* Leave gaps in the IDs, as deletes do */
+    int deletes = books / 20 > 0 ? books / 20 : 1;
+    int *deleted = (int*)malloc((size_t)deletes * sizeof(int));
+    int *present = (int*)malloc((size_t)books * sizeof(int));
+    if (deleted == NULL || present == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    int gaps = 0;
+    for (; gaps < deletes && library->count > 1; gaps++) {
+        deleted[gaps] = library->books[nextRandom(&state) % (uint64_t)library->count].id;
+        libraryDeleteBook(library, deleted[gaps]);
+    }
+    for (int i = 0; i < library->count; i++) {
+        present[i] = library->books[i].id;
+    }
+
+    printf("Catalog formats: %d books, %d per packed block\n", library->count,
+           PACK_BLOCK_BOOKS);
+    printf("  %-8s %10s %8s %7s %9s %9s %9s %11s %11s %11s\n", "format", "bytes",
+           "B/book", "ratio", "save ms", "cold ms", "warm ms", "cold ns/op",
+           "warm ns/op", "miss ns/op");
+
+    for (int f = 0; f < 2; f++) {
+        struct stat info;
+
+        snprintf(path, sizeof(path), "%s/catalog-format-%d.%s",
+                 dir != NULL ? dir : "/tmp", (int)getpid(), formats[f].name);
+
+        double start = nowSeconds();
+        if (Catalog_Write(library, path, NULL, formats[f].flags) != 0 ||
+            stat(path, &info) != 0) {
+            return 1;
+        }
+        double save = nowSeconds() - start;
+        verify(library, path);
+
+        double size = (double)info.st_size;
+        if (f == 0) {
+            plainSize = size;
+        }
+        double cold = timeLoad(path, library->count, 1);
+        double warm = timeLoad(path, library->count, 0);
+        double coldLookup = timeLookups(present, library->count, path, 1);
+        double warmLookup = timeLookups(present, library->count, path, 0);
+        double missLookup = gaps > 0 ? timeLookups(deleted, gaps, path, 0) : 0.0;
+
+        printf("  %-8s %10.0f %8.1f %6.1f%% %9.2f %9.2f %9.2f %11.0f %11.0f %11.0f\n",
+               formats[f].name, size, size / library->count,
+               size / plainSize * 100.0, save * 1e3, cold * 1e3, warm * 1e3,
+               coldLookup, warmLookup, missLookup);
+        unlink(path);
+    }
+
+    free(deleted);
+    free(present);
+    deleteLibrary(library);
+    return 0;
+}
@@ -0,0 +1,308 @@
+/**
+ * @file catalog_io.c
+ * @brief Catalog snapshot, load and log I/O through each AIO backend
+ *
+ * Builds a library of BOOKS books and, for every I/O backend (sync,
+ * threads, io_uring) with buffered and O_DIRECT files, measures:
+ *
+ *   - save: Catalog_Write of the whole catalog, synced to disk;
+ *   - load: Catalog_Load into an empty library (this includes building
+ *     the library's indexes, which is the same for every backend);
+ *   - log: the cost per update of logging it through a Wal and
+ *     committing after every update, as the menu loop does;
+ *   - query tail latency: a second thread runs indexed queries on the
+ *     library while the main thread saves snapshots back to back, and
+ *     the 50th, 99th and 99.9th percentile and worst query times are
+ *     compared with the same queries while nothing is being saved.
+ *
+ * Files go to DIR (default $TMPDIR or /tmp). Loads usually hit the page
+ * cache after a save, except with O_DIRECT. A file system without
+ * O_DIRECT (tmpfs) silently runs the direct rows buffered.
+ *
+ * Usage: catalog_io [books] [depth] [dir]
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../AIO.h"
+#include "../CATALOG.h"
+#include "../LIBRARY.h"
+#include "../QUERY.h"
+#include "../WAL.h"
+#include "bench_util.h"
+
+#define BOOKS 50000
+#define REPEATS 3
+#define SAVES_UNDER_LOAD 5
+#define LOG_UPDATES 20000
+#define MAX_SAMPLES (1 << 20)
+
+/* Queries timed by the reader thread */
+typedef struct {
+    const Library *library;
+    int stop;
+    double *samples;                  /* Seconds per query */
+    int count;
+} QueryLoad;
+
+static Library* newLibrary(void) {
+    Library *library = (Library*)calloc(1, sizeof(Library));
+
+    if (library == NULL || libraryInit(library) != 0) {
+        fprintf(stderr, "Failed to initialize library\n");
+        exit(1);
+    }
+    return library;
+}
+
+static void deleteLibrary(Library *library) {
+    libraryFree(library);
+    free(library);
+}
+
+/* ============= Query Load ============= */
+
+static void* runQueries(void *arg) {
+    QueryLoad *load = (QueryLoad*)arg;
+    int *positions = (int*)malloc(MAX_BOOKS * sizeof(int));
+    uint64_t state = 7;
+    Query query;
+
+    if (positions == NULL) {
+        fprintf(stderr, "Memory allocation failed for query results\n");
+        exit(1);
+    }
+    Query_Init(&query);
+    query.limit = 50;
+
+    while (!__atomic_load_n(&load->stop, __ATOMIC_ACQUIRE) &&
+           load->count < MAX_SAMPLES) {
+        int year = 1900 + (int)(nextRandom(&state) % 120);
+        query.where = Predicate_Range(FIELD_YEAR, year, year + 2);
+
+        double start = nowSeconds();
+        Query_Execute(load->library, &query, positions, MAX_BOOKS);
+        load->samples[load->count++] = nowSeconds() - start;
+
+        Predicate_Free(query.where);
+    }
+
+    free(positions);
+    return NULL;
+}
+
+static int compareSeconds(const void *a, const void *b) {
+    double left = *(const double*)a;
+    double right = *(const double*)b;
+    return (left > right) - (left < right);
+}
+
+/* Print percentiles of the samples, which are sorted in place */
+static void printLatency(const char *label, double *samples, int count) {
+    if (count == 0) {
+        printf("  %-22s no queries ran\n", label);
+        return;
+    }
+
+    qsort(samples, (size_t)count, sizeof(double), compareSeconds);
+    printf("  %-22s p50 %7.1f us  p99 %7.1f us  p99.9 %7.1f us  max %8.1f us  (%d queries)\n",
+           label, samples[count / 2] * 1e6, samples[(int)(count * 0.99)] * 1e6,
+           samples[(int)(count * 0.999)] * 1e6, samples[count - 1] * 1e6, count);
+}
+
+static void startQueries(QueryLoad *load, pthread_t *thread) {
+    load->stop = 0;
+    load->count = 0;
+    if (pthread_create(thread, NULL, runQueries, load) != 0) {
+        fprintf(stderr, "Cannot start the query thread\n");
+        exit(1);
+    }
+}
+
+static void stopQueries(QueryLoad *load, pthread_t thread) {
+    __atomic_store_n(&load->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+}
+
+/* ============= I/O Runs ============= */
+
+/* Best of REPEATS saves; returns seconds */
+static double timeSave(const Library *library, const char *path,
+                       AioQueue *queue, int flags) {
+    double best = 0.0;
+
+    for (int r = 0; r < REPEATS; r++) {
+        double start = nowSeconds();
+        if (Catalog_Write(library, path, queue, flags) != 0) {
+            exit(1);
+        }
+        double elapsed = nowSeconds() - start;
+        if (r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+/* Best of REPEATS loads into a fresh library; returns seconds */
+static double timeLoad(const char *path, int expected, AioQueue *queue,
+                       int flags) {
+    double best = 0.0;
+
+    for (int r = 0; r < REPEATS; r++) {
+        Library *copy = newLibrary();
+        double start = nowSeconds();
+        int loaded = Catalog_Load(copy, path, queue, flags);
+        double elapsed = nowSeconds() - start;
+
+        if (loaded != expected) {
+            fprintf(stderr, "Loaded %d books, expected %d\n", loaded, expected);
+            exit(1);
+        }
+        deleteLibrary(copy);
+        if (r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+/* Log LOG_UPDATES updates, committing after each; returns seconds per update */
+static double timeLog(const char *path, AioQueue *queue, int books) {
+    Library *library = newLibrary();
+    uint64_t state = 11;
+    Wal wal;
+    Book book;
+
+    for (int i = 0; i < books; i++) {
+        makeBook(&book, &state, "Stored Title");
+        libraryAddBook(library, &book);
+    }
+    unlink(path);
+    if (Wal_Open(&wal, library, path, queue) != 0) {
+        exit(1);
+    }
+
+    double start = nowSeconds();
+    for (int i = 0; i < LOG_UPDATES; i++) {
+        book = library->books[nextRandom(&state) % (uint64_t)library->count];
+        book.quantity = (int)(nextRandom(&state) % 50);
+        libraryUpdateBook(library, &book);
+        Wal_Commit(&wal);
+    }
+    Wal_Sync(&wal);
+    double elapsed = nowSeconds() - start;
+
+    Wal_Close(&wal);
+    unlink(path);
+    deleteLibrary(library);
+    return elapsed / LOG_UPDATES;
+}
+
+int main(int argc, char *argv[]) {
+    static const AioBackend backends[] = {AIO_SYNC, AIO_THREADS, AIO_URING};
+    int books = argc > 1 ? atoi(argv[1]) : BOOKS;
+    int depth = argc > 2 ? atoi(argv[2]) : AIO_DEFAULT_DEPTH;
+    const char *dir = argc > 3 ? argv[3] : getenv("TMPDIR");
+    char path[4096];
+    char logPath[sizeof(path) + 4];
+
+    if (books < 1 || books > MAX_BOOKS || depth < 1 || depth > AIO_MAX_DEPTH) {
+        fprintf(stderr, "Usage: %s [books (1..%d)] [depth (1..%d)] [dir]\n",
+                argv[0], MAX_BOOKS, AIO_MAX_DEPTH);
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/catalog-io-%d.db", dir != NULL ? dir : "/tmp",
+             (int)getpid());
+    snprintf(logPath, sizeof(logPath), "%s.wal", path);
+
+    Library *library = newLibrary();
+    uint64_t state = 42;
+    Book book;
+    for (int i = 0; i < books; i++) {
+        makeBook(&book, &state, "Stored Title");
+        libraryAddBook(library, &book);
+    }
+
+    QueryLoad load = {library, 0, NULL, 0};
+    pthread_t thread;
+    load.samples = (double*)malloc(MAX_SAMPLES * sizeof(double));
+    if (load.samples == NULL) {
+        fprintf(stderr, "Memory allocation failed for samples\n");
+        return 1;
+    }
+
+    printf("Catalog I/O: %d books (%.1f MiB), queue depth %d, %s\n", books,
+           (double)books * sizeof(Book) / (1 << 20), depth, path);
+    printf("  %-18s %10s %10s %12s\n", "backend", "save ms", "load ms", "log us/op");
+
+    /* Each configuration's save-time query samples, printed afterwards */
+    double *underSave[6] = {NULL};
+    int underSaveCount[6] = {0};
+    double saveSeconds[6] = {0};
+    char labels[6][32];
+
+    for (int b = 0; b < 3; b++) {
+        for (int direct = 0; direct <= 1; direct++) {
+            int c = b * 2 + direct;
+            int flags = direct ? CATALOG_IO_DIRECT : 0;
+            AioQueue queue;
+
+            if (Aio_Init(&queue, backends[b], (unsigned)depth) != 0) {
+                return 1;
+            }
+            snprintf(labels[c], sizeof(labels[c]), "%s%s",
+                     Aio_BackendName(queue.backend), direct ? ", direct" : "");
+
+            double save = timeSave(library, path, &queue, flags);
+            double loadTime = timeLoad(path, library->count, &queue, flags);
+            double logTime = timeLog(logPath, &queue, books < 1000 ? books : 1000);
+            printf("  %-18s %10.2f %10.2f %12.2f\n", labels[c], save * 1e3,
+                   loadTime * 1e3, logTime * 1e6);
+
+            startQueries(&load, &thread);
+            double start = nowSeconds();
+            for (int s = 0; s < SAVES_UNDER_LOAD; s++) {
+                Catalog_Write(library, path, &queue, flags);
+            }
+            saveSeconds[c] = nowSeconds() - start;
+            stopQueries(&load, thread);
+
+            underSave[c] = (double*)malloc((size_t)load.count * sizeof(double) + 1);
+            if (underSave[c] == NULL) {
+                fprintf(stderr, "Memory allocation failed for samples\n");
+                return 1;
+            }
+            memcpy(underSave[c], load.samples, (size_t)load.count * sizeof(double));
+            underSaveCount[c] = load.count;
+            Aio_Free(&queue);
+        }
+    }
+
+    /* Baseline: the same queries for as long as the slowest save run */
+    double longest = 0.0;
+    for (int c = 0; c < 6; c++) {
+        longest = saveSeconds[c] > longest ? saveSeconds[c] : longest;
+    }
+    startQueries(&load, &thread);
+    usleep((useconds_t)(longest * 1e6));
+    stopQueries(&load, thread);
+
+    printf("Query latency while saving:\n");
+    printLatency("idle", load.samples, load.count);
+    for (int c = 0; c < 6; c++) {
+        printLatency(labels[c], underSave[c], underSaveCount[c]);
+        free(underSave[c]);
+    }
+
+    unlink(path);
+    free(load.samples);
+    deleteLibrary(library);
+    return 0;
+}
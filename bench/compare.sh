@@ -0,0 +1,39 @@
+#!/bin/sh
+# Compare two bench result files: bench/compare.sh BASE NEW
+# Prints ns/op for each benchmark present in both and the change in
+# percent (positive means NEW is slower). A file may hold several runs
+# appended together; the fastest row for each benchmark is used. When
+# both files carry data TLB misses per op for a benchmark, those of the
+# fastest rows are printed too.
+set -e
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 BASE NEW" >&2
+    exit 1
+fi
+
+awk -F '\t' '
+    /^#/ || $1 == "benchmark" { next }
+    FNR == NR {
+        key = $1 "/" $2
+        if (!(key in base) || $5 + 0 < base[key]) { base[key] = $5 + 0; baseTlb[key] = $7 }
+        next
+    }
+    ($1 "/" $2) in base {
+        key = $1 "/" $2
+        if (!(key in new)) order[++n] = key
+        if (!(key in new) || $5 + 0 < new[key]) { new[key] = $5 + 0; newTlb[key] = $7 }
+    }
+    END {
+        for (i = 1; i <= n; i++) {
+            key = order[i]
+            old = base[key]
+            change = old > 0 ? (new[key] - old) * 100 / old : 0
+            printf "%-28s %12.1f %12.1f %+8.1f%%", key, old, new[key], change
+            if (baseTlb[key] != "" && baseTlb[key] != "-" &&
+                newTlb[key] != "" && newTlb[key] != "-") {
+                printf "  dtlb/op %.3f -> %.3f", baseTlb[key], newTlb[key]
+            }
+            printf "\n"
+        }
+    }' "$1" "$2" | { printf "%-28s %12s %12s %9s\n" "benchmark" "base_ns" "new_ns" "change"; cat; }
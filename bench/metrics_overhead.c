@@ -0,0 +1,325 @@
+/**
+ * @file metrics_overhead.c
+ * @brief Measure the cost of the METRICS.h hooks
+ *
+ * bench/metrics_overhead.sh builds the workloads in this file twice,
+ * with and without -DMETRICS_DISABLED, each into a shared object
+ * together with the library, and builds this file again with
+ * -DOVERHEAD_DRIVER as the program that loads both objects. Each object
+ * keeps its own trees and library between calls, and the driver times
+ * short batches of one workload from each object back to back, swapping
+ * which goes first. Both builds thus run in the same process and a slow
+ * stretch of the machine hits both halves of a pair alike: separate
+ * processes of a single build differed by up to 60% on a shared VM.
+ *
+ * Reported per workload: the best time per operation of each build and
+ * the median of the per-pair overheads.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Workloads, in the order a pair runs them */
+enum {
+    WORK_RB_INSERT = 0,
+    WORK_RB_SEARCH,
+    WORK_RB_DELETE,
+    WORK_RB_SEARCH_HOT,
+    WORK_CATALOG_CHURN,
+    WORK_QUERY_TOPK,
+    WORKLOADS
+};
+
+#ifndef OVERHEAD_DRIVER
+
+#include "../LIBRARY.h"
+#include "../QUERY.h"
+#include "../RBTREE.h"
+#include "bench_util.h"
+
+#define TREE_KEYS 1000000             /* Keys resident in the tree */
+#define TREE_BATCH 100000             /* Keys inserted, searched, deleted per pair */
+#define HOT_KEYS 1000
+#define HOT_SEARCHES 2000000
+#define CATALOG_ROUNDS 100
+#define QUERY_ROUNDS 20000
+
+/* State each build keeps between batches */
+static struct {
+    int *keys;                        /* TREE_KEYS resident, then a batch */
+    RBTree *tree;
+    RBTree *hot;
+    Library *library;
+    Query query;
+    uint64_t random;
+} bench;
+
+static int payload = 1;
+
+static double runTreeInsert(void) {
+    double start = nowSeconds();
+    for (int i = TREE_KEYS; i < TREE_KEYS + TREE_BATCH; i++) {
+        RBTree_Insert(bench.tree, bench.keys[i], &payload);
+    }
+    return nowSeconds() - start;
+}
+
+static double runTreeSearch(void) {
+    volatile uintptr_t sink = 0;
+
+    double start = nowSeconds();
+    for (int i = 0; i < TREE_BATCH; i++) {
+        int k = (int)(nextRandom(&bench.random) % (TREE_KEYS + TREE_BATCH));
+        sink += (uintptr_t)RBTree_Search(bench.tree, bench.keys[k]);
+    }
+    (void)sink;
+    return nowSeconds() - start;
+}
+
+/* Takes the batch back out, so every pair starts from the same tree */
+static double runTreeDelete(void) {
+    double start = nowSeconds();
+    for (int i = TREE_KEYS; i < TREE_KEYS + TREE_BATCH; i++) {
+        RBTree_Delete(bench.tree, bench.keys[i], NULL);
+    }
+    return nowSeconds() - start;
+}
+
+/*
+ * Searches of a tree that stays in cache: the hooks' own instructions
+ * are not hidden behind cache misses here
+ */
+static double runHotSearch(void) {
+    volatile uintptr_t sink = 0;
+
+    double start = nowSeconds();
+    for (int i = 0; i < HOT_SEARCHES; i++) {
+        sink += (uintptr_t)RBTree_Search(bench.hot, bench.keys[i % HOT_KEYS]);
+    }
+    (void)sink;
+    return nowSeconds() - start;
+}
+
+/* Fill the library, update a third of it, delete half; ops done in *ops */
+static double runCatalog(double *ops) {
+    Library *library = bench.library;
+    Book book;
+
+    double start = nowSeconds();
+    for (int round = 0; round < CATALOG_ROUNDS; round++) {
+        while (library->count < MAX_BOOKS) {
+            memset(&book, 0, sizeof(book));
+            snprintf(book.title, sizeof(book.title), "Title %u",
+                     (uint32_t)(nextRandom(&bench.random) % 1000));
+            snprintf(book.author, sizeof(book.author), "Author %u",
+                     (uint32_t)(nextRandom(&bench.random) % 50));
+            snprintf(book.isbn, sizeof(book.isbn), "978%010u",
+                     (uint32_t)nextRandom(&bench.random));
+            book.year = 1900 + (int)(nextRandom(&bench.random) % 125);
+            book.price = (float)(nextRandom(&bench.random) % 10000) / 100.0f;
+            book.quantity = (int)(nextRandom(&bench.random) % 20);
+            libraryAddBook(library, &book);
+            (*ops)++;
+        }
+        for (int i = 0; i < library->count; i += 3) {
+            book = library->books[i];
+            book.price += 1.0f;
+            libraryUpdateBook(library, &book);
+            (*ops)++;
+        }
+        for (int i = 0; i < MAX_BOOKS / 2; i++) {
+            uint32_t victim = (uint32_t)(nextRandom(&bench.random) % (uint64_t)library->count);
+            libraryDeleteBook(library, library->books[victim].id);
+            (*ops)++;
+        }
+    }
+    return nowSeconds() - start;
+}
+
+static double runQuery(void) {
+    int positions[MAX_BOOKS];
+
+    double start = nowSeconds();
+    for (int i = 0; i < QUERY_ROUNDS; i++) {
+        Query_Execute(bench.library, &bench.query, positions, MAX_BOOKS);
+    }
+    return nowSeconds() - start;
+}
+
+/**
+ * Build the trees and the library the workloads run against
+ * @return: 0 on success, -1 on allocation failure
+ */
+static int setUp(void) {
+    bench.keys = (int*)malloc((TREE_KEYS + TREE_BATCH) * sizeof(int));
+    bench.tree = RBTree_Create();
+    bench.hot = RBTree_Create();
+    bench.library = (Library*)calloc(1, sizeof(Library));
+    if (bench.keys == NULL || bench.tree == NULL || bench.hot == NULL ||
+        bench.library == NULL || libraryInit(bench.library) != 0) {
+        fprintf(stderr, "Failed to set up the benchmark\n");
+        return -1;
+    }
+    /* An odd multiplier permutes 31-bit values: scattered, distinct keys */
+    for (int i = 0; i < TREE_KEYS + TREE_BATCH; i++) {
+        bench.keys[i] = (int)(((uint32_t)i * 2654435761u) & 0x7FFFFFFF);
+    }
+    for (int i = 0; i < TREE_KEYS; i++) {
+        RBTree_Insert(bench.tree, bench.keys[i], &payload);
+    }
+    for (int i = 0; i < HOT_KEYS; i++) {
+        RBTree_Insert(bench.hot, bench.keys[i], &payload);
+    }
+
+    bench.random = 12345;
+    Query_Init(&bench.query);
+    bench.query.where = Predicate_And(Predicate_Range(FIELD_YEAR, 1950, 2000),
+                                      Predicate_Range(FIELD_PRICE, 0, 50));
+    bench.query.ordered = 1;
+    bench.query.orderBy = FIELD_TITLE;
+    bench.query.limit = 10;
+
+    double ops = 0;
+    runCatalog(&ops);
+    return 0;
+}
+
+/**
+ * Run one batch of a workload
+ * @return: Time per operation in nanoseconds, or -1 on failure
+ */
+__attribute__((visibility("default"))) double Overhead_Run(int workload) {
+    double ops = 0;
+    double seconds = 0;
+
+    if (bench.keys == NULL && setUp() != 0) {
+        return -1;
+    }
+
+    switch (workload) {
+    case WORK_RB_INSERT:
+        seconds = runTreeInsert();
+        ops = TREE_BATCH;
+        break;
+    case WORK_RB_SEARCH:
+        seconds = runTreeSearch();
+        ops = TREE_BATCH;
+        break;
+    case WORK_RB_DELETE:
+        seconds = runTreeDelete();
+        ops = TREE_BATCH;
+        break;
+    case WORK_RB_SEARCH_HOT:
+        seconds = runHotSearch();
+        ops = HOT_SEARCHES;
+        break;
+    case WORK_CATALOG_CHURN:
+        seconds = runCatalog(&ops);
+        break;
+    case WORK_QUERY_TOPK:
+        seconds = runQuery();
+        ops = QUERY_ROUNDS;
+        break;
+    default:
+        return -1;
+    }
+
+    return seconds * 1e9 / ops;
+}
+
+#else /* OVERHEAD_DRIVER */
+
+#include <dlfcn.h>
+
+#define DEFAULT_PAIRS 100
+
+typedef double (*RunFunction)(int workload);
+
+static const char *workloadNames[WORKLOADS] = {
+    "rb_insert", "rb_search", "rb_delete",
+    "rb_search_hot", "catalog_churn", "query_topk"
+};
+
+static RunFunction loadRun(const char *path) {
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "Cannot load %s: %s\n", path, dlerror());
+        return NULL;
+    }
+    RunFunction run = (RunFunction)dlsym(handle, "Overhead_Run");
+    if (run == NULL) {
+        fprintf(stderr, "%s has no Overhead_Run\n", path);
+    }
+    return run;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s OFF.so ON.so [PAIRS]\n", argv[0]);
+        return 1;
+    }
+    int pairs = argc > 3 ? atoi(argv[3]) : DEFAULT_PAIRS;
+    if (pairs < 1) {
+        pairs = DEFAULT_PAIRS;
+    }
+
+    RunFunction off = loadRun(argv[1]);
+    RunFunction on = loadRun(argv[2]);
+    double *ratios = (double*)malloc((size_t)pairs * WORKLOADS * sizeof(double));
+    double bestOff[WORKLOADS] = {0};
+    double bestOn[WORKLOADS] = {0};
+
+    if (off == NULL || on == NULL || ratios == NULL) {
+        return 1;
+    }
+
+    for (int p = 0; p < pairs; p++) {
+        for (int w = 0; w < WORKLOADS; w++) {
+            double offNs;
+            double onNs;
+
+            if (p % 2 == 0) {
+                offNs = off(w);
+                onNs = on(w);
+            } else {
+                onNs = on(w);
+                offNs = off(w);
+            }
+            if (offNs <= 0 || onNs <= 0) {
+                return 1;
+            }
+            if (p == 0 || offNs < bestOff[w]) {
+                bestOff[w] = offNs;
+            }
+            if (p == 0 || onNs < bestOn[w]) {
+                bestOn[w] = onNs;
+            }
+            ratios[w * pairs + p] = (onNs - offNs) * 100.0 / offNs;
+        }
+    }
+
+    printf("%-16s %10s %10s %9s\n", "workload", "off_ns", "on_ns", "overhead");
+    for (int w = 0; w < WORKLOADS; w++) {
+        double *mine = &ratios[w * pairs];
+
+        qsort(mine, (size_t)pairs, sizeof(double), compareDoubles);
+        double median = pairs % 2 ? mine[pairs / 2]
+                                  : (mine[pairs / 2 - 1] + mine[pairs / 2]) / 2;
+        printf("%-16s %10.2f %10.2f %8.2f%%\n", workloadNames[w],
+               bestOff[w], bestOn[w], median);
+    }
+
+    free(ratios);
+    return 0;
+}
+
+#endif /* OVERHEAD_DRIVER */
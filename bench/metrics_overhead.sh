@@ -0,0 +1,29 @@
+#!/bin/sh
+# Build the workloads of bench/metrics_overhead.c with and without
+# -DMETRICS_DISABLED, each into a shared object, and print the
+# per-operation cost of the metrics hooks from one process that runs
+# both. ON_FLAGS adds flags to the instrumented build only, e.g.
+# ON_FLAGS=-DMETRICS_TREE to include the tree-level timers. PAIRS sets
+# how many batches of each workload are timed per build.
+set -e
+
+cd "$(dirname "$0")/.."
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-"-O2 -std=gnu11 -pthread"}
+SOURCES="bench/metrics_overhead.c LIBRARY.c INDEX.c BLOOM.c STRKEY.c RBTREE.c QUERY.c SORT.c METRICS.c TEXT.c PAGES.c"
+OUT=${TMPDIR:-/tmp}/metrics_overhead.$$
+PAIRS=${PAIRS:-100}
+
+# Hidden symbols keep each object's calls inside its own copy of the
+# library and let it reach its globals without the GOT; initial-exec TLS
+# gives the hooks' per-thread state the same one-instruction access as
+# in a program, instead of a __tls_get_addr call
+SHARED="-fPIC -shared -fvisibility=hidden -ftls-model=initial-exec"
+$CC $CFLAGS $SHARED -DMETRICS_DISABLED $SOURCES -o "$OUT.off.so"
+$CC $CFLAGS $SHARED ${ON_FLAGS:-} $SOURCES -o "$OUT.on.so"
+$CC $CFLAGS -DOVERHEAD_DRIVER bench/metrics_overhead.c -o "$OUT" -ldl
+
+status=0
+"$OUT" "$OUT.off.so" "$OUT.on.so" "$PAIRS" || status=$?
+rm -f "$OUT" "$OUT.off.so" "$OUT.on.so"
+exit $status
@@ -0,0 +1,262 @@
+/**
+ * @file replica_lag.c
+ * @brief Replication lag and throughput between two local processes
+ *
+ * The parent process loads BOOKS books, starts a ReplicaLeader and
+ * forks a follower process that bootstraps from it. The parent then
+ * runs WRITES mutations (70% updates, 20% adds, 10% deletes; a
+ * delete shifts the rows after it, so it is the costly kind) while the follower applies them, and once the follower has
+ * applied the last LSN it reports its lag counters back over a pipe.
+ *
+ * Prints the bootstrap time, the leader's cost per write without a
+ * leader, with a leader logging but no follower, and with a follower
+ * applying (on a machine with fewer cores than processes the last one
+ * includes time lost to the follower), how long the follower took to catch up after
+ * the last write, its apply throughput and the mean and worst delay
+ * from a write being logged to it being visible on the follower.
+ *
+ * Usage: replica_lag [books] [writes]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../LIBRARY.h"
+#include "../REPLICA.h"
+#include "bench_util.h"
+
+#define BOOKS 10000
+#define WRITES 50000
+
+/* What the follower reports back */
+typedef struct {
+    double bootstrapSeconds;
+    int caughtUp;
+    ReplicaStatus status;
+    int count;                        /* Books on the follower at the end */
+    uint64_t checksum;                /* Of their contents */
+} FollowerReport;
+
+static uint64_t hashBytes(uint64_t hash, const void *bytes, size_t length) {
+    const unsigned char *p = (const unsigned char*)bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Contents of a library, field by field so padding does not count */
+static uint64_t checksum(const Library *library) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (int i = 0; i < library->count; i++) {
+        const Book *book = &library->books[i];
+        hash = hashBytes(hash, &book->id, sizeof(book->id));
+        hash = hashBytes(hash, book->title, strlen(book->title));
+        hash = hashBytes(hash, book->author, strlen(book->author));
+        hash = hashBytes(hash, book->isbn, strlen(book->isbn));
+        hash = hashBytes(hash, &book->year, sizeof(book->year));
+        hash = hashBytes(hash, &book->price, sizeof(book->price));
+        hash = hashBytes(hash, &book->quantity, sizeof(book->quantity));
+    }
+    return hash;
+}
+
+static Library* loadLibrary(int books, uint64_t *state) {
+    Library *library = (Library*)calloc(1, sizeof(Library));
+    Book book;
+
+    if (library == NULL || libraryInit(library) != 0) {
+        fprintf(stderr, "Failed to initialize library\n");
+        exit(1);
+    }
+    for (int i = 0; i < books; i++) {
+        makeBook(&book, state, "Replicated Title");
+        libraryAddBook(library, &book);
+    }
+    return library;
+}
+
+/* Mixed writes; returns seconds taken */
+static double runWrites(Library *library, int writes, uint64_t *state) {
+    Book book;
+
+    double start = nowSeconds();
+    for (int i = 0; i < writes; i++) {
+        uint64_t dice = nextRandom(state) % 10;
+        const Book *victim = &library->books[nextRandom(state) % (uint64_t)library->count];
+
+        if (dice < 7) {
+            book = *victim;
+            book.quantity = (int)(nextRandom(state) % 50);
+            book.price = (float)(100 + nextRandom(state) % 9900) / 100.0f;
+            libraryUpdateBook(library, &book);
+        } else if (dice < 9 || library->count < 2) {
+            makeBook(&book, state, "Replicated Title");
+            libraryAddBook(library, &book);
+        } else {
+            libraryDeleteBook(library, victim->id);
+        }
+    }
+    return nowSeconds() - start;
+}
+
+static void readOrDie(int fd, void *buffer, size_t length) {
+    char *bytes = (char*)buffer;
+    while (length > 0) {
+        ssize_t got = read(fd, bytes, length);
+        if (got <= 0) {
+            fprintf(stderr, "Replica benchmark pipe closed early\n");
+            exit(1);
+        }
+        bytes += got;
+        length -= (size_t)got;
+    }
+}
+
+static void writeOrDie(int fd, const void *buffer, size_t length) {
+    if (write(fd, buffer, length) != (ssize_t)length) {
+        fprintf(stderr, "Replica benchmark pipe write failed\n");
+        exit(1);
+    }
+}
+
+static void runFollower(const char *path, int commands, int reports) {
+    Library *library = (Library*)calloc(1, sizeof(Library));
+    ReplicaFollower follower;
+    FollowerReport report;
+    uint64_t target;
+    char go;
+
+    memset(&report, 0, sizeof(report));
+    if (library == NULL || libraryInit(library) != 0) {
+        exit(1);
+    }
+    readOrDie(commands, &go, 1);
+
+    double start = nowSeconds();
+    if (ReplicaFollower_Start(&follower, library, path) != 0) {
+        exit(1);
+    }
+    report.bootstrapSeconds = nowSeconds() - start;
+    writeOrDie(reports, &report, sizeof(report));
+
+    readOrDie(commands, &target, sizeof(target));
+    report.caughtUp = ReplicaFollower_WaitFor(&follower, target, 60000);
+    ReplicaFollower_GetStatus(&follower, &report.status);
+    ReplicaFollower_ReadLock(&follower);
+    report.count = library->count;
+    report.checksum = checksum(library);
+    ReplicaFollower_ReadUnlock(&follower);
+    writeOrDie(reports, &report, sizeof(report));
+
+    ReplicaFollower_Stop(&follower);
+    libraryFree(library);
+    free(library);
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    int books = argc > 1 ? atoi(argv[1]) : BOOKS;
+    int writes = argc > 2 ? atoi(argv[2]) : WRITES;
+    char path[64];
+    int commands[2];
+    int reports[2];
+
+    if (books < 2 || books > MAX_BOOKS / 2 || writes < 1) {
+        fprintf(stderr, "Usage: %s [books (2..%d)] [writes]\n", argv[0], MAX_BOOKS / 2);
+        return 1;
+    }
+    snprintf(path, sizeof(path), "/tmp/replica-lag-%d.sock", (int)getpid());
+
+    /* Fork before any thread exists */
+    if (pipe(commands) != 0 || pipe(reports) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (child == 0) {
+        close(commands[1]);
+        close(reports[0]);
+        runFollower(path, commands[0], reports[1]);
+    }
+    close(commands[0]);
+    close(reports[1]);
+
+    /* Baseline: the same writes with nobody listening */
+    uint64_t state = 42;
+    Library *plain = loadLibrary(books, &state);
+    double plainSeconds = runWrites(plain, writes, &state);
+    libraryFree(plain);
+    free(plain);
+
+    /* Logging alone: a leader with no follower connected */
+    state = 42;
+    Library *logged = loadLibrary(books, &state);
+    ReplicaLeader idle;
+    char idlePath[80];
+    snprintf(idlePath, sizeof(idlePath), "%s.idle", path);
+    if (ReplicaLeader_Start(&idle, logged, idlePath) != 0) {
+        return 1;
+    }
+    double loggedSeconds = runWrites(logged, writes, &state);
+    ReplicaLeader_Stop(&idle);
+    libraryFree(logged);
+    free(logged);
+
+    state = 42;
+    Library *library = loadLibrary(books, &state);
+    ReplicaLeader leader;
+    FollowerReport report;
+    if (ReplicaLeader_Start(&leader, library, path) != 0) {
+        return 1;
+    }
+
+    writeOrDie(commands[1], "g", 1);
+    readOrDie(reports[0], &report, sizeof(report));
+
+    double start = nowSeconds();
+    double writeSeconds = runWrites(library, writes, &state);
+    uint64_t lsn;
+    int followers;
+    ReplicaLeader_GetStatus(&leader, &lsn, &followers);
+    writeOrDie(commands[1], &lsn, sizeof(lsn));
+    readOrDie(reports[0], &report, sizeof(report));
+    double caughtUp = nowSeconds() - start;
+
+    waitpid(child, NULL, 0);
+    ReplicaLeader_Stop(&leader);
+
+    printf("Replica: %d books, %d writes, 1 follower process\n", books, writes);
+    printf("  bootstrap        %8.1f ms\n", report.bootstrapSeconds * 1e3);
+    printf("  write, no leader %8.1f us\n", plainSeconds * 1e6 / writes);
+    printf("  write, logged    %8.1f us  (%+.1f%%, no follower connected)\n",
+           loggedSeconds * 1e6 / writes, (loggedSeconds / plainSeconds - 1.0) * 100.0);
+    printf("  write, followed  %8.1f us  (%+.1f%%, follower process applying)\n",
+           writeSeconds * 1e6 / writes, (writeSeconds / plainSeconds - 1.0) * 100.0);
+    printf("  caught up        %8.1f ms after the last write%s\n",
+           (caughtUp - writeSeconds) * 1e3, report.caughtUp ? "" : " (TIMED OUT)");
+    printf("  apply rate       %8.0f frames/s\n",
+           (double)report.status.frames / caughtUp);
+    printf("  lag per frame    %8.1f us mean, %.1f us max\n",
+           report.status.frames > 0
+               ? (double)report.status.totalLagNs / (double)report.status.frames / 1e3
+               : 0.0,
+           (double)report.status.maxLagNs / 1e3);
+    int same = report.count == library->count && report.checksum == checksum(library);
+    printf("  follower rows    %8d (leader %d), contents %s\n", report.count,
+           library->count, same ? "identical" : "DIFFER");
+
+    libraryFree(library);
+    free(library);
+    return report.caughtUp && same ? 0 : 1;
+}
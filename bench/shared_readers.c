@@ -0,0 +1,383 @@
+/**
+ * @file shared_readers.c
+ * @brief Reader processes querying a shared-memory catalog
+ *
+ * The parent loads BOOKS books and publishes them with
+ * SharedCatalog_Publish, then forks READERS processes that attach the
+ * segment read-only. Each reader first looks up random IDs and scans
+ * the whole catalog with the writer idle, then keeps looking books up
+ * while the parent runs WRITES mutations (70% updates, 20% adds, 10%
+ * deletes), and finally checksums every book it can see.
+ *
+ * Prints the attach time against building a private copy of the
+ * catalog, lookup and scan cost with the writer idle and busy, how
+ * often a reader had to retry a read section, the writer's cost per
+ * mutation unpublished, published with no readers and published with
+ * readers running (on a machine with fewer cores than processes the
+ * last includes time lost to the readers), and whether every reader
+ * ended up seeing exactly the parent's catalog.
+ *
+ * Usage: shared_readers [books] [writes] [readers]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../LIBRARY.h"
+#include "../SHARED.h"
+#include "bench_util.h"
+
+#define BOOKS 30000
+#define WRITES 20000
+#define READERS 2
+#define MAX_READERS 16
+#define LOOKUPS 1000000
+#define SCANS 5
+
+/* Phases the parent moves the readers through */
+enum { PHASE_START, PHASE_IDLE, PHASE_BUSY, PHASE_BUSY_DONE, PHASE_CHECK, PHASE_EXIT };
+
+/* What one reader measured */
+typedef struct {
+    double attachSeconds;
+    double copySeconds;               /* Building a private Library instead */
+    double idleLookupSeconds;
+    uint64_t idleLookups;
+    uint64_t idleHits;
+    double scanSeconds;
+    uint64_t scanned;
+    uint64_t busyLookups;
+    uint64_t busyRetries;
+    double busySeconds;
+    int busyScans;
+    int consistentScans;
+    int count;                        /* Books seen by the final scan */
+    uint64_t checksum;
+} ReaderReport;
+
+/* Anonymous shared page the parent and readers coordinate through */
+typedef struct {
+    int phase;
+    int done;                         /* Readers finished with the phase */
+    ReaderReport reports[MAX_READERS];
+} Control;
+
+/* Order-independent checksum of one book, since slots are unordered */
+static uint64_t hashBook(const Book *book) {
+    uint64_t hash = 14695981039346656037ull;
+    const char *fields[] = {book->title, book->author, book->isbn,
+                            book->titleFolded, book->authorFolded};
+    int numbers[] = {book->id, book->year, book->quantity};
+    float price = book->price;
+
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+        for (const char *p = fields[f]; *p != '\0'; p++) {
+            hash = (hash ^ (unsigned char)*p) * 1099511628211ull;
+        }
+        hash = (hash ^ 0xFF) * 1099511628211ull;
+    }
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        hash = (hash ^ (uint32_t)numbers[i]) * 1099511628211ull;
+    }
+    uint32_t bits;
+    memcpy(&bits, &price, sizeof(bits));
+    return (hash ^ bits) * 1099511628211ull;
+}
+
+typedef struct {
+    int count;
+    uint64_t checksum;
+    Book *books;                      /* Receives the books, or NULL */
+} ScanTotals;
+
+static int sumBook(void *context, const Book *book) {
+    ScanTotals *totals = (ScanTotals*)context;
+    totals->count++;
+    totals->checksum += hashBook(book);
+    if (totals->books != NULL) {
+        totals->books[totals->count - 1] = *book;
+    }
+    return 0;
+}
+
+static int compareIds(const void *a, const void *b) {
+    int left = ((const Book*)a)->id;
+    int right = ((const Book*)b)->id;
+    return (left > right) - (left < right);
+}
+
+static Library* loadLibrary(int books, uint64_t *state) {
+    Library *library = (Library*)calloc(1, sizeof(Library));
+    Book book;
+
+    if (library == NULL || libraryInit(library) != 0) {
+        fprintf(stderr, "Failed to initialize library\n");
+        exit(1);
+    }
+    for (int i = 0; i < books; i++) {
+        makeBook(&book, state, "Shared Title");
+        libraryAddBook(library, &book);
+    }
+    return library;
+}
+
+/* Mixed writes; returns seconds taken */
+static double runWrites(Library *library, int writes, uint64_t *state) {
+    Book book;
+
+    double start = nowSeconds();
+    for (int i = 0; i < writes; i++) {
+        uint64_t dice = nextRandom(state) % 10;
+        const Book *victim = &library->books[nextRandom(state) % (uint64_t)library->count];
+
+        if (dice < 7) {
+            book = *victim;
+            book.quantity = (int)(nextRandom(state) % 50);
+            book.price = (float)(100 + nextRandom(state) % 9900) / 100.0f;
+            if (dice == 0) {
+                makeBook(&book, state, "Shared Title");
+                book.id = victim->id;
+            }
+            libraryUpdateBook(library, &book);
+        } else if (dice < 9 || library->count < 2) {
+            makeBook(&book, state, "Shared Title");
+            libraryAddBook(library, &book);
+        } else {
+            libraryDeleteBook(library, victim->id);
+        }
+    }
+    return nowSeconds() - start;
+}
+
+static void waitPhase(Control *control, int phase) {
+    while (__atomic_load_n(&control->phase, __ATOMIC_ACQUIRE) < phase) {
+        usleep(200);
+    }
+}
+
+static void finishPhase(Control *control) {
+    __atomic_add_fetch(&control->done, 1, __ATOMIC_ACQ_REL);
+}
+
+static void runReader(Control *control, int index, const char *name) {
+    ReaderReport *report = &control->reports[index];
+    uint64_t state = 1000 + (uint64_t)index;
+    ScanTotals totals;
+    Book book;
+
+    waitPhase(control, PHASE_IDLE);
+
+    double start = nowSeconds();
+    SharedCatalog *shared = SharedCatalog_Attach(name);
+    report->attachSeconds = nowSeconds() - start;
+    if (shared == NULL) {
+        exit(1);
+    }
+
+    /* What every tool pays today: a private copy of the catalog */
+    Library *copy = (Library*)calloc(1, sizeof(Library));
+    memset(&totals, 0, sizeof(totals));
+    totals.books = (Book*)malloc(sizeof(Book) * MAX_BOOKS);
+    if (copy == NULL || totals.books == NULL || libraryInit(copy) != 0) {
+        exit(1);
+    }
+    start = nowSeconds();
+    SharedCatalog_Scan(shared, sumBook, &totals);
+    qsort(totals.books, (size_t)totals.count, sizeof(Book), compareIds);
+    for (int i = 0; i < totals.count; i++) {
+        libraryRestoreBook(copy, &totals.books[i]);
+    }
+    report->copySeconds = nowSeconds() - start;
+    free(totals.books);
+    libraryFree(copy);
+    free(copy);
+
+    int nextId;
+    SharedCatalog_Count(shared, &nextId);
+    start = nowSeconds();
+    for (int i = 0; i < LOOKUPS; i++) {
+        int id = 1 + (int)(nextRandom(&state) % (uint64_t)(nextId - 1));
+        report->idleHits += (uint64_t)SharedCatalog_FindById(shared, id, &book);
+    }
+    report->idleLookupSeconds = nowSeconds() - start;
+    report->idleLookups = LOOKUPS;
+
+    start = nowSeconds();
+    for (int i = 0; i < SCANS; i++) {
+        memset(&totals, 0, sizeof(totals));
+        SharedCatalog_Scan(shared, sumBook, &totals);
+        report->scanned += (uint64_t)totals.count;
+    }
+    report->scanSeconds = nowSeconds() - start;
+    finishPhase(control);
+
+    /* Lookups and scans while the parent mutates */
+    waitPhase(control, PHASE_BUSY);
+    uint64_t retries = shared->retries;
+    start = nowSeconds();
+    while (__atomic_load_n(&control->phase, __ATOMIC_ACQUIRE) == PHASE_BUSY) {
+        for (int i = 0; i < 1000; i++) {
+            SharedCatalog_Count(shared, &nextId);
+            int id = 1 + (int)(nextRandom(&state) % (uint64_t)(nextId - 1));
+            SharedCatalog_FindById(shared, id, &book);
+        }
+        report->busyLookups += 1000;
+        if (report->busyLookups % 100000 == 0) {
+            memset(&totals, 0, sizeof(totals));
+            report->consistentScans += SharedCatalog_Scan(shared, sumBook, &totals);
+            report->busyScans++;
+        }
+    }
+    report->busySeconds = nowSeconds() - start;
+    report->busyRetries = shared->retries - retries;
+    finishPhase(control);
+
+    waitPhase(control, PHASE_CHECK);
+    memset(&totals, 0, sizeof(totals));
+    SharedCatalog_Scan(shared, sumBook, &totals);
+    report->count = totals.count;
+    report->checksum = totals.checksum;
+    finishPhase(control);
+
+    SharedCatalog_Detach(shared);
+    exit(0);
+}
+
+static void enterPhase(Control *control, int phase, int readers, int wait) {
+    __atomic_store_n(&control->done, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&control->phase, phase, __ATOMIC_RELEASE);
+    while (wait && __atomic_load_n(&control->done, __ATOMIC_ACQUIRE) < readers) {
+        usleep(200);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int books = argc > 1 ? atoi(argv[1]) : BOOKS;
+    int writes = argc > 2 ? atoi(argv[2]) : WRITES;
+    int readers = argc > 3 ? atoi(argv[3]) : READERS;
+    char name[64];
+
+    if (books < 2 || books > MAX_BOOKS / 2 || writes < 1 ||
+        readers < 1 || readers > MAX_READERS) {
+        fprintf(stderr, "Usage: %s [books (2..%d)] [writes] [readers (1..%d)]\n",
+                argv[0], MAX_BOOKS / 2, MAX_READERS);
+        return 1;
+    }
+    snprintf(name, sizeof(name), "/shared-readers-%d", (int)getpid());
+
+    Control *control = (Control*)mmap(NULL, sizeof(Control), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (control == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(control, 0, sizeof(*control));
+
+    /* Baseline: the same writes with nothing published */
+    uint64_t state = 42;
+    Library *plain = loadLibrary(books, &state);
+    double plainSeconds = runWrites(plain, writes, &state);
+    libraryFree(plain);
+    free(plain);
+
+    /* Publishing alone: the observer keeping a segment current, no readers */
+    state = 42;
+    Library *unread = loadLibrary(books, &state);
+    char unreadName[80];
+    snprintf(unreadName, sizeof(unreadName), "%s-unread", name);
+    SharedCatalog *idle = SharedCatalog_Publish(unread, unreadName);
+    if (idle == NULL) {
+        return 1;
+    }
+    double unreadSeconds = runWrites(unread, writes, &state);
+    SharedCatalog_Unpublish(idle);
+    libraryFree(unread);
+    free(unread);
+
+    state = 42;
+    Library *library = loadLibrary(books, &state);
+    double start = nowSeconds();
+    SharedCatalog *shared = SharedCatalog_Publish(library, name);
+    double publishSeconds = nowSeconds() - start;
+    if (shared == NULL) {
+        return 1;
+    }
+
+    pid_t children[MAX_READERS];
+    for (int i = 0; i < readers; i++) {
+        children[i] = fork();
+        if (children[i] < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (children[i] == 0) {
+            runReader(control, i, name);
+        }
+    }
+
+    enterPhase(control, PHASE_IDLE, readers, 1);
+    enterPhase(control, PHASE_BUSY, readers, 0);
+    double writeSeconds = runWrites(library, writes, &state);
+    enterPhase(control, PHASE_BUSY_DONE, readers, 1);
+    enterPhase(control, PHASE_CHECK, readers, 1);
+    enterPhase(control, PHASE_EXIT, readers, 0);
+    for (int i = 0; i < readers; i++) {
+        waitpid(children[i], NULL, 0);
+    }
+
+    uint64_t expected = 0;
+    for (int i = 0; i < library->count; i++) {
+        expected += hashBook(&library->books[i]);
+    }
+
+    printf("Shared catalog: %d books, %d writes, %d reader process(es)\n",
+           books, writes, readers);
+    const SharedHeader *header = shared->header;
+    printf("  segment          %8.1f MiB in use of %.1f MiB mapped "
+           "(private Book array: %.1f MiB + indexes)\n",
+           (double)(header->arenaOffset + header->arenaUsed) / (1 << 20),
+           (double)shared->size / (1 << 20),
+           (double)library->count * sizeof(Book) / (1 << 20));
+    printf("  publish          %8.1f ms\n", publishSeconds * 1e3);
+    printf("  write, private   %8.2f us\n", plainSeconds * 1e6 / writes);
+    printf("  write, published %8.2f us  (%+.1f%%, no readers)\n",
+           unreadSeconds * 1e6 / writes, (unreadSeconds / plainSeconds - 1.0) * 100.0);
+    printf("  write, read      %8.2f us  (%+.1f%%, readers running)\n",
+           writeSeconds * 1e6 / writes, (writeSeconds / plainSeconds - 1.0) * 100.0);
+    printf("  arena            %8llu compaction(s), %.1f KiB live of %.1f KiB\n",
+           (unsigned long long)header->compactions,
+           (double)(header->arenaUsed - header->arenaDead) / 1024.0,
+           (double)header->arenaUsed / 1024.0);
+
+    int same = 1;
+    for (int i = 0; i < readers; i++) {
+        const ReaderReport *report = &control->reports[i];
+        printf("  reader %d: attach %.3f ms (private copy %.1f ms); "
+               "idle lookup %.0f ns (%.0f%% hit), scan %.1f ns/book\n",
+               i, report->attachSeconds * 1e3, report->copySeconds * 1e3,
+               report->idleLookupSeconds * 1e9 / (double)report->idleLookups,
+               100.0 * (double)report->idleHits / (double)report->idleLookups,
+               report->scanSeconds * 1e9 / (double)report->scanned);
+        printf("            busy lookup %.0f ns, %.3f%% retried, %d/%d scans consistent\n",
+               report->busySeconds * 1e9 / (double)(report->busyLookups ? report->busyLookups : 1),
+               100.0 * (double)report->busyRetries / (double)(report->busyLookups ? report->busyLookups : 1),
+               report->consistentScans, report->busyScans);
+        if (report->count != library->count || report->checksum != expected) {
+            same = 0;
+        }
+    }
+    printf("  readers see      %s (%d books)\n", same ? "the writer's catalog" : "DIFFERENT books",
+           library->count);
+
+    SharedCatalog_Unpublish(shared);
+    libraryFree(library);
+    free(library);
+    munmap(control, sizeof(Control));
+    return same ? 0 : 1;
+}
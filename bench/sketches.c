@@ -0,0 +1,261 @@
+/**
+ * @file sketches.c
+ * @brief Accuracy and cost of merged shard sketches (SKETCH.h)
+ *
+ * Generates BOOKS synthetic books spread over SHARDS shards, each
+ * summarized by its own CatalogSketches, along with SEARCHES searches
+ * whose terms follow a Zipf distribution. The shard sketches are then
+ * merged, and the merge is compared with the exact answers:
+ *
+ *   - distinct authors: HyperLogLog estimate against a bitmap count;
+ *   - price quantiles: KLL estimate against the sorted prices, as the
+ *     error in rank (the fraction of prices between the two values);
+ *   - search terms: count-min estimates of the most frequent terms
+ *     against their true counts, and whether the top list matches.
+ *
+ * A single sketch fed every book is reported beside the merge, to show
+ * that merging costs no accuracy. Update cost is reported per book and
+ * per search, and the memory of one shard's sketches next to the
+ * memory the exact answers took.
+ *
+ * Usage: sketches [books]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../LIBRARY.h"
+#include "../SKETCH.h"
+#include "../TEXT.h"
+#include "bench_util.h"
+
+#define BOOKS 4000000
+#define SHARDS 8
+#define AUTHORS 1500000               /* Authors drawn from; not all appear */
+#define TERMS 20000
+#define SEARCHES 1000000
+#define SHOWN_TERMS 5
+
+static const double quantiles[] = {0.01, 0.10, 0.25, 0.50, 0.75, 0.90, 0.99};
+
+#define COUNT_OF(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+static double nextUnit(uint64_t *state) {
+    return (double)(nextRandom(state) >> 11) / 9007199254740992.0;
+}
+
+/* A price spread like a real catalog: many cheap books, a long tail */
+static float makePrice(uint64_t *state) {
+    double u = nextUnit(state);
+    double cents = 299.0 + 1500.0 * (-log(1.0 - u)) + (double)(nextRandom(state) % 100);
+    return (float)(floor(cents) / 100.0);
+}
+
+static int compareFloats(const void *a, const void *b) {
+    float left = *(const float*)a;
+    float right = *(const float*)b;
+    return (left > right) - (left < right);
+}
+
+/* Fraction of sorted values at or below value */
+static double rankOf(const float *sorted, int count, float value) {
+    int low = 0, high = count;
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (sorted[middle] <= value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return (double)low / count;
+}
+
+/* Term of rank r (0 = most frequent) drawn from a Zipf distribution */
+static int drawTerm(const double *cumulative, uint64_t *state) {
+    double u = nextUnit(state) * cumulative[TERMS - 1];
+    int low = 0, high = TERMS - 1;
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (cumulative[middle] < u) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void termName(int term, char *name, size_t size) {
+    snprintf(name, size, "topic %d", term);
+}
+
+static void report(const char *label, const CatalogSketches *sketches, int distinct,
+                   const float *sorted, int count) {
+    double estimate = Hll_Estimate(&sketches->authors);
+    double worst = 0.0;
+
+    printf("%-8s authors ~%.0f (%+.2f%%)", label, estimate,
+           100.0 * (estimate - distinct) / distinct);
+    for (int q = 0; q < COUNT_OF(quantiles); q++) {
+        double error = fabs(rankOf(sorted, count,
+                                   Kll_Quantile(&sketches->prices, quantiles[q])) -
+                            quantiles[q]);
+        worst = error > worst ? error : worst;
+    }
+    printf("  price rank error max %.2f%%\n", 100.0 * worst);
+}
+
+int main(int argc, char *argv[]) {
+    int books = argc > 1 ? atoi(argv[1]) : BOOKS;
+    CatalogSketches *shards = (CatalogSketches*)malloc(SHARDS * sizeof(CatalogSketches));
+    CatalogSketches *merged = (CatalogSketches*)malloc(sizeof(CatalogSketches));
+    CatalogSketches *single = (CatalogSketches*)malloc(sizeof(CatalogSketches));
+    uint8_t *seen = (uint8_t*)calloc(AUTHORS / 8 + 1, 1);
+    float *prices = (float*)malloc((size_t)(books > 0 ? books : 1) * sizeof(float));
+    double *cumulative = (double*)malloc(TERMS * sizeof(double));
+    uint32_t *termCounts = (uint32_t*)calloc(TERMS, sizeof(uint32_t));
+    char (*names)[COUNT_MIN_TERM_LEN] = malloc(TERMS * sizeof(*names));
+    int *drawn = (int*)malloc(SEARCHES * sizeof(int));
+    uint64_t state = 0x2545F4914F6CDD1Dull;
+    int distinct = 0;
+
+    if (books <= 0) {
+        fprintf(stderr, "Usage: %s [books]\n", argv[0]);
+        return 1;
+    }
+    if (shards == NULL || merged == NULL || single == NULL || seen == NULL ||
+        prices == NULL || cumulative == NULL || termCounts == NULL || names == NULL ||
+        drawn == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    for (int s = 0; s < SHARDS; s++) {
+        CatalogSketches_Init(&shards[s], NULL);
+    }
+    CatalogSketches_Init(single, NULL);
+
+    /* Books, generated up front so only sketch updates are timed */
+    Book *batch = (Book*)malloc((size_t)books * sizeof(Book));
+    if (batch == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    for (int i = 0; i < books; i++) {
+        uint32_t author = (uint32_t)(nextRandom(&state) % AUTHORS);
+
+        memset(&batch[i], 0, sizeof(Book));
+        snprintf(batch[i].author, sizeof(batch[i].author), "Author %u", author);
+        Text_Fold(batch[i].author, batch[i].authorFolded, sizeof(batch[i].authorFolded));
+        batch[i].price = makePrice(&state);
+        prices[i] = batch[i].price;
+        if (!(seen[author / 8] & (1u << (author % 8)))) {
+            seen[author / 8] |= (uint8_t)(1u << (author % 8));
+            distinct++;
+        }
+    }
+
+    double start = nowSeconds();
+    for (int i = 0; i < books; i++) {
+        CatalogSketches_AddBook(&shards[i % SHARDS], &batch[i]);
+    }
+    double bookSeconds = nowSeconds() - start;
+    for (int i = 0; i < books; i++) {
+        CatalogSketches_AddBook(single, &batch[i]);
+    }
+    free(batch);
+
+    /* Searches, Zipf-distributed over TERMS terms */
+    double total = 0.0;
+    for (int t = 0; t < TERMS; t++) {
+        total += 1.0 / (t + 1);
+        cumulative[t] = total;
+    }
+    for (int t = 0; t < TERMS; t++) {
+        termName(t, names[t], sizeof(names[t]));
+    }
+    for (int i = 0; i < SEARCHES; i++) {
+        drawn[i] = drawTerm(cumulative, &state);
+        termCounts[drawn[i]]++;
+    }
+    start = nowSeconds();
+    for (int i = 0; i < SEARCHES; i++) {
+        CatalogSketches_RecordSearch(&shards[i % SHARDS], names[drawn[i]]);
+    }
+    double searchSeconds = nowSeconds() - start;
+
+    start = nowSeconds();
+    CatalogSketches_Init(merged, NULL);
+    for (int s = 0; s < SHARDS; s++) {
+        CatalogSketches_Merge(merged, &shards[s]);
+    }
+    double mergeSeconds = nowSeconds() - start;
+
+    qsort(prices, (size_t)books, sizeof(float), compareFloats);
+
+    printf("%d books over %d shards, %d distinct authors, %d searches of %d terms\n",
+           books, SHARDS, distinct, SEARCHES, TERMS);
+    printf("update: %.0f ns per book, %.0f ns per search; merge of %d shards: %.2f ms\n",
+           1e9 * bookSeconds / books, 1e9 * searchSeconds / SEARCHES, SHARDS,
+           1e3 * mergeSeconds);
+    printf("memory: %zu bytes of sketches per shard; exact answers held %zu bytes\n",
+           sizeof(CatalogSketches),
+           (size_t)books * sizeof(float) + AUTHORS / 8 + TERMS * sizeof(uint32_t));
+
+    report("merged", merged, distinct, prices, books);
+    report("single", single, distinct, prices, books);
+
+    printf("quantile    exact  merged\n");
+    for (int q = 0; q < COUNT_OF(quantiles); q++) {
+        int at = (int)(quantiles[q] * (books - 1));
+        printf("  p%-4g %8.2f %8.2f\n", 100 * quantiles[q], prices[at],
+               Kll_Quantile(&merged->prices, quantiles[q]));
+    }
+
+    printf("top terms   exact  merged\n");
+    int topMatches = 0;
+    for (int i = 0; i < merged->searches.topCount; i++) {
+        const CountMinTerm *top = &merged->searches.top[i];
+        int rank = -1;
+
+        sscanf(top->term, "topic %d", &rank);
+        topMatches += rank == i;
+        if (i < SHOWN_TERMS) {
+            printf("  %-8s %7u %7u\n", top->term,
+                   rank >= 0 && rank < TERMS ? termCounts[rank] : 0, top->estimate);
+        }
+    }
+    printf("top %d list in true order: %d of %d\n", COUNT_MIN_TOP, topMatches,
+           merged->searches.topCount);
+
+    uint32_t worstOver = 0;
+    for (int t = 0; t < TERMS; t++) {
+        uint32_t estimate = CountMin_Estimate(&merged->searches, names[t]);
+        if (estimate < termCounts[t]) {
+            fprintf(stderr, "count-min undercounted \"%s\"\n", names[t]);
+            return 1;
+        }
+        worstOver = estimate - termCounts[t] > worstOver ? estimate - termCounts[t]
+                                                         : worstOver;
+    }
+    printf("count-min worst overcount: %u (%.3f%% of searches)\n", worstOver,
+           100.0 * worstOver / SEARCHES);
+
+    free(shards);
+    free(merged);
+    free(single);
+    free(seen);
+    free(prices);
+    free(cumulative);
+    free(termCounts);
+    free(names);
+    free(drawn);
+    return 0;
+}
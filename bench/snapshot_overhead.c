@@ -0,0 +1,147 @@
+/**
+ * @file snapshot_overhead.c
+ * @brief Cost of persistent (copy-on-write) trees against in-place ones
+ *
+ * Inserts KEYS random keys and deletes them again, with the in-place
+ * RBTree and with PRBTree under three snapshot rates: never, every
+ * 1000 writes and every write (the newest snapshot is kept and the
+ * previous one released, as a running report would). Prints the best
+ * time per write over REPEATS runs, the slowdown against RBTree, the
+ * peak bytes per key and the nodes copied per write.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../PRBTREE.h"
+#include "../RBTREE.h"
+#include "bench_util.h"
+
+#define KEYS 1000000
+#define REPEATS 3
+
+typedef struct {
+    const char *name;
+    long snapshotEvery;               /* 0: in-place RBTree; -1: no snapshots */
+    double insertNs;
+    double deleteNs;
+    double bytesPerKey;
+    double copiesPerWrite;
+} Variant;
+
+static void keepBest(double *best, double ns) {
+    if (*best == 0.0 || ns < *best) {
+        *best = ns;
+    }
+}
+
+static void runInPlace(Variant *variant, const int *keys) {
+    static int payload;
+    RBTree *tree = RBTree_Create();
+
+    double start = nowSeconds();
+    for (int i = 0; i < KEYS; i++) {
+        RBTree_Insert(tree, keys[i], &payload);
+    }
+    keepBest(&variant->insertNs, (nowSeconds() - start) * 1e9 / KEYS);
+    variant->bytesPerKey = (double)sizeof(RBNode);
+
+    start = nowSeconds();
+    for (int i = KEYS - 1; i >= 0; i--) {
+        RBTree_Delete(tree, keys[i], NULL);
+    }
+    keepBest(&variant->deleteNs, (nowSeconds() - start) * 1e9 / KEYS);
+
+    RBTree_Destroy(tree, NULL);
+}
+
+/* One write of the persistent run, taking a snapshot when due */
+static void afterWrite(PRBTree *tree, const Variant *variant, long writes,
+                       PRBSnapshot *snapshot, size_t *peakNodes) {
+    if (variant->snapshotEvery > 0 && writes % variant->snapshotEvery == 0) {
+        PRBSnapshot next;
+        PRBTree_Snapshot(tree, &next);
+        PRBSnapshot_Release(snapshot);
+        *snapshot = next;
+    }
+    if (tree->liveNodes > *peakNodes) {
+        *peakNodes = tree->liveNodes;
+    }
+}
+
+static void runPersistent(Variant *variant, const int *keys) {
+    static int payload;
+    PRBTree *tree = PRBTree_Create();
+    PRBSnapshot snapshot = {NULL, NULL, 0};
+    size_t peakNodes = 0;
+    long writes = 0;
+
+    double start = nowSeconds();
+    for (int i = 0; i < KEYS; i++) {
+        PRBTree_Insert(tree, keys[i], &payload);
+        afterWrite(tree, variant, ++writes, &snapshot, &peakNodes);
+    }
+    keepBest(&variant->insertNs, (nowSeconds() - start) * 1e9 / KEYS);
+    variant->bytesPerKey = (double)(peakNodes + tree->spareCount) *
+                           sizeof(PRBNode) / KEYS;
+
+    start = nowSeconds();
+    for (int i = KEYS - 1; i >= 0; i--) {
+        PRBTree_Delete(tree, keys[i]);
+        afterWrite(tree, variant, ++writes, &snapshot, &peakNodes);
+    }
+    keepBest(&variant->deleteNs, (nowSeconds() - start) * 1e9 / KEYS);
+    variant->copiesPerWrite = (double)tree->copies / (double)writes;
+
+    PRBSnapshot_Release(&snapshot);
+    PRBTree_Destroy(tree);
+}
+
+int main(void) {
+    Variant variants[] = {
+        {"rbtree_inplace", 0, 0, 0, 0, 0},
+        {"cow_no_snapshot", -1, 0, 0, 0, 0},
+        {"cow_snapshot_1k", 1000, 0, 0, 0, 0},
+        {"cow_snapshot_1", 1, 0, 0, 0, 0}
+    };
+    int count = (int)(sizeof(variants) / sizeof(variants[0]));
+    int *keys = (int*)malloc(KEYS * sizeof(int));
+    uint32_t state = 2463534242u;
+
+    if (keys == NULL) {
+        fprintf(stderr, "Memory allocation failed for benchmark keys\n");
+        return 1;
+    }
+    for (int i = 0; i < KEYS; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        keys[i] = (int)(state & 0x7FFFFFFF);
+    }
+
+    /* Alternate the variants so machine noise hits all of them alike */
+    for (int r = 0; r < REPEATS; r++) {
+        for (int v = 0; v < count; v++) {
+            if (variants[v].snapshotEvery == 0) {
+                runInPlace(&variants[v], keys);
+            } else {
+                runPersistent(&variants[v], keys);
+            }
+        }
+    }
+
+    double base = variants[0].insertNs + variants[0].deleteNs;
+    printf("%-16s %10s %10s %9s %13s %13s\n", "variant", "insert_ns",
+           "delete_ns", "slowdown", "bytes_per_key", "copies/write");
+    for (int v = 0; v < count; v++) {
+        printf("%-16s %10.1f %10.1f %8.2fx %13.1f %13.2f\n", variants[v].name,
+               variants[v].insertNs, variants[v].deleteNs,
+               (variants[v].insertNs + variants[v].deleteNs) / base,
+               variants[v].bytesPerKey, variants[v].copiesPerWrite);
+    }
+
+    free(keys);
+    return 0;
+}
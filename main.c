@@ -2,28 +2,62 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-
-#define MAX_BOOKS 100
-#define MAX_TITLE_LEN 100
-#define MAX_AUTHOR_LEN 100
-#define MAX_ISBN_LEN 20
-
-typedef struct {
-    int id;
-    char title[MAX_TITLE_LEN];
-    char author[MAX_AUTHOR_LEN];
-    char isbn[MAX_ISBN_LEN];
-    int year;
-    float price;
-    int quantity;
-} Book;
-
-typedef struct {
-    Book books[MAX_BOOKS];
-    int count;
-} Library;
+#include <unistd.h>
+
+#include "AIO.h"
+#include "CATALOG.h"
+#include "GROUPSTATS.h"
+#include "SKETCH.h"
+#include "LIBRARY.h"
+#include "PAGES.h"
+#include "QUERY.h"
+#include "QUERYCACHE.h"
+#include "RENDER.h"
+#include "REPLICA.h"
+#include "SHARED.h"
+#include "SNAPSHOT.h"
+#include "SORT.h"
+#include "TRIE.h"
+#include "WAL.h"
+
+#define TEXT_SEARCH_RESULTS 10
+#define FUZZY_SEARCH_EDITS 2
+#define STATS_TOP_AUTHORS 10
+#define STATS_TOP_SEARCHES 5
 
 Library library = {0};
+QueryCache queryCache;
+TextIndex textIndex;
+GroupStats groupStats;
+int sketching = 0;                    // --sketches: keep approximate summaries too
+CatalogSketches sketches;
+RenderBuffer output;
+int pageSize = 0;                     // Rows per page of a listing; 0 = no paging
+const char *replicateTo = NULL;       // --replicate: serve the mutation log here
+const char *followFrom = NULL;        // --follow: read-only replica of this leader
+ReplicaLeader replicaLeader;
+ReplicaFollower replicaFollower;
+CatalogVersions versions;             // A follower's books, for reports that run unlocked
+const char *shareAs = NULL;           // --share: publish in this shared-memory segment
+SharedCatalog *sharedCatalog = NULL;
+const char *catalogPath = NULL;       // --catalog: load at start, log changes, save at exit
+AioBackend ioBackend = AIO_AUTO;      // --io: how the catalog and its log are written
+int ioDepth = AIO_DEFAULT_DEPTH;      // --io-depth: transfers in flight
+int ioFlags = 0;                      // --direct, --compress: CATALOG_IO_DIRECT, CATALOG_COMPRESSED
+AioQueue ioQueue;
+Wal wal;
+uint64_t walSynced;                   // wal.appended at the last sync
+size_t tieredBudget = 0;              // --tiered: read books from the catalog file through a cache this big
+Catalog *tieredCatalog = NULL;        // In tiered mode the library holds only changed books
+RBTree *changedIds = NULL;            // IDs added, changed or deleted since the file was written
+int tieredCount = 0;                  // Books in the file and the library together
+int tieredStale = 0;                  // A change went untracked; the file is not rewritten
+
+// Rows of a tiered listing shown so far, out of limit
+typedef struct {
+    int listed;
+    int limit;
+} TieredListing;
 
 // Function prototypes
 void displayMenu();
@@ -33,10 +67,45 @@ void searchBook();
 void updateBook();
 void deleteBook();
 void viewBookStatistics();
+int scanTieredStatistics(LibraryStats *stats, GroupStats *groups,
+                         CatalogSketches *values);
+void printGroupStatistics(const GroupStats *tables);
+void printSketchStatistics(const LibraryStats *stats, const GroupStats *tables,
+                           const CatalogSketches *values);
+int compareGroupValue(const void *a, const void *b);
+int compareGroupYear(const void *a, const void *b);
+void exportSortedCatalog();
+void viewPerformanceMetrics();
 void saveToFile();
 void loadFromFile();
 void clearInputBuffer();
-int getBookIndexById(int id);
+int promptSortOrder(BookField *field, int *descending);
+int getBookById(int id, Book *book);
+void beginRead();
+void endRead();
+int takeSnapshot(CatalogSnapshot *snapshot);
+const Book** snapshotBooks(const CatalogSnapshot *snapshot, int *count);
+int nextListedBook(void *context, Book *book);
+int nextTieredBook(void *context, Book *book);
+int sortTieredView(BookField field, int descending, SortSink emit, void *sink);
+int listTieredBook(void *context, const Book *book);
+int searchTieredView(const Predicate *where, int **ids);
+int isLibraryEmpty();
+void renderListedBook(int id, int details);
+void textSearch(int fuzzy);
+int continueListing(int listed, int total);
+void printReplicationStatus();
+void printSharedCatalogStatus();
+void printTieredCatalogStatus();
+int openCatalog();
+void closeCatalog();
+int openTieredCatalog();
+int writeTieredCatalog();
+void closeTieredCatalog();
+void markChanged(void *context, const Book *before, const Book *after);
+void faultChangedBook(void *context, Library *target, int id);
+int parseBytes(const char *text, size_t *bytes);
+const char* optionValue(int argc, char *argv[], int *i, const char *name);
 
 // Helper function to clear input buffer
 void clearInputBuffer() {
@@ -52,13 +121,15 @@ void displayMenu() {
     printf("╚════════════════════════════════════════╝\n");
     printf("1. Add a New Book\n");
     printf("2. View All Books\n");
-    printf("3. Search Book by Title or Author\n");
+    printf("3. Search Books\n");
     printf("4. Update Book Information\n");
     printf("5. Delete a Book\n");
     printf("6. View Library Statistics\n");
-    printf("7. Exit\n");
+    printf("7. Export Sorted Catalog (CSV)\n");
+    printf("8. View Performance Metrics\n");
+    printf("9. Exit\n");
     printf("─────────────────────────────────────────\n");
-    printf("Enter your choice (1-7): ");
+    printf("Enter your choice (1-9): ");
 }
 
 // Add a new book to the library
@@ -72,8 +143,7 @@ void addBook() {
     printf("║          ADD A NEW BOOK                ║\n");
     printf("╚════════════════════════════════════════╝\n");
 
-    Book newBook;
-    newBook.id = library.count + 1;
+    Book newBook = {0};
 
     printf("Enter Book Title: ");
     fgets(newBook.title, MAX_TITLE_LEN, stdin);
@@ -119,54 +189,374 @@ void addBook() {
     }
     clearInputBuffer();
 
-    library.books[library.count] = newBook;
-    library.count++;
+    if (libraryAddBook(&library, &newBook) == -1) {
+        printf("❌ Could not add book: out of memory!\n");
+        return;
+    }
 
     printf("\n✅ Book added successfully! (Book ID: %d)\n", newBook.id);
 }
 
+// Ask for a listing order; returns 0 on success, -1 on invalid input
+int promptSortOrder(BookField *field, int *descending) {
+    printf("Sort by:\n");
+    printf("1. Insertion Order\n");
+    printf("2. Title\n");
+    printf("3. Author\n");
+    printf("4. Newest First\n");
+    printf("5. Cheapest First\n");
+    printf("6. Most Expensive First\n");
+    printf("Enter choice (1-6): ");
+
+    int choice;
+    if (scanf("%d", &choice) != 1) {
+        printf("❌ Invalid input!\n");
+        clearInputBuffer();
+        return -1;
+    }
+    clearInputBuffer();
+
+    static const BookField fields[] = {
+        FIELD_ID, FIELD_TITLE, FIELD_AUTHOR, FIELD_YEAR, FIELD_PRICE, FIELD_PRICE
+    };
+    if (choice < 1 || choice > 6) {
+        printf("❌ Invalid choice!\n");
+        return -1;
+    }
+
+    *field = fields[choice - 1];
+    *descending = choice == 4 || choice == 6;
+    return 0;
+}
+
 // View all books in the library
 void viewAllBooks() {
-    if (library.count == 0) {
+    if (isLibraryEmpty()) {
         printf("\n📚 The library is empty. No books to display.\n");
         return;
     }
 
-    printf("\n╔════════════════════════════════════════════════════════════════════════════════════╗\n");
-    printf("║                              ALL BOOKS IN LIBRARY                                 ║\n");
-    printf("╠════════════════════════════════════════════════════════════════════════════════════╣\n");
-    printf("| ID | Title                    | Author              | ISBN         | Year | Price |\n");
-    printf("├────┼──────────────────────────┼─────────────────────┼───────────────┼──────┼───────┤\n");
+    Query query;
+    Query_Init(&query);
+    query.ordered = 1;
+    if (promptSortOrder(&query.orderBy, &query.descending) != 0) {
+        return;
+    }
+
+    printf("How many books to show (0 = all): ");
+    if (scanf("%d", &query.limit) != 1 || query.limit < 0) {
+        printf("❌ Invalid number!\n");
+        clearInputBuffer();
+        return;
+    }
+    clearInputBuffer();
+    if (query.limit == 0) {
+        query.limit = QUERY_NO_LIMIT;
+    }
+
+    // Rows are rendered later by ID, as the replica may change in between
+    beginRead();
+    int total = tieredCatalog != NULL ? tieredCount : library.count;
+    int *ids = NULL;
+    int shown = query.limit == QUERY_NO_LIMIT || total < query.limit ? total : query.limit;
+    if (tieredCatalog == NULL) {
+        ids = (int*)malloc((size_t)(total > 0 ? total : 1) * sizeof(int));
+        shown = ids != NULL ? Query_Execute(&library, &query, ids, total) : -1;
+        for (int i = 0; i < shown; i++) {
+            ids[i] = library.books[ids[i]].id;
+        }
+    }
+    endRead();
+    if (shown == -1) {
+        printf("❌ Listing failed: out of memory!\n");
+        free(ids);
+        return;
+    }
+
+    fflush(stdout);
+    Render_Text(&output, "\n╔════════════════════════════════════════════════════════════════════════════════════╗\n");
+    Render_Text(&output, "║                              ALL BOOKS IN LIBRARY                                 ║\n");
+    Render_Text(&output, "╠════════════════════════════════════════════════════════════════════════════════════╣\n");
+    Render_Text(&output, "| ID | Title                    | Author              | ISBN         | Year | Price |\n");
+    Render_Text(&output, "├────┼──────────────────────────┼─────────────────────┼───────────────┼──────┼───────┤\n");
+
+    int listed = 0;
+    int failed = 0;
+    if (tieredCatalog != NULL) {
+        TieredListing listing = {0, shown};
+        failed = sortTieredView(query.orderBy, query.descending, listTieredBook,
+                                &listing) == -1;
+        listed = listing.listed;
+    }
+    while (listed < shown && ids != NULL) {
+        renderListedBook(ids[listed], 0);
+        listed++;
+        if (!continueListing(listed, shown)) {
+            break;
+        }
+    }
+
+    Render_Text(&output, "├────┴──────────────────────────┴─────────────────────┴───────────────┴──────┴───────┤\n");
+    char footer[128];
+    snprintf(footer, sizeof(footer), "| Showing %d of %-71d |\n", listed, total);
+    Render_Text(&output, footer);
+    Render_Text(&output, "╚════════════════════════════════════════════════════════════════════════════════════╝\n");
+    Render_Flush(&output);
+    free(ids);
+    if (failed) {
+        printf("❌ Listing failed!\n");
+    }
+}
+
+// Copy out a book by ID; in tiered mode books unchanged since the
+// catalog file was written are read from it through the record cache
+int getBookById(int id, Book *book) {
+    int index = libraryFindById(&library, id);
+    if (index != -1) {
+        *book = library.books[index];
+        return 1;
+    }
+
+    // Changed but not in memory: deleted
+    if (tieredCatalog != NULL && !RBTree_Contains(changedIds, id)) {
+        return Catalog_FindById(tieredCatalog, id, book);
+    }
+    return 0;
+}
+
+// A follower's library may only be read under the replica's read lock;
+// it is taken per lookup, query or render, never across a prompt
+void beginRead() {
+    if (followFrom != NULL) {
+        ReplicaFollower_ReadLock(&replicaFollower);
+    }
+}
+
+void endRead() {
+    if (followFrom != NULL) {
+        ReplicaFollower_ReadUnlock(&replicaFollower);
+    }
+}
+
+// A follower's long reports work on a snapshot taken under the read
+// lock, so replication carries on while they run
+// @return: 1 with a snapshot to release, 0 to read the library instead
+int takeSnapshot(CatalogSnapshot *snapshot) {
+    if (followFrom == NULL) {
+        return 0;
+    }
+
+    beginRead();
+    int taken = CatalogVersions_Snapshot(&versions, snapshot) == 0;
+    endRead();
+    return taken;
+}
+
+// A snapshot's books in ID order; NULL with *count -1 if out of memory
+const Book** snapshotBooks(const CatalogSnapshot *snapshot, int *count) {
+    int total = CatalogSnapshot_Count(snapshot);
+    const Book **books = (const Book**)malloc((size_t)(total > 0 ? total : 1) *
+                                              sizeof(Book*));
+    if (books == NULL) {
+        *count = -1;
+        return NULL;
+    }
+    *count = CatalogSnapshot_Books(snapshot, books, total);
+    return books;
+}
+
+// Books handed to Sort_ExportSource from an array of pointers
+typedef struct {
+    const Book **books;
+    int count;
+    int next;
+} BookList;
+
+int nextListedBook(void *context, Book *book) {
+    BookList *list = (BookList*)context;
+
+    if (list->next == list->count) {
+        return 0;
+    }
+    *book = *list->books[list->next++];
+    return 1;
+}
 
-    for (int i = 0; i < library.count; i++) {
-        Book *book = &library.books[i];
-        printf("| %2d | %-24s | %-19s | %-13s | %4d | $%-5.2f |\n",
-               book->id,
-               book->title,
-               book->author,
-               book->isbn,
-               book->year,
-               book->price);
+// A tiered catalog's books in ID order: the file's records that have
+// not changed since it was written, merged with the library's books
+typedef struct {
+    CatalogCursor cursor;
+    Book record;                      // Next unchanged record of the file
+    int hasRecord;
+    int fileDone;
+    int next;                         // Next position in library.books
+} TieredView;
+
+int startTieredView(TieredView *view) {
+    memset(view, 0, sizeof(*view));
+    return Catalog_StartScan(tieredCatalog, &view->cursor);
+}
+
+void endTieredView(TieredView *view) {
+    Catalog_EndScan(&view->cursor);
+}
+
+int nextTieredBook(void *context, Book *book) {
+    TieredView *view = (TieredView*)context;
+
+    while (!view->hasRecord && !view->fileDone) {
+        int read = Catalog_NextRecord(&view->cursor, &view->record);
+        if (read == -1) {
+            return -1;
+        }
+        view->fileDone = read == 0;
+        view->hasRecord = read == 1 && !RBTree_Contains(changedIds, view->record.id);
     }
 
-    printf("├────┴──────────────────────────┴─────────────────────┴───────────────┴──────┴───────┤\n");
-    printf("| Total Books: %-79d |\n", library.count);
-    printf("╚════════════════════════════════════════════════════════════════════════════════════╝\n");
+    const Book *changed = view->next < library.count ? &library.books[view->next] : NULL;
+    if (view->hasRecord && (changed == NULL || view->record.id < changed->id)) {
+        *book = view->record;
+        view->hasRecord = 0;
+        return 1;
+    }
+    if (changed == NULL) {
+        return 0;
+    }
+    // A book brought in for a change that then failed is the same as its record
+    if (view->hasRecord && view->record.id == changed->id) {
+        view->hasRecord = 0;
+    }
+    *book = *changed;
+    view->next++;
+    return 1;
 }
 
-// Get book index by ID
-int getBookIndexById(int id) {
-    for (int i = 0; i < library.count; i++) {
-        if (library.books[i].id == id) {
-            return i;
+// Pass the tiered catalog's books to a sink in listing order; the view
+// is in ID order already, anything else is sorted within the export budget
+// @return: Books passed to emit, or -1 on failure
+int sortTieredView(BookField field, int descending, SortSink emit, void *sink) {
+    TieredView view;
+    int passed = 0;
+
+    if (startTieredView(&view) != 0) {
+        return -1;
+    }
+    if (field == FIELD_ID && !descending) {
+        Book book;
+        int read;
+        while ((read = nextTieredBook(&view, &book)) == 1) {
+            passed++;
+            if (emit(sink, &book) != 0) {
+                break;
+            }
+        }
+        if (read == -1) {
+            passed = -1;
         }
+    } else {
+        passed = Sort_Source(nextTieredBook, &view, field, descending,
+                             SORT_DEFAULT_MEMORY_BUDGET, emit, sink);
     }
-    return -1;
+    endTieredView(&view);
+    return passed;
+}
+
+// Rows of viewAllBooks in tiered mode, rendered as they arrive
+int listTieredBook(void *context, const Book *book) {
+    TieredListing *listing = (TieredListing*)context;
+
+    Render_BookRow(&output, book);
+    listing->listed++;
+    return listing->listed == listing->limit ||
+           !continueListing(listing->listed, listing->limit);
+}
+
+// IDs of the tiered catalog's books matching a predicate, in ID order
+// @param ids: Receives the IDs (free() them)
+// @return: Number of matches, or -1 on failure
+int searchTieredView(const Predicate *where, int **ids) {
+    TieredView view;
+    Book book;
+    int found = 0;
+    int capacity = 0;
+    int read;
+
+    *ids = NULL;
+    if (startTieredView(&view) != 0) {
+        return -1;
+    }
+    while ((read = nextTieredBook(&view, &book)) == 1) {
+        if (!Predicate_Matches(where, &book)) {
+            continue;
+        }
+        if (found == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 64;
+            int *grown = (int*)realloc(*ids, (size_t)capacity * sizeof(int));
+            if (grown == NULL) {
+                read = -1;
+                break;
+            }
+            *ids = grown;
+        }
+        (*ids)[found++] = book.id;
+    }
+    endTieredView(&view);
+
+    if (read == -1) {
+        free(*ids);
+        *ids = NULL;
+        return -1;
+    }
+    return found;
+}
+
+int isLibraryEmpty() {
+    beginRead();
+    int empty = (tieredCatalog != NULL ? tieredCount : library.count) == 0;
+    endRead();
+    return empty;
+}
+
+// Render a listed book as a table row or in detail, unless it has
+// been deleted since the listing was made
+void renderListedBook(int id, int details) {
+    Book book;
+
+    beginRead();
+    if (getBookById(id, &book)) {
+        if (details) {
+            Render_BookDetails(&output, &book);
+        } else {
+            Render_BookRow(&output, &book);
+        }
+    }
+    endRead();
+}
+
+// Flush a page of rendered rows and ask whether to show the next one
+int continueListing(int listed, int total) {
+    char answer[16];
+
+    if (pageSize <= 0 || listed % pageSize != 0 || listed >= total) {
+        return 1;
+    }
+
+    Render_Flush(&output);
+    printf("── %d of %d shown: Enter for more, q to stop ── ", listed, total);
+    fflush(stdout);
+    if (fgets(answer, sizeof(answer), stdin) == NULL) {
+        return 0;
+    }
+    if (strchr(answer, '\n') == NULL) {
+        clearInputBuffer();
+    }
+
+    return answer[0] != 'q' && answer[0] != 'Q';
 }
 
 // Search for a book
 void searchBook() {
-    if (library.count == 0) {
+    if (isLibraryEmpty()) {
         printf("\n📚 The library is empty. No books to search.\n");
         return;
     }
@@ -177,7 +567,11 @@ void searchBook() {
     printf("Search by:\n");
     printf("1. Title\n");
     printf("2. Author\n");
-    printf("Enter choice (1-2): ");
+    printf("3. ISBN\n");
+    printf("4. Year and Price Range\n");
+    printf("5. Title Prefix (type-ahead)\n");
+    printf("6. Title or Author, Allowing Typos\n");
+    printf("Enter choice (1-6): ");
 
     int choice;
     if (scanf("%d", &choice) != 1) {
@@ -187,61 +581,164 @@ void searchBook() {
     }
     clearInputBuffer();
 
-    if (choice < 1 || choice > 2) {
+    if (choice < 1 || choice > 6) {
         printf("❌ Invalid choice!\n");
         return;
     }
+    if (choice >= 5 && tieredCatalog != NULL) {
+        // The tries would hold every title of a catalog kept out of memory
+        printf("❌ Prefix and typo-tolerant search are not available with --tiered.\n");
+        return;
+    }
+    if (choice >= 5) {
+        textSearch(choice == 6);
+        return;
+    }
 
     char searchTerm[100];
-    int found = 0;
+    Query query;
+    Query_Init(&query);
 
-    if (choice == 1) {
-        printf("Enter Book Title: ");
+    if (choice == 1 || choice == 2 || choice == 3) {
+        static const char *prompts[] = {"Book Title", "Author Name", "ISBN"};
+        printf("Enter %s: ", prompts[choice - 1]);
         fgets(searchTerm, 100, stdin);
         searchTerm[strcspn(searchTerm, "\n")] = 0;
+        if (sketching) {
+            beginRead();
+            CatalogSketches_RecordSearch(&sketches, searchTerm);
+            endRead();
+        }
 
-        printf("\n╔════════════════════════════════════════════════════════════════════╗\n");
-        printf("║                     SEARCH RESULTS                                ║\n");
-        printf("╚════════════════════════════════════════════════════════════════════╝\n");
-
-        for (int i = 0; i < library.count; i++) {
-            if (strstr(library.books[i].title, searchTerm) != NULL) {
-                Book *book = &library.books[i];
-                printf("\nBook ID: %d\n", book->id);
-                printf("Title: %s\n", book->title);
-                printf("Author: %s\n", book->author);
-                printf("ISBN: %s\n", book->isbn);
-                printf("Year: %d\n", book->year);
-                printf("Price: $%.2f\n", book->price);
-                printf("Quantity: %d\n", book->quantity);
-                printf("─────────────────────────────────────────────────────────────────────\n");
-                found++;
-            }
+        if (choice == 1) {
+            query.where = Predicate_Contains(FIELD_TITLE, searchTerm);
+        } else if (choice == 2) {
+            query.where = Predicate_Contains(FIELD_AUTHOR, searchTerm);
+        } else {
+            query.where = Predicate_EqualsText(FIELD_ISBN, searchTerm);
         }
-    } else if (choice == 2) {
-        printf("Enter Author Name: ");
-        fgets(searchTerm, 100, stdin);
-        searchTerm[strcspn(searchTerm, "\n")] = 0;
+    } else {
+        int yearMin, yearMax;
+        float priceMin, priceMax;
 
-        printf("\n╔════════════════════════════════════════════════════════════════════╗\n");
-        printf("║                     SEARCH RESULTS                                ║\n");
-        printf("╚════════════════════════════════════════════════════════════════════╝\n");
-
-        for (int i = 0; i < library.count; i++) {
-            if (strstr(library.books[i].author, searchTerm) != NULL) {
-                Book *book = &library.books[i];
-                printf("\nBook ID: %d\n", book->id);
-                printf("Title: %s\n", book->title);
-                printf("Author: %s\n", book->author);
-                printf("ISBN: %s\n", book->isbn);
-                printf("Year: %d\n", book->year);
-                printf("Price: $%.2f\n", book->price);
-                printf("Quantity: %d\n", book->quantity);
-                printf("─────────────────────────────────────────────────────────────────────\n");
-                found++;
-            }
+        printf("Enter Year Range (from to): ");
+        if (scanf("%d %d", &yearMin, &yearMax) != 2) {
+            printf("❌ Invalid year range!\n");
+            clearInputBuffer();
+            return;
+        }
+        printf("Enter Price Range ($ from to): ");
+        if (scanf("%f %f", &priceMin, &priceMax) != 2) {
+            printf("❌ Invalid price range!\n");
+            clearInputBuffer();
+            return;
+        }
+        clearInputBuffer();
+
+        query.where = Predicate_And(Predicate_Range(FIELD_YEAR, yearMin, yearMax),
+                                    Predicate_Range(FIELD_PRICE, priceMin, priceMax));
+    }
+
+    int positions[MAX_BOOKS];
+    int *ids = positions;
+    int found = -1;
+    if (query.where != NULL && tieredCatalog != NULL) {
+        found = searchTieredView(query.where, &ids);
+    } else if (query.where != NULL) {
+        beginRead();
+        found = QueryCache_Execute(&queryCache, &query, positions, MAX_BOOKS);
+        for (int i = 0; i < found; i++) {
+            ids[i] = library.books[positions[i]].id;
+        }
+        endRead();
+    }
+    Predicate_Free(query.where);
+
+    if (found == -1) {
+        printf("❌ Search failed: out of memory!\n");
+        return;
+    }
+
+    printf("\n╔════════════════════════════════════════════════════════════════════╗\n");
+    printf("║                     SEARCH RESULTS                                ║\n");
+    printf("╚════════════════════════════════════════════════════════════════════╝\n");
+
+    fflush(stdout);
+    for (int i = 0; i < found; i++) {
+        renderListedBook(ids[i], 1);
+        if (!continueListing(i + 1, found)) {
+            break;
         }
     }
+    Render_Flush(&output);
+    if (ids != positions) {
+        free(ids);
+    }
+
+    if (found == 0) {
+        printf("❌ No books found matching your search.\n");
+    } else {
+        printf("✅ Found %d book(s).\n", found);
+    }
+}
+
+// Prefix or typo-tolerant search through the title and author tries
+void textSearch(int fuzzy) {
+    char searchTerm[100];
+    char key[MAX_TITLE_LEN];
+    TrieMatch matches[2 * TEXT_SEARCH_RESULTS];
+    int found;
+
+    printf("Enter %s: ", fuzzy ? "Title, Author or a Word of Either"
+                               : "Start of Title or Title Word");
+    fgets(searchTerm, sizeof(searchTerm), stdin);
+    searchTerm[strcspn(searchTerm, "\n")] = 0;
+    Trie_Normalize(searchTerm, key, sizeof(key));
+
+    beginRead();
+    if (sketching) {
+        CatalogSketches_RecordSearch(&sketches, searchTerm);
+    }
+    if (fuzzy) {
+        found = Trie_Fuzzy(&textIndex.titles, key, FUZZY_SEARCH_EDITS,
+                           matches, TEXT_SEARCH_RESULTS);
+        if (found >= 0) {
+            int authors = Trie_Fuzzy(&textIndex.authors, key, FUZZY_SEARCH_EDITS,
+                                     matches + found, TEXT_SEARCH_RESULTS);
+            // A book matching on both title and author is listed once
+            found = authors >= 0
+                    ? Trie_MergeMatches(matches, found + authors, TEXT_SEARCH_RESULTS)
+                    : -1;
+        }
+    } else {
+        found = Trie_Complete(&textIndex.titles, key, matches,
+                              TEXT_SEARCH_RESULTS);
+    }
+    endRead();
+
+    if (found == -1) {
+        printf("❌ Search failed: out of memory!\n");
+        return;
+    }
+
+    printf("\n╔════════════════════════════════════════════════════════════════════╗\n");
+    printf("║                     SEARCH RESULTS                                ║\n");
+    printf("╚════════════════════════════════════════════════════════════════════╝\n");
+
+    fflush(stdout);
+    for (int i = 0; i < found; i++) {
+        Book book;
+        beginRead();
+        int listed = getBookById(matches[i].id, &book);
+        endRead();
+        if (listed) {
+            Render_BookDetails(&output, &book);
+        }
+        if (!continueListing(i + 1, found)) {
+            break;
+        }
+    }
+    Render_Flush(&output);
 
     if (found == 0) {
         printf("❌ No books found matching your search.\n");
@@ -252,7 +749,7 @@ void searchBook() {
 
 // Update book information
 void updateBook() {
-    if (library.count == 0) {
+    if (isLibraryEmpty()) {
         printf("\n📚 The library is empty. No books to update.\n");
         return;
     }
@@ -270,13 +767,13 @@ void updateBook() {
     }
     clearInputBuffer();
 
-    int index = getBookIndexById(bookId);
-    if (index == -1) {
+    Book updated;
+    if (!getBookById(bookId, &updated)) {
         printf("❌ Book with ID %d not found!\n", bookId);
         return;
     }
 
-    Book *book = &library.books[index];
+    Book *book = &updated;
     printf("\nCurrent Book Information:\n");
     printf("Title: %s\n", book->title);
     printf("Author: %s\n", book->author);
@@ -303,13 +800,11 @@ void updateBook() {
             printf("Enter new title: ");
             fgets(book->title, MAX_TITLE_LEN, stdin);
             book->title[strcspn(book->title, "\n")] = 0;
-            printf("✅ Title updated successfully!\n");
             break;
         case 2:
             printf("Enter new author: ");
             fgets(book->author, MAX_AUTHOR_LEN, stdin);
             book->author[strcspn(book->author, "\n")] = 0;
-            printf("✅ Author updated successfully!\n");
             break;
         case 3:
             printf("Enter new price: $");
@@ -319,7 +814,6 @@ void updateBook() {
                 return;
             }
             clearInputBuffer();
-            printf("✅ Price updated successfully!\n");
             break;
         case 4:
             printf("Enter new quantity: ");
@@ -329,16 +823,24 @@ void updateBook() {
                 return;
             }
             clearInputBuffer();
-            printf("✅ Quantity updated successfully!\n");
             break;
         default:
             printf("❌ Invalid choice!\n");
+            return;
+    }
+
+    if (libraryUpdateBook(&library, book) != 1) {
+        printf("❌ Could not update book: library full or out of memory!\n");
+        return;
     }
+
+    static const char *fields[] = {"Title", "Author", "Price", "Quantity"};
+    printf("✅ %s updated successfully!\n", fields[choice - 1]);
 }
 
 // Delete a book
 void deleteBook() {
-    if (library.count == 0) {
+    if (isLibraryEmpty()) {
         printf("\n📚 The library is empty. No books to delete.\n");
         return;
     }
@@ -356,15 +858,15 @@ void deleteBook() {
     }
     clearInputBuffer();
 
-    int index = getBookIndexById(bookId);
-    if (index == -1) {
+    Book book;
+    if (!getBookById(bookId, &book)) {
         printf("❌ Book with ID %d not found!\n", bookId);
         return;
     }
 
     printf("\nAre you sure you want to delete:\n");
-    printf("Title: %s\n", library.books[index].title);
-    printf("Author: %s\n", library.books[index].author);
+    printf("Title: %s\n", book.title);
+    printf("Author: %s\n", book.author);
     printf("Confirm deletion? (Y/N): ");
 
     char confirm;
@@ -376,10 +878,11 @@ void deleteBook() {
     clearInputBuffer();
 
     if (confirm == 'Y' || confirm == 'y') {
-        for (int i = index; i < library.count - 1; i++) {
-            library.books[i] = library.books[i + 1];
+        // In tiered mode the book must first be brought into the library
+        if (libraryDeleteBook(&library, bookId) != 1) {
+            printf("❌ Could not delete book: library full or out of memory!\n");
+            return;
         }
-        library.count--;
         printf("✅ Book deleted successfully!\n");
     } else {
         printf("⚠ Deletion cancelled.\n");
@@ -388,7 +891,53 @@ void deleteBook() {
 
 // View library statistics
 void viewBookStatistics() {
-    if (library.count == 0) {
+    LibraryStats stats;
+    CatalogSnapshot snapshot;
+    const GroupStats *groups = &groupStats;
+    const CatalogSketches *values = &sketches;
+    GroupStats scannedGroups;
+    CatalogSketches *scannedValues = NULL;
+
+    // The totals scan every book; the group tables and sketches below
+    // are maintained as books change and are read under the lock, except
+    // in tiered mode, where the scan of the file and changes builds them
+    if (tieredCatalog != NULL) {
+        scannedValues = (CatalogSketches*)malloc(sizeof(CatalogSketches));
+        if (scannedValues == NULL ||
+            scanTieredStatistics(&stats, &scannedGroups, scannedValues) != 0) {
+            free(scannedValues);
+            printf("❌ Statistics failed: out of memory or an unreadable catalog file!\n");
+            return;
+        }
+        groups = &scannedGroups;
+        values = scannedValues;
+        beginRead();
+    } else if (takeSnapshot(&snapshot)) {
+        int count;
+        const Book **books = snapshotBooks(&snapshot, &count);
+
+        memset(&stats, 0, sizeof(stats));
+        for (int i = 0; i < count; i++) {
+            libraryAccumulateStats(&stats, books[i]);
+        }
+        free(books);
+        CatalogSnapshot_Release(&snapshot);
+        if (count < 0) {
+            printf("❌ Not enough memory for the statistics.\n");
+            return;
+        }
+        beginRead();
+    } else {
+        beginRead();
+        libraryComputeStats(&library, &stats);
+    }
+
+    if (stats.totalBooks == 0) {
+        endRead();
+        if (scannedValues != NULL) {
+            GroupStats_Free(&scannedGroups);
+            free(scannedValues);
+        }
         printf("\n📚 The library is empty. No statistics available.\n");
         return;
     }
@@ -397,47 +946,589 @@ void viewBookStatistics() {
     printf("║      LIBRARY STATISTICS                ║\n");
     printf("╚════════════════════════════════════════╝\n");
 
-    int totalBooks = 0;
-    int totalQuantity = 0;
-    float totalValue = 0.0;
-    float avgPrice = 0.0;
-    float minPrice = library.books[0].price;
-    float maxPrice = library.books[0].price;
-    int oldestYear = library.books[0].year;
-    int newestYear = library.books[0].year;
-
-    for (int i = 0; i < library.count; i++) {
-        totalBooks++;
-        totalQuantity += library.books[i].quantity;
-        totalValue += library.books[i].price * library.books[i].quantity;
-
-        if (library.books[i].price < minPrice)
-            minPrice = library.books[i].price;
-        if (library.books[i].price > maxPrice)
-            maxPrice = library.books[i].price;
-        if (library.books[i].year < oldestYear)
-            oldestYear = library.books[i].year;
-        if (library.books[i].year > newestYear)
-            newestYear = library.books[i].year;
-    }
-
-    avgPrice = totalValue / totalBooks;
-
-    printf("Total Unique Books: %d\n", totalBooks);
-    printf("Total Quantity in Stock: %d\n", totalQuantity);
-    printf("Total Inventory Value: $%.2f\n", totalValue);
+    float avgPrice = stats.totalValue / stats.totalBooks;
+
+    printf("Total Unique Books: %d\n", stats.totalBooks);
+    printf("Total Quantity in Stock: %d\n", stats.totalQuantity);
+    printf("Total Inventory Value: $%.2f\n", stats.totalValue);
     printf("Average Price per Book: $%.2f\n", avgPrice);
-    printf("Lowest Price: $%.2f\n", minPrice);
-    printf("Highest Price: $%.2f\n", maxPrice);
-    printf("Oldest Publication Year: %d\n", oldestYear);
-    printf("Newest Publication Year: %d\n", newestYear);
+    printf("Lowest Price: $%.2f\n", stats.minPrice);
+    printf("Highest Price: $%.2f\n", stats.maxPrice);
+    printf("Oldest Publication Year: %d\n", stats.oldestYear);
+    printf("Newest Publication Year: %d\n", stats.newestYear);
+    printGroupStatistics(groups);
+    if (sketching) {
+        printSketchStatistics(&stats, groups, values);
+    }
+    endRead();
     printf("╚════════════════════════════════════════╝\n");
+    if (scannedValues != NULL) {
+        GroupStats_Free(&scannedGroups);
+        free(scannedValues);
+    }
+}
+
+// Totals, group tables and sketch values of a tiered catalog from one
+// scan of its file merged with the changes in memory
+// @return: 0 on success, -1 on failure with nothing to free
+int scanTieredStatistics(LibraryStats *stats, GroupStats *groups,
+                         CatalogSketches *values) {
+    TieredView view;
+    Book book;
+    int read;
+
+    memset(stats, 0, sizeof(*stats));
+    if (GroupStats_Init(groups, NULL) != 0) {
+        return -1;
+    }
+    CatalogSketches_Init(values, NULL);
+    if (startTieredView(&view) != 0) {
+        GroupStats_Free(groups);
+        return -1;
+    }
+    while ((read = nextTieredBook(&view, &book)) == 1) {
+        libraryAccumulateStats(stats, &book);
+        GroupStats_AddBook(groups, &book);
+        CatalogSketches_AddBook(values, &book);
+    }
+    endTieredView(&view);
+
+    if (read == -1 || groups->failed) {
+        GroupStats_Free(groups);
+        return -1;
+    }
+    return 0;
+}
+
+// Highest inventory value first
+int compareGroupValue(const void *a, const void *b) {
+    const StatsGroup *left = *(const StatsGroup * const *)a;
+    const StatsGroup *right = *(const StatsGroup * const *)b;
+    return (left->valueCents < right->valueCents) - (left->valueCents > right->valueCents);
+}
+
+// Oldest year first
+int compareGroupYear(const void *a, const void *b) {
+    const StatsGroup *left = *(const StatsGroup * const *)a;
+    const StatsGroup *right = *(const StatsGroup * const *)b;
+    return (left->year > right->year) - (left->year < right->year);
+}
+
+// Per-year and per-author totals, read from the group tables
+void printGroupStatistics(const GroupStats *tables) {
+    int capacity = tables->years.live > tables->authors.live
+                 ? tables->years.live : tables->authors.live;
+    const StatsGroup **groups = (const StatsGroup**)malloc(
+        (size_t)(capacity > 0 ? capacity : 1) * sizeof(StatsGroup*));
+
+    if (groups == NULL) {
+        printf("❌ Not enough memory for the group statistics.\n");
+        return;
+    }
+
+    int count = GroupStats_List(&tables->years, groups, capacity);
+    qsort(groups, (size_t)count, sizeof(groups[0]), compareGroupYear);
+    printf("─────────────────────────────────────────\n");
+    printf("Books by Publication Year:\n");
+    for (int i = 0; i < count; i++) {
+        printf("  %d: %d book(s), %d in stock, $%.2f\n", groups[i]->year,
+               groups[i]->books, groups[i]->quantity, groups[i]->valueCents / 100.0);
+    }
+
+    count = GroupStats_List(&tables->authors, groups, capacity);
+    qsort(groups, (size_t)count, sizeof(groups[0]), compareGroupValue);
+    printf("Top Authors by Inventory Value:\n");
+    for (int i = 0; i < count && i < STATS_TOP_AUTHORS; i++) {
+        printf("  %s: %d book(s), %d in stock, $%.2f\n", groups[i]->name,
+               groups[i]->books, groups[i]->quantity, groups[i]->valueCents / 100.0);
+    }
+
+#ifdef RB_DEBUG
+    // Debug builds recount the tables from the books
+    if (GroupStats_Verify(tables) != 0) {
+        printf("⚠ Group statistics differ from a recount (see stderr).\n");
+    }
+#endif
+    free(groups);
+}
+
+// Sketch estimates beside the exact figures they approximate; search
+// terms are always counted in the maintained sketches
+void printSketchStatistics(const LibraryStats *stats, const GroupStats *tables,
+                           const CatalogSketches *values) {
+    printf("─────────────────────────────────────────\n");
+    printf("Approximate (sketches):\n");
+    if (CatalogSketches_Refresh(&sketches)) {
+        printf("  (Rebuilt: too many deleted or changed books were counted.)\n");
+    }
+    printf("  Distinct Authors: ~%.0f (exact %d)\n",
+           Hll_Estimate(&values->authors), tables->authors.live);
+    printf("  Price p10 / median / p90: $%.2f / $%.2f / $%.2f "
+           "(exact range $%.2f - $%.2f)\n",
+           Kll_Quantile(&values->prices, 0.10), Kll_Quantile(&values->prices, 0.50),
+           Kll_Quantile(&values->prices, 0.90), stats->minPrice, stats->maxPrice);
+
+    printf("  Top Search Terms (%llu searches):\n",
+           (unsigned long long)sketches.searches.total);
+    for (int i = 0; i < sketches.searches.topCount && i < STATS_TOP_SEARCHES; i++) {
+        printf("    \"%s\": ~%u\n", sketches.searches.top[i].term,
+               sketches.searches.top[i].estimate);
+    }
+    if (sketches.searches.topCount == 0) {
+        printf("    (none yet)\n");
+    }
+}
+
+// Export the catalog as CSV in a chosen order
+void exportSortedCatalog() {
+    if (isLibraryEmpty()) {
+        printf("\n📚 The library is empty. Nothing to export.\n");
+        return;
+    }
+
+    BookField field;
+    int descending;
+    if (promptSortOrder(&field, &descending) != 0) {
+        return;
+    }
+
+    char path[256];
+    printf("Enter output file name: ");
+    fgets(path, sizeof(path), stdin);
+    path[strcspn(path, "\n")] = 0;
+
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        printf("❌ Cannot open %s for writing!\n", path);
+        return;
+    }
+
+    int written;
+    CatalogSnapshot snapshot;
+    if (tieredCatalog != NULL) {
+        TieredView view;
+
+        written = startTieredView(&view) != 0 ? -1
+                : Sort_ExportSource(nextTieredBook, &view, field, descending, out,
+                                    SORT_DEFAULT_MEMORY_BUDGET);
+        endTieredView(&view);
+    } else if (takeSnapshot(&snapshot)) {
+        BookList list = {NULL, 0, 0};
+
+        list.books = snapshotBooks(&snapshot, &list.count);
+        written = list.books == NULL ? -1
+                : Sort_ExportSource(nextListedBook, &list, field, descending, out,
+                                    SORT_DEFAULT_MEMORY_BUDGET);
+        free(list.books);
+        CatalogSnapshot_Release(&snapshot);
+    } else {
+        beginRead();
+        written = Sort_ExportCsv(&library, field, descending, out,
+                                 SORT_DEFAULT_MEMORY_BUDGET);
+        endRead();
+    }
+    if (fclose(out) != 0) {
+        written = -1;
+    }
+
+    if (written == -1) {
+        printf("❌ Export failed!\n");
+    } else {
+        printf("✅ Exported %d book(s) to %s\n", written, path);
+    }
+}
+
+// Dump operation counters and latency histograms
+void viewPerformanceMetrics() {
+    printf("Output format:\n");
+    printf("1. Text\n");
+    printf("2. JSON\n");
+    printf("Enter choice (1-2): ");
+
+    int choice;
+    if (scanf("%d", &choice) != 1 || choice < 1 || choice > 2) {
+        printf("❌ Invalid choice!\n");
+        clearInputBuffer();
+        return;
+    }
+    clearInputBuffer();
+
+    printf("\n");
+    beginRead();
+    libraryDumpMetrics(&library, stdout, choice == 2);
+    endRead();
+    if (choice == 1) {
+        printReplicationStatus();
+        printSharedCatalogStatus();
+        printTieredCatalogStatus();
+    }
+}
+
+// Show the leader's log position or the follower's lag
+void printReplicationStatus() {
+    if (replicateTo != NULL) {
+        uint64_t lsn;
+        int followers;
+        ReplicaLeader_GetStatus(&replicaLeader, &lsn, &followers);
+        printf("\nReplication: leader on %s, LSN %llu, %d follower(s)\n",
+               replicateTo, (unsigned long long)lsn, followers);
+    } else if (followFrom != NULL) {
+        ReplicaStatus status;
+        ReplicaFollower_GetStatus(&replicaFollower, &status);
+        printf("\nReplication: following %s (%s)\n", followFrom,
+               status.connected ? "connected" : "disconnected, retrying");
+        printf("  applied LSN %llu of %llu (%llu behind)\n",
+               (unsigned long long)status.appliedLsn,
+               (unsigned long long)status.leaderLsn,
+               (unsigned long long)(status.leaderLsn - status.appliedLsn));
+        printf("  lag: last %.3f ms, mean %.3f ms, max %.3f ms over %llu changes\n",
+               (double)status.lastLagNs / 1e6,
+               status.frames > 0 ? (double)status.totalLagNs / (double)status.frames / 1e6 : 0.0,
+               (double)status.maxLagNs / 1e6, (unsigned long long)status.frames);
+    }
+}
+
+// Show what readers of the shared-memory segment can see
+void printSharedCatalogStatus() {
+    if (sharedCatalog == NULL) {
+        return;
+    }
+
+    const SharedHeader *header = sharedCatalog->header;
+    printf("\nShared catalog: %s, version %llu, %d book(s)\n", shareAs,
+           (unsigned long long)SharedCatalog_Version(sharedCatalog), header->count);
+    printf("  %.1f KiB of text (%.1f KiB dead), %llu compaction(s)\n",
+           (double)header->arenaUsed / 1024.0, (double)header->arenaDead / 1024.0,
+           (unsigned long long)header->compactions);
+}
+
+// Show how well the record cache in front of the catalog file does
+void printTieredCatalogStatus() {
+    if (tieredCatalog == NULL) {
+        return;
+    }
+
+    CatalogCacheStats stats;
+    Catalog_GetCacheStats(tieredCatalog, &stats);
+    printf("\nTiered catalog: %s, %d book(s): %d record(s) on file, %zu changed since, "
+           "%d book(s) in memory\n", catalogPath, tieredCount,
+           Catalog_Count(tieredCatalog), RBTree_Size(changedIds), library.count);
+    printf("  cache %zu of %zu record(s) in %.1f KiB: %llu hit(s), %llu miss(es), "
+           "%llu eviction(s)\n", stats.entries, stats.capacity,
+           (double)stats.bytes / 1024.0, (unsigned long long)stats.hits,
+           (unsigned long long)stats.misses, (unsigned long long)stats.evictions);
+}
+
+// Load the --catalog snapshot, or map it in tiered mode, and replay its
+// log into the empty library
+int openCatalog() {
+    char logPath[4096];
+
+    if (Aio_Init(&ioQueue, ioBackend, (unsigned)ioDepth) != 0) {
+        return -1;
+    }
+    if (tieredBudget > 0) {
+        if (openTieredCatalog() != 0) {
+            Aio_Free(&ioQueue);
+            return -1;
+        }
+    } else if (access(catalogPath, F_OK) == 0 &&
+               Catalog_Load(&library, catalogPath, &ioQueue, ioFlags) == -1) {
+        Aio_Free(&ioQueue);
+        return -1;
+    }
+
+    snprintf(logPath, sizeof(logPath), "%s.wal", catalogPath);
+    if (Wal_Open(&wal, &library, logPath, &ioQueue) != 0) {
+        closeTieredCatalog();
+        Aio_Free(&ioQueue);
+        return -1;
+    }
+    if (tieredCatalog != NULL) {
+        printf("Opened %d book(s) in %s, %d of them in memory "
+               "(%d logged change(s), %s I/O)\n", tieredCount, catalogPath,
+               library.count, wal.replayed, Aio_BackendName(ioQueue.backend));
+    } else if (library.count > 0 || wal.replayed > 0) {
+        printf("Loaded %d book(s) from %s (%d logged change(s), %s I/O)\n",
+               library.count, catalogPath, wal.replayed,
+               Aio_BackendName(ioQueue.backend));
+    }
+    return 0;
+}
+
+// Save a fresh snapshot; the log is only emptied once the snapshot is safe
+void closeCatalog() {
+    int saved = tieredCatalog != NULL
+              ? writeTieredCatalog()
+              : Catalog_Write(&library, catalogPath, &ioQueue, ioFlags);
+
+    closeTieredCatalog();
+    if (saved == 0) {
+        Wal_Reset(&wal);
+    } else {
+        fprintf(stderr, "Snapshot failed; changes remain in the log\n");
+    }
+    Wal_Close(&wal);
+    Aio_Free(&ioQueue);
+}
+
+// Map the catalog file; the library starts empty and from then on holds
+// only the books changed since the file was written, the log's included
+int openTieredCatalog() {
+    if (access(catalogPath, F_OK) != 0 &&
+        Catalog_Write(&library, catalogPath, &ioQueue, ioFlags) != 0) {
+        return -1;
+    }
+
+    tieredCatalog = Catalog_Open(catalogPath, tieredBudget);
+    if (tieredCatalog == NULL) {
+        return -1;
+    }
+    library.nextId = Catalog_NextId(tieredCatalog);
+    tieredCount = Catalog_Count(tieredCatalog);
+    changedIds = RBTree_Create();
+    if (changedIds == NULL || libraryAddObserver(&library, markChanged, NULL) != 0) {
+        fprintf(stderr, "Cannot track changes to the tiered catalog\n");
+        RBTree_Destroy(changedIds, NULL);
+        changedIds = NULL;
+        Catalog_Close(tieredCatalog);
+        tieredCatalog = NULL;
+        return -1;
+    }
+    librarySetFault(&library, faultChangedBook, NULL);
+    return 0;
+}
+
+// Rewrite the file from itself and the changes, if there are any
+int writeTieredCatalog() {
+    TieredView view;
+
+    if (tieredStale) {
+        fprintf(stderr, "A change to the tiered catalog went untracked\n");
+        return -1;
+    }
+    if (RBTree_Size(changedIds) == 0) {
+        return 0;
+    }
+    if (startTieredView(&view) != 0) {
+        return -1;
+    }
+    int status = Catalog_WriteSource(nextTieredBook, &view, tieredCount, library.nextId,
+                                     catalogPath, &ioQueue, ioFlags);
+    endTieredView(&view);
+    return status;
+}
+
+void closeTieredCatalog() {
+    if (tieredCatalog == NULL) {
+        return;
+    }
+    librarySetFault(&library, NULL, NULL);
+    libraryRemoveObserver(&library, markChanged, NULL);
+    RBTree_Destroy(changedIds, NULL);
+    changedIds = NULL;
+    Catalog_Close(tieredCatalog);
+    tieredCatalog = NULL;
+}
+
+// Later reads of a changed book go to the library, not the stale file
+void markChanged(void *context, const Book *before, const Book *after) {
+    static int changed = 1;
+    int id = before != NULL ? before->id : after->id;
+
+    (void)context;
+    tieredCount += (after != NULL) - (before != NULL);
+    if (RBTree_Insert(changedIds, id, &changed) == -1) {
+        // A deleted book would come back from the file
+        fprintf(stderr, "Cannot track change to book %d; "
+                "the catalog file will not be rewritten\n", id);
+        tieredStale = 1;
+    }
+}
+
+// A file record is brought into the library when it is first changed,
+// so the change and its observers start from the record
+void faultChangedBook(void *context, Library *target, int id) {
+    Book book;
+
+    (void)context;
+    if (RBTree_Contains(changedIds, id) || !Catalog_FindById(tieredCatalog, id, &book)) {
+        return;
+    }
+    if (libraryAdoptBook(target, &book) == -1) {
+        fprintf(stderr, "Cannot keep book %d in memory to change it\n", id);
+    }
+}
+
+// Parse a byte count with an optional K, M or G suffix
+int parseBytes(const char *text, size_t *bytes) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    switch (toupper((unsigned char)*end)) {
+        case 'G':
+            value <<= 10;
+            /* fall through */
+        case 'M':
+            value <<= 10;
+            /* fall through */
+        case 'K':
+            value <<= 10;
+            end++;
+            break;
+        default:
+            break;
+    }
+    if (end == text || *end != '\0') {
+        return -1;
+    }
+    *bytes = (size_t)value;
+    return 0;
+}
+
+// Value of a "--name value" or "--name=value" option at argv[*i], or NULL
+const char* optionValue(int argc, char *argv[], int *i, const char *name) {
+    size_t length = strlen(name);
+
+    if (strcmp(argv[*i], name) == 0 && *i + 1 < argc) {
+        return argv[++*i];
+    }
+    if (strncmp(argv[*i], name, length) == 0 && argv[*i][length] == '=') {
+        return argv[*i] + length + 1;
+    }
+    return NULL;
 }
 
 // Main function
-int main() {
+int main(int argc, char *argv[]) {
     int choice;
     int running = 1;
+    int replicating = 0;
+    int status = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value;
+
+        if ((value = optionValue(argc, argv, &i, "--page-size")) != NULL) {
+            pageSize = atoi(value);
+        } else if ((value = optionValue(argc, argv, &i, "--replicate")) != NULL) {
+            replicateTo = value;
+        } else if ((value = optionValue(argc, argv, &i, "--follow")) != NULL) {
+            followFrom = value;
+        } else if ((value = optionValue(argc, argv, &i, "--share")) != NULL) {
+            shareAs = value;
+        } else if ((value = optionValue(argc, argv, &i, "--pages")) != NULL) {
+            // Must be set before libraryInit so the book array gets it too
+            PagesPolicy pages;
+            if (Pages_ParsePolicy(value, &pages) != 0) {
+                fprintf(stderr, "Unknown page policy: %s\n", value);
+                return 1;
+            }
+            Pages_SetPolicy(&pages);
+        } else if ((value = optionValue(argc, argv, &i, "--catalog")) != NULL) {
+            catalogPath = value;
+        } else if ((value = optionValue(argc, argv, &i, "--tiered")) != NULL) {
+            if (parseBytes(value, &tieredBudget) != 0 || tieredBudget == 0) {
+                fprintf(stderr, "Invalid cache budget: %s\n", value);
+                return 1;
+            }
+        } else if ((value = optionValue(argc, argv, &i, "--io")) != NULL) {
+            if (Aio_ParseBackend(value, &ioBackend) != 0) {
+                fprintf(stderr, "Unknown I/O backend: %s\n", value);
+                return 1;
+            }
+        } else if ((value = optionValue(argc, argv, &i, "--io-depth")) != NULL) {
+            ioDepth = atoi(value);
+        } else if (strcmp(argv[i], "--direct") == 0) {
+            ioFlags |= CATALOG_IO_DIRECT;
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            ioFlags |= CATALOG_COMPRESSED;
+        } else if (strcmp(argv[i], "--sketches") == 0) {
+            sketching = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--page-size rows] "
+                    "[--replicate socket | --follow socket] [--share name] [--sketches] "
+                    "[--pages small|thp|hugetlb[,local|,interleave|,node=N][,pin]] "
+                    "[--catalog file [--tiered bytes[K|M|G]] [--io auto|uring|threads|sync] "
+                    "[--io-depth n] [--direct] [--compress]]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (pageSize < 0) {
+        fprintf(stderr, "Page size must not be negative\n");
+        return 1;
+    }
+    if (replicateTo != NULL && followFrom != NULL) {
+        fprintf(stderr, "A catalog cannot both lead and follow\n");
+        return 1;
+    }
+    if (catalogPath != NULL && followFrom != NULL) {
+        fprintf(stderr, "A replica takes its catalog from the leader, not a file\n");
+        return 1;
+    }
+    if (tieredBudget > 0 && catalogPath == NULL) {
+        fprintf(stderr, "Tiered lookups need a --catalog file\n");
+        return 1;
+    }
+    if (tieredBudget > 0 && (replicateTo != NULL || shareAs != NULL)) {
+        // Both ship the library's books, which are only the changed ones
+        fprintf(stderr, "A tiered catalog cannot be replicated or shared\n");
+        return 1;
+    }
+    if (ioDepth < 1 || ioDepth > AIO_MAX_DEPTH) {
+        fprintf(stderr, "I/O depth must be 1 to %d\n", AIO_MAX_DEPTH);
+        return 1;
+    }
+
+    if (Render_Init(&output, STDOUT_FILENO, RENDER_DEFAULT_CAPACITY) != 0) {
+        return 1;
+    }
+    if (libraryInit(&library) != 0) {
+        fprintf(stderr, "Failed to initialize library\n");
+        goto freeOutput;
+    }
+    // Loaded first so the caches, text index and replicas start from its books
+    if (catalogPath != NULL && openCatalog() != 0) {
+        goto freeLibrary;
+    }
+    if (QueryCache_Init(&queryCache, &library, QUERY_CACHE_DEFAULT_ENTRIES,
+                        QUERY_CACHE_DEFAULT_IDS) != 0) {
+        goto closeFile;
+    }
+    if (TextIndex_Init(&textIndex, &library) != 0) {
+        goto freeQueryCache;
+    }
+    // In tiered mode the library holds only changed books: statistics
+    // scan the catalog instead, and the sketches only count searches
+    if (GroupStats_Init(&groupStats, tieredCatalog != NULL ? NULL : &library) != 0) {
+        goto freeTextIndex;
+    }
+    if (sketching &&
+        CatalogSketches_Init(&sketches, tieredCatalog != NULL ? NULL : &library) != 0) {
+        goto freeGroupStats;
+    }
+
+    // Published before a follower bootstraps, so readers see its books arrive
+    if (shareAs != NULL) {
+        sharedCatalog = SharedCatalog_Publish(&library, shareAs);
+        if (sharedCatalog == NULL) {
+            goto freeSketches;
+        }
+    }
+
+    // Started last so the caches and text index see replicated changes
+    if (replicateTo != NULL) {
+        replicating = ReplicaLeader_Start(&replicaLeader, &library, replicateTo) == 0;
+    } else if (followFrom != NULL && CatalogVersions_Init(&versions, &library) == 0) {
+        replicating = ReplicaFollower_Start(&replicaFollower, &library, followFrom) == 0;
+        if (!replicating) {
+            CatalogVersions_Free(&versions);
+        }
+    }
+    if ((replicateTo != NULL || followFrom != NULL) && !replicating) {
+        goto unpublish;
+    }
 
     printf("\n");
     printf("╔════════════════════════════════════════╗\n");
@@ -454,6 +1545,10 @@ int main() {
         }
         clearInputBuffer();
 
+        if (followFrom != NULL && (choice == 1 || choice == 4 || choice == 5)) {
+            printf("❌ This is a read-only replica; make changes on the leader.\n");
+            continue;
+        }
         switch (choice) {
             case 1:
                 addBook();
@@ -474,14 +1569,57 @@ int main() {
                 viewBookStatistics();
                 break;
             case 7:
+                exportSortedCatalog();
+                break;
+            case 8:
+                viewPerformanceMetrics();
+                break;
+            case 9:
                 printf("\nThank you for using Book Management System!\n");
                 printf("Goodbye! 👋\n\n");
                 running = 0;
                 break;
             default:
-                printf("❌ Invalid choice! Please select a valid option (1-7).\n");
+                printf("❌ Invalid choice! Please select a valid option (1-9).\n");
+        }
+
+        // The action's changes are on disk before the next prompt
+        if (catalogPath != NULL && wal.appended != walSynced) {
+            Wal_Sync(&wal);
+            walSynced = wal.appended;
         }
     }
 
-    return 0;
+    status = 0;
+
+    if (replicateTo != NULL) {
+        ReplicaLeader_Stop(&replicaLeader);
+    } else if (followFrom != NULL) {
+        ReplicaFollower_Stop(&replicaFollower);
+        CatalogVersions_Free(&versions);
+    }
+
+    // Torn down in the reverse order of setup; a failed step jumps in
+    // below the last one that succeeded
+unpublish:
+    SharedCatalog_Unpublish(sharedCatalog);
+freeSketches:
+    if (sketching) {
+        CatalogSketches_Free(&sketches);
+    }
+freeGroupStats:
+    GroupStats_Free(&groupStats);
+freeTextIndex:
+    TextIndex_Free(&textIndex);
+freeQueryCache:
+    QueryCache_Free(&queryCache);
+closeFile:
+    if (catalogPath != NULL) {
+        closeCatalog();
+    }
+freeLibrary:
+    libraryFree(&library);
+freeOutput:
+    Render_Free(&output);
+    return status;
 }